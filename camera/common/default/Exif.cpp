@@ -23,7 +23,9 @@
 #include <inttypes.h>
 #include <math.h>
 #include <stdint.h>
+#include <algorithm>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "Exif.h"
@@ -233,6 +235,13 @@ class ExifUtilsImpl : public ExifUtils {
     // Returns false if memory allocation fails.
     virtual bool setModel(const std::string& model);
 
+    // Keeps the tags set so far as a template for the following images.
+    virtual void saveTemplate();
+
+    // Starts a new image on top of the template.
+    // Returns false if no template has been saved.
+    virtual bool resetToTemplate();
+
     // Generates APP1 segment.
     // Returns false if generating APP1 segment fails.
     virtual bool generateApp1(const void* thumbnail_buffer, uint32_t size);
@@ -285,6 +294,13 @@ class ExifUtilsImpl : public ExifUtils {
     // Destroys the buffer of APP1 segment if exists.
     virtual void destroyApp1();
 
+    // Records that |tag| was set for the current image.
+    void markTagSet(ExifIfd ifd, ExifTag tag);
+
+    // Removes the entries that are neither in the template nor set for the
+    // current image.
+    void removeStaleEntries();
+
     // The Exif data (APP1). Owned by this class.
     ExifData* exif_data_;
     // The raw data of APP1 segment. It's allocated by ExifMem in |exif_data_| but
@@ -292,6 +308,13 @@ class ExifUtilsImpl : public ExifUtils {
     uint8_t* app1_buffer_;
     // The length of |app1_buffer_|.
     unsigned int app1_length_;
+    // Whether saveTemplate() has been called since initialize().
+    bool has_template_;
+    // The tags kept by resetToTemplate(). Sorted.
+    std::vector<std::pair<ExifIfd, ExifTag>> template_tags_;
+    // The tags set since the last resetToTemplate(). The capacity is kept
+    // between images so steady state captures don't allocate.
+    std::vector<std::pair<ExifIfd, ExifTag>> image_tags_;
 };
 
 #define SET_SHORT(ifd, tag, value)                                  \
@@ -339,7 +362,14 @@ ExifUtils* ExifUtils::create() {
 
 ExifUtils::~ExifUtils() {}
 
-ExifUtilsImpl::ExifUtilsImpl() : exif_data_(nullptr), app1_buffer_(nullptr), app1_length_(0) {}
+void ExifUtils::saveTemplate() {}
+
+bool ExifUtils::resetToTemplate() {
+    return false;
+}
+
+ExifUtilsImpl::ExifUtilsImpl()
+    : exif_data_(nullptr), app1_buffer_(nullptr), app1_length_(0), has_template_(false) {}
 
 ExifUtilsImpl::~ExifUtilsImpl() {
     reset();
@@ -704,8 +734,57 @@ bool ExifUtilsImpl::setYResolution(uint32_t numerator, uint32_t denominator) {
     return true;
 }
 
+void ExifUtilsImpl::saveTemplate() {
+    template_tags_.clear();
+    for (int ifd = 0; ifd < EXIF_IFD_COUNT; ifd++) {
+        ExifContent* content = exif_data_->ifd[ifd];
+        for (unsigned int i = 0; i < content->count; i++) {
+            template_tags_.push_back({static_cast<ExifIfd>(ifd), content->entries[i]->tag});
+        }
+    }
+    std::sort(template_tags_.begin(), template_tags_.end());
+    image_tags_.clear();
+    has_template_ = true;
+}
+
+bool ExifUtilsImpl::resetToTemplate() {
+    if (!has_template_) {
+        ALOGE("%s: No template saved", __FUNCTION__);
+        return false;
+    }
+    destroyApp1();
+    image_tags_.clear();
+    return true;
+}
+
+void ExifUtilsImpl::markTagSet(ExifIfd ifd, ExifTag tag) {
+    if (has_template_) {
+        image_tags_.push_back({ifd, tag});
+    }
+}
+
+void ExifUtilsImpl::removeStaleEntries() {
+    for (int ifd = 0; ifd < EXIF_IFD_COUNT; ifd++) {
+        ExifContent* content = exif_data_->ifd[ifd];
+        // Iterate backwards since removing an entry shifts the following ones
+        for (unsigned int i = content->count; i > 0; i--) {
+            ExifEntry* entry = content->entries[i - 1];
+            std::pair<ExifIfd, ExifTag> key = {static_cast<ExifIfd>(ifd), entry->tag};
+            if (std::binary_search(template_tags_.begin(), template_tags_.end(), key) ||
+                std::find(image_tags_.begin(), image_tags_.end(), key) != image_tags_.end()) {
+                continue;
+            }
+            exif_content_remove_entry(content, entry);
+        }
+    }
+}
+
 bool ExifUtilsImpl::generateApp1(const void* thumbnail_buffer, uint32_t size) {
     destroyApp1();
+    if (has_template_) {
+        // Drop the per-image tags of the previous image that were not set again
+        removeStaleEntries();
+    }
     exif_data_->data = const_cast<uint8_t*>(static_cast<const uint8_t*>(thumbnail_buffer));
     exif_data_->size = size;
     // Save the result into |app1_buffer_|.
@@ -763,15 +842,26 @@ void ExifUtilsImpl::reset() {
         exif_data_unref(exif_data_);
         exif_data_ = nullptr;
     }
+    has_template_ = false;
+    template_tags_.clear();
+    image_tags_.clear();
 }
 
 std::unique_ptr<ExifEntry> ExifUtilsImpl::addVariableLengthEntry(ExifIfd ifd, ExifTag tag,
                                                                  ExifFormat format,
                                                                  uint64_t components,
                                                                  unsigned int size) {
+    markTagSet(ifd, tag);
+    ExifEntry* oldEntry = exif_content_get_entry(exif_data_->ifd[ifd], tag);
+    if (oldEntry != nullptr && oldEntry->format == format && oldEntry->components == components &&
+        oldEntry->size == size) {
+        // Same layout as before, e.g. left over from the previous image. Let the
+        // caller overwrite its data instead of allocating a new entry.
+        exif_entry_ref(oldEntry);
+        return std::unique_ptr<ExifEntry>(oldEntry);
+    }
     // Remove old entry if exists.
-    exif_content_remove_entry(exif_data_->ifd[ifd],
-                              exif_content_get_entry(exif_data_->ifd[ifd], tag));
+    exif_content_remove_entry(exif_data_->ifd[ifd], oldEntry);
     ExifMem* mem = exif_mem_new_default();
     if (!mem) {
         ALOGE("%s: Allocate memory for exif entry failed", __FUNCTION__);
@@ -803,6 +893,7 @@ std::unique_ptr<ExifEntry> ExifUtilsImpl::addVariableLengthEntry(ExifIfd ifd, Ex
 }
 
 std::unique_ptr<ExifEntry> ExifUtilsImpl::addEntry(ExifIfd ifd, ExifTag tag) {
+    markTagSet(ifd, tag);
     std::unique_ptr<ExifEntry> entry(exif_content_get_entry(exif_data_->ifd[ifd], tag));
     if (entry) {
         // exif_content_get_entry() won't ref the entry, so we ref here.
@@ -35,6 +35,70 @@ using aidl::android::hardware::graphics::common::Smpte2086;
 
 HandleImporter::HandleImporter() : mInitialized(false) {}
 
+bool HandleImporter::getYCbCrOffsets(const std::vector<PlaneLayout>& planeLayouts,
+                                     YCbCrOffsets* offsets) {
+    bool hasY = false, hasCb = false, hasCr = false;
+    *offsets = {};
+
+    for (const auto& planeLayout : planeLayouts) {
+        for (const auto& component : planeLayout.components) {
+            if (!gralloc4::isStandardPlaneLayoutComponentType(component.type)) {
+                continue;
+            }
+
+            size_t offset = planeLayout.offsetInBytes + component.offsetInBits / 8;
+            size_t sampleIncrementInBytes;
+            auto type = static_cast<PlaneLayoutComponentType>(component.type.value);
+            switch (type) {
+                case PlaneLayoutComponentType::Y:
+                    if (hasY || component.sizeInBits < 8 ||
+                        planeLayout.sampleIncrementInBits != component.sizeInBits) {
+                        return false;
+                    }
+                    offsets->y = offset;
+                    offsets->ystride = planeLayout.strideInBytes;
+                    hasY = true;
+                    break;
+                case PlaneLayoutComponentType::CB:
+                case PlaneLayoutComponentType::CR:
+                    if (planeLayout.sampleIncrementInBits % 8 != 0) {
+                        return false;
+                    }
+                    sampleIncrementInBytes = planeLayout.sampleIncrementInBits / 8;
+                    if (sampleIncrementInBytes != 1 && sampleIncrementInBytes != 2 &&
+                        sampleIncrementInBytes != 4) {
+                        return false;
+                    }
+                    if (offsets->cstride == 0 && offsets->chromaStep == 0) {
+                        offsets->cstride = planeLayout.strideInBytes;
+                        offsets->chromaStep = sampleIncrementInBytes;
+                    } else if (offsets->cstride != static_cast<size_t>(planeLayout.strideInBytes) ||
+                               offsets->chromaStep != sampleIncrementInBytes) {
+                        return false;
+                    }
+                    if (type == PlaneLayoutComponentType::CB) {
+                        if (hasCb) {
+                            return false;
+                        }
+                        offsets->cb = offset;
+                        hasCb = true;
+                    } else {
+                        if (hasCr) {
+                            return false;
+                        }
+                        offsets->cr = offset;
+                        hasCr = true;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    return hasY && hasCb && hasCr;
+}
+
 void HandleImporter::initializeLocked() {
     if (mInitialized) {
         return;
@@ -58,9 +122,32 @@ bool HandleImporter::importBufferInternal(buffer_handle_t& handle) {
     }
 
     handle = importedHandle;
+    mBufferCache.try_emplace(handle);
     return true;
 }
 
+HandleImporter::BufferCacheEntry* HandleImporter::getCacheEntryLocked(
+        buffer_handle_t buf, BufferCacheEntry* uncached) {
+    // Buffers imported elsewhere are not cached, as nothing tells when they are freed
+    auto it = mBufferCache.find(buf);
+    if (it == mBufferCache.end() && uncached == nullptr) {
+        return nullptr;
+    }
+
+    BufferCacheEntry& entry = it != mBufferCache.end() ? it->second : *uncached;
+    if (!entry.planeLayoutsQueried) {
+        status_t status = GraphicBufferMapper::get().getPlaneLayouts(buf, &entry.planeLayouts);
+        if (status != OK) {
+            ALOGE("%s: failed to get PlaneLayouts! Status %d", __FUNCTION__, status);
+            return nullptr;
+        }
+        entry.planeLayoutsQueried = true;
+        entry.ycbcrOffsetsValid = getYCbCrOffsets(entry.planeLayouts, &entry.ycbcrOffsets);
+    }
+
+    return &entry;
+}
+
 android_ycbcr HandleImporter::lockYCbCr(buffer_handle_t& buf, uint64_t cpuUsage,
                                         const android::Rect& accessRegion) {
     Mutex::Autolock lock(mLock);
@@ -68,7 +155,36 @@ android_ycbcr HandleImporter::lockYCbCr(buffer_handle_t& buf, uint64_t cpuUsage,
     if (!mInitialized) {
         initializeLocked();
     }
-    android_ycbcr layout;
+    android_ycbcr layout = {};
+
+    // Fast path: plain lock plus the cached plane offsets, which skips the
+    // per-lock plane layout metadata query done by the mapper's lockYCbCr.
+    BufferCacheEntry* entry = getCacheEntryLocked(buf, /*uncached*/ nullptr);
+    if (entry != nullptr && entry->ycbcrOffsetsValid) {
+        void* data = nullptr;
+        status_t status = GraphicBufferMapper::get().lock(buf, cpuUsage, accessRegion, &data);
+        if (status != OK) {
+            ALOGE("%s: failed to lock error %d!", __FUNCTION__, status);
+            return layout;
+        }
+        if (data == nullptr) {
+            ALOGE("%s: mapper returned null address!", __FUNCTION__);
+            // Nothing was written through the null address, so the release fence is not
+            // needed to order later accesses.
+            closeFence(unlock(buf));
+            return layout;
+        }
+
+        uint8_t* base = static_cast<uint8_t*>(data);
+        const YCbCrOffsets& offsets = entry->ycbcrOffsets;
+        layout.y = base + offsets.y;
+        layout.cb = base + offsets.cb;
+        layout.cr = base + offsets.cr;
+        layout.ystride = offsets.ystride;
+        layout.cstride = offsets.cstride;
+        layout.chroma_step = offsets.chromaStep;
+        return layout;
+    }
 
     status_t status = GraphicBufferMapper::get().lockYCbCr(buf, cpuUsage, accessRegion, &layout);
 
@@ -79,16 +195,6 @@ android_ycbcr HandleImporter::lockYCbCr(buffer_handle_t& buf, uint64_t cpuUsage,
     return layout;
 }
 
-std::vector<PlaneLayout> getPlaneLayouts(buffer_handle_t& buf) {
-    std::vector<PlaneLayout> planeLayouts;
-    status_t status = GraphicBufferMapper::get().getPlaneLayouts(buf, &planeLayouts);
-    if (status != OK) {
-        ALOGE("%s: failed to get PlaneLayouts! Status %d", __FUNCTION__, status);
-    }
-
-    return planeLayouts;
-}
-
 // In IComposer, any buffer_handle_t is owned by the caller and we need to
 // make a clone for hwcomposer2.  We also need to translate empty handle
 // to nullptr.  This function does that, in-place.
@@ -116,6 +222,7 @@ void HandleImporter::freeBuffer(buffer_handle_t handle) {
         initializeLocked();
     }
 
+    mBufferCache.erase(handle);
     status_t status = GraphicBufferMapper::get().freeBuffer(handle);
     if (status != OK) {
         ALOGE("%s: mapper freeBuffer failed. Status %d", __FUNCTION__, status);
@@ -182,13 +289,17 @@ status_t HandleImporter::getMonoPlanarStrideBytes(buffer_handle_t& buf, uint32_t
         initializeLocked();
     }
 
-    std::vector<PlaneLayout> planeLayouts = getPlaneLayouts(buf);
-    if (planeLayouts.size() != 1) {
-        ALOGE("%s: Unexpected number of planes %zu!", __FUNCTION__, planeLayouts.size());
+    BufferCacheEntry uncached;
+    BufferCacheEntry* entry = getCacheEntryLocked(buf, &uncached);
+    if (entry == nullptr) {
+        return BAD_VALUE;
+    }
+    if (entry->planeLayouts.size() != 1) {
+        ALOGE("%s: Unexpected number of planes %zu!", __FUNCTION__, entry->planeLayouts.size());
         return BAD_VALUE;
     }
 
-    *stride = planeLayouts[0].strideInBytes;
+    *stride = entry->planeLayouts[0].strideInBytes;
 
     return OK;
 }
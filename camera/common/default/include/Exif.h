@@ -41,6 +41,18 @@ namespace helper {
 //  unsigned int app1Length = utils->GetApp1Length();
 //  uint8_t* app1Buffer = new uint8_t[app1Length];
 //  memcpy(app1Buffer, utils->GetApp1Buffer(), app1Length);
+//
+// When many images share most of their tags, e.g. all captures of a session,
+// the shared tags can be set once and kept as a template:
+//  utils->initialize();
+//  utils->setMake(make);
+//  ...
+//  utils->saveTemplate();
+//  // For each image:
+//  utils->resetToTemplate();
+//  // Call ExifUtils functions to set the per-image Exif tags.
+//  ...
+//  utils->generateApp1(thumbnail_buffer, thumbnail_size);
 class ExifUtils {
   public:
     virtual ~ExifUtils();
@@ -227,6 +239,18 @@ class ExifUtils {
     // Returns false if memory allocation fails.
     virtual bool setModel(const std::string& model) = 0;
 
+    // Keeps the tags set so far as a template for the following images.
+    // initialize() discards the template. Does nothing by default, so that
+    // implementations without templates keep building every image from scratch.
+    virtual void saveTemplate();
+
+    // Starts a new image on top of the template. Tags that are not part of the
+    // template are left out of the next APP1 segment unless they are set again,
+    // in which case their existing entries are reused.
+    // Returns false if no template has been saved, which is always the case by
+    // default; callers then call initialize() and set all the tags instead.
+    virtual bool resetToTemplate();
+
     // Generates APP1 segment.
     // Returns false if generating APP1 segment fails.
     virtual bool generateApp1(const void* thumbnail_buffer, uint32_t size) = 0;
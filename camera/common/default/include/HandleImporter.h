@@ -17,11 +17,15 @@
 #ifndef CAMERA_COMMON_1_0_HANDLEIMPORTED_H
 #define CAMERA_COMMON_1_0_HANDLEIMPORTED_H
 
+#include <aidl/android/hardware/graphics/common/PlaneLayout.h>
 #include <cutils/native_handle.h>
 #include <system/graphics.h>
 #include <ui/Rect.h>
 #include <utils/Mutex.h>
 
+#include <unordered_map>
+#include <vector>
+
 namespace android {
 namespace hardware {
 namespace camera {
@@ -37,6 +41,7 @@ class HandleImporter {
     // make a clone for hwcomposer2.  We also need to translate empty handle
     // to nullptr.  This function does that, in-place.
     bool importBuffer(buffer_handle_t& handle);
+    // Frees an imported buffer and drops any cached mapper state for it.
     void freeBuffer(buffer_handle_t handle);
     bool importFence(const native_handle_t* handle, int& fd) const;
     void closeFence(int fd) const;
@@ -62,14 +67,47 @@ class HandleImporter {
     bool isSmpte2094_40Present(const buffer_handle_t& buf);
 
   private:
+    // Byte offsets of the YCbCr planes relative to the locked base address.
+    struct YCbCrOffsets {
+        size_t y;
+        size_t cb;
+        size_t cr;
+        size_t ystride;
+        size_t cstride;
+        size_t chromaStep;
+    };
+
+    // Mapper state that stays valid for the lifetime of an imported buffer.
+    // Plane layouts are immutable once a buffer is allocated, so they are
+    // queried once and reused on every subsequent lock.
+    struct BufferCacheEntry {
+        bool planeLayoutsQueried = false;
+        std::vector<aidl::android::hardware::graphics::common::PlaneLayout> planeLayouts;
+        bool ycbcrOffsetsValid = false;
+        YCbCrOffsets ycbcrOffsets = {};
+    };
+
+    static bool getYCbCrOffsets(
+            const std::vector<aidl::android::hardware::graphics::common::PlaneLayout>& planeLayouts,
+            YCbCrOffsets* offsets /*out*/);
+
     void initializeLocked();
     void cleanup();
 
     bool importBufferInternal(buffer_handle_t& handle);
     int unlockInternal(buffer_handle_t& buf);
 
+    // Returns the entry of buf with its plane layouts queried: the cache entry of a
+    // buffer imported through this importer, or uncached if the buffer was imported
+    // elsewhere. Returns nullptr if the plane layouts cannot be queried, or if the
+    // buffer was imported elsewhere and uncached is nullptr.
+    BufferCacheEntry* getCacheEntryLocked(buffer_handle_t buf, BufferCacheEntry* uncached);
+
     Mutex mLock;
     bool mInitialized;
+    std::unordered_map<buffer_handle_t, BufferCacheEntry> mBufferCache;
+
+    friend class HandleImporterTest;
 };
 
 }  // namespace helper
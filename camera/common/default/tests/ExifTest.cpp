@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include <libexif/exif-data.h>
+
+#include "Exif.h"
+
+using ::android::hardware::camera::common::helper::ExifUtils;
+
+namespace {
+
+// The tags of a capture that change from one image to the next. The optional
+// ones are only set for some images.
+struct ImageTags {
+    uint32_t width;
+    uint32_t height;
+    uint16_t orientation;
+    uint16_t iso;
+    std::string subsecTime;
+    bool hasGps;
+    double latitude;
+    double longitude;
+    bool hasFlash;
+    uint16_t flash;
+};
+
+const ImageTags kImages[] = {
+        {.width = 1920,
+         .height = 1080,
+         .orientation = 1,
+         .iso = 100,
+         .subsecTime = "120",
+         .hasGps = true,
+         .latitude = 37.422,
+         .longitude = -122.084,
+         .hasFlash = true,
+         .flash = 1},
+        // Without the GPS tags
+        {.width = 640,
+         .height = 480,
+         .orientation = 6,
+         .iso = 400,
+         .subsecTime = "345",
+         .hasGps = false,
+         .hasFlash = true,
+         .flash = 0},
+        // Without the GPS and flash tags
+        {.width = 320, .height = 240, .orientation = 3, .iso = 800, .subsecTime = "678"},
+};
+
+// Sets the tags shared by all the captures of a session.
+void setSessionTags(ExifUtils* utils) {
+    ASSERT_TRUE(utils->setMake("Make"));
+    ASSERT_TRUE(utils->setModel("Model"));
+    ASSERT_TRUE(utils->setFNumber(18, 10));
+    ASSERT_TRUE(utils->setFocalLength(35, 10));
+    ASSERT_TRUE(utils->setXResolution(72, 1));
+    ASSERT_TRUE(utils->setYResolution(72, 1));
+    ASSERT_TRUE(utils->setResolutionUnit(2));
+}
+
+void setImageTags(ExifUtils* utils, const ImageTags& image) {
+    ASSERT_TRUE(utils->setImageWidth(image.width));
+    ASSERT_TRUE(utils->setImageHeight(image.height));
+    ASSERT_TRUE(utils->setOrientation(image.orientation));
+    ASSERT_TRUE(utils->setIsoSpeedRating(image.iso));
+    ASSERT_TRUE(utils->setSubsecTime(image.subsecTime));
+    if (image.hasGps) {
+        ASSERT_TRUE(utils->setGpsLatitude(image.latitude));
+        ASSERT_TRUE(utils->setGpsLongitude(image.longitude));
+    }
+    if (image.hasFlash) {
+        ASSERT_TRUE(utils->setFlash(image.flash));
+    }
+}
+
+std::vector<uint8_t> getApp1(ExifUtils* utils) {
+    const uint8_t* app1 = utils->getApp1Buffer();
+    return std::vector<uint8_t>(app1, app1 + utils->getApp1Length());
+}
+
+// The APP1 segment of |image| built on a freshly initialized ExifUtils.
+std::vector<uint8_t> buildFresh(const ImageTags& image) {
+    std::unique_ptr<ExifUtils> utils(ExifUtils::create());
+    EXPECT_TRUE(utils->initialize());
+    setSessionTags(utils.get());
+    setImageTags(utils.get(), image);
+    EXPECT_TRUE(utils->generateApp1(nullptr, 0));
+    return getApp1(utils.get());
+}
+
+// Whether the APP1 segment |app1| has an entry of |tag| in |ifd|.
+bool hasTag(const std::vector<uint8_t>& app1, ExifIfd ifd, ExifTag tag) {
+    ExifData* data = exif_data_new_from_data(app1.data(), app1.size());
+    if (data == nullptr) {
+        ADD_FAILURE() << "cannot parse the APP1 segment";
+        return false;
+    }
+    bool found = exif_content_get_entry(data->ifd[ifd], tag) != nullptr;
+    exif_data_unref(data);
+    return found;
+}
+
+TEST(ExifUtilsTest, TemplateReuseMatchesFreshBuild) {
+    std::unique_ptr<ExifUtils> utils(ExifUtils::create());
+    ASSERT_TRUE(utils->initialize());
+    ASSERT_NO_FATAL_FAILURE(setSessionTags(utils.get()));
+    utils->saveTemplate();
+
+    // Each image leaves out tags the previous one set, which must not be carried over.
+    for (const ImageTags& image : kImages) {
+        SCOPED_TRACE(testing::Message() << "image " << image.width << "x" << image.height);
+        ASSERT_TRUE(utils->resetToTemplate());
+        ASSERT_NO_FATAL_FAILURE(setImageTags(utils.get(), image));
+        ASSERT_TRUE(utils->generateApp1(nullptr, 0));
+        EXPECT_EQ(buildFresh(image), getApp1(utils.get()));
+    }
+}
+
+TEST(ExifUtilsTest, RemovesStaleEntries) {
+    std::unique_ptr<ExifUtils> utils(ExifUtils::create());
+    ASSERT_TRUE(utils->initialize());
+    ASSERT_NO_FATAL_FAILURE(setSessionTags(utils.get()));
+    utils->saveTemplate();
+
+    ASSERT_TRUE(utils->resetToTemplate());
+    ASSERT_NO_FATAL_FAILURE(setImageTags(utils.get(), kImages[0]));
+    ASSERT_TRUE(utils->generateApp1(nullptr, 0));
+    std::vector<uint8_t> first = getApp1(utils.get());
+    EXPECT_TRUE(hasTag(first, EXIF_IFD_GPS, static_cast<ExifTag>(EXIF_TAG_GPS_LATITUDE)));
+    EXPECT_TRUE(hasTag(first, EXIF_IFD_EXIF, EXIF_TAG_FLASH));
+
+    ASSERT_TRUE(utils->resetToTemplate());
+    ASSERT_NO_FATAL_FAILURE(setImageTags(utils.get(), kImages[2]));
+    ASSERT_TRUE(utils->generateApp1(nullptr, 0));
+    std::vector<uint8_t> second = getApp1(utils.get());
+    EXPECT_FALSE(hasTag(second, EXIF_IFD_GPS, static_cast<ExifTag>(EXIF_TAG_GPS_LATITUDE)));
+    EXPECT_FALSE(hasTag(second, EXIF_IFD_GPS, static_cast<ExifTag>(EXIF_TAG_GPS_LONGITUDE_REF)));
+    EXPECT_FALSE(hasTag(second, EXIF_IFD_EXIF, EXIF_TAG_FLASH));
+    // The template and the tags set again are kept
+    EXPECT_TRUE(hasTag(second, EXIF_IFD_0, EXIF_TAG_MAKE));
+    EXPECT_TRUE(hasTag(second, EXIF_IFD_EXIF, EXIF_TAG_FNUMBER));
+    EXPECT_TRUE(hasTag(second, EXIF_IFD_EXIF, EXIF_TAG_ISO_SPEED_RATINGS));
+}
+
+TEST(ExifUtilsTest, ResetWithoutTemplateFails) {
+    std::unique_ptr<ExifUtils> utils(ExifUtils::create());
+    ASSERT_TRUE(utils->initialize());
+    EXPECT_FALSE(utils->resetToTemplate());
+    utils->saveTemplate();
+    EXPECT_TRUE(utils->resetToTemplate());
+    // initialize() discards the template
+    ASSERT_TRUE(utils->initialize());
+    EXPECT_FALSE(utils->resetToTemplate());
+}
+
+}  // namespace
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <ui/GraphicBuffer.h>
+
+#include "HandleImporter.h"
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace common {
+namespace helper {
+
+class HandleImporterTest : public testing::Test {
+  protected:
+    void SetUp() override {
+        mBuffer = sp<GraphicBuffer>::make(
+                kWidth, kHeight, PIXEL_FORMAT_RGBA_8888, /*layerCount*/ 1,
+                GraphicBuffer::USAGE_SW_READ_OFTEN | GraphicBuffer::USAGE_SW_WRITE_OFTEN,
+                "HandleImporterTest");
+        ASSERT_EQ(OK, mBuffer->initCheck());
+    }
+
+    bool isCached(buffer_handle_t buf) {
+        Mutex::Autolock lock(mImporter.mLock);
+        return mImporter.mBufferCache.count(buf) != 0;
+    }
+
+    bool isPlaneLayoutsCached(buffer_handle_t buf) {
+        Mutex::Autolock lock(mImporter.mLock);
+        auto it = mImporter.mBufferCache.find(buf);
+        return it != mImporter.mBufferCache.end() && it->second.planeLayoutsQueried;
+    }
+
+    static constexpr uint32_t kWidth = 64;
+    static constexpr uint32_t kHeight = 16;
+
+    HandleImporter mImporter;
+    sp<GraphicBuffer> mBuffer;
+};
+
+TEST_F(HandleImporterTest, FreeBufferDropsCacheEntry) {
+    buffer_handle_t handle = mBuffer->handle;
+    ASSERT_TRUE(mImporter.importBuffer(handle));
+    ASSERT_NE(nullptr, handle);
+    EXPECT_TRUE(isCached(handle));
+    EXPECT_FALSE(isPlaneLayoutsCached(handle));
+
+    uint32_t stride = 0;
+    ASSERT_EQ(OK, mImporter.getMonoPlanarStrideBytes(handle, &stride));
+    EXPECT_GE(stride, kWidth * 4);
+    EXPECT_TRUE(isPlaneLayoutsCached(handle));
+
+    // Served from the cache
+    uint32_t cachedStride = 0;
+    ASSERT_EQ(OK, mImporter.getMonoPlanarStrideBytes(handle, &cachedStride));
+    EXPECT_EQ(stride, cachedStride);
+
+    mImporter.freeBuffer(handle);
+    EXPECT_FALSE(isCached(handle));
+}
+
+TEST_F(HandleImporterTest, BuffersImportedElsewhereAreNotCached) {
+    buffer_handle_t handle = mBuffer->handle;
+    uint32_t stride = 0;
+    ASSERT_EQ(OK, mImporter.getMonoPlanarStrideBytes(handle, &stride));
+    EXPECT_GE(stride, kWidth * 4);
+    EXPECT_FALSE(isCached(handle));
+}
+
+}  // namespace helper
+}  // namespace common
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
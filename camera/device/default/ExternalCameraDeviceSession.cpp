@@ -220,7 +220,30 @@ void ExternalCameraDeviceSession::initOutputThread() {
     mBufferRequestThread = std::make_shared<BufferRequestThread>(/*parent=*/thiz, mCallback);
     mBufferRequestThread->run();
     mOutputThread = std::make_shared<OutputThread>(/*parent=*/thiz, mCroppingType,
-                                                   mCameraCharacteristics, mBufferRequestThread);
+                                                   mCameraCharacteristics, mBufferRequestThread,
+                                                   mCfg.numProcessingThreads);
+    mOutputThread->setFrameTimingStats(mFrameTimings);
+    initResultDispatcher();
+}
+
+void ExternalCameraDeviceSession::initResultDispatcher() {
+    if (mCfg.resultBatchSize <= 1) {
+        return;
+    }
+
+    std::shared_ptr<ExternalCameraDeviceSession> thiz = ref<ExternalCameraDeviceSession>();
+    mResultDispatcher = std::make_shared<ResultDispatcherThread>(
+            /*parent=*/thiz, mCfg.resultBatchSize,
+            std::chrono::microseconds(mCfg.resultBatchMaxDelayUs));
+    mResultDispatcher->run();
+}
+
+void ExternalCameraDeviceSession::closeResultDispatcher() {
+    if (mResultDispatcher != nullptr) {
+        mResultDispatcher->flush();
+        mResultDispatcher->requestExitAndWait();
+        mResultDispatcher.reset();
+    }
 }
 
 void ExternalCameraDeviceSession::closeOutputThread() {
@@ -476,6 +499,9 @@ ScopedAStatus ExternalCameraDeviceSession::flush() {
         return fromStatus(status);
     }
     mOutputThread->flush();
+    if (mResultDispatcher != nullptr) {
+        mResultDispatcher->flush();
+    }
     return fromStatus(Status::OK);
 }
 
@@ -701,6 +727,10 @@ ScopedAStatus ExternalCameraDeviceSession::switchToOffline(
     std::shared_ptr<ICameraOfflineSession> session;
     Status st = switchToOffline(in_streamsToKeep, &msgs, &results, &info, &session);
 
+    // Results batched before the switch must reach the framework first
+    if (mResultDispatcher != nullptr) {
+        mResultDispatcher->flush();
+    }
     mCallback->notify(msgs);
     invokeProcessCaptureResultCallback(results, /* tryWriteFmq= */ true);
     freeReleaseFences(results);
@@ -1233,6 +1263,7 @@ std::unique_ptr<V4L2Frame> ExternalCameraDeviceSession::dequeueV4l2FrameLocked(n
     }
 
     ATRACE_BEGIN("VIDIOC_DQBUF");
+    nsecs_t dqbufStartNs = systemTime(SYSTEM_TIME_MONOTONIC);
     v4l2_buffer buffer{};
     buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     buffer.memory = V4L2_MEMORY_MMAP;
@@ -1240,6 +1271,8 @@ std::unique_ptr<V4L2Frame> ExternalCameraDeviceSession::dequeueV4l2FrameLocked(n
         ALOGE("%s: DQBUF fails: %s", __FUNCTION__, strerror(errno));
         return ret;
     }
+    mFrameTimings->record(FrameTimingStats::V4L2_DEQUEUE,
+                          systemTime(SYSTEM_TIME_MONOTONIC) - dqbufStartNs);
     ATRACE_END();
 
     if (buffer.index >= mV4L2BufferCount) {
@@ -1381,6 +1414,7 @@ void ExternalCameraDeviceSession::closeImpl() {
     if (!closed) {
         closeOutputThread();
         closeBufferRequestThread();
+        closeResultDispatcher();
 
         Mutex::Autolock _l(mLock);
         // free all buffers
@@ -1501,7 +1535,7 @@ void ExternalCameraDeviceSession::notifyShutter(int32_t frameNumber, nsecs_t shu
             .frameNumber = frameNumber,
             .timestamp = shutterTs,
     });
-    mCallback->notify({msg});
+    sendNotify(msg);
 }
 void ExternalCameraDeviceSession::notifyError(int32_t frameNumber, int32_t streamId, ErrorCode ec) {
     NotifyMsg msg;
@@ -1510,9 +1544,26 @@ void ExternalCameraDeviceSession::notifyError(int32_t frameNumber, int32_t strea
             .errorStreamId = streamId,
             .errorCode = ec,
     });
+    sendNotify(msg);
+}
+
+void ExternalCameraDeviceSession::sendNotify(const NotifyMsg& msg) {
+    if (mResultDispatcher != nullptr) {
+        mResultDispatcher->queueNotify(msg);
+        return;
+    }
     mCallback->notify({msg});
 }
 
+void ExternalCameraDeviceSession::sendCaptureResults(std::vector<CaptureResult>& results) {
+    if (mResultDispatcher != nullptr) {
+        mResultDispatcher->queueResults(results);
+        return;
+    }
+    invokeProcessCaptureResultCallback(results, /* tryWriteFmq */ true);
+    freeReleaseFences(results);
+}
+
 void ExternalCameraDeviceSession::invokeProcessCaptureResultCallback(
         std::vector<CaptureResult>& results, bool tryWriteFmq) {
     if (mProcessCaptureResultLock.tryLock() != OK) {
@@ -1523,6 +1574,7 @@ void ExternalCameraDeviceSession::invokeProcessCaptureResultCallback(
             return;
         }
     }
+    FrameTimingStats::ScopedTimer timer(mFrameTimings.get(), FrameTimingStats::RESULT_DISPATCH);
     if (tryWriteFmq && mResultMetadataQueue->availableToWrite() > 0) {
         for (CaptureResult& result : results) {
             CameraMetadata& md = result.result;
@@ -1743,8 +1795,7 @@ Status ExternalCameraDeviceSession::processCaptureRequestError(
         // Callback into framework
         std::vector<CaptureResult> results(1);
         results[0] = std::move(result);
-        invokeProcessCaptureResultCallback(results, /* tryWriteFmq */ true);
-        freeReleaseFences(results);
+        sendCaptureResults(results);
     } else {
         outResults->push_back(std::move(result));
     }
@@ -1804,8 +1855,7 @@ Status ExternalCameraDeviceSession::processCaptureResult(std::shared_ptr<HalRequ
     }
 
     // Callback into framework
-    invokeProcessCaptureResultCallback(results, /* tryWriteFmq */ true);
-    freeReleaseFences(results);
+    sendCaptureResults(results);
     return Status::OK;
 }
 
@@ -1844,6 +1894,20 @@ ssize_t ExternalCameraDeviceSession::getJpegBufferSize(int32_t width, int32_t he
 
     return jpegBufferSize;
 }
+
+OutputBufferMapper& ExternalCameraDeviceSession::getOutputBufferMapper() {
+    static GrallocBufferMapper sBufferMapper(sHandleImporter);
+    return sBufferMapper;
+}
+
+void ExternalCameraDeviceSession::dispatchNotify(const std::vector<NotifyMsg>& msgs) {
+    mCallback->notify(msgs);
+}
+
+void ExternalCameraDeviceSession::dispatchCaptureResults(std::vector<CaptureResult>& results) {
+    invokeProcessCaptureResultCallback(results, /* tryWriteFmq */ true);
+}
+
 binder_status_t ExternalCameraDeviceSession::dump(int fd, const char** /*args*/,
                                                   uint32_t /*numArgs*/) {
     bool intfLocked = tryLock(mInterfaceLock);
@@ -1912,6 +1976,10 @@ binder_status_t ExternalCameraDeviceSession::dump(int fd, const char** /*args*/,
     }
     dprintf(fd, "\n");
     mOutputThread->dump(fd);
+    if (mResultDispatcher != nullptr) {
+        mResultDispatcher->dump(fd);
+    }
+    mFrameTimings->dump(fd);
     dprintf(fd, "\n");
 
     if (intfLocked) {
@@ -2120,16 +2188,120 @@ bool ExternalCameraDeviceSession::BufferRequestThread::threadLoop() {
 
 // End ExternalCameraDeviceSession::BufferRequestThread functions
 
+// Start ExternalCameraDeviceSession::ResultDispatcherThread functions
+
+ExternalCameraDeviceSession::ResultDispatcherThread::ResultDispatcherThread(
+        std::weak_ptr<ResultDispatcherInterface> parent, uint32_t maxBatchSize,
+        std::chrono::microseconds maxDelay)
+    : mParent(parent), mMaxBatchSize(maxBatchSize), mMaxDelay(maxDelay) {
+    mPendingResults.reserve(maxBatchSize);
+}
+
+void ExternalCameraDeviceSession::ResultDispatcherThread::queueNotify(const NotifyMsg& msg) {
+    std::lock_guard<std::mutex> lk(mLock);
+    if (mPendingMsgs.empty() && mPendingResults.empty()) {
+        mOldestPendingTime = std::chrono::steady_clock::now();
+    }
+    mPendingMsgs.push_back(msg);
+    mBatchCond.notify_one();
+}
+
+void ExternalCameraDeviceSession::ResultDispatcherThread::queueResults(
+        std::vector<CaptureResult>& results) {
+    std::lock_guard<std::mutex> lk(mLock);
+    if (mPendingMsgs.empty() && mPendingResults.empty()) {
+        mOldestPendingTime = std::chrono::steady_clock::now();
+    }
+    for (auto& result : results) {
+        mPendingResults.push_back(std::move(result));
+    }
+    results.clear();
+    mBatchCond.notify_one();
+}
+
+void ExternalCameraDeviceSession::ResultDispatcherThread::flush() {
+    ATRACE_CALL();
+    dispatchPending();
+}
+
+void ExternalCameraDeviceSession::ResultDispatcherThread::dump(int fd) {
+    std::lock_guard<std::mutex> lk(mLock);
+    dprintf(fd, "ResultDispatcher: max batch size %u, max delay %lldus\n", mMaxBatchSize,
+            static_cast<long long>(mMaxDelay.count()));
+    dprintf(fd, "ResultDispatcher: %" PRIu64 " results in %" PRIu64 " batches, %zu pending\n",
+            mNumDispatchedResults, mNumBatches, mPendingResults.size());
+}
+
+bool ExternalCameraDeviceSession::ResultDispatcherThread::threadLoop() {
+    std::unique_lock<std::mutex> lk(mLock);
+    if (mPendingMsgs.empty() && mPendingResults.empty()) {
+        // Wake up periodically so a pending exit request is noticed
+        mBatchCond.wait_for(lk, std::chrono::milliseconds(kIdleWaitTimeoutMs));
+        if (mPendingMsgs.empty() && mPendingResults.empty()) {
+            return true;
+        }
+    }
+
+    auto deadline = mOldestPendingTime + mMaxDelay;
+    while (!mPendingMsgs.empty() || !mPendingResults.empty()) {
+        if (mPendingResults.size() >= mMaxBatchSize) {
+            break;
+        }
+        if (mBatchCond.wait_until(lk, deadline) == std::cv_status::timeout) {
+            break;
+        }
+    }
+    lk.unlock();
+
+    dispatchPending();
+    return true;
+}
+
+void ExternalCameraDeviceSession::ResultDispatcherThread::dispatchPending() {
+    std::lock_guard<std::mutex> dispatchLk(mDispatchLock);
+    {
+        std::lock_guard<std::mutex> lk(mLock);
+        if (mPendingMsgs.empty() && mPendingResults.empty()) {
+            return;
+        }
+        mDispatchMsgs.swap(mPendingMsgs);
+        mDispatchResults.swap(mPendingResults);
+        mNumBatches++;
+        mNumDispatchedResults += mDispatchResults.size();
+    }
+
+    auto parent = mParent.lock();
+    if (parent == nullptr) {
+        ALOGE("%s: session has been disconnected!", __FUNCTION__);
+    } else {
+        ATRACE_BEGIN("dispatchResultBatch");
+        // Notify first so each shutter still precedes its capture result
+        if (!mDispatchMsgs.empty()) {
+            parent->dispatchNotify(mDispatchMsgs);
+        }
+        if (!mDispatchResults.empty()) {
+            parent->dispatchCaptureResults(mDispatchResults);
+        }
+        ATRACE_END();
+    }
+    freeReleaseFences(mDispatchResults);
+    mDispatchMsgs.clear();
+    mDispatchResults.clear();
+}
+
+// End ExternalCameraDeviceSession::ResultDispatcherThread functions
+
 // Start ExternalCameraDeviceSession::OutputThread functions
 
 ExternalCameraDeviceSession::OutputThread::OutputThread(
         std::weak_ptr<OutputThreadInterface> parent, CroppingType ct,
         const common::V1_0::helper::CameraMetadata& chars,
-        std::shared_ptr<BufferRequestThread> bufReqThread)
+        std::shared_ptr<BufferRequestThread> bufReqThread, uint32_t numProcessingThreads)
     : mParent(parent),
       mCroppingType(ct),
       mCameraCharacteristics(chars),
-      mBufferRequestThread(bufReqThread) {}
+      mBufferRequestThread(bufReqThread),
+      mFrameProcessor(numProcessingThreads) {}
 
 ExternalCameraDeviceSession::OutputThread::~OutputThread() {}
 
@@ -2263,8 +2435,16 @@ void ExternalCameraDeviceSession::OutputThread::dump(int fd) {
 
 void ExternalCameraDeviceSession::OutputThread::setExifMakeModel(const std::string& make,
                                                                  const std::string& model) {
+    std::lock_guard<std::mutex> lk(mBufferLock);
     mExifMake = make;
     mExifModel = model;
+    // Rebuilt with the new make and model on the next JPEG capture
+    mExifUtils.reset();
+}
+
+void ExternalCameraDeviceSession::OutputThread::setFrameTimingStats(
+        std::shared_ptr<FrameTimingStats> stats) {
+    mFrameTimings = std::move(stats);
 }
 
 std::list<std::shared_ptr<HalRequest>>
@@ -2405,17 +2585,14 @@ int ExternalCameraDeviceSession::OutputThread::cropAndScaleLocked(
         return ret;
     }
 
-    ret = libyuv::I420Scale(
-            static_cast<uint8_t*>(croppedLayout.y), croppedLayout.yStride,
-            static_cast<uint8_t*>(croppedLayout.cb), croppedLayout.cStride,
-            static_cast<uint8_t*>(croppedLayout.cr), croppedLayout.cStride, inputCrop.width,
-            inputCrop.height, static_cast<uint8_t*>(outLayout.y), outLayout.yStride,
-            static_cast<uint8_t*>(outLayout.cb), outLayout.cStride,
-            static_cast<uint8_t*>(outLayout.cr), outLayout.cStride, outSz.width, outSz.height,
-            // TODO: b/72261744 see if we can use better filter without losing too much perf
-            libyuv::FilterMode::kFilterNone);
+    {
+        FrameTimingStats::ScopedTimer timer(mFrameTimings.get(), FrameTimingStats::SCALE);
+        ret = mFrameProcessor.scale(croppedLayout, inputCrop.width, inputCrop.height, outLayout,
+                                    outSz.width, outSz.height);
+    }
 
     if (ret != 0) {
+        recordFailure(FrameTimingStats::SCALE);
         ALOGE("%s: failed to scale buffer from %dx%d to %dx%d. Ret %d", __FUNCTION__,
               inputCrop.width, inputCrop.height, outSz.width, outSz.height, ret);
         return ret;
@@ -2540,6 +2717,7 @@ int ExternalCameraDeviceSession::OutputThread::cropAndScaleThumbLocked(
                             outSz.width, outSz.height, libyuv::FilterMode::kFilterNone);
 
     if (ret != 0) {
+        recordFailure(FrameTimingStats::SCALE);
         ALOGE("%s: failed to scale buffer from %dx%d to %dx%d. Ret %d", __FUNCTION__,
               inputCrop.width, inputCrop.height, outSz.width, outSz.height, ret);
         return ret;
@@ -2647,33 +2825,28 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
         }
     }
 
-    /* Combine camera characteristics with request settings to form EXIF
-     * metadata */
-    common::V1_0::helper::CameraMetadata meta(mCameraCharacteristics);
-    meta.append(setting);
-
-    /* Generate EXIF object */
-    std::unique_ptr<ExifUtils> utils(ExifUtils::create());
-    /* Make sure it's initialized */
-    utils->initialize();
+    /* Generate EXIF object. Tags from the camera characteristics are in the
+     * template, only the request settings are applied per capture. Without
+     * template support, the EXIF object is built from scratch instead */
+    if ((mExifUtils == nullptr || !mExifUtils->resetToTemplate()) && !initExifTemplateLocked()) {
+        return lfail("%s: initializing EXIF template failed", __FUNCTION__);
+    }
 
-    utils->setFromMetadata(meta, jpegSize.width, jpegSize.height);
-    utils->setMake(mExifMake);
-    utils->setModel(mExifModel);
+    mExifUtils->setFromMetadata(setting, jpegSize.width, jpegSize.height);
 
-    ret = utils->generateApp1(outputThumbnail ? &thumbCode[0] : nullptr, thumbCodeSize);
+    ret = mExifUtils->generateApp1(outputThumbnail ? &thumbCode[0] : nullptr, thumbCodeSize);
 
     if (!ret) {
         return lfail("%s: generating APP1 failed", __FUNCTION__);
     }
 
     /* Get internal buffer */
-    size_t exifDataSize = utils->getApp1Length();
-    const uint8_t* exifData = utils->getApp1Buffer();
+    size_t exifDataSize = mExifUtils->getApp1Length();
+    const uint8_t* exifData = mExifUtils->getApp1Buffer();
 
     /* Lock the HAL jpeg code buffer */
-    void* bufPtr = sHandleImporter.lock(*(halBuf.bufPtr), static_cast<uint64_t>(halBuf.usage),
-                                        maxJpegCodeSize);
+    void* bufPtr = parent->getOutputBufferMapper().lock(
+            *(halBuf.bufPtr), static_cast<uint64_t>(halBuf.usage), maxJpegCodeSize);
 
     if (!bufPtr) {
         return lfail("%s: could not lock %zu bytes", __FUNCTION__, maxJpegCodeSize);
@@ -2691,7 +2864,7 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
     memcpy(blobDst, &blob, sizeof(CameraBlob));
 
     /* Unlock the HAL jpeg code buffer */
-    int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
+    int relFence = parent->getOutputBufferMapper().unlock(*(halBuf.bufPtr));
     if (relFence >= 0) {
         halBuf.acquireFence = relFence;
     }
@@ -2707,6 +2880,29 @@ int ExternalCameraDeviceSession::OutputThread::createJpegLocked(
     return 0;
 }
 
+bool ExternalCameraDeviceSession::OutputThread::initExifTemplateLocked() {
+    std::unique_ptr<ExifUtils> utils(ExifUtils::create());
+    if (!utils->initialize()) {
+        return false;
+    }
+
+    /* Image size and capture time are overwritten by each capture */
+    utils->setFromMetadata(mCameraCharacteristics, 0, 0);
+    if (!utils->setMake(mExifMake) || !utils->setModel(mExifModel)) {
+        return false;
+    }
+
+    utils->saveTemplate();
+    mExifUtils = std::move(utils);
+    return true;
+}
+
+void ExternalCameraDeviceSession::OutputThread::recordFailure(FrameTimingStats::Stage stage) {
+    if (mFrameTimings != nullptr) {
+        mFrameTimings->recordFailure(stage);
+    }
+}
+
 void ExternalCameraDeviceSession::OutputThread::clearIntermediateBuffers() {
     std::lock_guard<std::mutex> lk(mBufferLock);
     mYu12Frame.reset();
@@ -2800,12 +2996,12 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
                     mYu12Frame->mWidth, mYu12Frame->mHeight, mYu12Frame->mWidth,
                     mYu12Frame->mHeight, libyuv::kRotate0, libyuv::FOURCC_RAW);
         } else {
-            res = libyuv::MJPGToI420(
-                    inData, inDataSize, static_cast<uint8_t*>(mYu12FrameLayout.y),
-                    mYu12FrameLayout.yStride, static_cast<uint8_t*>(mYu12FrameLayout.cb),
-                    mYu12FrameLayout.cStride, static_cast<uint8_t*>(mYu12FrameLayout.cr),
-                    mYu12FrameLayout.cStride, mYu12Frame->mWidth, mYu12Frame->mHeight,
-                    mYu12Frame->mWidth, mYu12Frame->mHeight);
+            FrameTimingStats::ScopedTimer timer(mFrameTimings.get(), FrameTimingStats::DECODE);
+            res = mFrameProcessor.decodeMjpeg(inData, inDataSize, mYu12Frame->mWidth,
+                                              mYu12Frame->mHeight, mYu12FrameLayout);
+            if (res != 0) {
+                recordFailure(FrameTimingStats::DECODE);
+            }
         }
         ATRACE_END();
 
@@ -2866,20 +3062,26 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
         // Gralloc lockYCbCr the buffer
         switch (halBuf.format) {
             case PixelFormat::BLOB: {
-                int ret = createJpegLocked(halBuf, req->setting);
+                int ret;
+                {
+                    FrameTimingStats::ScopedTimer timer(mFrameTimings.get(),
+                                                        FrameTimingStats::ENCODE);
+                    ret = createJpegLocked(halBuf, req->setting);
+                }
 
                 if (ret != 0) {
+                    recordFailure(FrameTimingStats::ENCODE);
                     lk.unlock();
                     return onDeviceError("%s: createJpegLocked failed with %d", __FUNCTION__, ret);
                 }
             } break;
             case PixelFormat::Y16: {
-                void* outLayout = sHandleImporter.lock(
+                void* outLayout = parent->getOutputBufferMapper().lock(
                         *(halBuf.bufPtr), static_cast<uint64_t>(halBuf.usage), inDataSize);
 
                 std::memcpy(outLayout, inData, inDataSize);
 
-                int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
+                int relFence = parent->getOutputBufferMapper().unlock(*(halBuf.bufPtr));
                 if (relFence >= 0) {
                     halBuf.acquireFence = relFence;
                 }
@@ -2888,7 +3090,7 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
             case PixelFormat::YV12: {
                 android::Rect outRect{0, 0, static_cast<int32_t>(halBuf.width),
                                       static_cast<int32_t>(halBuf.height)};
-                android_ycbcr result = sHandleImporter.lockYCbCr(
+                android_ycbcr result = parent->getOutputBufferMapper().lockYCbCr(
                         *(halBuf.bufPtr), static_cast<uint64_t>(halBuf.usage), outRect);
                 ALOGV("%s: outLayout y %p cb %p cr %p y_str %zu c_str %zu c_step %zu", __FUNCTION__,
                       result.y, result.cb, result.cr, result.ystride, result.cstride,
@@ -2922,13 +3124,23 @@ bool ExternalCameraDeviceSession::OutputThread::threadLoop() {
 
                 Size sz{halBuf.width, halBuf.height};
                 ATRACE_BEGIN("formatConvert");
-                ret = formatConvert(cropAndScaled, outLayout, sz, outputFourcc);
+                {
+                    FrameTimingStats::ScopedTimer timer(mFrameTimings.get(),
+                                                        FrameTimingStats::CONVERT);
+                    if (outputFourcc == FLEX_YUV_GENERIC) {
+                        ret = formatConvert(cropAndScaled, outLayout, sz, outputFourcc);
+                    } else {
+                        ret = mFrameProcessor.formatConvert(cropAndScaled, outLayout, sz.width,
+                                                            sz.height, outputFourcc);
+                    }
+                }
                 ATRACE_END();
                 if (ret != 0) {
+                    recordFailure(FrameTimingStats::CONVERT);
                     lk.unlock();
                     return onDeviceError("%s: format conversion failed!", __FUNCTION__);
                 }
-                int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
+                int relFence = parent->getOutputBufferMapper().unlock(*(halBuf.bufPtr));
                 if (relFence >= 0) {
                     halBuf.acquireFence = relFence;
                 }
@@ -17,7 +17,10 @@
 #ifndef HARDWARE_INTERFACES_CAMERA_DEVICE_DEFAULT_EXTERNALCAMERADEVICESESSION_H_
 #define HARDWARE_INTERFACES_CAMERA_DEVICE_DEFAULT_EXTERNALCAMERADEVICESESSION_H_
 
+#include <Exif.h>
 #include <ExternalCameraUtils.h>
+#include <FrameTimingStats.h>
+#include <ParallelFrameProcessor.h>
 #include <SimpleThread.h>
 #include <aidl/android/hardware/camera/common/Status.h>
 #include <aidl/android/hardware/camera/device/BnCameraDeviceSession.h>
@@ -29,6 +32,7 @@
 #include <android/hardware/graphics/mapper/4.0/IMapper.h>
 #include <fmq/AidlMessageQueue.h>
 #include <utils/Thread.h>
+#include <chrono>
 #include <deque>
 #include <list>
 
@@ -61,7 +65,9 @@ using ::android::hardware::camera::external::common::SizeHasher;
 using ::android::hardware::graphics::mapper::V2_0::YCbCrLayout;
 using ::ndk::ScopedAStatus;
 
-class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputThreadInterface {
+class ExternalCameraDeviceSession : public BnCameraDeviceSession,
+                                    public OutputThreadInterface,
+                                    public ResultDispatcherInterface {
   public:
     ExternalCameraDeviceSession(const std::shared_ptr<ICameraDeviceCallback>&,
                                 const ExternalCameraConfig& cfg,
@@ -111,6 +117,10 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
 
     Status processCaptureResult(std::shared_ptr<HalRequest>& ptr) override;
     ssize_t getJpegBufferSize(int32_t width, int32_t height) const override;
+    OutputBufferMapper& getOutputBufferMapper() override;
+
+    void dispatchNotify(const std::vector<NotifyMsg>& msgs) override;
+    void dispatchCaptureResults(std::vector<CaptureResult>& results) override;
 
     // Called by CameraDevice to dump active device states
     binder_status_t dump(int fd, const char** args, uint32_t numArgs) override;
@@ -165,7 +175,8 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
       public:
         OutputThread(std::weak_ptr<OutputThreadInterface> parent, CroppingType,
                      const common::V1_0::helper::CameraMetadata&,
-                     std::shared_ptr<BufferRequestThread> bufReqThread);
+                     std::shared_ptr<BufferRequestThread> bufReqThread,
+                     uint32_t numProcessingThreads = 1);
         ~OutputThread();
 
         Status allocateIntermediateBuffers(const Size& v4lSize, const Size& thumbSize,
@@ -178,6 +189,9 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
 
         void setExifMakeModel(const std::string& make, const std::string& model);
 
+        // Per-stage timings are recorded into stats when set
+        void setFrameTimingStats(std::shared_ptr<FrameTimingStats> stats);
+
         // The remaining request list is returned for offline processing
         std::list<std::shared_ptr<HalRequest>> switchToOffline();
 
@@ -203,8 +217,14 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
         int createJpegLocked(HalStreamBuffer& halBuf,
                              const common::V1_0::helper::CameraMetadata& settings);
 
+        // Builds the EXIF template shared by all JPEG captures of the session
+        bool initExifTemplateLocked();
+
         void clearIntermediateBuffers();
 
+        // Counts a frame the stage failed on, if frame timings are recorded
+        void recordFailure(FrameTimingStats::Stage stage);
+
         const std::weak_ptr<OutputThreadInterface> mParent;
         const CroppingType mCroppingType;
         const common::V1_0::helper::CameraMetadata mCameraCharacteristics;
@@ -235,8 +255,56 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
 
         std::string mExifMake;
         std::string mExifModel;
+        // Holds make, model and the tags derived from the camera characteristics;
+        // only the per-capture tags are set on it for each JPEG.
+        std::unique_ptr<common::V1_0::helper::ExifUtils> mExifUtils;
 
         const std::shared_ptr<BufferRequestThread> mBufferRequestThread;
+
+        // Splits decode/scale/convert of each frame across worker threads
+        ParallelFrameProcessor mFrameProcessor;
+
+        std::shared_ptr<FrameTimingStats> mFrameTimings;
+    };
+
+    // Coalesces notify messages and capture results that become ready close together
+    // into one notify() and one processCaptureResult() call. A batch is sent once it
+    // holds mMaxBatchSize results or its oldest entry has waited mMaxDelay.
+    class ResultDispatcherThread : public SimpleThread {
+      public:
+        ResultDispatcherThread(std::weak_ptr<ResultDispatcherInterface> parent,
+                               uint32_t maxBatchSize, std::chrono::microseconds maxDelay);
+
+        void queueNotify(const NotifyMsg& msg);
+        void queueResults(std::vector<CaptureResult>& results);
+
+        // Sends everything queued so far from the calling thread
+        void flush();
+        void dump(int fd);
+        bool threadLoop() override;
+
+      private:
+        // Moves the pending batch out and sends it. Batches are sent in queue order.
+        void dispatchPending();
+
+        static constexpr int kIdleWaitTimeoutMs = 100;
+
+        const std::weak_ptr<ResultDispatcherInterface> mParent;
+        const uint32_t mMaxBatchSize;
+        const std::chrono::microseconds mMaxDelay;
+
+        std::mutex mLock;  // protects the pending batch and stats below
+        std::condition_variable mBatchCond;
+        std::vector<NotifyMsg> mPendingMsgs;
+        std::vector<CaptureResult> mPendingResults;
+        std::chrono::steady_clock::time_point mOldestPendingTime;
+        uint64_t mNumBatches = 0;
+        uint64_t mNumDispatchedResults = 0;
+
+        // Held while a batch is being sent. Its vectors are reused across batches.
+        std::mutex mDispatchLock;
+        std::vector<NotifyMsg> mDispatchMsgs;
+        std::vector<CaptureResult> mDispatchResults;
     };
 
   private:
@@ -275,6 +343,13 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
 
     Status processOneCaptureRequest(const CaptureRequest& request);
     void notifyShutter(int32_t frameNumber, nsecs_t shutterTs);
+    // Sends a notify message directly or through the result dispatcher when batching is on
+    void sendNotify(const NotifyMsg& msg);
+    // Sends capture results directly or through the result dispatcher when batching is on.
+    // Release fences are freed once the results have been sent.
+    void sendCaptureResults(std::vector<CaptureResult>& results);
+    void initResultDispatcher();
+    void closeResultDispatcher();
 
     void invokeProcessCaptureResultCallback(std::vector<CaptureResult>& results, bool tryWriteFmq);
     Size getMaxJpegResolution() const;
@@ -362,6 +437,12 @@ class ExternalCameraDeviceSession : public BnCameraDeviceSession, public OutputT
 
     std::shared_ptr<BufferRequestThread> mBufferRequestThread;
 
+    // Only created when result batching is enabled in the config
+    std::shared_ptr<ResultDispatcherThread> mResultDispatcher;
+
+    // Shared with the OutputThread, reported in dump()
+    const std::shared_ptr<FrameTimingStats> mFrameTimings = std::make_shared<FrameTimingStats>();
+
     /* Beginning of members not changed after initialize() */
     using RequestMetadataQueue = AidlMessageQueue<int8_t, SynchronizedReadWrite>;
     std::unique_ptr<RequestMetadataQueue> mRequestMetadataQueue;
@@ -271,6 +271,11 @@ ssize_t ExternalCameraOfflineSession::getJpegBufferSize(int32_t, int32_t) const
     return 0;
 }
 
+OutputBufferMapper& ExternalCameraOfflineSession::getOutputBufferMapper() {
+    static GrallocBufferMapper sBufferMapper(sHandleImporter);
+    return sBufferMapper;
+}
+
 void ExternalCameraOfflineSession::notifyError(int32_t frameNumber, int32_t streamId,
                                                ErrorCode ec) {
     NotifyMsg msg;
@@ -477,12 +482,12 @@ bool ExternalCameraOfflineSession::OutputThread::threadLoop() {
                 }
             } break;
             case PixelFormat::Y16: {
-                void* outLayout = sHandleImporter.lock(
+                void* outLayout = parent->getOutputBufferMapper().lock(
                         *(halBuf.bufPtr), static_cast<uint64_t>(halBuf.usage), inDataSize);
 
                 std::memcpy(outLayout, inData, inDataSize);
 
-                int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
+                int relFence = parent->getOutputBufferMapper().unlock(*(halBuf.bufPtr));
                 if (relFence >= 0) {
                     halBuf.acquireFence = relFence;
                 }
@@ -491,7 +496,7 @@ bool ExternalCameraOfflineSession::OutputThread::threadLoop() {
             case PixelFormat::YV12: {
                 android::Rect outRect{0, 0, static_cast<int32_t>(halBuf.width),
                                       static_cast<int32_t>(halBuf.height)};
-                android_ycbcr result = sHandleImporter.lockYCbCr(
+                android_ycbcr result = parent->getOutputBufferMapper().lockYCbCr(
                         *(halBuf.bufPtr), static_cast<uint64_t>(halBuf.usage), outRect);
                 ALOGV("%s: outLayout y %p cb %p cr %p y_str %zu c_str %zu c_step %zu", __FUNCTION__,
                       result.y, result.cb, result.cr, result.ystride, result.cstride,
@@ -531,7 +536,7 @@ bool ExternalCameraOfflineSession::OutputThread::threadLoop() {
                     lk.unlock();
                     return onDeviceError("%s: format coversion failed!", __FUNCTION__);
                 }
-                int relFence = sHandleImporter.unlock(*(halBuf.bufPtr));
+                int relFence = parent->getOutputBufferMapper().unlock(*(halBuf.bufPtr));
                 if (relFence >= 0) {
                     halBuf.acquireFence = relFence;
                 }
@@ -68,6 +68,8 @@ class ExternalCameraOfflineSession final : public BnCameraOfflineSession,
     ssize_t getJpegBufferSize(int32_t width, int32_t height) const override;
 
     void notifyError(int32_t frameNumber, int32_t streamId, ErrorCode ec) override;
+
+    OutputBufferMapper& getOutputBufferMapper() override;
     // End of OutputThreadInterface methods
 
     ScopedAStatus setCallback(const std::shared_ptr<ICameraDeviceCallback>& in_cb) override;
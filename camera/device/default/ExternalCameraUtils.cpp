@@ -26,6 +26,7 @@
 #include <algorithm>
 #include <cinttypes>
 #include <cmath>
+#include <thread>
 
 #define HAVE_JPEG  // required for libyuv.h to export MJPEG decode APIs
 #include <libyuv.h>
@@ -44,6 +45,9 @@ const int kDefaultNumVideoBuffer = 4;
 const int kDefaultNumStillBuffer = 2;
 const int kDefaultOrientation = 0;  // suitable for natural landscape displays like tablet/TV
                                     // For phone devices 270 is better
+const int kDefaultNumProcessingThreads = 1;
+const int kDefaultResultBatchSize = 1;
+const int kDefaultResultBatchMaxDelayUs = 4000;
 }  // anonymous namespace
 
 const char* ExternalCameraConfig::kDefaultCfgPath = "/vendor/etc/external_camera_config.xml";
@@ -168,10 +172,33 @@ ExternalCameraConfig ExternalCameraConfig::loadFromCfg(const char* cfgPath) {
         ret.orientation = orientation->IntAttribute("degree", /*Default*/ kDefaultOrientation);
     }
 
+    XMLElement* procThreads = deviceCfg->FirstChildElement("ProcessingThreads");
+    if (procThreads == nullptr) {
+        ALOGI("%s: no processing thread count specified", __FUNCTION__);
+    } else {
+        uint32_t maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+        ret.numProcessingThreads = std::clamp(
+                procThreads->UnsignedAttribute("count", /*Default*/ kDefaultNumProcessingThreads),
+                1u, maxThreads);
+    }
+
+    XMLElement* resultBatching = deviceCfg->FirstChildElement("ResultBatching");
+    if (resultBatching == nullptr) {
+        ALOGI("%s: no result batching specified", __FUNCTION__);
+    } else {
+        ret.resultBatchSize = std::max(resultBatching->UnsignedAttribute(
+                                               "maxBatchSize", /*Default*/ kDefaultResultBatchSize),
+                                       1u);
+        ret.resultBatchMaxDelayUs = resultBatching->UnsignedAttribute(
+                "maxDelayUs", /*Default*/ kDefaultResultBatchMaxDelayUs);
+    }
+
     ALOGI("%s: external camera cfg loaded: maxJpgBufSize %d,"
-          " num video buffers %d, num still buffers %d, orientation %d",
+          " num video buffers %d, num still buffers %d, orientation %d, processing threads %u",
           __FUNCTION__, ret.maxJpegBufSize, ret.numVideoBuffers, ret.numStillBuffers,
-          ret.orientation);
+          ret.orientation, ret.numProcessingThreads);
+    ALOGI("%s: result batch size %u, max delay %uus", __FUNCTION__, ret.resultBatchSize,
+          ret.resultBatchMaxDelayUs);
     for (const auto& limit : ret.fpsLimits) {
         ALOGI("%s: fpsLimitList: %dx%d@%f", __FUNCTION__, limit.size.width, limit.size.height,
               limit.fpsUpperBound);
@@ -220,7 +247,10 @@ ExternalCameraConfig::ExternalCameraConfig()
       numVideoBuffers(kDefaultNumVideoBuffer),
       numStillBuffers(kDefaultNumStillBuffer),
       depthEnabled(false),
-      orientation(kDefaultOrientation) {
+      orientation(kDefaultOrientation),
+      numProcessingThreads(kDefaultNumProcessingThreads),
+      resultBatchSize(kDefaultResultBatchSize),
+      resultBatchMaxDelayUs(kDefaultResultBatchMaxDelayUs) {
     fpsLimits.push_back({/* size */ {/* width */ 640, /* height */ 480}, /* fpsUpperBound */ 30.0});
     fpsLimits.push_back({/* size */ {/* width */ 1280, /* height */ 720}, /* fpsUpperBound */ 7.5});
     fpsLimits.push_back(
@@ -107,6 +107,15 @@ struct ExternalCameraConfig {
     // The value of android.sensor.orientation
     int32_t orientation;
 
+    // Number of threads, including the output thread, used to decode, scale and
+    // convert each frame. 1 keeps all processing on the output thread.
+    uint32_t numProcessingThreads;
+
+    // Capture result batching. Results are sent one by one when the batch size is 1.
+    uint32_t resultBatchSize;
+    // Maximum time a result may wait for a batch to fill up, in microseconds
+    uint32_t resultBatchMaxDelayUs;
+
   private:
     ExternalCameraConfig();
     static bool updateFpsList(tinyxml2::XMLElement* fpsList, std::vector<FpsLimitation>& fpsLimits);
@@ -258,6 +267,40 @@ void freeReleaseFences(std::vector<CaptureResult>&);
 status_t fillCaptureResultCommon(common::V1_0::helper::CameraMetadata& md, nsecs_t timestamp,
                                  camera_metadata_ro_entry& activeArraySize);
 
+// Maps the output buffers of the requests into the CPU address space
+struct OutputBufferMapper {
+    virtual ~OutputBufferMapper() {}
+
+    // Locks a 1-D buffer. Assumes caller has waited for acquire fences.
+    virtual void* lock(buffer_handle_t& buf, uint64_t cpuUsage, size_t size) = 0;
+
+    // Assumes caller has waited for acquire fences.
+    virtual android_ycbcr lockYCbCr(buffer_handle_t& buf, uint64_t cpuUsage,
+                                    const android::Rect& accessRegion) = 0;
+
+    virtual int unlock(buffer_handle_t& buf) = 0;  // returns release fence
+};
+
+// Maps gralloc buffers through the graphics mapper HAL
+class GrallocBufferMapper : public OutputBufferMapper {
+  public:
+    explicit GrallocBufferMapper(HandleImporter& importer) : mImporter(importer) {}
+
+    void* lock(buffer_handle_t& buf, uint64_t cpuUsage, size_t size) override {
+        return mImporter.lock(buf, cpuUsage, size);
+    }
+
+    android_ycbcr lockYCbCr(buffer_handle_t& buf, uint64_t cpuUsage,
+                            const android::Rect& accessRegion) override {
+        return mImporter.lockYCbCr(buf, cpuUsage, accessRegion);
+    }
+
+    int unlock(buffer_handle_t& buf) override { return mImporter.unlock(buf); }
+
+  private:
+    HandleImporter& mImporter;
+};
+
 // Interface for OutputThread calling back to parent
 struct OutputThreadInterface {
     virtual ~OutputThreadInterface() {}
@@ -284,6 +327,16 @@ struct OutputThreadInterface {
             std::shared_ptr<HalRequest>&) = 0;
 
     virtual ssize_t getJpegBufferSize(int32_t width, int32_t height) const = 0;
+
+    // The mapper the OutputThread writes the output buffers through
+    virtual OutputBufferMapper& getOutputBufferMapper() = 0;
+};
+
+// Interface for ResultDispatcherThread sending its batches through the parent
+struct ResultDispatcherInterface {
+    virtual ~ResultDispatcherInterface() {}
+    virtual void dispatchNotify(const std::vector<NotifyMsg>& msgs) = 0;
+    virtual void dispatchCaptureResults(std::vector<CaptureResult>& results) = 0;
 };
 
 // A CPU copy of a mapped V4L2Frame. Will map the input V4L2 frame.
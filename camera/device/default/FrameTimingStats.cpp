@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FrameTimingStats.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace device {
+namespace implementation {
+
+FrameTimingStats::FrameTimingStats() {
+    reset();
+}
+
+void FrameTimingStats::record(Stage stage, nsecs_t durationNs) {
+    if (stage >= NUM_STAGES || durationNs < 0) {
+        return;
+    }
+
+    uint64_t ns = static_cast<uint64_t>(durationNs);
+    uint64_t us = ns / 1000;
+    size_t bucket = 0;
+    while (us > 0 && bucket < kNumBuckets - 1) {
+        us >>= 1;
+        bucket++;
+    }
+
+    Histogram& histogram = mHistograms[stage];
+    histogram.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    histogram.totalNs.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t prevMax = histogram.maxNs.load(std::memory_order_relaxed);
+    while (ns > prevMax &&
+           !histogram.maxNs.compare_exchange_weak(prevMax, ns, std::memory_order_relaxed)) {
+    }
+}
+
+void FrameTimingStats::recordFailure(Stage stage) {
+    if (stage >= NUM_STAGES) {
+        return;
+    }
+    mHistograms[stage].failures.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FrameTimingStats::reset() {
+    for (auto& histogram : mHistograms) {
+        for (auto& bucket : histogram.buckets) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        histogram.totalNs.store(0, std::memory_order_relaxed);
+        histogram.maxNs.store(0, std::memory_order_relaxed);
+        histogram.failures.store(0, std::memory_order_relaxed);
+    }
+}
+
+const char* FrameTimingStats::getStageName(Stage stage) {
+    switch (stage) {
+        case V4L2_DEQUEUE:
+            return "V4L2 dequeue";
+        case DECODE:
+            return "Decode";
+        case SCALE:
+            return "Scale";
+        case CONVERT:
+            return "Format convert";
+        case ENCODE:
+            return "JPEG encode";
+        case RESULT_DISPATCH:
+            return "Result dispatch";
+        default:
+            return "Unknown";
+    }
+}
+
+uint64_t FrameTimingStats::getPercentileUs(const std::array<uint64_t, kNumBuckets>& buckets,
+                                           uint64_t count, uint32_t percentile) {
+    uint64_t target = (count * percentile + 99) / 100;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kNumBuckets; i++) {
+        seen += buckets[i];
+        if (seen >= target) {
+            return 1ull << i;
+        }
+    }
+    return 1ull << (kNumBuckets - 1);
+}
+
+void FrameTimingStats::dump(int fd) const {
+    dprintf(fd, "Frame stage timings (percentiles are bucket upper bounds):\n");
+    dprintf(fd, "  %-16s %10s %10s %10s %10s %10s %10s %10s\n", "stage", "count", "failed",
+            "mean(us)", "p50(us)", "p90(us)", "p99(us)", "max(us)");
+    for (uint32_t stage = 0; stage < NUM_STAGES; stage++) {
+        const Histogram& histogram = mHistograms[stage];
+        // Take a snapshot; concurrent records may make it slightly inconsistent
+        std::array<uint64_t, kNumBuckets> buckets;
+        uint64_t count = 0;
+        for (size_t i = 0; i < kNumBuckets; i++) {
+            buckets[i] = histogram.buckets[i].load(std::memory_order_relaxed);
+            count += buckets[i];
+        }
+        uint64_t failures = histogram.failures.load(std::memory_order_relaxed);
+        if (count == 0) {
+            dprintf(fd, "  %-16s %10d %10" PRIu64 "\n", getStageName(static_cast<Stage>(stage)),
+                    0, failures);
+            continue;
+        }
+        uint64_t totalNs = histogram.totalNs.load(std::memory_order_relaxed);
+        uint64_t maxNs = histogram.maxNs.load(std::memory_order_relaxed);
+        dprintf(fd,
+                "  %-16s %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64
+                " %10" PRIu64 " %10" PRIu64 "\n",
+                getStageName(static_cast<Stage>(stage)), count, failures, totalNs / count / 1000,
+                getPercentileUs(buckets, count, 50), getPercentileUs(buckets, count, 90),
+                getPercentileUs(buckets, count, 99), maxNs / 1000);
+    }
+}
+
+}  // namespace implementation
+}  // namespace device
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HARDWARE_INTERFACES_CAMERA_DEVICE_DEFAULT_FRAMETIMINGSTATS_H_
+#define HARDWARE_INTERFACES_CAMERA_DEVICE_DEFAULT_FRAMETIMINGSTATS_H_
+
+#include <utils/Timers.h>
+
+#include <array>
+#include <atomic>
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace device {
+namespace implementation {
+
+// Per-stage latency histograms of the external camera pipeline. Recording only
+// uses relaxed atomic increments, so it is safe to call from any thread without
+// adding lock contention to the frame path.
+class FrameTimingStats {
+  public:
+    enum Stage : uint32_t {
+        V4L2_DEQUEUE = 0,
+        DECODE,
+        SCALE,
+        CONVERT,
+        ENCODE,
+        RESULT_DISPATCH,
+        NUM_STAGES,
+    };
+
+    FrameTimingStats();
+
+    void record(Stage stage, nsecs_t durationNs);
+    // Counts a frame the stage failed to process
+    void recordFailure(Stage stage);
+    void reset();
+    void dump(int fd) const;
+
+    static const char* getStageName(Stage stage);
+
+    // Records the lifetime of the scope into stats, if stats is not null.
+    class ScopedTimer {
+      public:
+        ScopedTimer(FrameTimingStats* stats, Stage stage)
+            : mStats(stats),
+              mStage(stage),
+              mStartNs(stats != nullptr ? systemTime(SYSTEM_TIME_MONOTONIC) : 0) {}
+        ~ScopedTimer() {
+            if (mStats != nullptr) {
+                mStats->record(mStage, systemTime(SYSTEM_TIME_MONOTONIC) - mStartNs);
+            }
+        }
+
+      private:
+        FrameTimingStats* const mStats;
+        const Stage mStage;
+        const nsecs_t mStartNs;
+    };
+
+  private:
+    // Bucket i holds samples in [2^(i-1), 2^i) microseconds, bucket 0 holds samples
+    // below 1us and the last bucket everything above.
+    static const size_t kNumBuckets = 24;
+
+    struct Histogram {
+        std::array<std::atomic<uint64_t>, kNumBuckets> buckets;
+        std::atomic<uint64_t> totalNs;
+        std::atomic<uint64_t> maxNs;
+        std::atomic<uint64_t> failures;
+    };
+
+    // Upper bound, in microseconds, of the bucket containing the given percentile
+    static uint64_t getPercentileUs(const std::array<uint64_t, kNumBuckets>& buckets,
+                                    uint64_t count, uint32_t percentile);
+
+    std::array<Histogram, NUM_STAGES> mHistograms;
+};
+
+}  // namespace implementation
+}  // namespace device
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
+
+#endif  // HARDWARE_INTERFACES_CAMERA_DEVICE_DEFAULT_FRAMETIMINGSTATS_H_
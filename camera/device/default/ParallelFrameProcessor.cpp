@@ -0,0 +1,470 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ExtCamFrameProc"
+// #define LOG_NDEBUG 0
+#include <log/log.h>
+
+#include "ParallelFrameProcessor.h"
+
+#include <linux/videodev2.h>
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+#define HAVE_JPEG  // required for libyuv.h to export MJPEG decode APIs
+#include <libyuv.h>
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace device {
+namespace implementation {
+
+namespace {
+
+const uint8_t kMarkerPrefix = 0xFF;
+const uint8_t kMarkerSOI = 0xD8;
+const uint8_t kMarkerEOI = 0xD9;
+const uint8_t kMarkerRST0 = 0xD0;
+const uint8_t kMarkerRST7 = 0xD7;
+const uint8_t kMarkerSOF0 = 0xC0;  // baseline DCT
+const uint8_t kMarkerSOF1 = 0xC1;  // extended sequential DCT
+const uint8_t kMarkerDHT = 0xC4;
+const uint8_t kMarkerJPG = 0xC8;
+const uint8_t kMarkerDAC = 0xCC;
+const uint8_t kMarkerSOF15 = 0xCF;
+const uint8_t kMarkerSOS = 0xDA;
+const uint8_t kMarkerDRI = 0xDD;
+
+// Bands smaller than this are not worth a thread hand-off
+const int32_t kMinBandHeight = 16;
+
+inline uint8_t* offsetPlane(void* plane, uint32_t stride, int32_t rows) {
+    return static_cast<uint8_t*>(plane) + static_cast<size_t>(stride) * rows;
+}
+
+}  // anonymous namespace
+
+ParallelFrameProcessor::ParallelFrameProcessor(uint32_t numThreads)
+    : mNumThreads(std::max(numThreads, 1u)) {
+    // The calling thread always works on a band too
+    for (uint32_t i = 1; i < mNumThreads; i++) {
+        mWorkers.emplace_back([this] { workerLoop(); });
+    }
+    mBandJpegs.resize(mNumThreads);
+}
+
+ParallelFrameProcessor::~ParallelFrameProcessor() {
+    {
+        std::lock_guard<std::mutex> lk(mLock);
+        mExiting = true;
+    }
+    mWorkCond.notify_all();
+    for (auto& worker : mWorkers) {
+        worker.join();
+    }
+}
+
+void ParallelFrameProcessor::workerLoop() {
+    std::unique_lock<std::mutex> lk(mLock);
+    while (true) {
+        mWorkCond.wait(lk, [this] {
+            return mExiting || (mTask != nullptr && mNextTask < mNumTasks);
+        });
+        if (mExiting) {
+            return;
+        }
+        lk.unlock();
+        drainTasks();
+        lk.lock();
+    }
+}
+
+void ParallelFrameProcessor::drainTasks() {
+    std::unique_lock<std::mutex> lk(mLock);
+    while (mTask != nullptr && mNextTask < mNumTasks) {
+        size_t idx = mNextTask++;
+        const std::function<int(size_t)>* task = mTask;
+        lk.unlock();
+        int ret = (*task)(idx);
+        lk.lock();
+        if (ret != 0 && mResult == 0) {
+            mResult = ret;
+        }
+        if (--mPendingTasks == 0) {
+            mDoneCond.notify_one();
+        }
+    }
+}
+
+int ParallelFrameProcessor::runTasks(size_t numTasks, const std::function<int(size_t)>& task) {
+    if (mWorkers.empty() || numTasks <= 1) {
+        for (size_t i = 0; i < numTasks; i++) {
+            int ret = task(i);
+            if (ret != 0) {
+                return ret;
+            }
+        }
+        return 0;
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(mLock);
+        mTask = &task;
+        mNumTasks = numTasks;
+        mNextTask = 0;
+        mPendingTasks = numTasks;
+        mResult = 0;
+    }
+    mWorkCond.notify_all();
+
+    drainTasks();
+
+    std::unique_lock<std::mutex> lk(mLock);
+    mDoneCond.wait(lk, [this] { return mPendingTasks == 0; });
+    mTask = nullptr;
+    return mResult;
+}
+
+bool ParallelFrameProcessor::parseMjpegLayout(const uint8_t* data, size_t dataSize,
+                                              MjpegLayout* out) {
+    if (dataSize < 4 || data[0] != kMarkerPrefix || data[1] != kMarkerSOI) {
+        return false;
+    }
+
+    bool haveSof = false;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t numComponents = 0;
+    uint32_t hMax = 0;
+    uint32_t vMax = 0;
+    out->restartInterval = 0;
+
+    size_t pos = 2;
+    while (pos + 4 <= dataSize) {
+        if (data[pos] != kMarkerPrefix) {
+            return false;
+        }
+        uint8_t marker = data[pos + 1];
+        if (marker == kMarkerPrefix) {
+            // Fill byte
+            pos++;
+            continue;
+        }
+
+        size_t segLen = (static_cast<size_t>(data[pos + 2]) << 8) | data[pos + 3];
+        if (segLen < 2 || pos + 2 + segLen > dataSize) {
+            return false;
+        }
+        const uint8_t* payload = data + pos + 4;
+        size_t payloadLen = segLen - 2;
+
+        if (marker == kMarkerSOF0 || marker == kMarkerSOF1) {
+            if (haveSof || payloadLen < 6) {
+                return false;
+            }
+            height = (static_cast<uint32_t>(payload[1]) << 8) | payload[2];
+            width = (static_cast<uint32_t>(payload[3]) << 8) | payload[4];
+            numComponents = payload[5];
+            if (numComponents == 0 || payloadLen < 6 + 3 * numComponents) {
+                return false;
+            }
+            for (uint32_t i = 0; i < numComponents; i++) {
+                uint8_t samplingFactors = payload[6 + 3 * i + 1];
+                hMax = std::max<uint32_t>(hMax, samplingFactors >> 4);
+                vMax = std::max<uint32_t>(vMax, samplingFactors & 0xF);
+            }
+            if (numComponents == 1) {
+                // Non-interleaved scans always use 8x8 MCUs
+                hMax = 1;
+                vMax = 1;
+            }
+            out->sofHeightOffset = pos + 5;
+            haveSof = true;
+        } else if (marker > kMarkerSOF1 && marker <= kMarkerSOF15 && marker != kMarkerDHT &&
+                   marker != kMarkerJPG && marker != kMarkerDAC) {
+            // Progressive, lossless or arithmetic coded: no simple band split
+            return false;
+        } else if (marker == kMarkerDRI) {
+            if (payloadLen < 2) {
+                return false;
+            }
+            out->restartInterval = (static_cast<uint32_t>(payload[0]) << 8) | payload[1];
+        } else if (marker == kMarkerSOS) {
+            // Only a single scan containing all components can be split
+            if (!haveSof || payloadLen < 1 || payload[0] != numComponents) {
+                return false;
+            }
+            if (out->restartInterval == 0 || width == 0 || height == 0 || hMax == 0 ||
+                vMax == 0) {
+                return false;
+            }
+            uint32_t mcuWidth = 8 * hMax;
+            out->mcuHeight = 8 * vMax;
+            out->mcusPerRow = (width + mcuWidth - 1) / mcuWidth;
+            out->mcuRows = (height + out->mcuHeight - 1) / out->mcuHeight;
+            out->scanStart = pos + 2 + segLen;
+            out->scanEnd = dataSize;
+            return true;
+        }
+
+        pos += 2 + segLen;
+    }
+    return false;
+}
+
+int ParallelFrameProcessor::decodeMjpeg(const uint8_t* data, size_t dataSize, int32_t width,
+                                        int32_t height, const YCbCrLayout& out) {
+    if (mNumThreads > 1) {
+        int ret = decodeMjpegBands(data, dataSize, width, height, out);
+        if (ret <= 0) {
+            return ret;
+        }
+        // Positive return: frame can't be split, decode it in one go
+    }
+
+    return libyuv::MJPGToI420(data, dataSize, static_cast<uint8_t*>(out.y),
+                              static_cast<int32_t>(out.yStride), static_cast<uint8_t*>(out.cb),
+                              static_cast<int32_t>(out.cStride), static_cast<uint8_t*>(out.cr),
+                              static_cast<int32_t>(out.cStride), width, height, width, height);
+}
+
+// Returns 1 if the frame is not suitable for a band split
+int ParallelFrameProcessor::decodeMjpegBands(const uint8_t* data, size_t dataSize, int32_t width,
+                                             int32_t height, const YCbCrLayout& out) {
+    MjpegLayout layout;
+    if (!parseMjpegLayout(data, dataSize, &layout)) {
+        return 1;
+    }
+
+    uint32_t ri = layout.restartInterval;
+    uint32_t rowUnit;  // band boundaries must fall on multiples of this many MCU rows
+    if (ri % layout.mcusPerRow == 0) {
+        rowUnit = ri / layout.mcusPerRow;
+    } else if (layout.mcusPerRow % ri == 0) {
+        rowUnit = 1;
+    } else {
+        ALOGV("%s: restart interval %u not aligned to %u MCUs per row", __FUNCTION__, ri,
+              layout.mcusPerRow);
+        return 1;
+    }
+
+    // Locate restart markers in the entropy-coded data
+    mRestartMarkers.clear();
+    size_t pos = layout.scanStart;
+    while (pos + 1 < dataSize) {
+        const void* next = memchr(data + pos, kMarkerPrefix, dataSize - pos - 1);
+        if (next == nullptr) {
+            break;
+        }
+        pos = static_cast<const uint8_t*>(next) - data;
+        uint8_t marker = data[pos + 1];
+        if (marker >= kMarkerRST0 && marker <= kMarkerRST7) {
+            mRestartMarkers.push_back(pos);
+            pos += 2;
+        } else if (marker == kMarkerEOI) {
+            layout.scanEnd = pos;
+            break;
+        } else {
+            // Stuffed zero byte or fill byte
+            pos++;
+        }
+    }
+
+    size_t numSegments = mRestartMarkers.size() + 1;
+    size_t totalMcus = static_cast<size_t>(layout.mcusPerRow) * layout.mcuRows;
+    if (numSegments != (totalMcus + ri - 1) / ri) {
+        ALOGV("%s: found %zu restart segments, expected %zu", __FUNCTION__, numSegments,
+              (totalMcus + ri - 1) / ri);
+        return 1;
+    }
+
+    uint32_t numUnits = (layout.mcuRows + rowUnit - 1) / rowUnit;
+    uint32_t maxBands = std::max<int32_t>(height / kMinBandHeight, 1);
+    size_t numBands = std::min({mNumThreads, numUnits, maxBands});
+    if (numBands <= 1) {
+        return 1;
+    }
+
+    auto segmentStart = [&](size_t seg) {
+        return seg == 0 ? layout.scanStart : mRestartMarkers[seg - 1] + 2;
+    };
+    auto segmentEnd = [&](size_t seg) {
+        return seg == numSegments - 1 ? layout.scanEnd : mRestartMarkers[seg];
+    };
+
+    auto decodeBand = [&](size_t band) -> int {
+        uint32_t row0 = numUnits * band / numBands * rowUnit;
+        uint32_t row1 = (band == numBands - 1) ? layout.mcuRows
+                                                : numUnits * (band + 1) / numBands * rowUnit;
+        size_t seg0 = static_cast<size_t>(row0) * layout.mcusPerRow / ri;
+        size_t seg1 = (band == numBands - 1) ? numSegments
+                                              : static_cast<size_t>(row1) * layout.mcusPerRow / ri;
+        int32_t y0 = row0 * layout.mcuHeight;
+        int32_t y1 = std::min<int32_t>(row1 * layout.mcuHeight, height);
+        int32_t bandHeight = y1 - y0;
+
+        // Standalone JPEG: original headers with the band height, then the band's restart
+        // segments renumbered from RST0, then EOI.
+        std::vector<uint8_t>& jpeg = mBandJpegs[band];
+        jpeg.assign(data, data + layout.scanStart);
+        jpeg[layout.sofHeightOffset] = static_cast<uint8_t>(bandHeight >> 8);
+        jpeg[layout.sofHeightOffset + 1] = static_cast<uint8_t>(bandHeight & 0xFF);
+        for (size_t seg = seg0; seg < seg1; seg++) {
+            if (seg != seg0) {
+                jpeg.push_back(kMarkerPrefix);
+                jpeg.push_back(kMarkerRST0 + ((seg - seg0 - 1) & 0x7));
+            }
+            jpeg.insert(jpeg.end(), data + segmentStart(seg), data + segmentEnd(seg));
+        }
+        jpeg.push_back(kMarkerPrefix);
+        jpeg.push_back(kMarkerEOI);
+
+        int ret = libyuv::MJPGToI420(
+                jpeg.data(), jpeg.size(), offsetPlane(out.y, out.yStride, y0),
+                static_cast<int32_t>(out.yStride), offsetPlane(out.cb, out.cStride, y0 / 2),
+                static_cast<int32_t>(out.cStride), offsetPlane(out.cr, out.cStride, y0 / 2),
+                static_cast<int32_t>(out.cStride), width, bandHeight, width, bandHeight);
+        if (ret != 0) {
+            ALOGE("%s: decode of rows [%d, %d) failed: %d", __FUNCTION__, y0, y1, ret);
+        }
+        return ret;
+    };
+
+    return runTasks(numBands, decodeBand);
+}
+
+int ParallelFrameProcessor::scale(const YCbCrLayout& in, int32_t inWidth, int32_t inHeight,
+                                  const YCbCrLayout& out, int32_t outWidth, int32_t outHeight) {
+    // libyuv point-samples output row r from input row (dy / 2 + r * dy) >> 16, where dy is
+    // the 16.16 fixed-point step (inHeight << 16) / outHeight. A band that starts on a
+    // multiple of the reduced ratio samples the same rows as one full-frame call only when
+    // dy is exact; otherwise its rounding error adds up differently in each band. Upscales
+    // that keep the width step by (inHeight - 1) / (outHeight - 1) instead, and odd heights
+    // give the chroma planes a different ratio than the luma plane. Those cases are scaled
+    // in a single call so the output never depends on the thread budget. Band starts are
+    // kept even so the chroma planes split cleanly too.
+    bool canSplit = outHeight > 0 && outHeight <= inHeight && (inHeight | outHeight) % 2 == 0 &&
+                    (static_cast<int64_t>(inHeight) << 16) % outHeight == 0;
+    int32_t outStep = 0;
+    int32_t inStep = 0;
+    int32_t numSteps = 0;
+    size_t numBands = 1;
+    if (canSplit) {
+        int32_t divisor = std::gcd(inHeight, outHeight);
+        outStep = outHeight / divisor;
+        inStep = inHeight / divisor;
+        if ((outStep | inStep) & 1) {
+            outStep *= 2;
+            inStep *= 2;
+        }
+        while (outStep < kMinBandHeight && outStep * 2 <= outHeight) {
+            outStep *= 2;
+            inStep *= 2;
+        }
+        numSteps = outHeight / outStep;
+        numBands = std::min<int32_t>(mNumThreads, numSteps);
+    }
+
+    auto scaleBand = [&](size_t band) -> int {
+        int32_t outY0 = 0, outY1 = outHeight, inY0 = 0, inY1 = inHeight;
+        if (numBands > 1) {
+            int32_t step0 = numSteps * band / numBands;
+            int32_t step1 = numSteps * (band + 1) / numBands;
+            outY0 = step0 * outStep;
+            inY0 = step0 * inStep;
+            if (band != numBands - 1) {
+                outY1 = step1 * outStep;
+                inY1 = step1 * inStep;
+            }
+        }
+        return libyuv::I420Scale(
+                offsetPlane(in.y, in.yStride, inY0), in.yStride,
+                offsetPlane(in.cb, in.cStride, inY0 / 2), in.cStride,
+                offsetPlane(in.cr, in.cStride, inY0 / 2), in.cStride, inWidth, inY1 - inY0,
+                offsetPlane(out.y, out.yStride, outY0), out.yStride,
+                offsetPlane(out.cb, out.cStride, outY0 / 2), out.cStride,
+                offsetPlane(out.cr, out.cStride, outY0 / 2), out.cStride, outWidth,
+                outY1 - outY0,
+                // TODO: b/72261744 see if we can use better filter without losing too much perf
+                libyuv::FilterMode::kFilterNone);
+    };
+
+    if (numBands <= 1) {
+        return scaleBand(0);
+    }
+    return runTasks(numBands, scaleBand);
+}
+
+int ParallelFrameProcessor::formatConvert(const YCbCrLayout& in, const YCbCrLayout& out,
+                                          int32_t width, int32_t height, uint32_t format) {
+    if (format != V4L2_PIX_FMT_NV21 && format != V4L2_PIX_FMT_NV12 &&
+        format != V4L2_PIX_FMT_YVU420 && format != V4L2_PIX_FMT_YUV420) {
+        ALOGE("%s: unsupported YUV format 0x%x!", __FUNCTION__, format);
+        return -1;
+    }
+
+    int32_t numPairs = height / 2;
+    size_t numBands = std::min<int32_t>(mNumThreads, std::max(height / kMinBandHeight, 1));
+
+    auto convertBand = [&](size_t band) -> int {
+        int32_t y0 = 0, y1 = height;
+        if (numBands > 1) {
+            y0 = 2 * (numPairs * band / numBands);
+            if (band != numBands - 1) {
+                y1 = 2 * (numPairs * (band + 1) / numBands);
+            }
+        }
+        int32_t rows = y1 - y0;
+        uint8_t* inY = offsetPlane(in.y, in.yStride, y0);
+        uint8_t* inCb = offsetPlane(in.cb, in.cStride, y0 / 2);
+        uint8_t* inCr = offsetPlane(in.cr, in.cStride, y0 / 2);
+        int32_t inYStride = static_cast<int32_t>(in.yStride);
+        int32_t inCStride = static_cast<int32_t>(in.cStride);
+        uint8_t* outY = offsetPlane(out.y, out.yStride, y0);
+        int32_t outYStride = static_cast<int32_t>(out.yStride);
+        int32_t outCStride = static_cast<int32_t>(out.cStride);
+
+        switch (format) {
+            case V4L2_PIX_FMT_NV21:
+                return libyuv::I420ToNV21(inY, inYStride, inCb, inCStride, inCr, inCStride, outY,
+                                          outYStride, offsetPlane(out.cr, out.cStride, y0 / 2),
+                                          outCStride, width, rows);
+            case V4L2_PIX_FMT_NV12:
+                return libyuv::I420ToNV12(inY, inYStride, inCb, inCStride, inCr, inCStride, outY,
+                                          outYStride, offsetPlane(out.cb, out.cStride, y0 / 2),
+                                          outCStride, width, rows);
+            default:  // YV12 or YU12
+                return libyuv::I420Copy(inY, inYStride, inCb, inCStride, inCr, inCStride, outY,
+                                        outYStride, offsetPlane(out.cb, out.cStride, y0 / 2),
+                                        outCStride, offsetPlane(out.cr, out.cStride, y0 / 2),
+                                        outCStride, width, rows);
+        }
+    };
+
+    int ret = (numBands <= 1) ? convertBand(0) : runTasks(numBands, convertBand);
+    if (ret != 0) {
+        ALOGE("%s: convert to format 0x%x failed! ret %d", __FUNCTION__, format, ret);
+    }
+    return ret;
+}
+
+}  // namespace implementation
+}  // namespace device
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
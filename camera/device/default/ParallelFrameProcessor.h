@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HARDWARE_INTERFACES_CAMERA_DEVICE_DEFAULT_PARALLELFRAMEPROCESSOR_H_
+#define HARDWARE_INTERFACES_CAMERA_DEVICE_DEFAULT_PARALLELFRAMEPROCESSOR_H_
+
+#include <android/hardware/graphics/mapper/2.0/types.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace camera {
+namespace device {
+namespace implementation {
+
+using ::android::hardware::graphics::mapper::V2_0::YCbCrLayout;
+
+// Splits MJPEG decoding, YU12 scaling and YU12 format conversion into horizontal
+// bands and runs the bands concurrently on a fixed pool of worker threads.
+//
+// MJPEG frames are only split when they carry restart markers that line up with
+// MCU rows; each band is then decoded as a standalone JPEG. Everything else
+// falls back to a single libyuv call, which is also what happens when the
+// thread budget is 1. Scaling is only split when the bands sample the same rows
+// as a single call, so the output never depends on the thread budget.
+//
+// Not thread-safe: all methods must be called from the same thread.
+class ParallelFrameProcessor {
+  public:
+    // numThreads is the total CPU budget, including the calling thread.
+    explicit ParallelFrameProcessor(uint32_t numThreads);
+    ~ParallelFrameProcessor();
+
+    uint32_t getNumThreads() const { return mNumThreads; }
+
+    // Decodes a width x height MJPEG frame into the I420 layout out.
+    int decodeMjpeg(const uint8_t* data, size_t dataSize, int32_t width, int32_t height,
+                    const YCbCrLayout& out);
+
+    // Point-sampled I420 to I420 scale.
+    int scale(const YCbCrLayout& in, int32_t inWidth, int32_t inHeight, const YCbCrLayout& out,
+              int32_t outWidth, int32_t outHeight);
+
+    // Converts I420 to the V4L2 fourcc format (NV21, NV12, YV12 or YU12).
+    int formatConvert(const YCbCrLayout& in, const YCbCrLayout& out, int32_t width,
+                      int32_t height, uint32_t format);
+
+  private:
+    // Position of the pieces of a baseline MJPEG frame needed to split it along
+    // restart markers.
+    struct MjpegLayout {
+        size_t sofHeightOffset;  // offset of the 16-bit frame height in the SOF segment
+        size_t scanStart;        // offset of the first entropy-coded byte
+        size_t scanEnd;          // offset of the EOI marker, or the end of data
+        uint32_t mcuHeight;
+        uint32_t mcusPerRow;
+        uint32_t mcuRows;
+        uint32_t restartInterval;  // in MCUs
+    };
+
+    static bool parseMjpegLayout(const uint8_t* data, size_t dataSize, MjpegLayout* out);
+
+    int decodeMjpegBands(const uint8_t* data, size_t dataSize, int32_t width, int32_t height,
+                         const YCbCrLayout& out);
+
+    // Runs task(0) .. task(numTasks - 1) on the worker pool and the calling thread.
+    // Returns the first non-zero task result, or 0.
+    int runTasks(size_t numTasks, const std::function<int(size_t)>& task);
+    void drainTasks();
+    void workerLoop();
+
+    const uint32_t mNumThreads;
+    std::vector<std::thread> mWorkers;
+
+    std::mutex mLock;  // protects the task batch state below
+    std::condition_variable mWorkCond;
+    std::condition_variable mDoneCond;
+    const std::function<int(size_t)>* mTask = nullptr;
+    size_t mNumTasks = 0;
+    size_t mNextTask = 0;
+    size_t mPendingTasks = 0;
+    int mResult = 0;
+    bool mExiting = false;
+
+    // Scratch storage reused across frames for restart-interval decode
+    std::vector<size_t> mRestartMarkers;
+    std::vector<std::vector<uint8_t>> mBandJpegs;
+};
+
+}  // namespace implementation
+}  // namespace device
+}  // namespace camera
+}  // namespace hardware
+}  // namespace android
+
+#endif  // HARDWARE_INTERFACES_CAMERA_DEVICE_DEFAULT_PARALLELFRAMEPROCESSOR_H_
@@ -0,0 +1,406 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replays recorded MJPEG V4L2 frames through the external camera OutputThread, the code
+// ExternalCameraDeviceSession processes its capture requests with (decode, crop and scale,
+// format conversion into the output buffers and JPEG encode), without a camera. It prints the
+// per-stage timings and failures that the session reports in dump().
+//
+// The input is a file of concatenated MJPEG frames, as written for example by
+//   v4l2-ctl --set-fmt-video=width=1920,height=1080,pixelformat=MJPG \
+//            --stream-mmap --stream-count=300 --stream-to=frames.mjpeg
+//
+// The output buffers are heap memory mapped through a HeapBufferMapper in place of gralloc,
+// so this runs on a headless Linux host as well as on a device.
+
+#include <ExternalCameraDeviceSession.h>
+#include <FrameTimingStats.h>
+#include <aidl/android/hardware/camera/device/CameraBlob.h>
+#include <cutils/native_handle.h>
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <linux/videodev2.h>
+#include <unistd.h>
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using ::aidl::android::hardware::camera::device::CameraBlob;
+using ::android::hardware::camera::device::implementation::CroppingType;
+using ::android::hardware::camera::device::implementation::ExternalCameraDeviceSession;
+using ::android::hardware::camera::device::implementation::Frame;
+using ::android::hardware::camera::device::implementation::FrameTimingStats;
+using ::android::hardware::camera::device::implementation::HalRequest;
+using ::android::hardware::camera::device::implementation::HalStreamBuffer;
+using ::android::hardware::camera::device::implementation::HORIZONTAL;
+using ::android::hardware::camera::device::implementation::OutputBufferMapper;
+using ::android::hardware::camera::device::implementation::OutputThreadInterface;
+using ::android::hardware::camera::device::implementation::Stream;
+using ::android::hardware::camera::device::implementation::VERTICAL;
+using ::android::hardware::camera::external::common::Size;
+
+namespace {
+
+// Thumbnail of the JPEG captures, as the framework requests by default
+const Size kThumbSize = {320, 240};
+
+struct Options {
+    std::string inputPath;
+    Size inputSize = {0, 0};
+    std::vector<Size> outputSizes;
+    Size jpegSize = {0, 0};
+    uint32_t numThreads = 1;
+    uint32_t repeat = 1;
+};
+
+void usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s -i frames.mjpeg -s WxH [-o WxH]... [-j WxH] [-t threads] [-r repeat]\n"
+            "  -i  file of concatenated MJPEG frames\n"
+            "  -s  size of the recorded frames\n"
+            "  -o  YCbCr 420 output stream size, may be repeated\n"
+            "  -j  JPEG (BLOB) output stream size\n"
+            "  -t  processing thread budget (default 1)\n"
+            "  -r  number of passes over the input (default 1)\n",
+            name);
+}
+
+bool parseSize(const char* str, Size* out) {
+    return sscanf(str, "%dx%d", &out->width, &out->height) == 2 && out->width > 0 &&
+           out->height > 0;
+}
+
+// Splits a recorded stream at each SOI marker that follows an EOI marker
+std::vector<std::pair<size_t, size_t>> splitMjpegFrames(const std::vector<uint8_t>& data) {
+    std::vector<std::pair<size_t, size_t>> frames;
+    size_t start = SIZE_MAX;
+    for (size_t i = 0; i + 1 < data.size(); i++) {
+        if (data[i] != 0xFF) {
+            continue;
+        }
+        if (data[i + 1] == 0xD8 && start == SIZE_MAX) {
+            start = i;
+        } else if (data[i + 1] == 0xD9 && start != SIZE_MAX) {
+            frames.push_back({start, i + 2 - start});
+            start = SIZE_MAX;
+        }
+    }
+    return frames;
+}
+
+// A recorded frame in place of a dequeued V4L2 buffer
+class ReplayFrame : public Frame {
+  public:
+    ReplayFrame(const Size& size, const uint8_t* data, size_t dataSize)
+        : Frame(size.width, size.height, V4L2_PIX_FMT_MJPEG), mData(data), mDataSize(dataSize) {}
+
+    int getData(uint8_t** outData, size_t* dataSize) override {
+        *outData = const_cast<uint8_t*>(mData);
+        *dataSize = mDataSize;
+        return 0;
+    }
+
+  private:
+    const uint8_t* const mData;
+    const size_t mDataSize;
+};
+
+// Output buffers in heap memory. The handles only identify the buffers, they hold no fds.
+class HeapBufferMapper : public OutputBufferMapper {
+  public:
+    ~HeapBufferMapper() {
+        for (auto& [handle, buffer] : mBuffers) {
+            native_handle_delete(const_cast<native_handle_t*>(handle));
+        }
+    }
+
+    // YCbCr buffers are laid out as YU12, BLOB buffers are size bytes
+    buffer_handle_t allocate(const Size& sz, PixelFormat format, size_t size) {
+        if (format != PixelFormat::BLOB) {
+            size = sz.width * sz.height + 2 * chromaSize(sz);
+        }
+        buffer_handle_t handle = native_handle_create(/*numFds*/ 0, /*numInts*/ 0);
+        if (handle != nullptr) {
+            mBuffers[handle] = {sz, std::vector<uint8_t>(size)};
+        }
+        return handle;
+    }
+
+    void* lock(buffer_handle_t& buf, uint64_t /*cpuUsage*/, size_t size) override {
+        auto it = mBuffers.find(buf);
+        if (it == mBuffers.end() || size > it->second.data.size()) {
+            return nullptr;
+        }
+        return it->second.data.data();
+    }
+
+    android_ycbcr lockYCbCr(buffer_handle_t& buf, uint64_t /*cpuUsage*/,
+                            const android::Rect& /*accessRegion*/) override {
+        android_ycbcr layout = {};
+        auto it = mBuffers.find(buf);
+        if (it == mBuffers.end()) {
+            return layout;
+        }
+        const Size& sz = it->second.size;
+        uint8_t* y = it->second.data.data();
+        layout.y = y;
+        layout.cb = y + sz.width * sz.height;
+        layout.cr = static_cast<uint8_t*>(layout.cb) + chromaSize(sz);
+        layout.ystride = sz.width;
+        layout.cstride = (sz.width + 1) / 2;
+        layout.chroma_step = 1;
+        return layout;
+    }
+
+    int unlock(buffer_handle_t& /*buf*/) override { return -1; }
+
+  private:
+    static size_t chromaSize(const Size& sz) {
+        return static_cast<size_t>((sz.width + 1) / 2) * ((sz.height + 1) / 2);
+    }
+
+    struct Buffer {
+        Size size;
+        std::vector<uint8_t> data;
+    };
+    std::unordered_map<buffer_handle_t, Buffer> mBuffers;
+};
+
+// Stands in for the session: counts how the OutputThread completes each request
+class ReplaySession : public OutputThreadInterface {
+  public:
+    explicit ReplaySession(ssize_t jpegBufferSize) : mJpegBufferSize(jpegBufferSize) {}
+
+    Status importBuffer(int32_t /*streamId*/, uint64_t /*bufId*/, buffer_handle_t /*buf*/,
+                        buffer_handle_t** /*outBufPtr*/) override {
+        // Buffers are allocated up front, as with HAL buffer management disabled
+        return Status::ILLEGAL_ARGUMENT;
+    }
+
+    void notifyError(int32_t /*frameNumber*/, int32_t /*streamId*/, ErrorCode /*ec*/) override {
+        mNumDeviceErrors++;
+    }
+
+    Status processCaptureRequestError(const std::shared_ptr<HalRequest>& req,
+                                      std::vector<NotifyMsg>* /*msgs*/,
+                                      std::vector<CaptureResult>* /*results*/) override {
+        mNumRequestErrors++;
+        closeReleaseFences(req);
+        return Status::OK;
+    }
+
+    Status processCaptureResult(std::shared_ptr<HalRequest>& req) override {
+        mNumResults++;
+        closeReleaseFences(req);
+        return Status::OK;
+    }
+
+    ssize_t getJpegBufferSize(int32_t /*width*/, int32_t /*height*/) const override {
+        return mJpegBufferSize;
+    }
+
+    OutputBufferMapper& getOutputBufferMapper() override { return mBufferMapper; }
+
+    HeapBufferMapper mBufferMapper;
+    std::atomic<uint64_t> mNumResults = 0;
+    std::atomic<uint64_t> mNumRequestErrors = 0;
+    std::atomic<uint64_t> mNumDeviceErrors = 0;
+
+  private:
+    // The OutputThread hands the unlock fences back in acquireFence
+    static void closeReleaseFences(const std::shared_ptr<HalRequest>& req) {
+        for (auto& halBuf : req->buffers) {
+            if (halBuf.acquireFence >= 0) {
+                ::close(halBuf.acquireFence);
+                halBuf.acquireFence = -1;
+            }
+        }
+    }
+
+    const ssize_t mJpegBufferSize;
+};
+
+// Same settings the framework sends for a still capture
+CameraMetadata makeRequestSettings() {
+    CameraMetadata settings;
+    const uint8_t jpegQuality = 90;
+    const int32_t thumbSize[] = {kThumbSize.width, kThumbSize.height};
+    settings.update(ANDROID_JPEG_QUALITY, &jpegQuality, 1);
+    settings.update(ANDROID_JPEG_THUMBNAIL_QUALITY, &jpegQuality, 1);
+    settings.update(ANDROID_JPEG_THUMBNAIL_SIZE, thumbSize, 2);
+    return settings;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options opts;
+    int c;
+    while ((c = getopt(argc, argv, "i:s:o:j:t:r:h")) != -1) {
+        Size sz;
+        switch (c) {
+            case 'i':
+                opts.inputPath = optarg;
+                break;
+            case 's':
+                if (!parseSize(optarg, &opts.inputSize)) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'o':
+                if (!parseSize(optarg, &sz)) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                opts.outputSizes.push_back(sz);
+                break;
+            case 'j':
+                if (!parseSize(optarg, &opts.jpegSize)) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 't':
+                opts.numThreads = std::max(atoi(optarg), 1);
+                break;
+            case 'r':
+                opts.repeat = std::max(atoi(optarg), 1);
+                break;
+            default:
+                usage(argv[0]);
+                return c == 'h' ? 0 : 1;
+        }
+    }
+    if (opts.inputPath.empty() || opts.inputSize.width == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::ifstream in(opts.inputPath, std::ios::binary);
+    if (!in) {
+        fprintf(stderr, "Cannot open %s\n", opts.inputPath.c_str());
+        return 1;
+    }
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)),
+                              std::istreambuf_iterator<char>());
+    auto frames = splitMjpegFrames(data);
+    if (frames.empty()) {
+        fprintf(stderr, "No MJPEG frames found in %s\n", opts.inputPath.c_str());
+        return 1;
+    }
+
+    // One buffer per output stream, reused by every request
+    const uint64_t usage = static_cast<uint64_t>(BufferUsage::CPU_READ_OFTEN) |
+                           static_cast<uint64_t>(BufferUsage::CPU_WRITE_OFTEN);
+    const ssize_t jpegBufferSize =
+            opts.jpegSize.width * opts.jpegSize.height * 3 / 2 + 256 * 1024 + sizeof(CameraBlob);
+    auto session = std::make_shared<ReplaySession>(jpegBufferSize);
+    std::vector<Stream> streams;
+    std::vector<HalStreamBuffer> halBufs;
+    std::vector<buffer_handle_t> handles;
+    auto addStream = [&](const Size& sz, PixelFormat format) {
+        Stream stream;
+        stream.id = static_cast<int32_t>(streams.size());
+        stream.width = sz.width;
+        stream.height = sz.height;
+        stream.format = format;
+        stream.usage = static_cast<BufferUsage>(usage);
+        streams.push_back(stream);
+
+        // BLOB buffers hold the largest JPEG
+        buffer_handle_t handle = session->mBufferMapper.allocate(sz, format, jpegBufferSize);
+        if (handle == nullptr) {
+            fprintf(stderr, "Cannot allocate %dx%d output buffer\n", sz.width, sz.height);
+            return false;
+        }
+        handles.push_back(handle);
+        halBufs.push_back({.streamId = stream.id,
+                           .bufferId = stream.id + 1,
+                           .width = sz.width,
+                           .height = sz.height,
+                           .format = format,
+                           .usage = stream.usage,
+                           .bufPtr = nullptr,
+                           .acquireFence = -1,
+                           .fenceTimeout = false});
+        return true;
+    };
+    for (const auto& sz : opts.outputSizes) {
+        if (!addStream(sz, PixelFormat::YCBCR_420_888)) {
+            return 1;
+        }
+    }
+    if (opts.jpegSize.width > 0 && !addStream(opts.jpegSize, PixelFormat::BLOB)) {
+        return 1;
+    }
+    for (size_t i = 0; i < halBufs.size(); i++) {
+        halBufs[i].bufPtr = &handles[i];
+    }
+
+    auto stats = std::make_shared<FrameTimingStats>();
+    // The session crops all the outputs one way: rows, unless an output is narrower than
+    // the input
+    CroppingType croppingType = VERTICAL;
+    for (const auto& sz : opts.outputSizes) {
+        if (ASPECT_RATIO(sz) < ASPECT_RATIO(opts.inputSize)) {
+            croppingType = HORIZONTAL;
+        }
+    }
+    // No BufferRequestThread: the output buffers come with the requests
+    auto outputThread = std::make_shared<ExternalCameraDeviceSession::OutputThread>(
+            session, croppingType, CameraMetadata(), nullptr, opts.numThreads);
+    outputThread->setFrameTimingStats(stats);
+    outputThread->setExifMakeModel("replay", "replay");
+    if (outputThread->allocateIntermediateBuffers(opts.inputSize, kThumbSize, streams,
+                                                  jpegBufferSize) != Status::OK) {
+        fprintf(stderr, "Cannot allocate the intermediate buffers for %dx%d input\n",
+                opts.inputSize.width, opts.inputSize.height);
+        return 1;
+    }
+
+    // Each request is processed by a threadLoop() iteration on this thread, so frames
+    // are timed back to back without V4L2 or the framework pacing them
+    const CameraMetadata settings = makeRequestSettings();
+    int32_t frameNumber = 0;
+    for (uint32_t pass = 0; pass < opts.repeat; pass++) {
+        for (const auto& [offset, size] : frames) {
+            auto req = std::make_shared<HalRequest>();
+            req->frameNumber = frameNumber++;
+            req->setting = settings;
+            req->frameIn = std::make_shared<ReplayFrame>(opts.inputSize, data.data() + offset, size);
+            req->shutterTs = systemTime(SYSTEM_TIME_MONOTONIC);
+            req->buffers = halBufs;
+            outputThread->submitRequest(req);
+            outputThread->threadLoop();
+        }
+    }
+
+    printf("Replayed %zu frames x %u passes from %s (%dx%d) with %u processing threads: "
+           "%" PRIu64 " completed, %" PRIu64 " failed to decode, %" PRIu64
+           " failed to scale, convert or encode\n",
+           frames.size(), opts.repeat, opts.inputPath.c_str(), opts.inputSize.width,
+           opts.inputSize.height, opts.numThreads, session->mNumResults.load(),
+           session->mNumRequestErrors.load(), session->mNumDeviceErrors.load());
+    fflush(stdout);
+    stats->dump(STDOUT_FILENO);
+    return 0;
+}
@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "benchmark/benchmark.h"
+
+#include <ParallelFrameProcessor.h>
+
+#include <jpeglib.h>
+#include <linux/videodev2.h>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+using ::android::hardware::camera::device::implementation::ParallelFrameProcessor;
+using ::android::hardware::camera::device::implementation::YCbCrLayout;
+using ::benchmark::Counter;
+using ::benchmark::kMillisecond;
+using ::benchmark::State;
+using ::benchmark::internal::Benchmark;
+
+namespace {
+
+// Resolutions commonly advertised by UVC webcams
+const std::vector<std::pair<int32_t, int32_t>> kResolutions = {
+        {640, 480}, {1280, 720}, {1920, 1080}, {3840, 2160}};
+const std::vector<int32_t> kThreadCounts = {1, 2, 4};
+
+// Contiguous I420 image
+struct I420Image {
+    I420Image(int32_t w, int32_t h)
+        : width(w), height(h), data(w * h + 2 * ((w + 1) / 2) * ((h + 1) / 2)) {
+        layout.y = data.data();
+        layout.cb = data.data() + w * h;
+        layout.cr = data.data() + w * h + ((w + 1) / 2) * ((h + 1) / 2);
+        layout.yStride = w;
+        layout.cStride = (w + 1) / 2;
+        layout.chromaStep = 1;
+    }
+
+    const int32_t width;
+    const int32_t height;
+    std::vector<uint8_t> data;
+    YCbCrLayout layout;
+};
+
+// Fills the image with gradients so the encoder produces realistic entropy-coded sizes
+void fillPattern(I420Image* image) {
+    auto* y = static_cast<uint8_t*>(image->layout.y);
+    auto* cb = static_cast<uint8_t*>(image->layout.cb);
+    auto* cr = static_cast<uint8_t*>(image->layout.cr);
+    for (int32_t row = 0; row < image->height; row++) {
+        for (int32_t col = 0; col < image->width; col++) {
+            y[row * image->layout.yStride + col] = static_cast<uint8_t>((row * 3 + col * 7) ^ col);
+        }
+    }
+    for (int32_t row = 0; row < (image->height + 1) / 2; row++) {
+        for (int32_t col = 0; col < (image->width + 1) / 2; col++) {
+            cb[row * image->layout.cStride + col] = static_cast<uint8_t>(row + col);
+            cr[row * image->layout.cStride + col] = static_cast<uint8_t>(row * 2 - col);
+        }
+    }
+}
+
+// Encodes a 4:2:0 MJPEG frame, optionally with one restart marker per MCU row as
+// emitted by most UVC cameras.
+std::vector<uint8_t> encodeMjpeg(const I420Image& image, bool restartMarkers) {
+    jpeg_compress_struct cinfo = {};
+    jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+
+    unsigned char* outBuffer = nullptr;
+    unsigned long outSize = 0;
+    jpeg_mem_dest(&cinfo, &outBuffer, &outSize);
+
+    cinfo.image_width = image.width;
+    cinfo.image_height = image.height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_YCbCr;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 90, TRUE);
+    jpeg_set_colorspace(&cinfo, JCS_YCbCr);
+    cinfo.raw_data_in = TRUE;
+    cinfo.comp_info[0].h_samp_factor = 2;
+    cinfo.comp_info[0].v_samp_factor = 2;
+    cinfo.comp_info[1].h_samp_factor = 1;
+    cinfo.comp_info[1].v_samp_factor = 1;
+    cinfo.comp_info[2].h_samp_factor = 1;
+    cinfo.comp_info[2].v_samp_factor = 1;
+    if (restartMarkers) {
+        cinfo.restart_in_rows = 1;
+    }
+
+    jpeg_start_compress(&cinfo, TRUE);
+
+    const int32_t mcuV = DCTSIZE * 2;
+    std::vector<JSAMPROW> yLines(mcuV);
+    std::vector<JSAMPROW> cbLines(mcuV / 2);
+    std::vector<JSAMPROW> crLines(mcuV / 2);
+    JSAMPARRAY planes[3] = {yLines.data(), cbLines.data(), crLines.data()};
+    auto* y = static_cast<uint8_t*>(image.layout.y);
+    auto* cb = static_cast<uint8_t*>(image.layout.cb);
+    auto* cr = static_cast<uint8_t*>(image.layout.cr);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        for (int32_t i = 0; i < mcuV; i++) {
+            int32_t row = std::min<int32_t>(cinfo.next_scanline + i, image.height - 1);
+            yLines[i] = y + row * image.layout.yStride;
+            if (i < mcuV / 2) {
+                int32_t cRow = std::min<int32_t>(cinfo.next_scanline / 2 + i,
+                                                 (image.height - 1) / 2);
+                cbLines[i] = cb + cRow * image.layout.cStride;
+                crLines[i] = cr + cRow * image.layout.cStride;
+            }
+        }
+        jpeg_write_raw_data(&cinfo, planes, mcuV);
+    }
+
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    std::vector<uint8_t> jpeg(outBuffer, outBuffer + outSize);
+    free(outBuffer);
+    return jpeg;
+}
+
+void resolutionArgs(Benchmark* b) {
+    b->Unit(kMillisecond);
+    b->ArgNames({"width", "height", "threads"});
+    for (const auto& [width, height] : kResolutions) {
+        for (int32_t threads : kThreadCounts) {
+            b->Args({width, height, threads});
+        }
+    }
+}
+
+void setFrameCounters(State& state) {
+    state.counters["ms/frame"] =
+            Counter(state.iterations() * 1e-3, Counter::kIsRate | Counter::kInvert);
+}
+
+void runMjpegDecode(State& state, bool restartMarkers) {
+    int32_t width = state.range(0);
+    int32_t height = state.range(1);
+    ParallelFrameProcessor processor(state.range(2));
+
+    I420Image source(width, height);
+    fillPattern(&source);
+    std::vector<uint8_t> jpeg = encodeMjpeg(source, restartMarkers);
+    I420Image decoded(width, height);
+
+    for (auto _ : state) {
+        if (processor.decodeMjpeg(jpeg.data(), jpeg.size(), width, height, decoded.layout) != 0) {
+            state.SkipWithError("MJPEG decode failed");
+            break;
+        }
+    }
+    setFrameCounters(state);
+}
+
+}  // namespace
+
+static void BM_MjpegDecode(State& state) {
+    runMjpegDecode(state, /*restartMarkers*/ false);
+}
+BENCHMARK(BM_MjpegDecode)->Apply(resolutionArgs);
+
+static void BM_MjpegDecodeRestartMarkers(State& state) {
+    runMjpegDecode(state, /*restartMarkers*/ true);
+}
+BENCHMARK(BM_MjpegDecodeRestartMarkers)->Apply(resolutionArgs);
+
+// Downscale by 2/3 in each dimension, e.g. 1920x1080 -> 1280x720
+static void BM_Scale(State& state) {
+    int32_t width = state.range(0);
+    int32_t height = state.range(1);
+    ParallelFrameProcessor processor(state.range(2));
+
+    I420Image source(width, height);
+    fillPattern(&source);
+    I420Image scaled((width * 2 / 3) & ~1, (height * 2 / 3) & ~1);
+
+    for (auto _ : state) {
+        if (processor.scale(source.layout, width, height, scaled.layout, scaled.width,
+                            scaled.height) != 0) {
+            state.SkipWithError("scale failed");
+            break;
+        }
+    }
+    setFrameCounters(state);
+}
+BENCHMARK(BM_Scale)->Apply(resolutionArgs);
+
+static void BM_ConvertToNV21(State& state) {
+    int32_t width = state.range(0);
+    int32_t height = state.range(1);
+    ParallelFrameProcessor processor(state.range(2));
+
+    I420Image source(width, height);
+    fillPattern(&source);
+    // NV21: full size Y plane followed by interleaved VU
+    std::vector<uint8_t> nv21(width * height * 3 / 2);
+    YCbCrLayout out = {.y = nv21.data(),
+                       .cb = nv21.data() + width * height + 1,
+                       .cr = nv21.data() + width * height,
+                       .yStride = static_cast<uint32_t>(width),
+                       .cStride = static_cast<uint32_t>(width),
+                       .chromaStep = 2};
+
+    for (auto _ : state) {
+        if (processor.formatConvert(source.layout, out, width, height, V4L2_PIX_FMT_NV21) != 0) {
+            state.SkipWithError("format conversion failed");
+            break;
+        }
+    }
+    setFrameCounters(state);
+}
+BENCHMARK(BM_ConvertToNV21)->Apply(resolutionArgs);
+
+BENCHMARK_MAIN();
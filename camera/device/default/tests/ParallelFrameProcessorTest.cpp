@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <linux/videodev2.h>
+#include <stdio.h>
+
+#include <cstdint>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include <jpeglib.h>
+
+#include "ParallelFrameProcessor.h"
+
+using ::android::hardware::camera::device::implementation::ParallelFrameProcessor;
+using ::android::hardware::camera::device::implementation::YCbCrLayout;
+
+namespace {
+
+// Thread budgets compared against a single thread, chosen to give uneven band splits
+const uint32_t kThreadCounts[] = {2, 3, 4, 7};
+
+struct Size {
+    int32_t width;
+    int32_t height;
+};
+
+// A tightly packed I420 image
+struct I420Image {
+    I420Image(int32_t width, int32_t height)
+        : width(width),
+          height(height),
+          chromaWidth((width + 1) / 2),
+          chromaHeight((height + 1) / 2),
+          data(width * height + 2 * chromaWidth * chromaHeight, 0x5A) {}
+
+    YCbCrLayout layout() {
+        uint8_t* y = data.data();
+        uint8_t* cb = y + width * height;
+        uint8_t* cr = cb + chromaWidth * chromaHeight;
+        return {.y = y,
+                .cb = cb,
+                .cr = cr,
+                .yStride = static_cast<uint32_t>(width),
+                .cStride = static_cast<uint32_t>(chromaWidth),
+                .chromaStep = 1};
+    }
+
+    void fillRandom(uint32_t seed) {
+        std::mt19937 rng(seed);
+        for (auto& byte : data) {
+            byte = static_cast<uint8_t>(rng());
+        }
+    }
+
+    const int32_t width;
+    const int32_t height;
+    const int32_t chromaWidth;
+    const int32_t chromaHeight;
+    std::vector<uint8_t> data;
+};
+
+// Encodes a noisy gradient as a 4:2:0 baseline JPEG with the given restart interval
+std::vector<uint8_t> encodeMjpeg(int32_t width, int32_t height, uint32_t restartInterval,
+                                 uint32_t restartRows) {
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+
+    unsigned char* outBuffer = nullptr;
+    unsigned long outSize = 0;
+    jpeg_mem_dest(&cinfo, &outBuffer, &outSize);
+
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 90, TRUE);
+    cinfo.restart_interval = restartInterval;
+    cinfo.restart_in_rows = restartRows;
+    jpeg_start_compress(&cinfo, TRUE);
+
+    std::mt19937 rng(width * 31 + height);
+    std::vector<uint8_t> row(width * 3);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        uint32_t y = cinfo.next_scanline;
+        for (int32_t x = 0; x < width; x++) {
+            row[3 * x] = static_cast<uint8_t>(x * 255 / width + rng() % 16);
+            row[3 * x + 1] = static_cast<uint8_t>(y * 255 / height + rng() % 16);
+            row[3 * x + 2] = static_cast<uint8_t>((x + y) + rng() % 16);
+        }
+        JSAMPROW rowPtr = row.data();
+        jpeg_write_scanlines(&cinfo, &rowPtr, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    std::vector<uint8_t> jpeg(outBuffer, outBuffer + outSize);
+    free(outBuffer);
+    return jpeg;
+}
+
+class ParallelFrameProcessorTest : public ::testing::TestWithParam<uint32_t> {};
+
+TEST_P(ParallelFrameProcessorTest, DecodeMatchesSingleThread) {
+    // Odd sizes leave a partial MCU row and column at the end of the frame
+    const Size sizes[] = {{640, 480}, {321, 243}, {97, 35}, {1280, 721}};
+    // Restart markers after every MCU, every MCU row and every 3 MCU rows
+    const std::tuple<uint32_t, uint32_t> restarts[] = {{1, 0}, {0, 1}, {0, 3}};
+    ParallelFrameProcessor single(1);
+    ParallelFrameProcessor banded(GetParam());
+    for (const Size& size : sizes) {
+        for (const auto& [restartInterval, restartRows] : restarts) {
+            SCOPED_TRACE(testing::Message() << size.width << "x" << size.height << " restart "
+                                            << restartInterval << "/" << restartRows);
+            std::vector<uint8_t> jpeg =
+                    encodeMjpeg(size.width, size.height, restartInterval, restartRows);
+            I420Image expected(size.width, size.height);
+            I420Image actual(size.width, size.height);
+            ASSERT_EQ(0, single.decodeMjpeg(jpeg.data(), jpeg.size(), size.width, size.height,
+                                            expected.layout()));
+            ASSERT_EQ(0, banded.decodeMjpeg(jpeg.data(), jpeg.size(), size.width, size.height,
+                                            actual.layout()));
+            EXPECT_EQ(expected.data, actual.data);
+        }
+    }
+}
+
+TEST_P(ParallelFrameProcessorTest, ScaleMatchesSingleThread) {
+    // Scales that are split into bands and scales that must fall back to a single call
+    const std::tuple<Size, Size> scales[] = {
+            {{640, 480}, {320, 240}},     // 2:1
+            {{1920, 1080}, {1280, 720}},  // 3:2
+            {{640, 480}, {480, 360}},     // 4:3
+            {{1920, 1080}, {176, 144}},   // 7.5:1
+            {{640, 480}, {640, 360}},     // vertical only
+            {{640, 486}, {320, 270}},     // step not exact in 16.16 fixed point
+            {{640, 480}, {352, 270}},     // step not exact in 16.16 fixed point
+            {{320, 240}, {640, 480}},     // upscale
+            {{320, 240}, {320, 480}},     // vertical only upscale
+            {{321, 243}, {161, 121}},     // odd sizes
+            {{321, 243}, {107, 81}},      // odd sizes, 3:1
+            {{640, 482}, {352, 289}},     // odd output height
+    };
+    ParallelFrameProcessor single(1);
+    ParallelFrameProcessor banded(GetParam());
+    for (const auto& [in, out] : scales) {
+        SCOPED_TRACE(testing::Message() << in.width << "x" << in.height << " to " << out.width
+                                        << "x" << out.height);
+        I420Image input(in.width, in.height);
+        input.fillRandom(in.width + in.height);
+        I420Image expected(out.width, out.height);
+        I420Image actual(out.width, out.height);
+        ASSERT_EQ(0, single.scale(input.layout(), in.width, in.height, expected.layout(),
+                                  out.width, out.height));
+        ASSERT_EQ(0, banded.scale(input.layout(), in.width, in.height, actual.layout(),
+                                  out.width, out.height));
+        EXPECT_EQ(expected.data, actual.data);
+    }
+}
+
+TEST_P(ParallelFrameProcessorTest, FormatConvertMatchesSingleThread) {
+    const Size sizes[] = {{640, 480}, {321, 243}, {97, 35}, {1280, 721}};
+    const uint32_t formats[] = {V4L2_PIX_FMT_NV21, V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_YVU420,
+                                V4L2_PIX_FMT_YUV420};
+    ParallelFrameProcessor single(1);
+    ParallelFrameProcessor banded(GetParam());
+    for (const Size& size : sizes) {
+        I420Image input(size.width, size.height);
+        input.fillRandom(size.width * size.height);
+        for (uint32_t format : formats) {
+            SCOPED_TRACE(testing::Message() << size.width << "x" << size.height << " format 0x"
+                                            << std::hex << format);
+            // Semi-planar outputs interleave the chroma into one plane
+            bool semiPlanar = format == V4L2_PIX_FMT_NV21 || format == V4L2_PIX_FMT_NV12;
+            I420Image expected(size.width, size.height);
+            I420Image actual(size.width, size.height);
+            auto outLayout = [&](I420Image& image) {
+                YCbCrLayout layout = image.layout();
+                if (semiPlanar) {
+                    uint8_t* uv = static_cast<uint8_t*>(layout.cb);
+                    layout.cStride = 2 * image.chromaWidth;
+                    layout.chromaStep = 2;
+                    layout.cb = format == V4L2_PIX_FMT_NV12 ? uv : uv + 1;
+                    layout.cr = format == V4L2_PIX_FMT_NV12 ? uv + 1 : uv;
+                }
+                return layout;
+            };
+            ASSERT_EQ(0, single.formatConvert(input.layout(), outLayout(expected), size.width,
+                                              size.height, format));
+            ASSERT_EQ(0, banded.formatConvert(input.layout(), outLayout(actual), size.width,
+                                              size.height, format));
+            EXPECT_EQ(expected.data, actual.data);
+        }
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(Threads, ParallelFrameProcessorTest, ::testing::ValuesIn(kThreadCounts),
+                         [](const testing::TestParamInfo<uint32_t>& info) {
+                             return std::to_string(info.param) + "Threads";
+                         });
+
+}  // namespace
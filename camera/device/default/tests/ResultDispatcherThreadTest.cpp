@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <aidl/android/hardware/camera/device/ShutterMsg.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "ExternalCameraDeviceSession.h"
+
+using ::aidl::android::hardware::camera::device::CaptureResult;
+using ::aidl::android::hardware::camera::device::NotifyMsg;
+using ::aidl::android::hardware::camera::device::ShutterMsg;
+using ::android::hardware::camera::device::implementation::ExternalCameraDeviceSession;
+using ::android::hardware::camera::device::implementation::ResultDispatcherInterface;
+
+using ResultDispatcherThread = ExternalCameraDeviceSession::ResultDispatcherThread;
+
+namespace {
+
+// Long enough that a batch is only sent when full or flushed
+const std::chrono::microseconds kLongDelay = std::chrono::seconds(10);
+const std::chrono::seconds kWaitTimeout = std::chrono::seconds(5);
+
+// What the dispatcher sent, in order
+struct Event {
+    bool isResult;
+    int32_t frameNumber;
+
+    bool operator==(const Event& other) const {
+        return isResult == other.isResult && frameNumber == other.frameNumber;
+    }
+};
+
+std::ostream& operator<<(std::ostream& os, const Event& event) {
+    return os << (event.isResult ? "result " : "shutter ") << event.frameNumber;
+}
+
+class FakeParent : public ResultDispatcherInterface {
+  public:
+    void dispatchNotify(const std::vector<NotifyMsg>& msgs) override {
+        std::lock_guard<std::mutex> lk(mLock);
+        for (const auto& msg : msgs) {
+            mEvents.push_back({false, msg.get<NotifyMsg::Tag::shutter>().frameNumber});
+        }
+    }
+
+    void dispatchCaptureResults(std::vector<CaptureResult>& results) override {
+        std::lock_guard<std::mutex> lk(mLock);
+        for (const auto& result : results) {
+            mEvents.push_back({true, result.frameNumber});
+        }
+        mNumResults += results.size();
+        mBatchSizes.push_back(results.size());
+        mResultsCond.notify_all();
+    }
+
+    bool waitForResults(size_t count) {
+        std::unique_lock<std::mutex> lk(mLock);
+        return mResultsCond.wait_for(lk, kWaitTimeout, [&] { return mNumResults >= count; });
+    }
+
+    std::vector<Event> getEvents() {
+        std::lock_guard<std::mutex> lk(mLock);
+        return mEvents;
+    }
+
+    std::vector<size_t> getBatchSizes() {
+        std::lock_guard<std::mutex> lk(mLock);
+        return mBatchSizes;
+    }
+
+  private:
+    std::mutex mLock;
+    std::condition_variable mResultsCond;
+    std::vector<Event> mEvents;
+    std::vector<size_t> mBatchSizes;
+    size_t mNumResults = 0;
+};
+
+// Queues the shutters and then the results of frames [first, first + count)
+void queueFrames(ResultDispatcherThread* dispatcher, int32_t first, int32_t count) {
+    std::vector<CaptureResult> results(count);
+    for (int32_t i = 0; i < count; i++) {
+        NotifyMsg msg;
+        msg.set<NotifyMsg::Tag::shutter>(ShutterMsg{.frameNumber = first + i});
+        dispatcher->queueNotify(msg);
+        results[i].frameNumber = first + i;
+    }
+    // In one call, so the dispatcher never sees part of them
+    dispatcher->queueResults(results);
+    EXPECT_TRUE(results.empty());
+}
+
+std::vector<Event> expectedEvents(int32_t first, int32_t count) {
+    std::vector<Event> events;
+    for (int32_t i = 0; i < count; i++) {
+        events.push_back({false, first + i});
+    }
+    for (int32_t i = 0; i < count; i++) {
+        events.push_back({true, first + i});
+    }
+    return events;
+}
+
+TEST(ResultDispatcherThreadTest, SendsFullBatchesInOrder) {
+    auto parent = std::make_shared<FakeParent>();
+    auto dispatcher =
+            std::make_shared<ResultDispatcherThread>(parent, /*maxBatchSize*/ 4, kLongDelay);
+    dispatcher->run();
+
+    queueFrames(dispatcher.get(), 0, 4);
+    ASSERT_TRUE(parent->waitForResults(4));
+    queueFrames(dispatcher.get(), 4, 4);
+    ASSERT_TRUE(parent->waitForResults(8));
+    dispatcher->requestExitAndWait();
+
+    std::vector<Event> expected = expectedEvents(0, 4);
+    std::vector<Event> second = expectedEvents(4, 4);
+    expected.insert(expected.end(), second.begin(), second.end());
+    EXPECT_EQ(expected, parent->getEvents());
+    EXPECT_EQ(std::vector<size_t>({4, 4}), parent->getBatchSizes());
+}
+
+TEST(ResultDispatcherThreadTest, SendsPartialBatchAfterMaxDelay) {
+    auto parent = std::make_shared<FakeParent>();
+    auto dispatcher = std::make_shared<ResultDispatcherThread>(
+            parent, /*maxBatchSize*/ 8, std::chrono::milliseconds(20));
+    dispatcher->run();
+
+    queueFrames(dispatcher.get(), 0, 3);
+    ASSERT_TRUE(parent->waitForResults(3));
+    dispatcher->requestExitAndWait();
+
+    EXPECT_EQ(expectedEvents(0, 3), parent->getEvents());
+    EXPECT_EQ(std::vector<size_t>({3}), parent->getBatchSizes());
+}
+
+// As the session does on close: flush, then stop the thread
+TEST(ResultDispatcherThreadTest, FlushSendsPendingBatchOnClose) {
+    auto parent = std::make_shared<FakeParent>();
+    auto dispatcher =
+            std::make_shared<ResultDispatcherThread>(parent, /*maxBatchSize*/ 8, kLongDelay);
+    dispatcher->run();
+
+    queueFrames(dispatcher.get(), 0, 3);
+    EXPECT_TRUE(parent->getEvents().empty());
+    // Sent from this thread, before flush returns
+    dispatcher->flush();
+    EXPECT_EQ(expectedEvents(0, 3), parent->getEvents());
+    dispatcher->requestExitAndWait();
+
+    EXPECT_EQ(expectedEvents(0, 3), parent->getEvents());
+    EXPECT_EQ(std::vector<size_t>({3}), parent->getBatchSizes());
+}
+
+TEST(ResultDispatcherThreadTest, FlushWithoutPendingSendsNothing) {
+    auto parent = std::make_shared<FakeParent>();
+    auto dispatcher =
+            std::make_shared<ResultDispatcherThread>(parent, /*maxBatchSize*/ 8, kLongDelay);
+    dispatcher->flush();
+    EXPECT_TRUE(parent->getBatchSizes().empty());
+}
+
+}  // namespace
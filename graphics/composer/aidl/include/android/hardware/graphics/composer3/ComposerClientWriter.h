@@ -19,6 +19,7 @@
 #include <algorithm>
 #include <limits>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 #include <inttypes.h>
@@ -87,8 +88,21 @@ class ComposerClientWriter final {
     void setClientTarget(int64_t display, uint32_t slot, const native_handle_t* target,
                          int acquireFence, Dataspace dataspace, const std::vector<Rect>& damage,
                          float hdrSdrRatio) {
+        setClientTarget(display, slot, target, acquireFence, dataspace, damage, hdrSdrRatio,
+                        std::nullopt);
+    }
+
+    // The overloads taking a bufferId remember which buffer each slot holds, and only send the
+    // slot of a buffer set to the slot it is already cached in, without dup'ing and marshalling
+    // its handle again. bufferId must never be reused for another buffer, e.g. the id of a
+    // GraphicBuffer. Callers must call invalidateBufferSlots whenever the composer may have dropped
+    // its cache, e.g. after a command of theirs failed.
+    void setClientTarget(int64_t display, uint32_t slot, const native_handle_t* target,
+                         int acquireFence, Dataspace dataspace, const std::vector<Rect>& damage,
+                         float hdrSdrRatio, std::optional<uint64_t> bufferId) {
         ClientTarget clientTargetCommand;
-        clientTargetCommand.buffer = getBufferCommand(slot, target, acquireFence);
+        clientTargetCommand.buffer =
+                getBufferCommand(slot, target, acquireFence, bufferId, &mClientTargetSlots);
         clientTargetCommand.dataspace = dataspace;
         clientTargetCommand.damage.assign(damage.begin(), damage.end());
         clientTargetCommand.hdrSdrRatio = hdrSdrRatio;
@@ -96,18 +110,28 @@ class ComposerClientWriter final {
     }
 
     void setOutputBuffer(int64_t display, uint32_t slot, const native_handle_t* buffer,
-                         int releaseFence) {
+                         int releaseFence, std::optional<uint64_t> bufferId = std::nullopt) {
         getDisplayCommand(display).virtualDisplayOutputBuffer.emplace(
-                getBufferCommand(slot, buffer, releaseFence));
+                getBufferCommand(slot, buffer, releaseFence, bufferId, &mOutputBufferSlots));
     }
 
     void setLayerLifecycleBatchCommandType(int64_t display, int64_t layer,
                                            LayerLifecycleBatchCommandType cmd) {
         getLayerCommand(display, layer).layerLifecycleBatchCommandType = cmd;
+        if (cmd != LayerLifecycleBatchCommandType::MODIFY) {
+            // A created layer starts with empty slots, which a destroyed layer's id may be reused
+            // for.
+            mLayerSlots.erase(layer);
+        }
     }
 
     void setNewBufferSlotCount(int64_t display, int64_t layer, int32_t newBufferSlotToCount) {
         getLayerCommand(display, layer).newBufferSlotCount = newBufferSlotToCount;
+        if (auto it = mLayerSlots.find(layer); it != mLayerSlots.end()) {
+            std::erase_if(it->second, [newBufferSlotToCount](const auto& entry) {
+                return entry.first >= static_cast<uint32_t>(newBufferSlotToCount);
+            });
+        }
     }
 
     void validateDisplay(int64_t display,
@@ -142,14 +166,18 @@ class ComposerClientWriter final {
     }
 
     void setLayerBuffer(int64_t display, int64_t layer, uint32_t slot,
-                        const native_handle_t* buffer, int acquireFence) {
-        getLayerCommand(display, layer).buffer = getBufferCommand(slot, buffer, acquireFence);
+                        const native_handle_t* buffer, int acquireFence,
+                        std::optional<uint64_t> bufferId = std::nullopt) {
+        getLayerCommand(display, layer).buffer =
+                getBufferCommand(slot, buffer, acquireFence, bufferId, &mLayerSlots[layer]);
     }
 
     void setLayerBufferWithNewCommand(int64_t display, int64_t layer, uint32_t slot,
-                                      const native_handle_t* buffer, int acquireFence) {
+                                      const native_handle_t* buffer, int acquireFence,
+                                      std::optional<uint64_t> bufferId = std::nullopt) {
         flushLayerCommand();
-        getLayerCommand(display, layer).buffer = getBufferCommand(slot, buffer, acquireFence);
+        getLayerCommand(display, layer).buffer =
+                getBufferCommand(slot, buffer, acquireFence, bufferId, &mLayerSlots[layer]);
         flushLayerCommand();
     }
 
@@ -157,6 +185,11 @@ class ComposerClientWriter final {
                                     const std::vector<uint32_t>& slotsToClear) {
         getLayerCommand(display, layer)
                 .bufferSlotsToClear.emplace(slotsToClear.begin(), slotsToClear.end());
+        if (auto it = mLayerSlots.find(layer); it != mLayerSlots.end()) {
+            for (uint32_t slot : slotsToClear) {
+                it->second.erase(slot);
+            }
+        }
     }
 
     void setLayerSurfaceDamage(int64_t display, int64_t layer, const std::vector<Rect>& damage) {
@@ -263,20 +296,89 @@ class ComposerClientWriter final {
         return moved;
     }
 
+    // Returns the pending commands without taking them, so that they can be executed in place.
+    // They stay pending until clearPendingCommands, which keeps their storage for the next frame.
+    const std::vector<DisplayCommand>& getPendingCommands() {
+        flushLayerCommand();
+        flushDisplayCommand();
+        return mCommands;
+    }
+
+    // Clears the pending commands and keeps them to build the next commands in, with their layers
+    // vectors. The fields of the commands are reset, as a field that is set is one that is sent.
+    void clearPendingCommands() {
+        for (DisplayCommand& command : mCommands) {
+            std::vector<LayerCommand> layers = std::move(command.layers);
+            layers.clear();
+            command = DisplayCommand();
+            command.layers = std::move(layers);
+        }
+        mSpareCommands.insert(mSpareCommands.end(), std::make_move_iterator(mCommands.begin()),
+                              std::make_move_iterator(mCommands.end()));
+        mCommands.clear();
+    }
+
+    // Moves the pending commands to the end of commands, so that the commands of the writers of
+    // several displays can be executed in a single executeCommands call. commands may be reused
+    // across frames by clearing it, which keeps its storage.
+    void appendPendingCommands(std::vector<DisplayCommand>* commands) {
+        flushLayerCommand();
+        flushDisplayCommand();
+        commands->insert(commands->end(), std::make_move_iterator(mCommands.begin()),
+                         std::make_move_iterator(mCommands.end()));
+        mCommands.clear();
+    }
+
+    // Forgets the buffers cached in all slots, so that the handles of the next buffers set are
+    // sent again.
+    void invalidateBufferSlots() {
+        mClientTargetSlots.clear();
+        mOutputBufferSlots.clear();
+        mLayerSlots.clear();
+    }
+
   private:
+    // The id of the buffer cached in each slot, for the slots that were set with one.
+    using BufferSlots = std::unordered_map<uint32_t, uint64_t>;
+
     std::optional<DisplayCommand> mDisplayCommand;
     std::optional<LayerCommand> mLayerCommand;
     std::vector<DisplayCommand> mCommands;
+    // Cleared commands whose layers vectors are reused by the next commands.
+    std::vector<DisplayCommand> mSpareCommands;
     const int64_t mDisplay;
-
-    Buffer getBufferCommand(uint32_t slot, const native_handle_t* bufferHandle, int fence) {
+    BufferSlots mClientTargetSlots;
+    BufferSlots mOutputBufferSlots;
+    std::unordered_map<int64_t, BufferSlots> mLayerSlots;
+    // The number of layers of the last display command, to size the layers of the next one.
+    size_t mLastLayerCount = 0;
+
+    Buffer getBufferCommand(uint32_t slot, const native_handle_t* bufferHandle, int fence,
+                            std::optional<uint64_t> bufferId, BufferSlots* slots) {
         Buffer bufferCommand;
         bufferCommand.slot = static_cast<int32_t>(slot);
-        if (bufferHandle) bufferCommand.handle.emplace(::android::dupToAidl(bufferHandle));
+        if (bufferHandle && !isCached(slots, slot, bufferId)) {
+            bufferCommand.handle.emplace(::android::dupToAidl(bufferHandle));
+        }
         if (fence > 0) bufferCommand.fence = ::ndk::ScopedFileDescriptor(fence);
         return bufferCommand;
     }
 
+    // Returns whether the buffer is cached in the slot, and caches it there if it is not. A buffer
+    // without an id replaces whatever the slot held with a buffer that is never matched.
+    bool isCached(BufferSlots* slots, uint32_t slot, std::optional<uint64_t> bufferId) {
+        if (!bufferId.has_value()) {
+            slots->erase(slot);
+            return false;
+        }
+        auto [it, inserted] = slots->try_emplace(slot, *bufferId);
+        if (!inserted && it->second == *bufferId) {
+            return true;
+        }
+        it->second = *bufferId;
+        return false;
+    }
+
     void flushLayerCommand() {
         if (mLayerCommand.has_value()) {
             mDisplayCommand->layers.emplace_back(std::move(*mLayerCommand));
@@ -286,6 +388,7 @@ class ComposerClientWriter final {
 
     void flushDisplayCommand() {
         if (mDisplayCommand.has_value()) {
+            mLastLayerCount = mDisplayCommand->layers.size();
             mCommands.emplace_back(std::move(*mDisplayCommand));
             mDisplayCommand.reset();
         }
@@ -296,7 +399,13 @@ class ComposerClientWriter final {
             LOG_ALWAYS_FATAL_IF(display != mDisplay);
             flushLayerCommand();
             flushDisplayCommand();
-            mDisplayCommand.emplace();
+            if (mSpareCommands.empty()) {
+                mDisplayCommand.emplace();
+                mDisplayCommand->layers.reserve(mLastLayerCount);
+            } else {
+                mDisplayCommand.emplace(std::move(mSpareCommands.back()));
+                mSpareCommands.pop_back();
+            }
             mDisplayCommand->display = display;
         }
         return *mDisplayCommand;
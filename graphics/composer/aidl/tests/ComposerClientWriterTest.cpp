@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <android/hardware/graphics/composer3/ComposerClientWriter.h>
+#include <cutils/native_handle.h>
+
+#include <memory>
+#include <vector>
+
+using aidl::android::hardware::graphics::composer3::Buffer;
+using aidl::android::hardware::graphics::composer3::ComposerClientWriter;
+using aidl::android::hardware::graphics::composer3::DisplayCommand;
+using aidl::android::hardware::graphics::composer3::LayerLifecycleBatchCommandType;
+
+namespace {
+
+constexpr int64_t kDisplay = 1;
+constexpr int64_t kLayer = 2;
+
+struct NativeHandleDeleter {
+    void operator()(native_handle_t* handle) const { native_handle_delete(handle); }
+};
+using UniqueNativeHandle = std::unique_ptr<native_handle_t, NativeHandleDeleter>;
+
+UniqueNativeHandle makeHandle(int value) {
+    UniqueNativeHandle handle(native_handle_create(0 /* numFds */, 1 /* numInts */));
+    handle->data[0] = value;
+    return handle;
+}
+
+class ComposerClientWriterTest : public ::testing::Test {
+  protected:
+    // Whether the handle of the buffer set to the layer was sent along with its slot.
+    bool sendsLayerBuffer(uint32_t slot, const native_handle_t* buffer,
+                          std::optional<uint64_t> bufferId) {
+        mWriter.setLayerBuffer(kDisplay, kLayer, slot, buffer, -1 /* acquireFence */, bufferId);
+        return takeCommand().layers.back().buffer->handle.has_value();
+    }
+
+    DisplayCommand takeCommand() {
+        std::vector<DisplayCommand> commands = mWriter.takePendingCommands();
+        EXPECT_EQ(commands.size(), 1u);
+        return std::move(commands.back());
+    }
+
+    ComposerClientWriter mWriter{kDisplay};
+    UniqueNativeHandle mBuffer = makeHandle(1);
+};
+
+TEST_F(ComposerClientWriterTest, SendsHandlesOfBuffersWithoutId) {
+    EXPECT_TRUE(sendsLayerBuffer(0, mBuffer.get(), std::nullopt));
+    EXPECT_TRUE(sendsLayerBuffer(0, mBuffer.get(), std::nullopt));
+}
+
+TEST_F(ComposerClientWriterTest, SkipsHandleOfBufferCachedInSlot) {
+    EXPECT_TRUE(sendsLayerBuffer(0, mBuffer.get(), 10));
+    EXPECT_FALSE(sendsLayerBuffer(0, mBuffer.get(), 10));
+    // Each slot caches its own buffer.
+    EXPECT_TRUE(sendsLayerBuffer(1, mBuffer.get(), 10));
+    EXPECT_FALSE(sendsLayerBuffer(0, mBuffer.get(), 10));
+}
+
+TEST_F(ComposerClientWriterTest, SendsHandleOfReallocatedBuffer) {
+    EXPECT_TRUE(sendsLayerBuffer(0, mBuffer.get(), 10));
+    // A new buffer may be allocated at the address, and with the contents, of a freed one; only
+    // its id tells them apart.
+    EXPECT_TRUE(sendsLayerBuffer(0, mBuffer.get(), 11));
+    EXPECT_FALSE(sendsLayerBuffer(0, mBuffer.get(), 11));
+}
+
+TEST_F(ComposerClientWriterTest, SendsHandleAfterBufferWithoutId) {
+    EXPECT_TRUE(sendsLayerBuffer(0, mBuffer.get(), 10));
+    UniqueNativeHandle other = makeHandle(2);
+    EXPECT_TRUE(sendsLayerBuffer(0, other.get(), std::nullopt));
+    EXPECT_TRUE(sendsLayerBuffer(0, mBuffer.get(), 10));
+}
+
+TEST_F(ComposerClientWriterTest, ForgetsClearedSlots) {
+    EXPECT_TRUE(sendsLayerBuffer(0, mBuffer.get(), 10));
+    EXPECT_TRUE(sendsLayerBuffer(1, mBuffer.get(), 11));
+    mWriter.setLayerBufferSlotsToClear(kDisplay, kLayer, {0});
+    takeCommand();
+
+    EXPECT_TRUE(sendsLayerBuffer(0, mBuffer.get(), 10));
+    EXPECT_FALSE(sendsLayerBuffer(1, mBuffer.get(), 11));
+}
+
+TEST_F(ComposerClientWriterTest, ForgetsSlotsPastNewSlotCount) {
+    EXPECT_TRUE(sendsLayerBuffer(0, mBuffer.get(), 10));
+    EXPECT_TRUE(sendsLayerBuffer(2, mBuffer.get(), 12));
+    mWriter.setNewBufferSlotCount(kDisplay, kLayer, 2);
+    takeCommand();
+
+    EXPECT_FALSE(sendsLayerBuffer(0, mBuffer.get(), 10));
+    EXPECT_TRUE(sendsLayerBuffer(2, mBuffer.get(), 12));
+}
+
+TEST_F(ComposerClientWriterTest, ForgetsSlotsOfCreatedAndDestroyedLayers) {
+    EXPECT_TRUE(sendsLayerBuffer(0, mBuffer.get(), 10));
+    for (auto type : {LayerLifecycleBatchCommandType::CREATE,
+                      LayerLifecycleBatchCommandType::DESTROY}) {
+        mWriter.setLayerLifecycleBatchCommandType(kDisplay, kLayer, type);
+        takeCommand();
+        EXPECT_TRUE(sendsLayerBuffer(0, mBuffer.get(), 10));
+        EXPECT_FALSE(sendsLayerBuffer(0, mBuffer.get(), 10));
+    }
+
+    // Modifying the layer keeps its slots.
+    mWriter.setLayerLifecycleBatchCommandType(kDisplay, kLayer,
+                                              LayerLifecycleBatchCommandType::MODIFY);
+    takeCommand();
+    EXPECT_FALSE(sendsLayerBuffer(0, mBuffer.get(), 10));
+}
+
+TEST_F(ComposerClientWriterTest, TracksLayersSeparately) {
+    EXPECT_TRUE(sendsLayerBuffer(0, mBuffer.get(), 10));
+    mWriter.setLayerBuffer(kDisplay, kLayer + 1, 0, mBuffer.get(), -1 /* acquireFence */, 10);
+    EXPECT_TRUE(takeCommand().layers.back().buffer->handle.has_value());
+    EXPECT_FALSE(sendsLayerBuffer(0, mBuffer.get(), 10));
+}
+
+TEST_F(ComposerClientWriterTest, TracksClientTargetAndOutputBufferSlots) {
+    auto sendsClientTarget = [&] {
+        mWriter.setClientTarget(kDisplay, 0, mBuffer.get(), -1 /* acquireFence */, {}, {},
+                                1.0f /* hdrSdrRatio */, 10);
+        return takeCommand().clientTarget->buffer.handle.has_value();
+    };
+    auto sendsOutputBuffer = [&] {
+        mWriter.setOutputBuffer(kDisplay, 0, mBuffer.get(), -1 /* releaseFence */, 10);
+        return takeCommand().virtualDisplayOutputBuffer->handle.has_value();
+    };
+
+    EXPECT_TRUE(sendsClientTarget());
+    EXPECT_FALSE(sendsClientTarget());
+    // The output buffer and the layers do not share the slots of the client target.
+    EXPECT_TRUE(sendsOutputBuffer());
+    EXPECT_FALSE(sendsOutputBuffer());
+    EXPECT_TRUE(sendsLayerBuffer(0, mBuffer.get(), 10));
+}
+
+TEST_F(ComposerClientWriterTest, InvalidateBufferSlotsForgetsAllSlots) {
+    EXPECT_TRUE(sendsLayerBuffer(0, mBuffer.get(), 10));
+    mWriter.setClientTarget(kDisplay, 0, mBuffer.get(), -1 /* acquireFence */, {}, {},
+                            1.0f /* hdrSdrRatio */, 11);
+    takeCommand();
+
+    mWriter.invalidateBufferSlots();
+
+    EXPECT_TRUE(sendsLayerBuffer(0, mBuffer.get(), 10));
+    mWriter.setClientTarget(kDisplay, 0, mBuffer.get(), -1 /* acquireFence */, {}, {},
+                            1.0f /* hdrSdrRatio */, 11);
+    EXPECT_TRUE(takeCommand().clientTarget->buffer.handle.has_value());
+}
+
+}  // namespace
@@ -20,7 +20,9 @@
 #include <android/hardware/graphics/mapper/utils/IMapperProvider.h>
 #include <drm/drm_fourcc.h>
 #include <gralloctypes/Gralloc4.h>
+#include <algorithm>
 #include <span>
+#include <tuple>
 #include <vector>
 
 using namespace ::android;
@@ -294,6 +296,36 @@ TEST(Metadata, setGetSmpte2094_10) {
     EXPECT_EQ(simpleBuffer, read->value());
 }
 
+TEST(Metadata, fixedEncodedSizes) {
+    static_assert(StandardMetadata<StandardMetadataType::BUFFER_ID>::value::kEncodedSize ==
+                  8 + HeaderSize);
+    static_assert(StandardMetadata<StandardMetadataType::DATASPACE>::value::kEncodedSize ==
+                  4 + HeaderSize);
+    static_assert(StandardMetadata<StandardMetadataType::SMPTE2086>::value::kEncodedSize ==
+                  10 * sizeof(float) + HeaderSize);
+    static_assert(StandardMetadata<StandardMetadataType::CTA861_3>::value::kEncodedSize ==
+                  2 * sizeof(float) + HeaderSize);
+
+    using StrideValue = StandardMetadata<StandardMetadataType::STRIDE>::value;
+    EXPECT_EQ(StrideValue::kEncodedSize, StrideValue::encode(1920, nullptr, 0));
+}
+
+TEST(Metadata, encodeIntoSmallBuffer) {
+    using PlaneLayoutValue = StandardMetadata<StandardMetadataType::PLANE_LAYOUTS>::value;
+    const std::vector<PlaneLayout> layouts = fakePlaneLayouts();
+    const int expectedSize = PlaneLayoutValue::encode(layouts, nullptr, 0);
+    std::vector<uint8_t> expected(expectedSize);
+    ASSERT_EQ(expectedSize, PlaneLayoutValue::encode(layouts, expected.data(), expected.size()));
+
+    // The fields that fit are written, as MetadataWriter writes them, and nothing past them.
+    std::vector<uint8_t> buffer(expectedSize, 0);
+    const size_t smallSize = expectedSize / 2;
+    EXPECT_EQ(expectedSize, PlaneLayoutValue::encode(layouts, buffer.data(), smallSize));
+    EXPECT_TRUE(std::equal(buffer.begin(), buffer.begin() + HeaderSize, expected.begin()));
+    EXPECT_TRUE(std::all_of(buffer.begin() + smallSize, buffer.end(),
+                            [](uint8_t byte) { return byte == 0; }));
+}
+
 TEST(MetadataProvider, bufferId) {
     using BufferId = StandardMetadata<StandardMetadataType::BUFFER_ID>::value;
     std::vector<uint8_t> buffer(10000, 0);
@@ -343,6 +375,66 @@ TEST(MetadataProvider, outOfBounds) {
             << "100 (out of range) should have resulted in UNSUPPORTED";
 }
 
+// An AIMapper with only getStandardMetadata, which gets a few types and counts its calls.
+static int sGetStandardMetadataCalls = 0;
+
+static AIMapper fakeMapper() {
+    AIMapper mapper{};
+    mapper.version = AIMAPPER_VERSION_5;
+    mapper.v5.getStandardMetadata = [](buffer_handle_t, int64_t standardMetadataType,
+                                       void* destBuffer, size_t destBufferSize) -> int32_t {
+        sGetStandardMetadataCalls++;
+        switch (static_cast<StandardMetadataType>(standardMetadataType)) {
+            case StandardMetadataType::DATASPACE:
+                return StandardMetadata<StandardMetadataType::DATASPACE>::value::encode(
+                        Dataspace::BT2020, destBuffer, destBufferSize);
+            case StandardMetadataType::PLANE_LAYOUTS:
+                return StandardMetadata<StandardMetadataType::PLANE_LAYOUTS>::value::encode(
+                        fakePlaneLayouts(), destBuffer, destBufferSize);
+            case StandardMetadataType::SMPTE2086:
+                return StandardMetadata<StandardMetadataType::SMPTE2086>::value::encode(
+                        std::nullopt, destBuffer, destBufferSize);
+            default:
+                return -AIMAPPER_ERROR_UNSUPPORTED;
+        }
+    };
+    return mapper;
+}
+
+TEST(MetadataBatch, getsAllTypes) {
+    const AIMapper mapper = fakeMapper();
+    native_handle_t handle{};
+    std::vector<uint8_t> scratch;
+
+    sGetStandardMetadataCalls = 0;
+    auto values = getStandardMetadataBatch<StandardMetadataType::DATASPACE,
+                                           StandardMetadataType::PLANE_LAYOUTS,
+                                           StandardMetadataType::SMPTE2086>(&mapper, &handle,
+                                                                            scratch);
+    ASSERT_TRUE(values.has_value());
+    EXPECT_EQ(Dataspace::BT2020, std::get<0>(*values));
+    EXPECT_EQ(fakePlaneLayouts(), std::get<1>(*values));
+    EXPECT_FALSE(std::get<2>(*values).has_value());
+
+    // Once scratch has grown, each type takes a single call.
+    sGetStandardMetadataCalls = 0;
+    values = getStandardMetadataBatch<StandardMetadataType::DATASPACE,
+                                      StandardMetadataType::PLANE_LAYOUTS,
+                                      StandardMetadataType::SMPTE2086>(&mapper, &handle, scratch);
+    ASSERT_TRUE(values.has_value());
+    EXPECT_EQ(3, sGetStandardMetadataCalls);
+}
+
+TEST(MetadataBatch, failsIfAnyTypeFails) {
+    const AIMapper mapper = fakeMapper();
+    native_handle_t handle{};
+    std::vector<uint8_t> scratch;
+
+    auto values = getStandardMetadataBatch<StandardMetadataType::DATASPACE,
+                                           StandardMetadataType::CROP>(&mapper, &handle, scratch);
+    EXPECT_FALSE(values.has_value());
+}
+
 template <StandardMetadataType T>
 std::vector<uint8_t> encode(const typename StandardMetadata<T>::value_type& value) {
     using Value = typename StandardMetadata<T>::value;
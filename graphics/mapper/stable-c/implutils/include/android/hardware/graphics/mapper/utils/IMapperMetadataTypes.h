@@ -31,7 +31,11 @@
 #include <android/hardware/graphics/mapper/IMapper.h>
 
 #include <cinttypes>
+#include <limits>
+#include <optional>
+#include <string>
 #include <string_view>
+#include <tuple>
 #include <type_traits>
 #include <vector>
 
@@ -131,6 +135,93 @@ class MetadataWriter {
     MetadataWriter& write(const XyColor& value) { return write(value.x).write(value.y); }
 };
 
+/**
+ * Writes metadata into a buffer that is known to hold all of it, so unlike MetadataWriter it
+ * does not check each write. It has the same writes as MetadataWriter so that an encoder can be
+ * written once for both, see encodeMetadata.
+ */
+class SizedMetadataWriter {
+  private:
+    uint8_t* _Nonnull mDest;
+
+    SizedMetadataWriter& copy(const void* _Nonnull src, size_t size) {
+        memcpy(mDest, src, size);
+        mDest += size;
+        return *this;
+    }
+
+  public:
+    explicit SizedMetadataWriter(void* _Nonnull destBuffer)
+        : mDest(reinterpret_cast<uint8_t*>(destBuffer)) {}
+
+    template <typename HEADER>
+    SizedMetadataWriter& writeHeader() {
+        return write(HEADER::name).template write<int64_t>(HEADER::value);
+    }
+
+    template <typename T, typename = std::enable_if_t<std::is_integral_v<T>>>
+    SizedMetadataWriter& write(T value) {
+        return copy(&value, sizeof(T));
+    }
+
+    SizedMetadataWriter& write(float value) { return copy(&value, sizeof(float)); }
+
+    SizedMetadataWriter& write(const std::string_view& value) {
+        write<int64_t>(value.length());
+        return copy(value.data(), value.length());
+    }
+
+    SizedMetadataWriter& write(const std::vector<uint8_t>& value) {
+        write<int64_t>(value.size());
+        return copy(value.data(), value.size());
+    }
+
+    SizedMetadataWriter& write(const ExtendableType& value) {
+        return write(value.name).write(value.value);
+    }
+
+    SizedMetadataWriter& write(const XyColor& value) { return write(value.x).write(value.y); }
+};
+
+// The number of bytes MetadataWriter writes for a header, a string and an ExtendableType.
+template <typename HEADER>
+constexpr uint64_t encodedHeaderSize() {
+    return sizeof(int64_t) + std::char_traits<char>::length(HEADER::name) + sizeof(int64_t);
+}
+
+constexpr uint64_t encodedStringSize(std::string_view value) {
+    return sizeof(int64_t) + value.length();
+}
+
+inline uint64_t encodedExtendableSize(const ExtendableType& value) {
+    return encodedStringSize(value.name) + sizeof(int64_t);
+}
+
+/**
+ * Encodes metadata of encodedSize bytes, which write writes with the writer it is given.
+ *
+ * When destBuffer holds all of it, it is written in a single pass without checking each write,
+ * and when destBuffer is empty, as when the caller only asks for the size, nothing is written.
+ * Otherwise as much as fits is written, as MetadataWriter does.
+ *
+ * @return encodedSize, or -AIMAPPER_ERROR_BAD_VALUE if it does not fit in an int32_t.
+ */
+template <typename F>
+[[nodiscard]] int32_t encodeMetadata(uint64_t encodedSize, void* _Nullable destBuffer,
+                                     size_t destBufferSize, F&& write) {
+    if (encodedSize > static_cast<uint64_t>(std::numeric_limits<int32_t>::max())) {
+        return -AIMAPPER_ERROR_BAD_VALUE;
+    }
+    if (destBufferSize >= encodedSize) {
+        SizedMetadataWriter writer{destBuffer};
+        write(writer);
+    } else if (destBufferSize > 0) {
+        MetadataWriter writer{destBuffer, destBufferSize};
+        write(writer);
+    }
+    return static_cast<int32_t>(encodedSize);
+}
+
 class MetadataReader {
   private:
     const uint8_t* _Nonnull mSrc;
@@ -250,12 +341,13 @@ struct MetadataValue {};
 
 template <typename HEADER, typename T>
 struct MetadataValue<HEADER, T, std::enable_if_t<std::is_integral_v<T>>> {
+    static constexpr uint64_t kEncodedSize = encodedHeaderSize<HEADER>() + sizeof(T);
+
     [[nodiscard]] static int32_t encode(T value, void* _Nullable destBuffer,
                                         size_t destBufferSize) {
-        return MetadataWriter{destBuffer, destBufferSize}
-                .template writeHeader<HEADER>()
-                .write(value)
-                .desiredSize();
+        return encodeMetadata(kEncodedSize, destBuffer, destBufferSize, [&](auto& writer) {
+            writer.template writeHeader<HEADER>().write(value);
+        });
     }
 
     [[nodiscard]] static std::optional<T> decode(const void* _Nonnull metadata,
@@ -268,12 +360,15 @@ struct MetadataValue<HEADER, T, std::enable_if_t<std::is_integral_v<T>>> {
 
 template <typename HEADER, typename T>
 struct MetadataValue<HEADER, T, std::enable_if_t<std::is_enum_v<T>>> {
+    static constexpr uint64_t kEncodedSize =
+            encodedHeaderSize<HEADER>() + sizeof(std::underlying_type_t<T>);
+
     [[nodiscard]] static int32_t encode(T value, void* _Nullable destBuffer,
                                         size_t destBufferSize) {
-        return MetadataWriter{destBuffer, destBufferSize}
-                .template writeHeader<HEADER>()
-                .write(static_cast<std::underlying_type_t<T>>(value))
-                .desiredSize();
+        return encodeMetadata(kEncodedSize, destBuffer, destBufferSize, [&](auto& writer) {
+            writer.template writeHeader<HEADER>().write(
+                    static_cast<std::underlying_type_t<T>>(value));
+        });
     }
 
     [[nodiscard]] static std::optional<T> decode(const void* _Nonnull metadata,
@@ -289,10 +384,10 @@ template <typename HEADER>
 struct MetadataValue<HEADER, std::string> {
     [[nodiscard]] static int32_t encode(const std::string_view& value, void* _Nullable destBuffer,
                                         size_t destBufferSize) {
-        return MetadataWriter{destBuffer, destBufferSize}
-                .template writeHeader<HEADER>()
-                .write(value)
-                .desiredSize();
+        return encodeMetadata(encodedHeaderSize<HEADER>() + encodedStringSize(value), destBuffer,
+                              destBufferSize, [&](auto& writer) {
+                                  writer.template writeHeader<HEADER>().write(value);
+                              });
     }
 
     [[nodiscard]] static std::optional<std::string> decode(const void* _Nonnull metadata,
@@ -309,10 +404,10 @@ struct MetadataValue<HEADER, ExtendableType> {
 
     [[nodiscard]] static int32_t encode(const ExtendableType& value, void* _Nullable destBuffer,
                                         size_t destBufferSize) {
-        return MetadataWriter{destBuffer, destBufferSize}
-                .template writeHeader<HEADER>()
-                .write(value)
-                .desiredSize();
+        return encodeMetadata(encodedHeaderSize<HEADER>() + encodedExtendableSize(value),
+                              destBuffer, destBufferSize, [&](auto& writer) {
+                                  writer.template writeHeader<HEADER>().write(value);
+                              });
     }
 
     [[nodiscard]] static std::optional<ExtendableType> decode(const void* _Nonnull metadata,
@@ -327,26 +422,35 @@ template <typename HEADER>
 struct MetadataValue<HEADER, std::vector<PlaneLayout>> {
     [[nodiscard]] static int32_t encode(const std::vector<PlaneLayout>& values,
                                         void* _Nullable destBuffer, size_t destBufferSize) {
-        MetadataWriter writer{destBuffer, destBufferSize};
-        writer.template writeHeader<HEADER>();
-        writer.write<int64_t>(values.size());
+        // The count of planes, then for each plane the count of components, each component and
+        // the 8 fields of the plane.
+        uint64_t encodedSize = encodedHeaderSize<HEADER>() + sizeof(int64_t);
         for (const auto& value : values) {
-            writer.write<int64_t>(value.components.size());
+            encodedSize += sizeof(int64_t) + 8 * sizeof(int64_t);
             for (const auto& component : value.components) {
-                writer.write(component.type)
-                        .write<int64_t>(component.offsetInBits)
-                        .write<int64_t>(component.sizeInBits);
+                encodedSize += encodedExtendableSize(component.type) + 2 * sizeof(int64_t);
             }
-            writer.write<int64_t>(value.offsetInBytes)
-                    .write<int64_t>(value.sampleIncrementInBits)
-                    .write<int64_t>(value.strideInBytes)
-                    .write<int64_t>(value.widthInSamples)
-                    .write<int64_t>(value.heightInSamples)
-                    .write<int64_t>(value.totalSizeInBytes)
-                    .write<int64_t>(value.horizontalSubsampling)
-                    .write<int64_t>(value.verticalSubsampling);
         }
-        return writer.desiredSize();
+        return encodeMetadata(encodedSize, destBuffer, destBufferSize, [&](auto& writer) {
+            writer.template writeHeader<HEADER>();
+            writer.template write<int64_t>(values.size());
+            for (const auto& value : values) {
+                writer.template write<int64_t>(value.components.size());
+                for (const auto& component : value.components) {
+                    writer.write(component.type)
+                            .template write<int64_t>(component.offsetInBits)
+                            .template write<int64_t>(component.sizeInBits);
+                }
+                writer.template write<int64_t>(value.offsetInBytes)
+                        .template write<int64_t>(value.sampleIncrementInBits)
+                        .template write<int64_t>(value.strideInBytes)
+                        .template write<int64_t>(value.widthInSamples)
+                        .template write<int64_t>(value.heightInSamples)
+                        .template write<int64_t>(value.totalSizeInBytes)
+                        .template write<int64_t>(value.horizontalSubsampling)
+                        .template write<int64_t>(value.verticalSubsampling);
+            }
+        });
     }
 
     using DecodeResult = std::optional<std::vector<PlaneLayout>>;
@@ -381,18 +485,22 @@ struct MetadataValue<HEADER, std::vector<PlaneLayout>> {
 
 template <typename HEADER>
 struct MetadataValue<HEADER, std::vector<Rect>> {
+    static constexpr uint64_t kEncodedRectSize = 4 * sizeof(int32_t);
+
     [[nodiscard]] static int32_t encode(const std::vector<Rect>& value, void* _Nullable destBuffer,
                                         size_t destBufferSize) {
-        MetadataWriter writer{destBuffer, destBufferSize};
-        writer.template writeHeader<HEADER>();
-        writer.write<int64_t>(value.size());
-        for (auto& rect : value) {
-            writer.write<int32_t>(rect.left)
-                    .write<int32_t>(rect.top)
-                    .write<int32_t>(rect.right)
-                    .write<int32_t>(rect.bottom);
-        }
-        return writer.desiredSize();
+        const uint64_t encodedSize =
+                encodedHeaderSize<HEADER>() + sizeof(int64_t) + value.size() * kEncodedRectSize;
+        return encodeMetadata(encodedSize, destBuffer, destBufferSize, [&](auto& writer) {
+            writer.template writeHeader<HEADER>();
+            writer.template write<int64_t>(value.size());
+            for (auto& rect : value) {
+                writer.template write<int32_t>(rect.left)
+                        .template write<int32_t>(rect.top)
+                        .template write<int32_t>(rect.right)
+                        .template write<int32_t>(rect.bottom);
+            }
+        });
     }
 
     using DecodeResult = std::optional<std::vector<Rect>>;
@@ -415,19 +523,22 @@ struct MetadataValue<HEADER, std::vector<Rect>> {
 
 template <typename HEADER>
 struct MetadataValue<HEADER, std::optional<Smpte2086>> {
+    // 4 XyColors and 2 luminances.
+    static constexpr uint64_t kEncodedSize = encodedHeaderSize<HEADER>() + 10 * sizeof(float);
+
     [[nodiscard]] static int32_t encode(const std::optional<Smpte2086>& optValue,
                                         void* _Nullable destBuffer, size_t destBufferSize) {
         if (optValue.has_value()) {
             const auto& value = *optValue;
-            return MetadataWriter{destBuffer, destBufferSize}
-                    .template writeHeader<HEADER>()
-                    .write(value.primaryRed)
-                    .write(value.primaryGreen)
-                    .write(value.primaryBlue)
-                    .write(value.whitePoint)
-                    .write(value.maxLuminance)
-                    .write(value.minLuminance)
-                    .desiredSize();
+            return encodeMetadata(kEncodedSize, destBuffer, destBufferSize, [&](auto& writer) {
+                writer.template writeHeader<HEADER>()
+                        .write(value.primaryRed)
+                        .write(value.primaryGreen)
+                        .write(value.primaryBlue)
+                        .write(value.whitePoint)
+                        .write(value.maxLuminance)
+                        .write(value.minLuminance);
+            });
         } else {
             return 0;
         }
@@ -459,15 +570,17 @@ struct MetadataValue<HEADER, std::optional<Smpte2086>> {
 
 template <typename HEADER>
 struct MetadataValue<HEADER, std::optional<Cta861_3>> {
+    static constexpr uint64_t kEncodedSize = encodedHeaderSize<HEADER>() + 2 * sizeof(float);
+
     [[nodiscard]] static int32_t encode(const std::optional<Cta861_3>& optValue,
                                         void* _Nullable destBuffer, size_t destBufferSize) {
         if (optValue.has_value()) {
             const auto& value = *optValue;
-            return MetadataWriter{destBuffer, destBufferSize}
-                    .template writeHeader<HEADER>()
-                    .write(value.maxContentLightLevel)
-                    .write(value.maxFrameAverageLightLevel)
-                    .desiredSize();
+            return encodeMetadata(kEncodedSize, destBuffer, destBufferSize, [&](auto& writer) {
+                writer.template writeHeader<HEADER>()
+                        .write(value.maxContentLightLevel)
+                        .write(value.maxFrameAverageLightLevel);
+            });
         } else {
             return 0;
         }
@@ -499,10 +612,10 @@ struct MetadataValue<HEADER, std::optional<std::vector<uint8_t>>> {
         if (!value.has_value()) {
             return 0;
         }
-        return MetadataWriter{destBuffer, destBufferSize}
-                .template writeHeader<HEADER>()
-                .write(*value)
-                .desiredSize();
+        return encodeMetadata(encodedHeaderSize<HEADER>() + sizeof(int64_t) + value->size(),
+                              destBuffer, destBufferSize, [&](auto& writer) {
+                                  writer.template writeHeader<HEADER>().write(*value);
+                              });
     }
 
     using DecodeResult = std::optional<std::optional<std::vector<uint8_t>>>;
@@ -567,6 +680,49 @@ DEFINE_TYPE(STRIDE, uint32_t);
 
 #undef DEFINE_TYPE
 
+/**
+ * Gets and decodes a standard metadata type of a buffer through a mapper, into scratch, which
+ * grows as needed. Reusing scratch across calls spares both the call that only asks for the
+ * size and the allocation whenever scratch already holds the metadata.
+ */
+template <StandardMetadataType T>
+[[nodiscard]] std::optional<typename StandardMetadata<T>::value_type> getStandardMetadata(
+        const AIMapper* _Nonnull mapper, buffer_handle_t _Nonnull buffer,
+        std::vector<uint8_t>& scratch) {
+    constexpr auto type = static_cast<int64_t>(T);
+    int32_t size = mapper->v5.getStandardMetadata(buffer, type, scratch.data(), scratch.size());
+    if (size > 0 && static_cast<size_t>(size) > scratch.size()) {
+        scratch.resize(size);
+        size = mapper->v5.getStandardMetadata(buffer, type, scratch.data(), scratch.size());
+    }
+    if (size < 0 || static_cast<size_t>(size) > scratch.size()) {
+        return std::nullopt;
+    }
+    return StandardMetadata<T>::value::decode(scratch.data(), size);
+}
+
+/**
+ * Gets and decodes several standard metadata types of a buffer in one call, such as those that
+ * are read for every frame, sharing scratch between them.
+ *
+ * @return The values in the order of the types, or std::nullopt if any type failed.
+ */
+template <StandardMetadataType... T>
+[[nodiscard]] std::optional<std::tuple<typename StandardMetadata<T>::value_type...>>
+getStandardMetadataBatch(const AIMapper* _Nonnull mapper, buffer_handle_t _Nonnull buffer,
+                         std::vector<uint8_t>& scratch) {
+    std::tuple<std::optional<typename StandardMetadata<T>::value_type>...> values{
+            getStandardMetadata<T>(mapper, buffer, scratch)...};
+    if (!std::apply([](const auto&... value) { return (value.has_value() && ...); }, values)) {
+        return std::nullopt;
+    }
+    return std::apply(
+            [](auto&&... value) {
+                return std::make_optional(std::make_tuple(std::move(*value)...));
+            },
+            std::move(values));
+}
+
 #if defined(__cplusplus) && __cplusplus >= 202002L
 
 template <typename F, std::size_t... I>
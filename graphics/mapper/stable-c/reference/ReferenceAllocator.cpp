@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mapper-reference/ReferenceAllocator.h"
+
+#include <aidl/android/hardware/graphics/allocator/AllocationError.h>
+#include <aidl/android/hardware/graphics/common/BufferUsage.h>
+#include <aidl/android/hardware/graphics/common/ChromaSiting.h>
+#include <android/binder_enums.h>
+#include <fcntl.h>
+#include <linux/dma-buf.h>
+#include <linux/dma-heap.h>
+#include <log/log.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "mapper-reference/ReferenceBuffer.h"
+
+namespace android::hardware::graphics::mapper::reference {
+
+using ::aidl::android::hardware::graphics::allocator::AllocationError;
+using ::aidl::android::hardware::graphics::common::BufferUsage;
+using ::aidl::android::hardware::graphics::common::ChromaSiting;
+using ::android::base::unique_fd;
+using ::ndk::ScopedAStatus;
+
+namespace {
+
+constexpr char kDmaHeapPath[] = "/dev/dma_heap/system";
+
+ScopedAStatus allocationError(AllocationError error) {
+    return ScopedAStatus::fromServiceSpecificError(static_cast<int32_t>(error));
+}
+
+uint64_t knownUsageMask() {
+    uint64_t mask = 0;
+    for (BufferUsage usage : ndk::enum_range<BufferUsage>()) {
+        mask |= static_cast<uint64_t>(usage);
+    }
+    return mask;
+}
+
+void initializeMetadata(SharedMetadata* metadata, const ReferenceAllocator::BufferDescriptorInfo& d,
+                        const char* name, const BufferLayout& layout, uint64_t bufferId,
+                        uint64_t dataSize) {
+    // The memory is zero-filled, which leaves the dataspace UNKNOWN, the blend mode INVALID and
+    // the HDR metadata unset.
+    metadata->magic = kMetadataMagic;
+    metadata->nameLength = strlen(name);
+    memcpy(metadata->name, name, metadata->nameLength);
+    metadata->bufferId = bufferId;
+    metadata->width = d.width;
+    metadata->height = d.height;
+    metadata->layerCount = d.layerCount;
+    metadata->pixelFormat = static_cast<int32_t>(d.format);
+    metadata->fourcc = layout.fourcc;
+    metadata->stride = layout.stride;
+    metadata->usage = static_cast<uint64_t>(d.usage);
+    metadata->allocationSize = dataSize;
+    metadata->reservedSize = d.reservedSize;
+    metadata->chromaSiting = static_cast<int64_t>(
+            layout.planeCount > 1 ? ChromaSiting::SITED_INTERSTITIAL : ChromaSiting::NONE);
+    metadata->planeCount = layout.planeCount;
+    metadata->cropCount = layout.planeCount;
+    for (uint32_t i = 0; i < layout.planeCount; i++) {
+        metadata->planes[i] = layout.planes[i];
+        metadata->crops[i] = CropRect{
+                .left = 0,
+                .top = 0,
+                .right = static_cast<int32_t>(layout.planes[i].widthInSamples),
+                .bottom = static_cast<int32_t>(layout.planes[i].heightInSamples),
+        };
+    }
+}
+
+}  // namespace
+
+ReferenceAllocator::ReferenceAllocator(Backing backing) : mBacking(backing) {
+    if (mBacking == Backing::DMA_HEAP) {
+        mHeapFd.reset(TEMP_FAILURE_RETRY(open(kDmaHeapPath, O_RDONLY | O_CLOEXEC)));
+        if (!mHeapFd.ok()) {
+            ALOGE("Failed to open %s: %s", kDmaHeapPath, strerror(errno));
+        }
+    }
+}
+
+bool ReferenceAllocator::isSupported(const BufferDescriptorInfo& descriptor) const {
+    static const uint64_t kKnownUsageMask = knownUsageMask();
+    const uint64_t usage = static_cast<uint64_t>(descriptor.usage);
+    // Memory from memfd and the system heap cannot be protected.
+    if ((usage & ~kKnownUsageMask) != 0 ||
+        (usage & static_cast<uint64_t>(BufferUsage::PROTECTED)) != 0) {
+        return false;
+    }
+    if (descriptor.width <= 0 || descriptor.height <= 0 || descriptor.layerCount <= 0) {
+        return false;
+    }
+    return computeLayout(descriptor.format, descriptor.width, descriptor.height).has_value();
+}
+
+ScopedAStatus ReferenceAllocator::allocate(const BufferDescriptorInfo& descriptor, int32_t count,
+                                           std::vector<native_handle_t*>* outHandles,
+                                           int32_t* outStride) {
+    if (count <= 0 || descriptor.width <= 0 || descriptor.height <= 0 ||
+        descriptor.layerCount <= 0 || descriptor.reservedSize < 0) {
+        return allocationError(AllocationError::BAD_DESCRIPTOR);
+    }
+    if (!isSupported(descriptor)) {
+        return allocationError(AllocationError::UNSUPPORTED);
+    }
+    const BufferLayout layout =
+            *computeLayout(descriptor.format, descriptor.width, descriptor.height);
+
+    uint64_t dataSize;
+    size_t metadataSize;
+    if (__builtin_mul_overflow(layout.layerSize, static_cast<uint64_t>(descriptor.layerCount),
+                               &dataSize) ||
+        __builtin_add_overflow(kReservedRegionOffset,
+                               static_cast<uint64_t>(descriptor.reservedSize), &metadataSize)) {
+        return allocationError(AllocationError::BAD_DESCRIPTOR);
+    }
+    metadataSize = roundUpToPageSize(metadataSize);
+    size_t totalSize;
+    if (metadataSize > INT32_MAX || __builtin_add_overflow(metadataSize, dataSize, &totalSize)) {
+        return allocationError(AllocationError::NO_RESOURCES);
+    }
+
+    // The name from the client may not be terminated.
+    char name[kMaxNameLength] = {};
+    memcpy(name, descriptor.name.data(), std::min(descriptor.name.size(), kMaxNameLength - 1));
+
+    std::vector<native_handle_t*> handles;
+    handles.reserve(count);
+    const auto freeHandles = [&handles] {
+        for (native_handle_t* handle : handles) {
+            native_handle_close(handle);
+            native_handle_delete(handle);
+        }
+    };
+    for (int32_t i = 0; i < count; i++) {
+        unique_fd fd = allocateMemory(name, totalSize);
+        if (!fd.ok()) {
+            freeHandles();
+            return allocationError(AllocationError::NO_RESOURCES);
+        }
+        void* metadata =
+                mmap(nullptr, metadataSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd.get(), 0);
+        if (metadata == MAP_FAILED) {
+            ALOGE("Failed to map buffer metadata: %s", strerror(errno));
+            freeHandles();
+            return allocationError(AllocationError::NO_RESOURCES);
+        }
+        const uint64_t bufferId = (static_cast<uint64_t>(getpid()) << 32) | mNextBufferId++;
+        initializeMetadata(static_cast<SharedMetadata*>(metadata), descriptor, name, layout,
+                           bufferId, dataSize);
+        munmap(metadata, metadataSize);
+
+        const int32_t flags = mBacking == Backing::DMA_HEAP ? kHandleFlagDmaBuf : 0;
+        native_handle_t* handle = BufferHandle::create(fd.get(), flags, metadataSize, dataSize);
+        if (handle == nullptr) {
+            freeHandles();
+            return allocationError(AllocationError::NO_RESOURCES);
+        }
+        fd.release();
+        handles.push_back(handle);
+    }
+
+    *outHandles = std::move(handles);
+    *outStride = layout.stride;
+    return ScopedAStatus::ok();
+}
+
+unique_fd ReferenceAllocator::allocateMemory(const char* name, size_t size) {
+    if (mBacking == Backing::DMA_HEAP) {
+        if (!mHeapFd.ok()) {
+            return {};
+        }
+        dma_heap_allocation_data data = {
+                .len = size,
+                .fd_flags = O_RDWR | O_CLOEXEC,
+        };
+        if (TEMP_FAILURE_RETRY(ioctl(mHeapFd.get(), DMA_HEAP_IOCTL_ALLOC, &data)) < 0) {
+            ALOGE("Failed to allocate %zu bytes from %s: %s", size, kDmaHeapPath, strerror(errno));
+            return {};
+        }
+        unique_fd fd(data.fd);
+        // The name only helps debugging, so failing to set it is not an error.
+        ioctl(fd.get(), DMA_BUF_SET_NAME, name);
+        return fd;
+    }
+
+    unique_fd fd(memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING));
+    if (!fd.ok()) {
+        ALOGE("Failed to create memfd: %s", strerror(errno));
+        return {};
+    }
+    if (TEMP_FAILURE_RETRY(ftruncate(fd.get(), size)) < 0) {
+        ALOGE("Failed to allocate %zu bytes of memfd: %s", size, strerror(errno));
+        return {};
+    }
+    // A buffer must not be shrunk under the processes that map it, which would then fault.
+    if (fcntl(fd.get(), F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+        ALOGE("Failed to seal memfd: %s", strerror(errno));
+        return {};
+    }
+    return fd;
+}
+
+}  // namespace android::hardware::graphics::mapper::reference
@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mapper-reference/ReferenceBuffer.h"
+
+#include <aidl/android/hardware/graphics/common/PlaneLayoutComponentType.h>
+#include <drm/drm_fourcc.h>
+#include <unistd.h>
+
+#include <initializer_list>
+
+namespace android::hardware::graphics::mapper::reference {
+
+using ::aidl::android::hardware::graphics::common::PlaneLayoutComponentType;
+
+namespace {
+
+// The alignment of rows, in pixels.
+constexpr uint32_t kStrideAlignment = 16;
+
+uint64_t alignTo(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+PlaneComponent component(PlaneLayoutComponentType type, int64_t offsetInBits, int64_t sizeInBits) {
+    return PlaneComponent{
+            .type = static_cast<int64_t>(type),
+            .offsetInBits = offsetInBits,
+            .sizeInBits = sizeInBits,
+    };
+}
+
+Plane makePlane(std::initializer_list<PlaneComponent> components, int64_t sampleIncrementInBits,
+                uint64_t offsetInBytes, uint64_t strideInBytes, uint64_t widthInSamples,
+                uint64_t heightInSamples, int64_t subsampling) {
+    Plane plane{};
+    for (const PlaneComponent& c : components) {
+        plane.components[plane.componentCount++] = c;
+    }
+    plane.offsetInBytes = offsetInBytes;
+    plane.sampleIncrementInBits = sampleIncrementInBits;
+    plane.strideInBytes = strideInBytes;
+    plane.widthInSamples = widthInSamples;
+    plane.heightInSamples = heightInSamples;
+    plane.totalSizeInBytes = strideInBytes * heightInSamples;
+    plane.horizontalSubsampling = subsampling;
+    plane.verticalSubsampling = subsampling;
+    return plane;
+}
+
+// A single plane of pixels of bitsPerPixel bits.
+BufferLayout packedLayout(uint32_t fourcc, uint32_t bitsPerPixel,
+                          std::initializer_list<PlaneComponent> components, uint32_t width,
+                          uint32_t height, uint32_t strideAlignment = kStrideAlignment) {
+    BufferLayout layout{};
+    layout.fourcc = fourcc;
+    layout.stride = alignTo(width, strideAlignment);
+    layout.planeCount = 1;
+    layout.planes[0] = makePlane(components, bitsPerPixel, 0, layout.stride * bitsPerPixel / 8,
+                                 width, height, 1);
+    layout.layerSize = layout.planes[0].totalSizeInBytes;
+    return layout;
+}
+
+// A luma plane followed by a plane of interleaved chroma samples at half resolution, each
+// sample of bytesPerSample bytes holding a value of bitsPerSample bits in its top bits.
+BufferLayout semiPlanarLayout(uint32_t fourcc, PlaneLayoutComponentType firstChroma,
+                              PlaneLayoutComponentType secondChroma, uint32_t bytesPerSample,
+                              uint32_t bitsPerSample, uint32_t width, uint32_t height) {
+    const int64_t sampleBits = bytesPerSample * 8;
+    const int64_t valueOffset = sampleBits - bitsPerSample;
+    const uint64_t stride = alignTo(width, kStrideAlignment);
+    const uint64_t strideInBytes = stride * bytesPerSample;
+
+    BufferLayout layout{};
+    layout.fourcc = fourcc;
+    layout.stride = stride;
+    layout.planeCount = 2;
+    layout.planes[0] =
+            makePlane({component(PlaneLayoutComponentType::Y, valueOffset, bitsPerSample)},
+                      sampleBits, 0, strideInBytes, width, height, 1);
+    layout.planes[1] = makePlane(
+            {component(firstChroma, valueOffset, bitsPerSample),
+             component(secondChroma, sampleBits + valueOffset, bitsPerSample)},
+            2 * sampleBits, layout.planes[0].totalSizeInBytes, strideInBytes, (width + 1) / 2,
+            (height + 1) / 2, 2);
+    layout.layerSize = layout.planes[0].totalSizeInBytes + layout.planes[1].totalSizeInBytes;
+    return layout;
+}
+
+// A luma plane followed by a Cr and a Cb plane at half resolution, whose rows are aligned to 16
+// bytes, as YV12 requires.
+BufferLayout yv12Layout(uint32_t width, uint32_t height) {
+    const uint64_t stride = alignTo(width, kStrideAlignment);
+    const uint64_t chromaStride = alignTo(stride / 2, kStrideAlignment);
+
+    BufferLayout layout{};
+    layout.fourcc = DRM_FORMAT_YVU420;
+    layout.stride = stride;
+    layout.planeCount = 3;
+    layout.planes[0] = makePlane({component(PlaneLayoutComponentType::Y, 0, 8)}, 8, 0, stride,
+                                 width, height, 1);
+    layout.planes[1] = makePlane({component(PlaneLayoutComponentType::CR, 0, 8)}, 8,
+                                 layout.planes[0].totalSizeInBytes, chromaStride, (width + 1) / 2,
+                                 (height + 1) / 2, 2);
+    layout.planes[2] = makePlane({component(PlaneLayoutComponentType::CB, 0, 8)}, 8,
+                                 layout.planes[1].offsetInBytes + layout.planes[1].totalSizeInBytes,
+                                 chromaStride, (width + 1) / 2, (height + 1) / 2, 2);
+    layout.layerSize = layout.planes[2].offsetInBytes + layout.planes[2].totalSizeInBytes;
+    return layout;
+}
+
+}  // namespace
+
+std::optional<BufferHandle> BufferHandle::from(const native_handle_t* handle) {
+    if (handle == nullptr || handle->version != sizeof(native_handle_t) ||
+        handle->numFds != kNumFds || handle->numInts != kNumInts ||
+        handle->data[kNumFds] != kHandleMagic || handle->data[0] < 0) {
+        return std::nullopt;
+    }
+    return BufferHandle(handle);
+}
+
+native_handle_t* BufferHandle::create(int fd, int32_t flags, size_t metadataSize,
+                                      uint64_t dataSize) {
+    native_handle_t* handle = native_handle_create(kNumFds, kNumInts);
+    if (handle == nullptr) {
+        return nullptr;
+    }
+    handle->data[0] = fd;
+    handle->data[kNumFds] = kHandleMagic;
+    handle->data[kNumFds + 1] = flags;
+    handle->data[kNumFds + 2] = static_cast<int32_t>(metadataSize);
+    handle->data[kNumFds + 3] = static_cast<int32_t>(dataSize & 0xffffffff);
+    handle->data[kNumFds + 4] = static_cast<int32_t>(dataSize >> 32);
+    return handle;
+}
+
+std::optional<BufferLayout> computeLayout(PixelFormat format, uint32_t width, uint32_t height) {
+    if (width == 0 || height == 0) {
+        return std::nullopt;
+    }
+    using Type = PlaneLayoutComponentType;
+    switch (format) {
+        case PixelFormat::RGBA_8888:
+            return packedLayout(DRM_FORMAT_ABGR8888, 32,
+                                {component(Type::R, 0, 8), component(Type::G, 8, 8),
+                                 component(Type::B, 16, 8), component(Type::A, 24, 8)},
+                                width, height);
+        case PixelFormat::RGBX_8888:
+            return packedLayout(DRM_FORMAT_XBGR8888, 32,
+                                {component(Type::R, 0, 8), component(Type::G, 8, 8),
+                                 component(Type::B, 16, 8)},
+                                width, height);
+        case PixelFormat::BGRA_8888:
+            return packedLayout(DRM_FORMAT_ARGB8888, 32,
+                                {component(Type::B, 0, 8), component(Type::G, 8, 8),
+                                 component(Type::R, 16, 8), component(Type::A, 24, 8)},
+                                width, height);
+        case PixelFormat::RGB_888:
+            return packedLayout(DRM_FORMAT_BGR888, 24,
+                                {component(Type::R, 0, 8), component(Type::G, 8, 8),
+                                 component(Type::B, 16, 8)},
+                                width, height);
+        case PixelFormat::RGB_565:
+            return packedLayout(DRM_FORMAT_RGB565, 16,
+                                {component(Type::B, 0, 5), component(Type::G, 5, 6),
+                                 component(Type::R, 11, 5)},
+                                width, height);
+        case PixelFormat::RGBA_FP16:
+            return packedLayout(DRM_FORMAT_ABGR16161616F, 64,
+                                {component(Type::R, 0, 16), component(Type::G, 16, 16),
+                                 component(Type::B, 32, 16), component(Type::A, 48, 16)},
+                                width, height);
+        case PixelFormat::RGBA_1010102:
+            return packedLayout(DRM_FORMAT_ABGR2101010, 32,
+                                {component(Type::R, 0, 10), component(Type::G, 10, 10),
+                                 component(Type::B, 20, 10), component(Type::A, 30, 2)},
+                                width, height);
+        case PixelFormat::BLOB:
+            // A blob is width bytes, locked in place, so its rows are not padded.
+            return packedLayout(DRM_FORMAT_R8, 8, {component(Type::RAW, 0, 8)}, width, height,
+                                1);
+        case PixelFormat::Y8:
+            return packedLayout(DRM_FORMAT_R8, 8, {component(Type::Y, 0, 8)}, width, height);
+        case PixelFormat::YCBCR_420_888:
+            return semiPlanarLayout(DRM_FORMAT_NV12, Type::CB, Type::CR, 1, 8, width, height);
+        case PixelFormat::YCRCB_420_SP:
+            return semiPlanarLayout(DRM_FORMAT_NV21, Type::CR, Type::CB, 1, 8, width, height);
+        case PixelFormat::YCBCR_P010:
+            return semiPlanarLayout(DRM_FORMAT_P010, Type::CB, Type::CR, 2, 10, width, height);
+        case PixelFormat::YV12:
+            return yv12Layout(width, height);
+        default:
+            return std::nullopt;
+    }
+}
+
+size_t roundUpToPageSize(size_t size) {
+    static const size_t pageSize = getpagesize();
+    return alignTo(size, pageSize);
+}
+
+}  // namespace android::hardware::graphics::mapper::reference
@@ -0,0 +1,655 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mapper-reference/ReferenceMapper.h"
+
+#include <aidl/android/hardware/graphics/common/Compression.h>
+#include <aidl/android/hardware/graphics/common/Interlaced.h>
+#include <android-base/unique_fd.h>
+#include <android/hardware/graphics/mapper/utils/IMapperMetadataTypes.h>
+#include <drm/drm_fourcc.h>
+#include <linux/dma-buf.h>
+#include <log/log.h>
+#include <sync/sync.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace android::hardware::graphics::mapper::reference {
+
+using ::aidl::android::hardware::graphics::common::Compression;
+using ::aidl::android::hardware::graphics::common::Interlaced;
+using ::android::base::unique_fd;
+
+namespace {
+
+using Type = StandardMetadataType;
+
+template <StandardMetadataType T>
+using Value = typename StandardMetadata<T>::value;
+
+template <StandardMetadataType T>
+using Header = typename StandardMetadata<T>::Header;
+
+constexpr const char* kStandardMetadataTypeName = Header<Type::BUFFER_ID>::name;
+constexpr std::string_view kCompressionName = "android.hardware.graphics.common.Compression";
+constexpr std::string_view kInterlacedName = "android.hardware.graphics.common.Interlaced";
+constexpr std::string_view kChromaSitingName = "android.hardware.graphics.common.ChromaSiting";
+constexpr std::string_view kPlaneLayoutComponentTypeName =
+        "android.hardware.graphics.common.PlaneLayoutComponentType";
+
+constexpr uint64_t kCpuReadMask = static_cast<uint64_t>(BufferUsage::CPU_READ_MASK);
+constexpr uint64_t kCpuWriteMask = static_cast<uint64_t>(BufferUsage::CPU_WRITE_MASK);
+
+// The standard metadata types that can be gotten, and whether they can be set.
+constexpr std::pair<StandardMetadataType, bool> kSupportedMetadataTypes[] = {
+        {Type::BUFFER_ID, false},
+        {Type::NAME, false},
+        {Type::WIDTH, false},
+        {Type::HEIGHT, false},
+        {Type::LAYER_COUNT, false},
+        {Type::PIXEL_FORMAT_REQUESTED, false},
+        {Type::PIXEL_FORMAT_FOURCC, false},
+        {Type::PIXEL_FORMAT_MODIFIER, false},
+        {Type::USAGE, false},
+        {Type::ALLOCATION_SIZE, false},
+        {Type::PROTECTED_CONTENT, false},
+        {Type::COMPRESSION, false},
+        {Type::INTERLACED, false},
+        {Type::CHROMA_SITING, false},
+        {Type::PLANE_LAYOUTS, false},
+        {Type::CROP, true},
+        {Type::DATASPACE, true},
+        {Type::BLEND_MODE, true},
+        {Type::SMPTE2086, true},
+        {Type::CTA861_3, true},
+        {Type::SMPTE2094_10, true},
+        {Type::SMPTE2094_40, true},
+        {Type::STRIDE, false},
+};
+
+template <StandardMetadataType T>
+int32_t encodeExtendable(std::string_view name, int64_t value, void* destBuffer,
+                         size_t destBufferSize) {
+    return encodeMetadata(
+            encodedHeaderSize<Header<T>>() + encodedStringSize(name) + sizeof(int64_t),
+            destBuffer, destBufferSize, [&](auto& writer) {
+                writer.template writeHeader<Header<T>>().write(name).template write<int64_t>(
+                        value);
+            });
+}
+
+template <StandardMetadataType T>
+int32_t encodeBlob(const uint8_t* data, uint32_t size, void* destBuffer, size_t destBufferSize) {
+    if (size == 0) {
+        return 0;
+    }
+    // Encoded like a std::vector<uint8_t>: its size, then its bytes.
+    const std::string_view blob(reinterpret_cast<const char*>(data),
+                                std::min<size_t>(size, kMaxDynamicMetadataSize));
+    return encodeMetadata(encodedHeaderSize<Header<T>>() + encodedStringSize(blob), destBuffer,
+                          destBufferSize, [&](auto& writer) {
+                              writer.template writeHeader<Header<T>>().write(blob);
+                          });
+}
+
+int32_t encodePlaneLayouts(const SharedMetadata& m, void* destBuffer, size_t destBufferSize) {
+    using PlaneLayoutsHeader = Header<Type::PLANE_LAYOUTS>;
+    const uint32_t planeCount = std::min<uint32_t>(m.planeCount, kMaxPlanes);
+    // The count of planes, then for each plane the count of components, each component and the
+    // 8 fields of the plane.
+    constexpr uint64_t kEncodedComponentSize =
+            encodedStringSize(kPlaneLayoutComponentTypeName) + 3 * sizeof(int64_t);
+    uint64_t encodedSize = encodedHeaderSize<PlaneLayoutsHeader>() + sizeof(int64_t);
+    for (uint32_t i = 0; i < planeCount; i++) {
+        encodedSize += sizeof(int64_t) + 8 * sizeof(int64_t) +
+                       std::min<uint32_t>(m.planes[i].componentCount, kMaxPlaneComponents) *
+                               kEncodedComponentSize;
+    }
+    return encodeMetadata(encodedSize, destBuffer, destBufferSize, [&](auto& writer) {
+        writer.template writeHeader<PlaneLayoutsHeader>();
+        writer.template write<int64_t>(planeCount);
+        for (uint32_t i = 0; i < planeCount; i++) {
+            const Plane& plane = m.planes[i];
+            const uint32_t componentCount =
+                    std::min<uint32_t>(plane.componentCount, kMaxPlaneComponents);
+            writer.template write<int64_t>(componentCount);
+            for (uint32_t j = 0; j < componentCount; j++) {
+                const PlaneComponent& component = plane.components[j];
+                writer.write(kPlaneLayoutComponentTypeName)
+                        .template write<int64_t>(component.type)
+                        .template write<int64_t>(component.offsetInBits)
+                        .template write<int64_t>(component.sizeInBits);
+            }
+            writer.template write<int64_t>(plane.offsetInBytes)
+                    .template write<int64_t>(plane.sampleIncrementInBits)
+                    .template write<int64_t>(plane.strideInBytes)
+                    .template write<int64_t>(plane.widthInSamples)
+                    .template write<int64_t>(plane.heightInSamples)
+                    .template write<int64_t>(plane.totalSizeInBytes)
+                    .template write<int64_t>(plane.horizontalSubsampling)
+                    .template write<int64_t>(plane.verticalSubsampling);
+        }
+    });
+}
+
+int32_t encodeCrop(const SharedMetadata& m, void* destBuffer, size_t destBufferSize) {
+    using CropHeader = Header<Type::CROP>;
+    const uint32_t cropCount = std::min<uint32_t>(m.cropCount, kMaxPlanes);
+    return encodeMetadata(
+            encodedHeaderSize<CropHeader>() + sizeof(int64_t) + cropCount * 4 * sizeof(int32_t),
+            destBuffer, destBufferSize, [&](auto& writer) {
+                writer.template writeHeader<CropHeader>();
+                writer.template write<int64_t>(cropCount);
+                for (uint32_t i = 0; i < cropCount; i++) {
+                    writer.template write<int32_t>(m.crops[i].left)
+                            .template write<int32_t>(m.crops[i].top)
+                            .template write<int32_t>(m.crops[i].right)
+                            .template write<int32_t>(m.crops[i].bottom);
+                }
+            });
+}
+
+// Encodes a standard metadata type straight from the shared metadata, as the encoders of
+// IMapperMetadataTypes.h do from their value types, without building those.
+int32_t encodeStandardMetadata(const SharedMetadata& m, StandardMetadataType type,
+                               void* destBuffer, size_t destBufferSize) {
+    switch (type) {
+        case Type::BUFFER_ID:
+            return Value<Type::BUFFER_ID>::encode(m.bufferId, destBuffer, destBufferSize);
+        case Type::NAME:
+            return Value<Type::NAME>::encode(
+                    std::string_view(m.name, std::min<size_t>(m.nameLength, kMaxNameLength)),
+                    destBuffer, destBufferSize);
+        case Type::WIDTH:
+            return Value<Type::WIDTH>::encode(m.width, destBuffer, destBufferSize);
+        case Type::HEIGHT:
+            return Value<Type::HEIGHT>::encode(m.height, destBuffer, destBufferSize);
+        case Type::LAYER_COUNT:
+            return Value<Type::LAYER_COUNT>::encode(m.layerCount, destBuffer, destBufferSize);
+        case Type::PIXEL_FORMAT_REQUESTED:
+            return Value<Type::PIXEL_FORMAT_REQUESTED>::encode(
+                    static_cast<PixelFormat>(m.pixelFormat), destBuffer, destBufferSize);
+        case Type::PIXEL_FORMAT_FOURCC:
+            return Value<Type::PIXEL_FORMAT_FOURCC>::encode(m.fourcc, destBuffer, destBufferSize);
+        case Type::PIXEL_FORMAT_MODIFIER:
+            return Value<Type::PIXEL_FORMAT_MODIFIER>::encode(DRM_FORMAT_MOD_LINEAR, destBuffer,
+                                                               destBufferSize);
+        case Type::USAGE:
+            return Value<Type::USAGE>::encode(static_cast<BufferUsage>(m.usage), destBuffer,
+                                              destBufferSize);
+        case Type::ALLOCATION_SIZE:
+            return Value<Type::ALLOCATION_SIZE>::encode(m.allocationSize, destBuffer,
+                                                        destBufferSize);
+        case Type::PROTECTED_CONTENT:
+            return Value<Type::PROTECTED_CONTENT>::encode(0, destBuffer, destBufferSize);
+        case Type::COMPRESSION:
+            return encodeExtendable<Type::COMPRESSION>(
+                    kCompressionName, static_cast<int64_t>(Compression::NONE), destBuffer,
+                    destBufferSize);
+        case Type::INTERLACED:
+            return encodeExtendable<Type::INTERLACED>(kInterlacedName,
+                                                      static_cast<int64_t>(Interlaced::NONE),
+                                                      destBuffer, destBufferSize);
+        case Type::CHROMA_SITING:
+            return encodeExtendable<Type::CHROMA_SITING>(kChromaSitingName, m.chromaSiting,
+                                                         destBuffer, destBufferSize);
+        case Type::PLANE_LAYOUTS:
+            return encodePlaneLayouts(m, destBuffer, destBufferSize);
+        case Type::CROP:
+            return encodeCrop(m, destBuffer, destBufferSize);
+        case Type::DATASPACE:
+            return Value<Type::DATASPACE>::encode(static_cast<Dataspace>(m.dataspace), destBuffer,
+                                                  destBufferSize);
+        case Type::BLEND_MODE:
+            return Value<Type::BLEND_MODE>::encode(static_cast<BlendMode>(m.blendMode), destBuffer,
+                                                   destBufferSize);
+        case Type::SMPTE2086: {
+            if (!m.hasSmpte2086) {
+                return 0;
+            }
+            const float* v = m.smpte2086;
+            const Smpte2086 value = {
+                    .primaryRed = {.x = v[0], .y = v[1]},
+                    .primaryGreen = {.x = v[2], .y = v[3]},
+                    .primaryBlue = {.x = v[4], .y = v[5]},
+                    .whitePoint = {.x = v[6], .y = v[7]},
+                    .maxLuminance = v[8],
+                    .minLuminance = v[9],
+            };
+            return Value<Type::SMPTE2086>::encode(value, destBuffer, destBufferSize);
+        }
+        case Type::CTA861_3: {
+            if (!m.hasCta861_3) {
+                return 0;
+            }
+            const Cta861_3 value = {
+                    .maxContentLightLevel = m.cta861_3[0],
+                    .maxFrameAverageLightLevel = m.cta861_3[1],
+            };
+            return Value<Type::CTA861_3>::encode(value, destBuffer, destBufferSize);
+        }
+        case Type::SMPTE2094_10:
+            return encodeBlob<Type::SMPTE2094_10>(m.smpte2094_10, m.smpte2094_10Size, destBuffer,
+                                                  destBufferSize);
+        case Type::SMPTE2094_40:
+            return encodeBlob<Type::SMPTE2094_40>(m.smpte2094_40, m.smpte2094_40Size, destBuffer,
+                                                  destBufferSize);
+        case Type::STRIDE:
+            return Value<Type::STRIDE>::encode(m.stride, destBuffer, destBufferSize);
+        default:
+            return -AIMAPPER_ERROR_UNSUPPORTED;
+    }
+}
+
+AIMapper_Error setBlob(const std::optional<std::vector<uint8_t>>& value, uint8_t* data,
+                       uint32_t* size) {
+    if (!value.has_value()) {
+        *size = 0;
+        return AIMAPPER_ERROR_NONE;
+    }
+    if (value->size() > kMaxDynamicMetadataSize) {
+        return AIMAPPER_ERROR_NO_RESOURCES;
+    }
+    memcpy(data, value->data(), value->size());
+    *size = value->size();
+    return AIMAPPER_ERROR_NONE;
+}
+
+void dumpMetadata(const SharedMetadata& m, AIMapper_DumpBufferCallback dumpBufferCallback,
+                  void* context) {
+    std::vector<uint8_t> buffer;
+    for (const auto& [type, settable] : kSupportedMetadataTypes) {
+        int32_t size = encodeStandardMetadata(m, type, nullptr, 0);
+        if (size <= 0) {
+            continue;
+        }
+        buffer.resize(size);
+        size = encodeStandardMetadata(m, type, buffer.data(), buffer.size());
+        if (size > 0 && static_cast<size_t>(size) <= buffer.size()) {
+            dumpBufferCallback(context,
+                               AIMapper_MetadataType{.name = kStandardMetadataTypeName,
+                                                     .value = static_cast<int64_t>(type)},
+                               buffer.data(), size);
+        }
+    }
+}
+
+// Synchronizes the CPU caches of a dma-buf with the device, for DMA_BUF_IOCTL_SYNC flags.
+void syncDmaBuf(int fd, uint64_t flags) {
+    dma_buf_sync sync = {.flags = flags};
+    if (TEMP_FAILURE_RETRY(ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync)) < 0) {
+        ALOGE("Failed to sync dma-buf: %s", strerror(errno));
+    }
+}
+
+uint64_t dmaBufSyncFlags(uint64_t cpuUsage) {
+    uint64_t flags = 0;
+    if (cpuUsage & kCpuReadMask) {
+        flags |= DMA_BUF_SYNC_READ;
+    }
+    if (cpuUsage & kCpuWriteMask) {
+        flags |= DMA_BUF_SYNC_WRITE;
+    }
+    return flags;
+}
+
+}  // namespace
+
+ReferenceMapperV5::~ReferenceMapperV5() {
+    for (auto& [handle, buffer] : mBuffers) {
+        release(buffer.get());
+    }
+}
+
+ReferenceMapperV5::ImportedBuffer* ReferenceMapperV5::getBuffer(buffer_handle_t buffer) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mBuffers.find(buffer);
+    return it != mBuffers.end() ? it->second.get() : nullptr;
+}
+
+void ReferenceMapperV5::release(ImportedBuffer* buffer) {
+    if (buffer->data != nullptr) {
+        munmap(buffer->data, buffer->dataSize);
+    }
+    munmap(buffer->metadata, buffer->metadataSize);
+    native_handle_close(buffer->handle);
+    native_handle_delete(buffer->handle);
+}
+
+AIMapper_Error ReferenceMapperV5::importBuffer(const native_handle_t* handle,
+                                               buffer_handle_t* outBufferHandle) {
+    const std::optional<BufferHandle> view = BufferHandle::from(handle);
+    if (!view || view->metadataSize() < sizeof(SharedMetadata)) {
+        return AIMAPPER_ERROR_BAD_BUFFER;
+    }
+    // Accessing a mapping beyond the end of the file would fault, so the file must hold all of
+    // the buffer.
+    const off64_t fileSize = lseek64(view->fd(), 0, SEEK_END);
+    if (fileSize < 0 ||
+        static_cast<uint64_t>(fileSize) < view->metadataSize() + view->dataSize()) {
+        return AIMAPPER_ERROR_BAD_BUFFER;
+    }
+
+    auto buffer = std::make_unique<ImportedBuffer>();
+    buffer->handle = native_handle_clone(handle);
+    if (buffer->handle == nullptr) {
+        return AIMAPPER_ERROR_NO_RESOURCES;
+    }
+    buffer->isDmaBuf = (view->flags() & kHandleFlagDmaBuf) != 0;
+    buffer->metadataSize = view->metadataSize();
+    buffer->dataSize = view->dataSize();
+    void* metadata = mmap(nullptr, buffer->metadataSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                          buffer->handle->data[0], 0);
+    if (metadata == MAP_FAILED) {
+        ALOGE("Failed to map buffer metadata: %s", strerror(errno));
+        native_handle_close(buffer->handle);
+        native_handle_delete(buffer->handle);
+        return AIMAPPER_ERROR_NO_RESOURCES;
+    }
+    buffer->metadata = static_cast<SharedMetadata*>(metadata);
+    if (buffer->metadata->magic != kMetadataMagic ||
+        kReservedRegionOffset + buffer->metadata->reservedSize > buffer->metadataSize) {
+        release(buffer.get());
+        return AIMAPPER_ERROR_BAD_BUFFER;
+    }
+
+    *outBufferHandle = buffer->handle;
+    std::lock_guard<std::mutex> lock(mMutex);
+    mBuffers.emplace(buffer->handle, std::move(buffer));
+    return AIMAPPER_ERROR_NONE;
+}
+
+AIMapper_Error ReferenceMapperV5::freeBuffer(buffer_handle_t buffer) {
+    std::unique_ptr<ImportedBuffer> imported;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mBuffers.find(buffer);
+        if (it == mBuffers.end()) {
+            return AIMAPPER_ERROR_BAD_BUFFER;
+        }
+        imported = std::move(it->second);
+        mBuffers.erase(it);
+    }
+    release(imported.get());
+    return AIMAPPER_ERROR_NONE;
+}
+
+AIMapper_Error ReferenceMapperV5::getTransportSize(buffer_handle_t buffer, uint32_t* outNumFds,
+                                                   uint32_t* outNumInts) {
+    if (getBuffer(buffer) == nullptr) {
+        return AIMAPPER_ERROR_BAD_BUFFER;
+    }
+    *outNumFds = BufferHandle::kNumFds;
+    *outNumInts = BufferHandle::kNumInts;
+    return AIMAPPER_ERROR_NONE;
+}
+
+AIMapper_Error ReferenceMapperV5::lock(buffer_handle_t buffer, uint64_t cpuUsage,
+                                       ARect accessRegion, int acquireFence, void** outData) {
+    unique_fd fence(acquireFence);
+    ImportedBuffer* imported = getBuffer(buffer);
+    if (imported == nullptr) {
+        return AIMAPPER_ERROR_BAD_BUFFER;
+    }
+    const SharedMetadata& m = *imported->metadata;
+    if (cpuUsage == 0 || (cpuUsage & ~(kCpuReadMask | kCpuWriteMask)) != 0 ||
+        ((cpuUsage & kCpuReadMask) != 0 && (m.usage & kCpuReadMask) == 0) ||
+        ((cpuUsage & kCpuWriteMask) != 0 && (m.usage & kCpuWriteMask) == 0)) {
+        return AIMAPPER_ERROR_BAD_VALUE;
+    }
+    const bool entireBuffer = accessRegion.left == 0 && accessRegion.top == 0 &&
+                              accessRegion.right == 0 && accessRegion.bottom == 0;
+    if (!entireBuffer &&
+        (accessRegion.left < 0 || accessRegion.top < 0 || accessRegion.left >= accessRegion.right ||
+         accessRegion.top >= accessRegion.bottom ||
+         static_cast<uint32_t>(accessRegion.right) > m.width ||
+         static_cast<uint32_t>(accessRegion.bottom) > m.height)) {
+        return AIMAPPER_ERROR_BAD_VALUE;
+    }
+    if (fence.ok() && sync_wait(fence.get(), -1) < 0) {
+        ALOGE("Failed to wait for the acquire fence: %s", strerror(errno));
+        return AIMAPPER_ERROR_NO_RESOURCES;
+    }
+
+    std::lock_guard<std::mutex> lock(imported->lockMutex);
+    if (imported->data == nullptr) {
+        void* data = mmap(nullptr, imported->dataSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                          imported->handle->data[0], imported->metadataSize);
+        if (data == MAP_FAILED) {
+            ALOGE("Failed to map buffer data: %s", strerror(errno));
+            return AIMAPPER_ERROR_NO_RESOURCES;
+        }
+        imported->data = static_cast<uint8_t*>(data);
+    }
+    if (imported->isDmaBuf) {
+        syncDmaBuf(imported->handle->data[0], DMA_BUF_SYNC_START | dmaBufSyncFlags(cpuUsage));
+    }
+    imported->lockCount++;
+    imported->lockUsage |= cpuUsage;
+    *outData = imported->data;
+    return AIMAPPER_ERROR_NONE;
+}
+
+AIMapper_Error ReferenceMapperV5::unlock(buffer_handle_t buffer, int* releaseFence) {
+    ImportedBuffer* imported = getBuffer(buffer);
+    if (imported == nullptr) {
+        return AIMAPPER_ERROR_BAD_BUFFER;
+    }
+    std::lock_guard<std::mutex> lock(imported->lockMutex);
+    if (imported->lockCount == 0) {
+        return AIMAPPER_ERROR_BAD_BUFFER;
+    }
+    if (--imported->lockCount == 0) {
+        if (imported->isDmaBuf) {
+            syncDmaBuf(imported->handle->data[0],
+                       DMA_BUF_SYNC_END | dmaBufSyncFlags(imported->lockUsage));
+        }
+        imported->lockUsage = 0;
+    }
+    // The mapping is kept for the next lock.
+    *releaseFence = -1;
+    return AIMAPPER_ERROR_NONE;
+}
+
+AIMapper_Error ReferenceMapperV5::flushLockedBuffer(buffer_handle_t buffer) {
+    ImportedBuffer* imported = getBuffer(buffer);
+    if (imported == nullptr) {
+        return AIMAPPER_ERROR_BAD_BUFFER;
+    }
+    std::lock_guard<std::mutex> lock(imported->lockMutex);
+    if (imported->lockCount == 0) {
+        return AIMAPPER_ERROR_BAD_BUFFER;
+    }
+    if (imported->isDmaBuf && (imported->lockUsage & kCpuWriteMask) != 0) {
+        syncDmaBuf(imported->handle->data[0], DMA_BUF_SYNC_END | DMA_BUF_SYNC_WRITE);
+        syncDmaBuf(imported->handle->data[0], DMA_BUF_SYNC_START | DMA_BUF_SYNC_WRITE);
+    }
+    return AIMAPPER_ERROR_NONE;
+}
+
+AIMapper_Error ReferenceMapperV5::rereadLockedBuffer(buffer_handle_t buffer) {
+    ImportedBuffer* imported = getBuffer(buffer);
+    if (imported == nullptr) {
+        return AIMAPPER_ERROR_BAD_BUFFER;
+    }
+    std::lock_guard<std::mutex> lock(imported->lockMutex);
+    if (imported->lockCount == 0) {
+        return AIMAPPER_ERROR_BAD_BUFFER;
+    }
+    if (imported->isDmaBuf && (imported->lockUsage & kCpuReadMask) != 0) {
+        syncDmaBuf(imported->handle->data[0], DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ);
+        syncDmaBuf(imported->handle->data[0], DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ);
+    }
+    return AIMAPPER_ERROR_NONE;
+}
+
+int32_t ReferenceMapperV5::getMetadata(buffer_handle_t buffer, AIMapper_MetadataType metadataType,
+                                       void* destBuffer, size_t destBufferSize) {
+    if (strcmp(metadataType.name, kStandardMetadataTypeName) != 0) {
+        return getBuffer(buffer) == nullptr ? -AIMAPPER_ERROR_BAD_BUFFER
+                                            : -AIMAPPER_ERROR_UNSUPPORTED;
+    }
+    return getStandardMetadata(buffer, metadataType.value, destBuffer, destBufferSize);
+}
+
+int32_t ReferenceMapperV5::getStandardMetadata(buffer_handle_t buffer,
+                                               int64_t standardMetadataType, void* destBuffer,
+                                               size_t destBufferSize) {
+    ImportedBuffer* imported = getBuffer(buffer);
+    if (imported == nullptr) {
+        return -AIMAPPER_ERROR_BAD_BUFFER;
+    }
+    return encodeStandardMetadata(*imported->metadata,
+                                  static_cast<StandardMetadataType>(standardMetadataType),
+                                  destBuffer, destBufferSize);
+}
+
+AIMapper_Error ReferenceMapperV5::setMetadata(buffer_handle_t buffer,
+                                              AIMapper_MetadataType metadataType,
+                                              const void* metadata, size_t metadataSize) {
+    if (strcmp(metadataType.name, kStandardMetadataTypeName) != 0) {
+        return getBuffer(buffer) == nullptr ? AIMAPPER_ERROR_BAD_BUFFER
+                                            : AIMAPPER_ERROR_UNSUPPORTED;
+    }
+    return setStandardMetadata(buffer, metadataType.value, metadata, metadataSize);
+}
+
+AIMapper_Error ReferenceMapperV5::setStandardMetadata(buffer_handle_t buffer,
+                                                      int64_t standardMetadataType,
+                                                      const void* metadata, size_t metadataSize) {
+    ImportedBuffer* imported = getBuffer(buffer);
+    if (imported == nullptr) {
+        return AIMAPPER_ERROR_BAD_BUFFER;
+    }
+    SharedMetadata& m = *imported->metadata;
+    return applyStandardMetadata(
+            static_cast<StandardMetadataType>(standardMetadataType), metadata, metadataSize,
+            [&]<StandardMetadataType T>(auto&& value) -> AIMapper_Error {
+                if constexpr (T == Type::DATASPACE) {
+                    m.dataspace = static_cast<int32_t>(value);
+                } else if constexpr (T == Type::BLEND_MODE) {
+                    m.blendMode = static_cast<int32_t>(value);
+                } else if constexpr (T == Type::CROP) {
+                    if (value.size() > kMaxPlanes) {
+                        return AIMAPPER_ERROR_BAD_VALUE;
+                    }
+                    for (size_t i = 0; i < value.size(); i++) {
+                        m.crops[i] = CropRect{
+                                .left = value[i].left,
+                                .top = value[i].top,
+                                .right = value[i].right,
+                                .bottom = value[i].bottom,
+                        };
+                    }
+                    m.cropCount = value.size();
+                } else if constexpr (T == Type::SMPTE2086) {
+                    if (value.has_value()) {
+                        const float v[] = {value->primaryRed.x,   value->primaryRed.y,
+                                           value->primaryGreen.x, value->primaryGreen.y,
+                                           value->primaryBlue.x,  value->primaryBlue.y,
+                                           value->whitePoint.x,   value->whitePoint.y,
+                                           value->maxLuminance,   value->minLuminance};
+                        memcpy(m.smpte2086, v, sizeof(v));
+                    }
+                    m.hasSmpte2086 = value.has_value();
+                } else if constexpr (T == Type::CTA861_3) {
+                    if (value.has_value()) {
+                        m.cta861_3[0] = value->maxContentLightLevel;
+                        m.cta861_3[1] = value->maxFrameAverageLightLevel;
+                    }
+                    m.hasCta861_3 = value.has_value();
+                } else if constexpr (T == Type::SMPTE2094_10) {
+                    return setBlob(value, m.smpte2094_10, &m.smpte2094_10Size);
+                } else if constexpr (T == Type::SMPTE2094_40) {
+                    return setBlob(value, m.smpte2094_40, &m.smpte2094_40Size);
+                } else if constexpr (T == Type::BUFFER_ID || T == Type::NAME || T == Type::WIDTH ||
+                                     T == Type::HEIGHT || T == Type::LAYER_COUNT ||
+                                     T == Type::PIXEL_FORMAT_REQUESTED || T == Type::USAGE) {
+                    return AIMAPPER_ERROR_BAD_VALUE;
+                } else {
+                    return AIMAPPER_ERROR_UNSUPPORTED;
+                }
+                return AIMAPPER_ERROR_NONE;
+            });
+}
+
+AIMapper_Error ReferenceMapperV5::listSupportedMetadataTypes(
+        const AIMapper_MetadataTypeDescription** outDescriptionList,
+        size_t* outNumberOfDescriptions) {
+    static const auto kDescriptions = [] {
+        std::array<AIMapper_MetadataTypeDescription, std::size(kSupportedMetadataTypes)> list{};
+        for (size_t i = 0; i < list.size(); i++) {
+            list[i].metadataType = {
+                    .name = kStandardMetadataTypeName,
+                    .value = static_cast<int64_t>(kSupportedMetadataTypes[i].first),
+            };
+            list[i].isGettable = true;
+            list[i].isSettable = kSupportedMetadataTypes[i].second;
+        }
+        return list;
+    }();
+    *outDescriptionList = kDescriptions.data();
+    *outNumberOfDescriptions = kDescriptions.size();
+    return AIMAPPER_ERROR_NONE;
+}
+
+AIMapper_Error ReferenceMapperV5::dumpBuffer(buffer_handle_t bufferHandle,
+                                             AIMapper_DumpBufferCallback dumpBufferCallback,
+                                             void* context) {
+    ImportedBuffer* imported = getBuffer(bufferHandle);
+    if (imported == nullptr) {
+        return AIMAPPER_ERROR_BAD_BUFFER;
+    }
+    dumpMetadata(*imported->metadata, dumpBufferCallback, context);
+    return AIMAPPER_ERROR_NONE;
+}
+
+AIMapper_Error ReferenceMapperV5::dumpAllBuffers(
+        AIMapper_BeginDumpBufferCallback beginDumpBufferCallback,
+        AIMapper_DumpBufferCallback dumpBufferCallback, void* context) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (const auto& [handle, buffer] : mBuffers) {
+        beginDumpBufferCallback(context);
+        dumpMetadata(*buffer->metadata, dumpBufferCallback, context);
+    }
+    return AIMAPPER_ERROR_NONE;
+}
+
+AIMapper_Error ReferenceMapperV5::getReservedRegion(buffer_handle_t buffer,
+                                                    void** outReservedRegion,
+                                                    uint64_t* outReservedSize) {
+    ImportedBuffer* imported = getBuffer(buffer);
+    if (imported == nullptr) {
+        return AIMAPPER_ERROR_BAD_BUFFER;
+    }
+    const uint64_t reservedSize = imported->metadata->reservedSize;
+    uint8_t* metadata = reinterpret_cast<uint8_t*>(imported->metadata);
+    *outReservedRegion = reservedSize > 0 ? metadata + kReservedRegionOffset : nullptr;
+    *outReservedSize = reservedSize;
+    return AIMAPPER_ERROR_NONE;
+}
+
+}  // namespace android::hardware::graphics::mapper::reference
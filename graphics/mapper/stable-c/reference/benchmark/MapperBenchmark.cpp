@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "benchmark/benchmark.h"
+
+#include <aidl/android/hardware/graphics/common/BufferUsage.h>
+#include <aidl/android/hardware/graphics/common/Dataspace.h>
+#include <aidl/android/hardware/graphics/common/PixelFormat.h>
+#include <android/hardware/graphics/mapper/IMapper.h>
+#include <android/hardware/graphics/mapper/utils/IMapperMetadataTypes.h>
+
+#include <unistd.h>
+
+#include <iterator>
+#include <vector>
+
+#include "mapper-reference/ReferenceAllocator.h"
+
+using ::aidl::android::hardware::graphics::common::BufferUsage;
+using ::aidl::android::hardware::graphics::common::Dataspace;
+using ::aidl::android::hardware::graphics::common::PixelFormat;
+using ::aidl::android::hardware::graphics::common::Smpte2086;
+using ::aidl::android::hardware::graphics::common::StandardMetadataType;
+using ::android::hardware::graphics::mapper::StandardMetadata;
+using ::android::hardware::graphics::mapper::reference::ReferenceAllocator;
+using ::benchmark::Fixture;
+using ::benchmark::State;
+
+extern "C" AIMapper_Error AIMapper_loadIMapper(AIMapper* _Nullable* _Nonnull outImplementation);
+
+// Each benchmark runs on a 1080p buffer of each of these formats.
+static const PixelFormat kFormats[] = {PixelFormat::RGBA_8888, PixelFormat::YCBCR_420_888};
+
+class MapperBench : public Fixture {
+  public:
+    void SetUp(State& state) override {
+        if (AIMapper_loadIMapper(&mMapper) != AIMAPPER_ERROR_NONE) {
+            state.SkipWithError("Failed to load the reference mapper");
+            return;
+        }
+        ReferenceAllocator::BufferDescriptorInfo descriptor;
+        descriptor.name = {'b', 'e', 'n', 'c', 'h'};
+        descriptor.width = 1920;
+        descriptor.height = 1080;
+        descriptor.layerCount = 1;
+        descriptor.format = kFormats[state.range(0)];
+        descriptor.usage = static_cast<BufferUsage>(
+                static_cast<int64_t>(BufferUsage::CPU_READ_OFTEN) |
+                static_cast<int64_t>(BufferUsage::CPU_WRITE_OFTEN) |
+                static_cast<int64_t>(BufferUsage::GPU_TEXTURE));
+        std::vector<native_handle_t*> handles;
+        int32_t stride;
+        if (!mAllocator.allocate(descriptor, 1, &handles, &stride).isOk()) {
+            state.SkipWithError("Failed to allocate a buffer");
+            return;
+        }
+        mRawHandle = handles[0];
+    }
+
+    void TearDown(State& /*state*/) override {
+        if (mRawHandle != nullptr) {
+            native_handle_close(mRawHandle);
+            native_handle_delete(mRawHandle);
+            mRawHandle = nullptr;
+        }
+    }
+
+    static void DefaultArgs(::benchmark::internal::Benchmark* b) {
+        b->ArgNames({"Format"});
+        for (size_t i = 0; i < std::size(kFormats); i++) {
+            b->Arg(i);
+        }
+    }
+
+  protected:
+    // Imports the buffer, for benchmarks of the imported buffer.
+    buffer_handle_t importOrSkip(State& state) {
+        buffer_handle_t buffer = nullptr;
+        if (mRawHandle == nullptr ||
+            mMapper->v5.importBuffer(mRawHandle, &buffer) != AIMAPPER_ERROR_NONE) {
+            state.SkipWithError("Failed to import the buffer");
+            return nullptr;
+        }
+        return buffer;
+    }
+
+    // Encodes a value of a standard metadata type, to set it.
+    template <StandardMetadataType T>
+    static std::vector<uint8_t> encode(const typename StandardMetadata<T>::value_type& value) {
+        std::vector<uint8_t> buffer(StandardMetadata<T>::value::encode(value, nullptr, 0));
+        StandardMetadata<T>::value::encode(value, buffer.data(), buffer.size());
+        return buffer;
+    }
+
+    ReferenceAllocator mAllocator;
+    AIMapper* mMapper = nullptr;
+    native_handle_t* mRawHandle = nullptr;
+};
+
+#define BENCHMARK_WRAPPER(fixt, test, code)                \
+    BENCHMARK_DEFINE_F(fixt, test)                         \
+    /* NOLINTNEXTLINE */                                   \
+    (State & state) {                                      \
+        if (mMapper == nullptr || mRawHandle == nullptr) { \
+            return;                                        \
+        }                                                  \
+                                                           \
+        code                                               \
+    }                                                      \
+    BENCHMARK_REGISTER_F(fixt, test)->Apply(fixt::DefaultArgs)
+
+BENCHMARK_WRAPPER(MapperBench, importFreeBuffer, {
+    for (auto _ : state) {
+        buffer_handle_t buffer;
+        if (mMapper->v5.importBuffer(mRawHandle, &buffer) != AIMAPPER_ERROR_NONE) {
+            state.SkipWithError("Failed to import the buffer");
+            return;
+        }
+        mMapper->v5.freeBuffer(buffer);
+    }
+});
+
+BENCHMARK_WRAPPER(MapperBench, lockUnlock, {
+    buffer_handle_t buffer = importOrSkip(state);
+    if (buffer == nullptr) {
+        return;
+    }
+    const uint64_t usage = static_cast<uint64_t>(BufferUsage::CPU_READ_OFTEN) |
+                           static_cast<uint64_t>(BufferUsage::CPU_WRITE_OFTEN);
+    for (auto _ : state) {
+        void* data;
+        int releaseFence;
+        if (mMapper->v5.lock(buffer, usage, ARect{}, -1, &data) != AIMAPPER_ERROR_NONE) {
+            state.SkipWithError("Failed to lock the buffer");
+            break;
+        }
+        ::benchmark::DoNotOptimize(data);
+        if (mMapper->v5.unlock(buffer, &releaseFence) != AIMAPPER_ERROR_NONE) {
+            state.SkipWithError("Failed to unlock the buffer");
+            break;
+        }
+        if (releaseFence >= 0) {
+            close(releaseFence);
+        }
+    }
+    mMapper->v5.freeBuffer(buffer);
+});
+
+BENCHMARK_WRAPPER(MapperBench, getStandardMetadata, {
+    buffer_handle_t buffer = importOrSkip(state);
+    if (buffer == nullptr) {
+        return;
+    }
+    const StandardMetadataType types[] = {StandardMetadataType::BUFFER_ID,
+                                          StandardMetadataType::DATASPACE,
+                                          StandardMetadataType::PLANE_LAYOUTS};
+    std::vector<uint8_t> dest(4096);
+    for (auto _ : state) {
+        for (StandardMetadataType type : types) {
+            int32_t size = mMapper->v5.getStandardMetadata(buffer, static_cast<int64_t>(type),
+                                                           dest.data(), dest.size());
+            if (size < 0 || static_cast<size_t>(size) > dest.size()) {
+                state.SkipWithError("Failed to get the metadata");
+                break;
+            }
+            ::benchmark::DoNotOptimize(size);
+        }
+        if (state.error_occurred()) {
+            break;
+        }
+    }
+    mMapper->v5.freeBuffer(buffer);
+});
+
+BENCHMARK_WRAPPER(MapperBench, setStandardMetadata, {
+    buffer_handle_t buffer = importOrSkip(state);
+    if (buffer == nullptr) {
+        return;
+    }
+    const std::vector<uint8_t> dataspace =
+            encode<StandardMetadataType::DATASPACE>(Dataspace::BT2020_ITU_PQ);
+    const std::vector<uint8_t> smpte2086 = encode<StandardMetadataType::SMPTE2086>(Smpte2086{
+            .primaryRed = {.x = 0.708f, .y = 0.292f},
+            .primaryGreen = {.x = 0.170f, .y = 0.797f},
+            .primaryBlue = {.x = 0.131f, .y = 0.046f},
+            .whitePoint = {.x = 0.3127f, .y = 0.3290f},
+            .maxLuminance = 1000.0f,
+            .minLuminance = 0.005f,
+    });
+    for (auto _ : state) {
+        if (mMapper->v5.setStandardMetadata(buffer,
+                                            static_cast<int64_t>(StandardMetadataType::DATASPACE),
+                                            dataspace.data(),
+                                            dataspace.size()) != AIMAPPER_ERROR_NONE ||
+            mMapper->v5.setStandardMetadata(buffer,
+                                            static_cast<int64_t>(StandardMetadataType::SMPTE2086),
+                                            smpte2086.data(),
+                                            smpte2086.size()) != AIMAPPER_ERROR_NONE) {
+            state.SkipWithError("Failed to set the metadata");
+            break;
+        }
+    }
+    mMapper->v5.freeBuffer(buffer);
+});
+
+// Gets and decodes the plane layouts, as clients do to find the planes of a locked buffer.
+BENCHMARK_WRAPPER(MapperBench, getPlaneLayouts, {
+    buffer_handle_t buffer = importOrSkip(state);
+    if (buffer == nullptr) {
+        return;
+    }
+    using PlaneLayouts = StandardMetadata<StandardMetadataType::PLANE_LAYOUTS>;
+    constexpr int64_t type = static_cast<int64_t>(StandardMetadataType::PLANE_LAYOUTS);
+    std::vector<uint8_t> dest;
+    for (auto _ : state) {
+        int32_t size = mMapper->v5.getStandardMetadata(buffer, type, nullptr, 0);
+        if (size <= 0) {
+            state.SkipWithError("Failed to get the plane layouts size");
+            break;
+        }
+        dest.resize(size);
+        if (mMapper->v5.getStandardMetadata(buffer, type, dest.data(), dest.size()) != size) {
+            state.SkipWithError("Failed to get the plane layouts");
+            break;
+        }
+        auto planeLayouts = PlaneLayouts::value::decode(dest.data(), dest.size());
+        if (!planeLayouts.has_value()) {
+            state.SkipWithError("Failed to decode the plane layouts");
+            break;
+        }
+        ::benchmark::DoNotOptimize(planeLayouts);
+    }
+    mMapper->v5.freeBuffer(buffer);
+});
+
+// Gets the metadata a compositor reads for every frame in one batch, reusing its scratch buffer.
+BENCHMARK_WRAPPER(MapperBench, getFrameMetadataBatch, {
+    buffer_handle_t buffer = importOrSkip(state);
+    if (buffer == nullptr) {
+        return;
+    }
+    std::vector<uint8_t> scratch;
+    for (auto _ : state) {
+        auto values = ::android::hardware::graphics::mapper::getStandardMetadataBatch<
+                StandardMetadataType::DATASPACE, StandardMetadataType::PLANE_LAYOUTS,
+                StandardMetadataType::CROP>(mMapper, buffer, scratch);
+        if (!values.has_value()) {
+            state.SkipWithError("Failed to get the frame metadata");
+            break;
+        }
+        ::benchmark::DoNotOptimize(values);
+    }
+    mMapper->v5.freeBuffer(buffer);
+});
+
+BENCHMARK_MAIN();
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/graphics/allocator/BufferDescriptorInfo.h>
+#include <android-base/unique_fd.h>
+#include <android/binder_auto_utils.h>
+#include <cutils/native_handle.h>
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace android::hardware::graphics::mapper::reference {
+
+/**
+ * The reference allocator, which allocates buffers in the layout of ReferenceBuffer.h for the
+ * reference mapper to import. It backs IAllocator, but is a plain class so that it can be used
+ * without binder, e.g. by benchmarks.
+ *
+ * This class is thread-safe.
+ */
+class ReferenceAllocator {
+  public:
+    using BufferDescriptorInfo =
+            ::aidl::android::hardware::graphics::allocator::BufferDescriptorInfo;
+
+    // Where the memory of buffers comes from.
+    enum class Backing {
+        // Anonymous shared memory, from memfd_create.
+        MEMFD,
+        // The system dma-buf heap, /dev/dma_heap/system.
+        DMA_HEAP,
+    };
+
+    explicit ReferenceAllocator(Backing backing = Backing::MEMFD);
+
+    ReferenceAllocator(const ReferenceAllocator&) = delete;
+    ReferenceAllocator& operator=(const ReferenceAllocator&) = delete;
+
+    /**
+     * Allocates buffers, as IAllocator::allocate2 does.
+     *
+     * @param descriptor The buffers to allocate.
+     * @param count The number of buffers to allocate.
+     * @param outHandles The handles of the buffers, which the caller owns and must free with
+     *     native_handle_close and native_handle_delete.
+     * @param outStride The stride of the buffers, in pixels.
+     * @return Status::ok on success
+     *         EX_SERVICE_SPECIFIC with AllocationError::UNSUPPORTED if the descriptor is valid but
+     *             not supported.
+     *         EX_SERVICE_SPECIFIC with AllocationError::BAD_DESCRIPTOR if the descriptor is
+     *             invalid.
+     *         EX_SERVICE_SPECIFIC with AllocationError::NO_RESOURCES if the memory cannot be
+     *             allocated.
+     */
+    ndk::ScopedAStatus allocate(const BufferDescriptorInfo& descriptor, int32_t count,
+                                std::vector<native_handle_t*>* outHandles, int32_t* outStride);
+
+    // Returns whether buffers of the descriptor can be allocated.
+    bool isSupported(const BufferDescriptorInfo& descriptor) const;
+
+  private:
+    // Allocates the memory of a buffer, returning an invalid fd on failure.
+    ::android::base::unique_fd allocateMemory(const char* name, size_t size);
+
+    const Backing mBacking;
+    // The fd of the dma-buf heap, when allocating from it.
+    ::android::base::unique_fd mHeapFd;
+    std::atomic<uint32_t> mNextBufferId = 0;
+};
+
+}  // namespace android::hardware::graphics::mapper::reference
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/graphics/common/PixelFormat.h>
+#include <cutils/native_handle.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+/**
+ * The layout of the buffers of the reference allocator and mapper, which share it.
+ *
+ * A buffer is a single shareable file, memfd or dma-buf. It starts with the metadata region,
+ * holding SharedMetadata followed by the reserved region, and the pixel data follows at the next
+ * page boundary. As every process that imports the buffer maps the same metadata region, metadata
+ * set in one process is seen by all of them.
+ */
+
+namespace android::hardware::graphics::mapper::reference {
+
+using ::aidl::android::hardware::graphics::common::PixelFormat;
+
+constexpr int32_t kHandleMagic = 0x52454642;  // "REFB"
+constexpr uint32_t kMetadataMagic = 0x5245464d;  // "REFM"
+
+constexpr size_t kMaxPlanes = 3;
+constexpr size_t kMaxPlaneComponents = 4;
+constexpr size_t kMaxNameLength = 128;
+// The most bytes of each of SMPTE2094_10 and SMPTE2094_40 a buffer holds.
+constexpr size_t kMaxDynamicMetadataSize = 4096;
+
+// Flags of BufferHandle.
+constexpr int32_t kHandleFlagDmaBuf = 1 << 0;
+
+/**
+ * A view of the handle of a buffer, as transported between processes: a native_handle_t holding
+ * the fd of the buffer, followed by the magic, the flags, the size of the metadata region and the
+ * size of the pixel data.
+ */
+class BufferHandle {
+  public:
+    static constexpr int kNumFds = 1;
+    static constexpr int kNumInts = 5;
+
+    // Returns a view of the handle, or nullopt if it is not the handle of a reference buffer.
+    static std::optional<BufferHandle> from(const native_handle_t* handle);
+
+    // Creates the handle of a buffer, which owns fd.
+    static native_handle_t* create(int fd, int32_t flags, size_t metadataSize, uint64_t dataSize);
+
+    int fd() const { return mHandle->data[0]; }
+    int32_t flags() const { return mHandle->data[kNumFds + 1]; }
+    // The size of the metadata region, which is a multiple of the page size.
+    size_t metadataSize() const { return static_cast<uint32_t>(mHandle->data[kNumFds + 2]); }
+    uint64_t dataSize() const {
+        return static_cast<uint32_t>(mHandle->data[kNumFds + 3]) |
+               (static_cast<uint64_t>(static_cast<uint32_t>(mHandle->data[kNumFds + 4])) << 32);
+    }
+
+  private:
+    explicit BufferHandle(const native_handle_t* handle) : mHandle(handle) {}
+
+    const native_handle_t* mHandle;
+};
+
+// A PlaneLayoutComponent, without the name of its type, which is always a PlaneLayoutComponentType.
+struct PlaneComponent {
+    int64_t type;
+    int64_t offsetInBits;
+    int64_t sizeInBits;
+};
+
+// A PlaneLayout, with its components inline.
+struct Plane {
+    uint32_t componentCount;
+    PlaneComponent components[kMaxPlaneComponents];
+    int64_t offsetInBytes;
+    int64_t sampleIncrementInBits;
+    int64_t strideInBytes;
+    int64_t widthInSamples;
+    int64_t heightInSamples;
+    int64_t totalSizeInBytes;
+    int64_t horizontalSubsampling;
+    int64_t verticalSubsampling;
+};
+
+struct CropRect {
+    int32_t left;
+    int32_t top;
+    int32_t right;
+    int32_t bottom;
+};
+
+/**
+ * The metadata of a buffer, laid out so that each StandardMetadataType can be encoded straight
+ * from it. Everything but the fields after "Settable" is fixed at allocation.
+ */
+struct SharedMetadata {
+    uint32_t magic;
+    uint32_t nameLength;
+    char name[kMaxNameLength];
+    uint64_t bufferId;
+    uint32_t width;
+    uint32_t height;
+    uint32_t layerCount;
+    int32_t pixelFormat;
+    uint32_t fourcc;
+    uint32_t stride;
+    uint64_t usage;
+    uint64_t allocationSize;
+    uint64_t reservedSize;
+    int64_t chromaSiting;
+    uint32_t planeCount;
+    Plane planes[kMaxPlanes];
+
+    // Settable
+    int32_t dataspace;
+    int32_t blendMode;
+    uint32_t cropCount;
+    CropRect crops[kMaxPlanes];
+    bool hasSmpte2086;
+    float smpte2086[10];
+    bool hasCta861_3;
+    float cta861_3[2];
+    // A size of 0 means the metadata is not set.
+    uint32_t smpte2094_10Size;
+    uint8_t smpte2094_10[kMaxDynamicMetadataSize];
+    uint32_t smpte2094_40Size;
+    uint8_t smpte2094_40[kMaxDynamicMetadataSize];
+};
+
+// The offset of the reserved region in the metadata region.
+constexpr size_t kReservedRegionOffset = (sizeof(SharedMetadata) + 7) & ~size_t(7);
+
+/**
+ * The layout of the pixel data of a buffer.
+ */
+struct BufferLayout {
+    uint32_t fourcc;
+    // The stride in pixels, as reported by the allocator and the STRIDE metadata.
+    uint32_t stride;
+    uint32_t planeCount;
+    Plane planes[kMaxPlanes];
+    // The size of each layer.
+    uint64_t layerSize;
+};
+
+/**
+ * Computes the layout of a layer of the pixel data of a buffer, or returns nullopt if the format
+ * or the dimensions are not supported. The layers of a buffer follow one another.
+ */
+std::optional<BufferLayout> computeLayout(PixelFormat format, uint32_t width, uint32_t height);
+
+// Rounds the size up to a multiple of the page size.
+size_t roundUpToPageSize(size_t size);
+
+}  // namespace android::hardware::graphics::mapper::reference
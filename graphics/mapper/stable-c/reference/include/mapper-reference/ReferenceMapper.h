@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android/hardware/graphics/mapper/IMapper.h>
+#include <android/hardware/graphics/mapper/utils/IMapperProvider.h>
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "mapper-reference/ReferenceBuffer.h"
+
+namespace android::hardware::graphics::mapper::reference {
+
+/**
+ * The reference IMapper, for buffers of the ReferenceAllocator.
+ *
+ * Importing a buffer maps its metadata region, which getStandardMetadata encodes from without
+ * intermediate copies. The pixel data is mapped by the first lock, and the mapping is kept until
+ * the buffer is freed, so that locking again only synchronizes the CPU caches of dma-bufs.
+ */
+class ReferenceMapperV5 final : public ::vendor::mapper::IMapperV5Impl {
+  public:
+    ReferenceMapperV5() = default;
+    ~ReferenceMapperV5() override;
+
+    AIMapper_Error importBuffer(const native_handle_t* _Nonnull handle,
+                                buffer_handle_t _Nullable* _Nonnull outBufferHandle) override;
+
+    AIMapper_Error freeBuffer(buffer_handle_t _Nonnull buffer) override;
+
+    AIMapper_Error getTransportSize(buffer_handle_t _Nonnull buffer, uint32_t* _Nonnull outNumFds,
+                                    uint32_t* _Nonnull outNumInts) override;
+
+    AIMapper_Error lock(buffer_handle_t _Nonnull buffer, uint64_t cpuUsage, ARect accessRegion,
+                        int acquireFence, void* _Nullable* _Nonnull outData) override;
+
+    AIMapper_Error unlock(buffer_handle_t _Nonnull buffer, int* _Nonnull releaseFence) override;
+
+    AIMapper_Error flushLockedBuffer(buffer_handle_t _Nonnull buffer) override;
+
+    AIMapper_Error rereadLockedBuffer(buffer_handle_t _Nonnull buffer) override;
+
+    int32_t getMetadata(buffer_handle_t _Nonnull buffer, AIMapper_MetadataType metadataType,
+                        void* _Nullable destBuffer, size_t destBufferSize) override;
+
+    int32_t getStandardMetadata(buffer_handle_t _Nonnull buffer, int64_t standardMetadataType,
+                                void* _Nullable destBuffer, size_t destBufferSize) override;
+
+    AIMapper_Error setMetadata(buffer_handle_t _Nonnull buffer, AIMapper_MetadataType metadataType,
+                               const void* _Nonnull metadata, size_t metadataSize) override;
+
+    AIMapper_Error setStandardMetadata(buffer_handle_t _Nonnull buffer,
+                                       int64_t standardMetadataType, const void* _Nonnull metadata,
+                                       size_t metadataSize) override;
+
+    AIMapper_Error listSupportedMetadataTypes(
+            const AIMapper_MetadataTypeDescription* _Nullable* _Nonnull outDescriptionList,
+            size_t* _Nonnull outNumberOfDescriptions) override;
+
+    AIMapper_Error dumpBuffer(buffer_handle_t _Nonnull bufferHandle,
+                              AIMapper_DumpBufferCallback _Nonnull dumpBufferCallback,
+                              void* _Null_unspecified context) override;
+
+    AIMapper_Error dumpAllBuffers(AIMapper_BeginDumpBufferCallback _Nonnull beginDumpBufferCallback,
+                                  AIMapper_DumpBufferCallback _Nonnull dumpBufferCallback,
+                                  void* _Null_unspecified context) override;
+
+    AIMapper_Error getReservedRegion(buffer_handle_t _Nonnull buffer,
+                                     void* _Nullable* _Nonnull outReservedRegion,
+                                     uint64_t* _Nonnull outReservedSize) override;
+
+  private:
+    struct ImportedBuffer {
+        // The imported clone of the handle, which is the buffer_handle_t of the buffer.
+        native_handle_t* handle;
+        bool isDmaBuf;
+        SharedMetadata* metadata;
+        size_t metadataSize;
+        uint64_t dataSize;
+
+        // Protects the lock state.
+        std::mutex lockMutex;
+        // The mapping of the pixel data, made by the first lock.
+        uint8_t* data = nullptr;
+        uint32_t lockCount = 0;
+        uint64_t lockUsage = 0;
+    };
+
+    // Returns the imported buffer, or nullptr if the handle is not one of an imported buffer.
+    ImportedBuffer* getBuffer(buffer_handle_t buffer);
+
+    static void release(ImportedBuffer* buffer);
+
+    std::mutex mMutex;
+    std::unordered_map<buffer_handle_t, std::unique_ptr<ImportedBuffer>> mBuffers;
+};
+
+}  // namespace android::hardware::graphics::mapper::reference
@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <aidl/android/hardware/graphics/common/BufferUsage.h>
+#include <aidl/android/hardware/graphics/common/Dataspace.h>
+#include <aidl/android/hardware/graphics/common/PixelFormat.h>
+#include <android/hardware/graphics/mapper/IMapper.h>
+#include <android/hardware/graphics/mapper/utils/IMapperMetadataTypes.h>
+
+#include <unistd.h>
+
+#include <vector>
+
+#include "mapper-reference/ReferenceAllocator.h"
+
+using namespace ::aidl::android::hardware::graphics::common;
+using namespace ::android::hardware::graphics::mapper;
+using ::android::hardware::graphics::mapper::reference::ReferenceAllocator;
+
+extern "C" AIMapper_Error AIMapper_loadIMapper(AIMapper* _Nullable* _Nonnull outImplementation);
+
+namespace {
+
+// Odd sizes, so that the chroma planes round their half resolution up.
+constexpr uint32_t kWidth = 641;
+constexpr uint32_t kHeight = 481;
+
+struct FormatInfo {
+    PixelFormat format;
+    size_t planeCount;
+};
+
+const FormatInfo kFormats[] = {
+        {PixelFormat::RGBA_8888, 1},
+        {PixelFormat::YCBCR_420_888, 2},
+        {PixelFormat::YV12, 3},
+};
+
+class ReferenceMapperTest : public ::testing::TestWithParam<FormatInfo> {
+  public:
+    void SetUp() override {
+        ASSERT_EQ(AIMAPPER_ERROR_NONE, AIMapper_loadIMapper(&mMapper));
+        ReferenceAllocator::BufferDescriptorInfo descriptor;
+        descriptor.name = {'t', 'e', 's', 't'};
+        descriptor.width = kWidth;
+        descriptor.height = kHeight;
+        descriptor.layerCount = 1;
+        descriptor.format = GetParam().format;
+        descriptor.usage = static_cast<BufferUsage>(
+                static_cast<int64_t>(BufferUsage::CPU_READ_OFTEN) |
+                static_cast<int64_t>(BufferUsage::CPU_WRITE_OFTEN));
+        std::vector<native_handle_t*> handles;
+        ASSERT_TRUE(mAllocator.allocate(descriptor, 1, &handles, &mStride).isOk());
+        ASSERT_EQ(1u, handles.size());
+        mRawHandle = handles[0];
+    }
+
+    void TearDown() override {
+        for (buffer_handle_t buffer : mImported) {
+            EXPECT_EQ(AIMAPPER_ERROR_NONE, mMapper->v5.freeBuffer(buffer));
+        }
+        if (mRawHandle != nullptr) {
+            native_handle_close(mRawHandle);
+            native_handle_delete(mRawHandle);
+        }
+    }
+
+  protected:
+    // Imports the buffer, which is freed at the end of the test.
+    buffer_handle_t import() {
+        buffer_handle_t buffer = nullptr;
+        EXPECT_EQ(AIMAPPER_ERROR_NONE, mMapper->v5.importBuffer(mRawHandle, &buffer));
+        if (buffer != nullptr) {
+            mImported.push_back(buffer);
+        }
+        return buffer;
+    }
+
+    template <StandardMetadataType T>
+    AIMapper_Error set(buffer_handle_t buffer,
+                       const typename StandardMetadata<T>::value_type& value) {
+        std::vector<uint8_t> encoded(StandardMetadata<T>::value::encode(value, nullptr, 0));
+        StandardMetadata<T>::value::encode(value, encoded.data(), encoded.size());
+        return mMapper->v5.setStandardMetadata(buffer, static_cast<int64_t>(T), encoded.data(),
+                                               encoded.size());
+    }
+
+    template <StandardMetadataType T>
+    std::optional<typename StandardMetadata<T>::value_type> get(buffer_handle_t buffer) {
+        return getStandardMetadata<T>(mMapper, buffer, mScratch);
+    }
+
+    ReferenceAllocator mAllocator;
+    AIMapper* mMapper = nullptr;
+    native_handle_t* mRawHandle = nullptr;
+    int32_t mStride = 0;
+    std::vector<buffer_handle_t> mImported;
+    std::vector<uint8_t> mScratch;
+};
+
+TEST_P(ReferenceMapperTest, PlaneLayouts) {
+    buffer_handle_t buffer = import();
+    ASSERT_NE(nullptr, buffer);
+
+    EXPECT_EQ(kWidth, get<StandardMetadataType::WIDTH>(buffer));
+    EXPECT_EQ(kHeight, get<StandardMetadataType::HEIGHT>(buffer));
+    EXPECT_EQ(static_cast<uint32_t>(mStride), get<StandardMetadataType::STRIDE>(buffer));
+    auto allocationSize = get<StandardMetadataType::ALLOCATION_SIZE>(buffer);
+    ASSERT_TRUE(allocationSize.has_value());
+
+    auto planeLayouts = get<StandardMetadataType::PLANE_LAYOUTS>(buffer);
+    ASSERT_TRUE(planeLayouts.has_value());
+    ASSERT_EQ(GetParam().planeCount, planeLayouts->size());
+    int64_t end = 0;
+    for (size_t i = 0; i < planeLayouts->size(); i++) {
+        SCOPED_TRACE(testing::Message() << "plane " << i);
+        const PlaneLayout& plane = (*planeLayouts)[i];
+        const int64_t subsampling = i == 0 ? 1 : 2;
+        EXPECT_FALSE(plane.components.empty());
+        EXPECT_EQ(subsampling, plane.horizontalSubsampling);
+        EXPECT_EQ(subsampling, plane.verticalSubsampling);
+        EXPECT_EQ((kWidth + subsampling - 1) / subsampling, plane.widthInSamples);
+        EXPECT_EQ((kHeight + subsampling - 1) / subsampling, plane.heightInSamples);
+        EXPECT_GE(plane.strideInBytes * 8, plane.widthInSamples * plane.sampleIncrementInBits);
+        EXPECT_EQ(plane.strideInBytes * plane.heightInSamples, plane.totalSizeInBytes);
+        // The planes follow one another without overlapping.
+        EXPECT_GE(plane.offsetInBytes, end);
+        end = plane.offsetInBytes + plane.totalSizeInBytes;
+    }
+    EXPECT_LE(static_cast<uint64_t>(end), *allocationSize);
+}
+
+TEST_P(ReferenceMapperTest, MetadataRoundTrip) {
+    buffer_handle_t buffer = import();
+    ASSERT_NE(nullptr, buffer);
+
+    ASSERT_EQ(AIMAPPER_ERROR_NONE,
+              set<StandardMetadataType::DATASPACE>(buffer, Dataspace::DISPLAY_P3));
+    EXPECT_EQ(Dataspace::DISPLAY_P3, get<StandardMetadataType::DATASPACE>(buffer));
+
+    const Smpte2086 smpte2086 = {
+            .primaryRed = {.x = 0.680f, .y = 0.320f},
+            .primaryGreen = {.x = 0.265f, .y = 0.690f},
+            .primaryBlue = {.x = 0.150f, .y = 0.060f},
+            .whitePoint = {.x = 0.3127f, .y = 0.3290f},
+            .maxLuminance = 1000.0f,
+            .minLuminance = 0.005f,
+    };
+    ASSERT_EQ(AIMAPPER_ERROR_NONE, set<StandardMetadataType::SMPTE2086>(buffer, smpte2086));
+    auto gotSmpte2086 = get<StandardMetadataType::SMPTE2086>(buffer);
+    ASSERT_TRUE(gotSmpte2086.has_value());
+    EXPECT_EQ(smpte2086, *gotSmpte2086);
+    ASSERT_EQ(AIMAPPER_ERROR_NONE, set<StandardMetadataType::SMPTE2086>(buffer, std::nullopt));
+    gotSmpte2086 = get<StandardMetadataType::SMPTE2086>(buffer);
+    ASSERT_TRUE(gotSmpte2086.has_value());
+    EXPECT_FALSE(gotSmpte2086->has_value());
+
+    const std::vector<Rect> crop = {{.left = 1, .top = 2, .right = 300, .bottom = 200}};
+    ASSERT_EQ(AIMAPPER_ERROR_NONE, set<StandardMetadataType::CROP>(buffer, crop));
+    EXPECT_EQ(crop, get<StandardMetadataType::CROP>(buffer));
+
+    // The properties the allocator fixed cannot be changed.
+    EXPECT_EQ(AIMAPPER_ERROR_BAD_VALUE, set<StandardMetadataType::WIDTH>(buffer, 1));
+}
+
+TEST_P(ReferenceMapperTest, MetadataSharedBetweenImports) {
+    buffer_handle_t first = import();
+    buffer_handle_t second = import();
+    ASSERT_NE(nullptr, first);
+    ASSERT_NE(nullptr, second);
+    ASSERT_NE(first, second);
+
+    EXPECT_EQ(get<StandardMetadataType::BUFFER_ID>(first),
+              get<StandardMetadataType::BUFFER_ID>(second));
+    ASSERT_EQ(AIMAPPER_ERROR_NONE, set<StandardMetadataType::DATASPACE>(first, Dataspace::BT2020));
+    EXPECT_EQ(Dataspace::BT2020, get<StandardMetadataType::DATASPACE>(second));
+    ASSERT_EQ(AIMAPPER_ERROR_NONE,
+              set<StandardMetadataType::BLEND_MODE>(second, BlendMode::COVERAGE));
+    EXPECT_EQ(BlendMode::COVERAGE, get<StandardMetadataType::BLEND_MODE>(first));
+}
+
+TEST_P(ReferenceMapperTest, LockUnlock) {
+    buffer_handle_t buffer = import();
+    ASSERT_NE(nullptr, buffer);
+
+    const uint64_t usage = static_cast<uint64_t>(BufferUsage::CPU_READ_OFTEN) |
+                           static_cast<uint64_t>(BufferUsage::CPU_WRITE_OFTEN);
+    void* data = nullptr;
+    ASSERT_EQ(AIMAPPER_ERROR_NONE, mMapper->v5.lock(buffer, usage, ARect{}, -1, &data));
+    ASSERT_NE(nullptr, data);
+    // Writes through one lock are visible to the next.
+    static_cast<uint8_t*>(data)[0] = 0xA5;
+    int releaseFence = -1;
+    ASSERT_EQ(AIMAPPER_ERROR_NONE, mMapper->v5.unlock(buffer, &releaseFence));
+    if (releaseFence >= 0) {
+        close(releaseFence);
+    }
+
+    ASSERT_EQ(AIMAPPER_ERROR_NONE, mMapper->v5.lock(buffer, usage, ARect{}, -1, &data));
+    EXPECT_EQ(0xA5, static_cast<uint8_t*>(data)[0]);
+    ASSERT_EQ(AIMAPPER_ERROR_NONE, mMapper->v5.unlock(buffer, &releaseFence));
+    if (releaseFence >= 0) {
+        close(releaseFence);
+    }
+
+    // A buffer that is not locked cannot be unlocked.
+    EXPECT_EQ(AIMAPPER_ERROR_BAD_BUFFER, mMapper->v5.unlock(buffer, &releaseFence));
+}
+
+INSTANTIATE_TEST_SUITE_P(Formats, ReferenceMapperTest, ::testing::ValuesIn(kFormats),
+                         [](const testing::TestParamInfo<FormatInfo>& info) {
+                             return toString(info.param.format);
+                         });
+
+}  // namespace
@@ -210,10 +210,13 @@ BufferPoolStatus Accessor::allocate(
         lock.unlock();
         std::shared_ptr<BufferPoolAllocation> alloc;
         size_t allocSize;
+        nsecs_t allocStartNs = systemTime();
         status = mAllocator->allocate(params, &alloc, &allocSize);
+        nsecs_t allocNs = systemTime() - allocStartNs;
         lock.lock();
         if (status == ResultStatus::OK) {
-            status = mBufferPool.addNewBuffer(alloc, allocSize, params, bufferId, handle);
+            status = mBufferPool.addNewBuffer(
+                    alloc, allocSize, params, allocNs, bufferId, handle);
         }
         ALOGV("create a buffer %d : %u %p",
               status == ResultStatus::OK, *bufferId, *handle);
@@ -222,28 +225,53 @@ BufferPoolStatus Accessor::allocate(
         // TODO: handle ownBuffer failure
         mBufferPool.handleOwnBuffer(connectionId, *bufferId);
     }
+    bool prefetch = mBufferPool.needsPrefetch(params);
     mBufferPool.cleanUp();
     scheduleEvictIfNeeded();
+    lock.unlock();
+    if (prefetch && sPrefetcher) {
+        sPrefetcher->addAccessor(ref<Accessor>());
+    }
     return status;
 }
 
+void Accessor::prefetch() {
+    std::vector<uint8_t> params;
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mBufferPool.mMutex);
+            mBufferPool.processStatusMessages();
+            if (!mBufferPool.getPrefetchParams(&params)) {
+                return;
+            }
+        }
+        // Allocate without the lock, as allocate() does.
+        std::shared_ptr<BufferPoolAllocation> alloc;
+        size_t allocSize;
+        if (mAllocator->allocate(params, &alloc, &allocSize) != ResultStatus::OK) {
+            ALOGD("bufferpool2 %p prefetch failed", this);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mBufferPool.mMutex);
+        mBufferPool.addPrefetchedBuffer(alloc, allocSize, params);
+    }
+}
+
 BufferPoolStatus Accessor::fetch(
         ConnectionId connectionId, TransactionId transactionId,
         BufferId bufferId, const native_handle_t** handle) {
     std::lock_guard<std::mutex> lock(mBufferPool.mMutex);
     mBufferPool.processStatusMessages();
-    auto found = mBufferPool.mTransactions.find(transactionId);
-    if (found != mBufferPool.mTransactions.end() &&
-            contains(&mBufferPool.mPendingTransactions,
-                     connectionId, transactionId)) {
-        if (found->second->mSenderValidated &&
-                found->second->mStatus == BufferStatus::TRANSFER_FROM &&
-                found->second->mBufferId == bufferId) {
-            found->second->mStatus = BufferStatus::TRANSFER_FETCH;
-            auto bufferIt = mBufferPool.mBuffers.find(bufferId);
-            if (bufferIt != mBufferPool.mBuffers.end()) {
+    TransactionStatus *found = mBufferPool.mTransactions.find(transactionId);
+    if (found != nullptr && found->mReceiver == connectionId) {
+        if (found->mSenderValidated &&
+                found->mStatus == BufferStatus::TRANSFER_FROM &&
+                found->mBufferId == bufferId) {
+            found->mStatus = BufferStatus::TRANSFER_FETCH;
+            std::unique_ptr<InternalBuffer> *buffer = mBufferPool.mBuffers.find(bufferId);
+            if (buffer != nullptr) {
                 mBufferPool.mStats.onBufferFetched();
-                *handle = bufferIt->second->handle();
+                *handle = (*buffer)->handle();
                 return ResultStatus::OK;
             }
         }
@@ -513,6 +541,55 @@ void Accessor::createEvictor() {
     }
 }
 
+void Accessor::prefetcherThread(
+        std::set<std::weak_ptr<Accessor>, std::owner_less<>> &accessors,
+        std::mutex &mutex,
+        std::condition_variable &cv) {
+    std::set<std::weak_ptr<Accessor>, std::owner_less<>> prefetchList;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (accessors.size() == 0) {
+                cv.wait(lock);
+            }
+            prefetchList.swap(accessors);
+        }
+        for (auto it = prefetchList.begin(); it != prefetchList.end(); ++it) {
+            const std::shared_ptr<Accessor> accessor = it->lock();
+            if (accessor) {
+                accessor->prefetch();
+            }
+        }
+        prefetchList.clear();
+    }
+}
+
+Accessor::AccessorPrefetcher::AccessorPrefetcher() {
+    std::thread prefetcher(
+            prefetcherThread,
+            std::ref(mAccessors),
+            std::ref(mMutex),
+            std::ref(mCv));
+    prefetcher.detach();
+}
+
+void Accessor::AccessorPrefetcher::addAccessor(const std::weak_ptr<Accessor> &accessor) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    bool notify = mAccessors.empty();
+    mAccessors.insert(accessor);
+    if (notify) {
+        mCv.notify_one();
+    }
+}
+
+std::unique_ptr<Accessor::AccessorPrefetcher> Accessor::sPrefetcher;
+
+void Accessor::createPrefetcher() {
+    if (!sPrefetcher) {
+        sPrefetcher = std::make_unique<Accessor::AccessorPrefetcher>();
+    }
+}
+
 void Accessor::scheduleEvictIfNeeded() {
     nsecs_t now = systemTime();
 
@@ -186,6 +186,8 @@ struct Accessor : public BnAccessor {
 
     static void createEvictor();
 
+    static void createPrefetcher();
+
 private:
     // ConnectionId = pid : (timestamp_created + seqId)
     // in order to guarantee uniqueness for each connection
@@ -239,6 +241,30 @@ private:
 
     void scheduleEvictIfNeeded();
 
+    /**
+     * Allocates buffers in the background for the recently requested allocation
+     * parameters running low on free buffers, so that allocate() recycles them
+     * instead of allocating on the caller's thread.
+     */
+    struct AccessorPrefetcher {
+        std::set<std::weak_ptr<Accessor>, std::owner_less<>> mAccessors;
+        std::mutex mMutex;
+        std::condition_variable mCv;
+
+        AccessorPrefetcher();
+        void addAccessor(const std::weak_ptr<Accessor> &accessor);
+    };
+
+    static std::unique_ptr<AccessorPrefetcher> sPrefetcher;
+
+    static void prefetcherThread(
+        std::set<std::weak_ptr<Accessor>, std::owner_less<>> &accessors,
+        std::mutex &mutex,
+        std::condition_variable &cv);
+
+    /** Prefetches buffers until the pool reaches the prefetch target. */
+    void prefetch();
+
     friend struct BufferPool;
 };
 
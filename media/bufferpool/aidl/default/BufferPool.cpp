@@ -22,6 +22,7 @@
 #include <time.h>
 #include <unistd.h>
 #include <utils/Log.h>
+#include <algorithm>
 #include <thread>
 #include "Accessor.h"
 #include "BufferPool.h"
@@ -38,6 +39,21 @@ namespace {
     static constexpr size_t kMinBufferCountForEviction = 25;
     static constexpr size_t kMaxUnusedBufferCount = 64;
     static constexpr size_t kUnusedBufferCountTarget = kMaxUnusedBufferCount - 16;
+
+    // Free buffers are prefetched for the allocation parameters requested within
+    // kPrefetchActiveMs, up to kPrefetchBufferCount once below kPrefetchLowWatermark.
+    static constexpr int64_t kPrefetchActiveMs = 1000; // 1 sec
+    static constexpr size_t kPrefetchBufferCount = 4;
+    static constexpr size_t kPrefetchLowWatermark = 2;
+
+    size_t hashConfig(const std::vector<uint8_t> &config) {
+        // FNV-1a
+        size_t hash = 14695981039346656037ULL;
+        for (uint8_t byte : config) {
+            hash = (hash ^ byte) * 1099511628211ULL;
+        }
+        return hash;
+    }
 }
 
 BufferPool::BufferPool()
@@ -62,11 +78,13 @@ BufferPool::~BufferPool() {
     std::lock_guard<std::mutex> lock(mMutex);
     ALOGD("Destruction - bufferpool2 %p "
           "cached: %zu/%zuM, %zu/%d%% in use; "
-          "allocs: %zu, %d%% recycled; "
+          "allocs: %zu, %d%% recycled, %zu prefetched, %lld/%lld us avg/max alloc; "
           "transfers: %zu, %d%% unfetched",
           this, mStats.mBuffersCached, mStats.mSizeCached >> 20,
           mStats.mBuffersInUse, percentage(mStats.mBuffersInUse, mStats.mBuffersCached),
           mStats.mTotalAllocations, percentage(mStats.mTotalRecycles, mStats.mTotalAllocations),
+          mStats.mTotalPrefetches, (long long)mStats.averageAllocNs() / 1000,
+          (long long)mStats.mMaxAllocNs / 1000,
           mStats.mTotalTransfers,
           percentage(mStats.mTotalTransfers - mStats.mTotalFetches, mStats.mTotalTransfers));
 }
@@ -176,126 +194,147 @@ void BufferPool::Invalidation::onHandleAck(
     }
 }
 
-bool BufferPool::handleOwnBuffer(
-        ConnectionId connectionId, BufferId bufferId) {
+BufferPool::FreeBuffers::Group *BufferPool::FreeBuffers::find(
+        const std::vector<uint8_t> &config, size_t hash) {
+    for (Group &group : mGroups) {
+        if (group.mHash == hash && group.mConfig == config) {
+            return &group;
+        }
+    }
+    return nullptr;
+}
+
+BufferPool::FreeBuffers::Group *BufferPool::FreeBuffers::get(
+        const std::vector<uint8_t> &config, size_t hash, int64_t timestampMs) {
+    Group *group = find(config, hash);
+    if (group == nullptr) {
+        // Drop the groups of parameters no longer in use.
+        mGroups.erase(std::remove_if(mGroups.begin(), mGroups.end(),
+                                     [timestampMs](const Group &g) {
+                                         return g.mIds.empty() &&
+                                                 timestampMs > g.mLastRequestMs +
+                                                         kPrefetchActiveMs;
+                                     }),
+                      mGroups.end());
+        mGroups.push_back(Group{hash, config, {}, 0, 0});
+        group = &mGroups.back();
+    }
+    return group;
+}
+
+void BufferPool::FreeBuffers::add(const InternalBuffer &buffer, int64_t timestampMs) {
+    Group *group = get(buffer.mConfig, hashConfig(buffer.mConfig), timestampMs);
+    group->mIds.push_back(buffer.mId);
+    group->mAllocSize = buffer.mAllocSize;
+    ++mSize;
+}
+
+void BufferPool::onBufferUnused(BufferId bufferId, InternalBuffer *buffer) {
+    mStats.onBufferUnused(buffer->mAllocSize);
+    if (!buffer->mInvalidated) {
+        mFreeBuffers.add(*buffer, mTimestampMs);
+    } else {
+        mStats.onBufferEvicted(buffer->mAllocSize);
+        mBuffers.erase(bufferId);
+        mInvalidation.onBufferInvalidated(bufferId, mInvalidationChannel);
+    }
+}
 
-    bool added = insert(&mUsingBuffers, connectionId, bufferId);
-    if (added) {
-        auto iter = mBuffers.find(bufferId);
-        iter->second->mOwnerCount++;
+void BufferPool::evictBuffer(BufferId bufferId) {
+    std::unique_ptr<InternalBuffer> *buffer = mBuffers.find(bufferId);
+    if (buffer != nullptr && (*buffer)->isUnused()) {
+        mStats.onBufferEvicted((*buffer)->mAllocSize);
+        mBuffers.erase(bufferId);
+    } else {
+        ALOGW("bufferpool2 inconsistent!");
     }
-    insert(&mUsingConnections, bufferId, connectionId);
-    return added;
+}
+
+bool BufferPool::handleOwnBuffer(
+        ConnectionId connectionId, BufferId bufferId) {
+    std::unique_ptr<InternalBuffer> *buffer = mBuffers.find(bufferId);
+    return buffer != nullptr && (*buffer)->mOwners.insert(connectionId);
 }
 
 bool BufferPool::handleReleaseBuffer(
         ConnectionId connectionId, BufferId bufferId) {
-    bool deleted = erase(&mUsingBuffers, connectionId, bufferId);
-    if (deleted) {
-        auto iter = mBuffers.find(bufferId);
-        iter->second->mOwnerCount--;
-        if (iter->second->mOwnerCount == 0 &&
-                iter->second->mTransactionCount == 0) {
-            if (!iter->second->mInvalidated) {
-                mStats.onBufferUnused(iter->second->mAllocSize);
-                mFreeBuffers.insert(bufferId);
-            } else {
-                mStats.onBufferUnused(iter->second->mAllocSize);
-                mStats.onBufferEvicted(iter->second->mAllocSize);
-                mBuffers.erase(iter);
-                mInvalidation.onBufferInvalidated(bufferId, mInvalidationChannel);
-            }
-        }
+    std::unique_ptr<InternalBuffer> *buffer = mBuffers.find(bufferId);
+    bool deleted = buffer != nullptr && (*buffer)->mOwners.erase(connectionId);
+    if (deleted && (*buffer)->isUnused()) {
+        onBufferUnused(bufferId, buffer->get());
     }
-    erase(&mUsingConnections, bufferId, connectionId);
     ALOGV("release buffer %u : %d", bufferId, deleted);
     return deleted;
 }
 
 bool BufferPool::handleTransferTo(const BufferStatusMessage &message) {
-    auto completed = mCompletedTransactions.find(
-            message.transactionId);
-    if (completed != mCompletedTransactions.end()) {
+    if (mCompletedTransactions.erase(message.transactionId)) {
         // already completed
-        mCompletedTransactions.erase(completed);
         return true;
     }
     // the buffer should exist and be owned.
-    auto bufferIter = mBuffers.find(message.bufferId);
-    if (bufferIter == mBuffers.end() ||
-            !contains(&mUsingBuffers, message.connectionId, FromAidl(message.bufferId))) {
+    std::unique_ptr<InternalBuffer> *buffer = mBuffers.find(message.bufferId);
+    if (buffer == nullptr || !(*buffer)->mOwners.contains(message.connectionId)) {
         return false;
     }
-    auto found = mTransactions.find(message.transactionId);
-    if (found != mTransactions.end()) {
+    TransactionStatus *found = mTransactions.find(message.transactionId);
+    if (found != nullptr) {
         // transfer_from was received earlier.
-        found->second->mSender = message.connectionId;
-        found->second->mSenderValidated = true;
+        found->mSender = message.connectionId;
+        found->mSenderValidated = true;
         return true;
     }
-    if (mConnectionIds.find(message.targetConnectionId) == mConnectionIds.end()) {
+    if (!mConnectionIds.contains(message.targetConnectionId)) {
         // N.B: it could be fake or receive connection already closed.
         ALOGD("bufferpool2 %p receiver connection %lld is no longer valid",
               this, (long long)message.targetConnectionId);
         return false;
     }
     mStats.onBufferSent();
-    mTransactions.insert(std::make_pair(
-            message.transactionId,
-            std::make_unique<TransactionStatus>(message, mTimestampMs)));
-    insert(&mPendingTransactions, message.targetConnectionId,
-           FromAidl(message.transactionId));
-    bufferIter->second->mTransactionCount++;
+    mTransactions.insert(message.transactionId, TransactionStatus(message, mTimestampMs));
+    (*buffer)->mTransactionCount++;
     return true;
 }
 
 bool BufferPool::handleTransferFrom(const BufferStatusMessage &message) {
-    auto found = mTransactions.find(message.transactionId);
-    if (found == mTransactions.end()) {
+    TransactionStatus *found = mTransactions.find(message.transactionId);
+    if (found == nullptr) {
         // TODO: is it feasible to check ownership here?
+        std::unique_ptr<InternalBuffer> *buffer = mBuffers.find(message.bufferId);
+        if (buffer == nullptr) {
+            return false;
+        }
         mStats.onBufferSent();
-        mTransactions.insert(std::make_pair(
-                message.transactionId,
-                std::make_unique<TransactionStatus>(message, mTimestampMs)));
-        insert(&mPendingTransactions, message.connectionId,
-               FromAidl(message.transactionId));
-        auto bufferIter = mBuffers.find(message.bufferId);
-        bufferIter->second->mTransactionCount++;
+        mTransactions.insert(message.transactionId, TransactionStatus(message, mTimestampMs));
+        (*buffer)->mTransactionCount++;
     } else {
-        if (message.connectionId == found->second->mReceiver) {
-            found->second->mStatus = BufferStatus::TRANSFER_FROM;
+        if (message.connectionId == found->mReceiver) {
+            found->mStatus = BufferStatus::TRANSFER_FROM;
         }
     }
     return true;
 }
 
 bool BufferPool::handleTransferResult(const BufferStatusMessage &message) {
-    auto found = mTransactions.find(message.transactionId);
-    if (found != mTransactions.end()) {
-        bool deleted = erase(&mPendingTransactions, message.connectionId,
-                             FromAidl(message.transactionId));
+    TransactionStatus *found = mTransactions.find(message.transactionId);
+    if (found != nullptr) {
+        // Only the receiver finishes a transaction.
+        bool deleted = message.connectionId == found->mReceiver;
         if (deleted) {
-            if (!found->second->mSenderValidated) {
+            if (!found->mSenderValidated) {
                 mCompletedTransactions.insert(message.transactionId);
             }
-            auto bufferIter = mBuffers.find(message.bufferId);
+            mTransactions.erase(message.transactionId);
             if (message.status == BufferStatus::TRANSFER_OK) {
                 handleOwnBuffer(message.connectionId, message.bufferId);
             }
-            bufferIter->second->mTransactionCount--;
-            if (bufferIter->second->mOwnerCount == 0
-                && bufferIter->second->mTransactionCount == 0) {
-                if (!bufferIter->second->mInvalidated) {
-                    mStats.onBufferUnused(bufferIter->second->mAllocSize);
-                    mFreeBuffers.insert(message.bufferId);
-                } else {
-                    mStats.onBufferUnused(bufferIter->second->mAllocSize);
-                    mStats.onBufferEvicted(bufferIter->second->mAllocSize);
-                    mBuffers.erase(bufferIter);
-                    mInvalidation.onBufferInvalidated(message.bufferId, mInvalidationChannel);
+            std::unique_ptr<InternalBuffer> *buffer = mBuffers.find(message.bufferId);
+            if (buffer != nullptr) {
+                (*buffer)->mTransactionCount--;
+                if ((*buffer)->isUnused()) {
+                    onBufferUnused(message.bufferId, buffer->get());
                 }
             }
-            mTransactions.erase(found);
         }
         ALOGV("transfer finished %llu %u - %d", (unsigned long long)message.transactionId,
               message.bufferId, deleted);
@@ -307,10 +346,9 @@ bool BufferPool::handleTransferResult(const BufferStatusMessage &message) {
 }
 
 void BufferPool::processStatusMessages() {
-    std::vector<BufferStatusMessage> messages;
-    mObserver.getBufferStatusChanges(messages);
+    mObserver.getBufferStatusChanges(mMessages);
     mTimestampMs = ::android::elapsedRealtime();
-    for (BufferStatusMessage& message: messages) {
+    for (BufferStatusMessage& message: mMessages) {
         bool ret = false;
         switch (message.status) {
             case BufferStatus::NOT_USED:
@@ -349,65 +387,44 @@ void BufferPool::processStatusMessages() {
                   message.status, (long long)message.connectionId);
         }
     }
-    messages.clear();
+    mMessages.clear();
 }
 
 bool BufferPool::handleClose(ConnectionId connectionId) {
     // Cleaning buffers
-    auto buffers = mUsingBuffers.find(connectionId);
-    if (buffers != mUsingBuffers.end()) {
-        for (const BufferId& bufferId : buffers->second) {
-            bool deleted = erase(&mUsingConnections, bufferId, connectionId);
-            if (deleted) {
-                auto bufferIter = mBuffers.find(bufferId);
-                bufferIter->second->mOwnerCount--;
-                if (bufferIter->second->mOwnerCount == 0 &&
-                        bufferIter->second->mTransactionCount == 0) {
-                    // TODO: handle freebuffer insert fail
-                    if (!bufferIter->second->mInvalidated) {
-                        mStats.onBufferUnused(bufferIter->second->mAllocSize);
-                        mFreeBuffers.insert(bufferId);
-                    } else {
-                        mStats.onBufferUnused(bufferIter->second->mAllocSize);
-                        mStats.onBufferEvicted(bufferIter->second->mAllocSize);
-                        mBuffers.erase(bufferIter);
-                        mInvalidation.onBufferInvalidated(bufferId, mInvalidationChannel);
-                    }
-                }
-            }
+    mBuffers.forEach([&](BufferId bufferId, std::unique_ptr<InternalBuffer> &buffer) {
+        if (buffer->mOwners.erase(connectionId) && buffer->isUnused()) {
+            mClosedBuffers.push_back(bufferId);
         }
-        mUsingBuffers.erase(buffers);
+    });
+    // Unused buffers may be freed, so they are handled after the iteration.
+    for (BufferId bufferId : mClosedBuffers) {
+        onBufferUnused(bufferId, mBuffers.find(bufferId)->get());
     }
+    mClosedBuffers.clear();
 
     // Cleaning transactions
-    auto pending = mPendingTransactions.find(connectionId);
-    if (pending != mPendingTransactions.end()) {
-        for (const TransactionId& transactionId : pending->second) {
-            auto iter = mTransactions.find(transactionId);
-            if (iter != mTransactions.end()) {
-                if (!iter->second->mSenderValidated) {
-                    mCompletedTransactions.insert(transactionId);
-                }
-                BufferId bufferId = iter->second->mBufferId;
-                auto bufferIter = mBuffers.find(bufferId);
-                bufferIter->second->mTransactionCount--;
-                if (bufferIter->second->mOwnerCount == 0 &&
-                    bufferIter->second->mTransactionCount == 0) {
-                    // TODO: handle freebuffer insert fail
-                    if (!bufferIter->second->mInvalidated) {
-                        mStats.onBufferUnused(bufferIter->second->mAllocSize);
-                        mFreeBuffers.insert(bufferId);
-                    } else {
-                        mStats.onBufferUnused(bufferIter->second->mAllocSize);
-                        mStats.onBufferEvicted(bufferIter->second->mAllocSize);
-                        mBuffers.erase(bufferIter);
-                        mInvalidation.onBufferInvalidated(bufferId, mInvalidationChannel);
-                    }
-                }
-                mTransactions.erase(iter);
+    mTransactions.forEach([&](TransactionId transactionId, TransactionStatus &transaction) {
+        if (transaction.mReceiver == connectionId) {
+            mClosedTransactions.push_back(transactionId);
+        }
+    });
+    for (TransactionId transactionId : mClosedTransactions) {
+        TransactionStatus *transaction = mTransactions.find(transactionId);
+        if (!transaction->mSenderValidated) {
+            mCompletedTransactions.insert(transactionId);
+        }
+        BufferId bufferId = transaction->mBufferId;
+        mTransactions.erase(transactionId);
+        std::unique_ptr<InternalBuffer> *buffer = mBuffers.find(bufferId);
+        if (buffer != nullptr) {
+            (*buffer)->mTransactionCount--;
+            if ((*buffer)->isUnused()) {
+                onBufferUnused(bufferId, buffer->get());
             }
         }
     }
+    mClosedTransactions.clear();
     mConnectionIds.erase(connectionId);
     return true;
 }
@@ -416,32 +433,43 @@ bool BufferPool::getFreeBuffer(
         const std::shared_ptr<BufferPoolAllocator> &allocator,
         const std::vector<uint8_t> &params, BufferId *pId,
         const native_handle_t** handle) {
-    auto bufferIt = mFreeBuffers.begin();
-    for (;bufferIt != mFreeBuffers.end(); ++bufferIt) {
-        BufferId bufferId = *bufferIt;
-        if (allocator->compatible(params, mBuffers[bufferId]->mConfig)) {
-            break;
+    FreeBuffers::Group *same = mFreeBuffers.get(params, hashConfig(params), mTimestampMs);
+    same->mLastRequestMs = mTimestampMs;
+    if (mFreeBuffers.mSize == 0) {
+        return false;
+    }
+    // Look for a buffer allocated with the same parameters first, then for the
+    // smallest compatible one.
+    FreeBuffers::Group *found = nullptr;
+    if (!same->mIds.empty() && allocator->compatible(params, same->mConfig)) {
+        found = same;
+    } else {
+        for (FreeBuffers::Group &group : mFreeBuffers.mGroups) {
+            if (&group != same && !group.mIds.empty() &&
+                    (found == nullptr || group.mAllocSize < found->mAllocSize) &&
+                    allocator->compatible(params, group.mConfig)) {
+                found = &group;
+            }
         }
     }
-    if (bufferIt != mFreeBuffers.end()) {
-        BufferId id = *bufferIt;
-        mFreeBuffers.erase(bufferIt);
-        mStats.onBufferRecycled(mBuffers[id]->mAllocSize);
-        *handle = mBuffers[id]->handle();
-        *pId = id;
-        ALOGV("recycle a buffer %u %p", id, *handle);
-        return true;
+    if (found == nullptr) {
+        return false;
     }
-    return false;
+    BufferId id = found->mIds.back();
+    found->mIds.pop_back();
+    --mFreeBuffers.mSize;
+    InternalBuffer *buffer = mBuffers.find(id)->get();
+    mStats.onBufferRecycled(buffer->mAllocSize);
+    *handle = buffer->handle();
+    *pId = id;
+    ALOGV("recycle a buffer %u %p", id, *handle);
+    return true;
 }
 
-BufferPoolStatus BufferPool::addNewBuffer(
+InternalBuffer *BufferPool::insertBuffer(
         const std::shared_ptr<BufferPoolAllocation> &alloc,
         const size_t allocSize,
-        const std::vector<uint8_t> &params,
-        BufferId *pId,
-        const native_handle_t** handle) {
-
+        const std::vector<uint8_t> &params) {
     BufferId bufferId = mSeq++;
     if (mSeq == Connection::SYNC_BUFFERID) {
         mSeq = 0;
@@ -450,18 +478,63 @@ BufferPoolStatus BufferPool::addNewBuffer(
             std::make_unique<InternalBuffer>(
                     bufferId, alloc, allocSize, params);
     if (buffer) {
-        auto res = mBuffers.insert(std::make_pair(
-                bufferId, std::move(buffer)));
+        auto res = mBuffers.insert(bufferId, std::move(buffer));
         if (res.second) {
-            mStats.onBufferAllocated(allocSize);
-            *handle = alloc->handle();
-            *pId = bufferId;
-            return ResultStatus::OK;
+            return res.first->get();
         }
     }
+    return nullptr;
+}
+
+BufferPoolStatus BufferPool::addNewBuffer(
+        const std::shared_ptr<BufferPoolAllocation> &alloc,
+        const size_t allocSize,
+        const std::vector<uint8_t> &params,
+        nsecs_t allocNs,
+        BufferId *pId,
+        const native_handle_t** handle) {
+    InternalBuffer *buffer = insertBuffer(alloc, allocSize, params);
+    if (buffer) {
+        mStats.onBufferAllocated(allocSize, allocNs);
+        *handle = alloc->handle();
+        *pId = buffer->mId;
+        return ResultStatus::OK;
+    }
     return ResultStatus::NO_MEMORY;
 }
 
+bool BufferPool::needsPrefetch(const std::vector<uint8_t> &params) {
+    FreeBuffers::Group *group = mFreeBuffers.find(params, hashConfig(params));
+    return group != nullptr && group->mIds.size() < kPrefetchLowWatermark;
+}
+
+bool BufferPool::getPrefetchParams(std::vector<uint8_t> *params) {
+    // Do not prefetch what cleanUp() would evict.
+    if (mStats.buffersNotInUse() >= kUnusedBufferCountTarget) {
+        return false;
+    }
+    for (const FreeBuffers::Group &group : mFreeBuffers.mGroups) {
+        if (group.mIds.size() < kPrefetchBufferCount &&
+                mTimestampMs <= group.mLastRequestMs + kPrefetchActiveMs) {
+            *params = group.mConfig;
+            return true;
+        }
+    }
+    return false;
+}
+
+void BufferPool::addPrefetchedBuffer(
+        const std::shared_ptr<BufferPoolAllocation> &alloc,
+        const size_t allocSize,
+        const std::vector<uint8_t> &params) {
+    InternalBuffer *buffer = insertBuffer(alloc, allocSize, params);
+    if (buffer) {
+        mStats.onBufferPrefetched(allocSize);
+        mFreeBuffers.add(*buffer, mTimestampMs);
+        ALOGV("prefetch a buffer %u %p", buffer->mId, buffer->handle());
+    }
+}
+
 void BufferPool::cleanUp(bool clearCache) {
     if (clearCache || mTimestampMs > mLastCleanUpMs + kCleanUpDurationMs ||
             mStats.buffersNotInUse() > kMaxUnusedBufferCount) {
@@ -471,28 +544,27 @@ void BufferPool::cleanUp(bool clearCache) {
             mLastLogMs = mTimestampMs;
             ALOGD("bufferpool2 %p : %zu(%zu size) total buffers - "
                   "%zu(%zu size) used buffers - %zu/%zu (recycle/alloc) - "
-                  "%zu/%zu (fetch/transfer)",
+                  "%zu/%zu (fetch/transfer) - %zu prefetched - "
+                  "%lld/%lld us (avg/max alloc)",
                   this, mStats.mBuffersCached, mStats.mSizeCached,
                   mStats.mBuffersInUse, mStats.mSizeInUse,
                   mStats.mTotalRecycles, mStats.mTotalAllocations,
-                  mStats.mTotalFetches, mStats.mTotalTransfers);
+                  mStats.mTotalFetches, mStats.mTotalTransfers, mStats.mTotalPrefetches,
+                  (long long)mStats.averageAllocNs() / 1000,
+                  (long long)mStats.mMaxAllocNs / 1000);
         }
-        for (auto freeIt = mFreeBuffers.begin(); freeIt != mFreeBuffers.end();) {
-            if (!clearCache && mStats.buffersNotInUse() <= kUnusedBufferCountTarget &&
-                    (mStats.mSizeCached < kMinAllocBytesForEviction ||
-                     mBuffers.size() < kMinBufferCountForEviction)) {
-                break;
-            }
-            auto it = mBuffers.find(*freeIt);
-            if (it != mBuffers.end() &&
-                    it->second->mOwnerCount == 0 && it->second->mTransactionCount == 0) {
-                mStats.onBufferEvicted(it->second->mAllocSize);
-                mBuffers.erase(it);
-                freeIt = mFreeBuffers.erase(freeIt);
-            } else {
-                ++freeIt;
-                ALOGW("bufferpool2 inconsistent!");
+        for (FreeBuffers::Group &group : mFreeBuffers.mGroups) {
+            size_t evicted = 0;
+            for (; evicted < group.mIds.size(); ++evicted) {
+                if (!clearCache && mStats.buffersNotInUse() <= kUnusedBufferCountTarget &&
+                        (mStats.mSizeCached < kMinAllocBytesForEviction ||
+                         mBuffers.size() < kMinBufferCountForEviction)) {
+                    break;
+                }
+                evictBuffer(group.mIds[evicted]);
             }
+            group.mIds.erase(group.mIds.begin(), group.mIds.begin() + evicted);
+            mFreeBuffers.mSize -= evicted;
         }
     }
 }
@@ -500,29 +572,26 @@ void BufferPool::cleanUp(bool clearCache) {
 void BufferPool::invalidate(
         bool needsAck, BufferId from, BufferId to,
         const std::shared_ptr<Accessor> &impl) {
-    for (auto freeIt = mFreeBuffers.begin(); freeIt != mFreeBuffers.end();) {
-        if (isBufferInRange(from, to, *freeIt)) {
-            auto it = mBuffers.find(*freeIt);
-            if (it != mBuffers.end() &&
-                it->second->mOwnerCount == 0 && it->second->mTransactionCount == 0) {
-                mStats.onBufferEvicted(it->second->mAllocSize);
-                mBuffers.erase(it);
-                freeIt = mFreeBuffers.erase(freeIt);
-                continue;
-            } else {
-                ALOGW("bufferpool2 inconsistent!");
-            }
-        }
-        ++freeIt;
+    for (FreeBuffers::Group &group : mFreeBuffers.mGroups) {
+        auto kept = std::remove_if(
+                group.mIds.begin(), group.mIds.end(), [&](BufferId bufferId) {
+                    if (!isBufferInRange(from, to, bufferId)) {
+                        return false;
+                    }
+                    evictBuffer(bufferId);
+                    return true;
+                });
+        mFreeBuffers.mSize -= group.mIds.end() - kept;
+        group.mIds.erase(kept, group.mIds.end());
     }
 
     size_t left = 0;
-    for (auto it = mBuffers.begin(); it != mBuffers.end(); ++it) {
-        if (isBufferInRange(from, to, it->first)) {
-            it->second->invalidate();
+    mBuffers.forEach([&](BufferId bufferId, std::unique_ptr<InternalBuffer> &buffer) {
+        if (isBufferInRange(from, to, bufferId)) {
+            buffer->invalidate();
             ++left;
         }
-    }
+    });
     mInvalidation.onInvalidationRequest(needsAck, from, to, left, mInvalidationChannel, impl);
 }
 
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <map>
 #include <set>
 #include <vector>
@@ -24,6 +25,7 @@
 #include <utils/Timers.h>
 
 #include "BufferStatus.h"
+#include "DataHelper.h"
 
 namespace aidl::android::hardware::media::bufferpool2::implementation {
 
@@ -31,8 +33,6 @@ using BufferStatus = aidl::android::hardware::media::bufferpool2::BufferStatus;
 using BufferStatusMessage = aidl::android::hardware::media::bufferpool2::BufferStatusMessage;
 
 struct Accessor;
-struct InternalBuffer;
-struct TransactionStatus;
 
 /**
  * Buffer pool implementation.
@@ -52,21 +52,51 @@ private:
     BufferStatusObserver mObserver;
     BufferInvalidationChannel mInvalidationChannel;
 
-    std::map<ConnectionId, std::set<BufferId>> mUsingBuffers;
-    std::map<BufferId, std::set<ConnectionId>> mUsingConnections;
+    // Buffer ownership is kept in InternalBuffer::mOwners. The pending transactions of a
+    // connection are the transactions it receives.
 
-    std::map<ConnectionId, std::set<TransactionId>> mPendingTransactions;
     // Transactions completed before TRANSFER_TO message arrival.
     // Fetch does not occur for the transactions.
     // Only transaction id is kept for the transactions in short duration.
-    std::set<TransactionId> mCompletedTransactions;
+    FlatSet<TransactionId> mCompletedTransactions;
     // Currently active(pending) transations' status & information.
-    std::map<TransactionId, std::unique_ptr<TransactionStatus>>
-            mTransactions;
+    FlatMap<TransactionId, TransactionStatus> mTransactions;
+
+    FlatMap<BufferId, std::unique_ptr<InternalBuffer>> mBuffers;
+    FlatSet<ConnectionId> mConnectionIds;
+
+    /// Buffers available to recycle, grouped by their allocation parameters.
+    /// The most recently freed buffers of a group are recycled first, and the least
+    /// recently freed ones evicted first. A group is also kept for recently requested
+    /// parameters without free buffers, in order to prefetch buffers for them.
+    struct FreeBuffers {
+        struct Group {
+            size_t mHash;
+            std::vector<uint8_t> mConfig;
+            std::vector<BufferId> mIds;
+            /// Size of the last buffer added, to prefer the smallest compatible buffers.
+            size_t mAllocSize;
+            /// When a buffer was last requested with the parameters.
+            int64_t mLastRequestMs;
+        };
+        std::vector<Group> mGroups;
+        size_t mSize;
+
+        FreeBuffers() : mSize(0) {}
+
+        /// Returns the group of the parameters, or nullptr if there is none.
+        Group *find(const std::vector<uint8_t> &config, size_t hash);
+
+        /// Returns the group of the parameters, creating it if needed.
+        Group *get(const std::vector<uint8_t> &config, size_t hash, int64_t timestampMs);
+
+        void add(const InternalBuffer &buffer, int64_t timestampMs);
+    } mFreeBuffers;
 
-    std::map<BufferId, std::unique_ptr<InternalBuffer>> mBuffers;
-    std::set<BufferId> mFreeBuffers;
-    std::set<ConnectionId> mConnectionIds;
+    // Reused across calls to process status messages without allocation.
+    std::vector<BufferStatusMessage> mMessages;
+    std::vector<BufferId> mClosedBuffers;
+    std::vector<TransactionId> mClosedTransactions;
 
     struct Invalidation {
         static std::atomic<std::uint32_t> sInvSeqId;
@@ -139,10 +169,26 @@ private:
         size_t mTotalTransfers;
         /// # of transfers that had to be fetched.
         size_t mTotalFetches;
+        /// # of buffers allocated in the background ahead of allocation requests.
+        size_t mTotalPrefetches;
+        /// Total and longest time to allocate a buffer on an allocation request. (ns)
+        nsecs_t mTotalAllocNs;
+        nsecs_t mMaxAllocNs;
 
         Stats()
             : mSizeCached(0), mBuffersCached(0), mSizeInUse(0), mBuffersInUse(0),
-              mTotalAllocations(0), mTotalRecycles(0), mTotalTransfers(0), mTotalFetches(0) {}
+              mTotalAllocations(0), mTotalRecycles(0), mTotalTransfers(0), mTotalFetches(0),
+              mTotalPrefetches(0), mTotalAllocNs(0), mMaxAllocNs(0) {}
+
+        /// # of allocation requests which had to allocate a buffer.
+        size_t misses() const {
+            return mTotalAllocations - mTotalRecycles;
+        }
+
+        /// Average time to allocate a buffer on an allocation request. (ns)
+        nsecs_t averageAllocNs() const {
+            return misses() ? mTotalAllocNs / static_cast<nsecs_t>(misses()) : 0;
+        }
 
         /// # of currently unused buffers
         size_t buffersNotInUse() const {
@@ -161,6 +207,21 @@ private:
             mTotalAllocations++;
         }
 
+        /// A buffer is allocated on an allocation request, taking |allocNs|.
+        void onBufferAllocated(size_t allocSize, nsecs_t allocNs) {
+            onBufferAllocated(allocSize);
+            mTotalAllocNs += allocNs;
+            mMaxAllocNs = std::max(mMaxAllocNs, allocNs);
+        }
+
+        /// A new buffer is allocated ahead of allocation requests.
+        void onBufferPrefetched(size_t allocSize) {
+            mSizeCached += allocSize;
+            mBuffersCached++;
+
+            mTotalPrefetches++;
+        }
+
         /// A buffer is evicted and destroyed.
         void onBufferEvicted(size_t allocSize) {
             mSizeCached -= allocSize;
@@ -202,6 +263,18 @@ private:
 
     static void createInvalidator();
 
+    /// Frees or makes available to recycle a buffer which became unused.
+    void onBufferUnused(BufferId bufferId, InternalBuffer *buffer);
+
+    /// Evicts a free buffer, which must be unused.
+    void evictBuffer(BufferId bufferId);
+
+    /// Adds a newly allocated buffer under a new buffer id.
+    InternalBuffer *insertBuffer(
+            const std::shared_ptr<BufferPoolAllocation> &alloc,
+            const size_t allocSize,
+            const std::vector<uint8_t> &params);
+
 public:
     /** Creates a buffer pool. */
     BufferPool();
@@ -301,6 +374,7 @@ public:
      * @param alloc     the newly allocated buffer.
      * @param allocSize the size of the newly allocated buffer.
      * @param params    the allocation parameters.
+     * @param allocNs   the time taken to allocate the buffer.
      * @param pId       the buffer id for the newly allocated buffer.
      * @param handle    the native handle for the newly allocated buffer.
      *
@@ -312,9 +386,41 @@ public:
             const std::shared_ptr<BufferPoolAllocation> &alloc,
             const size_t allocSize,
             const std::vector<uint8_t> &params,
+            nsecs_t allocNs,
             BufferId *pId,
             const native_handle_t **handle);
 
+    /**
+     * Returns whether the free buffers of the allocation parameters went below
+     * the prefetch low watermark.
+     *
+     * @param params    the allocation parameters of a request.
+     */
+    bool needsPrefetch(const std::vector<uint8_t> &params);
+
+    /**
+     * Looks for recently requested allocation parameters with fewer free buffers
+     * than the prefetch target.
+     *
+     * @param params    the allocation parameters to prefetch a buffer with.
+     *
+     * @return {@code true} when a buffer should be prefetched,
+     *         {@code false} otherwise.
+     */
+    bool getPrefetchParams(std::vector<uint8_t> *params);
+
+    /**
+     * Adds a buffer allocated ahead of allocation requests as a free buffer.
+     *
+     * @param alloc     the newly allocated buffer.
+     * @param allocSize the size of the newly allocated buffer.
+     * @param params    the allocation parameters.
+     */
+    void addPrefetchedBuffer(
+            const std::shared_ptr<BufferPoolAllocation> &alloc,
+            const size_t allocSize,
+            const std::vector<uint8_t> &params);
+
     /**
      * Processes pending buffer status messages and performs periodic cache
      * cleaning.
@@ -17,6 +17,9 @@
 #define LOG_TAG "AidlBufferPoolCli"
 //#define LOG_NDEBUG 0
 
+#include <stdio.h>
+#include <algorithm>
+#include <array>
 #include <thread>
 #include <aidlcommonsupport/NativeHandle.h>
 #include <utils/Log.h>
@@ -34,8 +37,13 @@ using FetchResult = aidl::android::hardware::media::bufferpool2::IConnection::Fe
 static constexpr int64_t kReceiveTimeoutMs = 2000; // 2s
 static constexpr int kPostMaxRetry = 3;
 static constexpr int kCacheTtlMs = 1000;
-static constexpr size_t kMaxCachedBufferCount = 64;
-static constexpr size_t kCachedBufferCountTarget = kMaxCachedBufferCount - 16;
+// Released buffers are cached up to a capacity sized to their observed reuse
+// distance, and resized every kCacheTtlMs.
+static constexpr size_t kMinCachedBufferCount = 16;
+static constexpr size_t kMaxCachedBufferCount = 512;
+static constexpr size_t kInitialCachedBufferCount = 48;
+// # of evicted buffers remembered to detect misses of a too small cache.
+static constexpr size_t kEvictedHistorySize = 128;
 
 class BufferPoolClient::Impl
         : public std::enable_shared_from_this<BufferPoolClient::Impl> {
@@ -82,6 +90,8 @@ public:
     bool postSend(
             BufferId bufferId, ConnectionId receiver,
             TransactionId *transactionId, int64_t *timestampMs);
+
+    void dump(int fd);
 private:
 
     bool postReceive(
@@ -131,8 +141,31 @@ private:
         int mActive;
         int64_t mLastChangeMs;
 
+        // Cached buffers without references, least recently released first.
+        ClientBuffer *mLruHead;
+        ClientBuffer *mLruTail;
+        size_t mLruCount;
+        size_t mCapacity;
+        // # of buffer releases, to measure how many releases a buffer is reused after.
+        uint64_t mReleaseSeq;
+        uint64_t mMaxReuseDistance;
+        // Recently evicted buffers and their release seq.
+        std::array<std::pair<BufferId, uint64_t>, kEvictedHistorySize> mEvicted;
+        size_t mEvictedCount;
+
+        // Stats
+        size_t mHits;
+        size_t mMisses;
+        size_t mCapacityMisses;
+        size_t mEvictions;
+        size_t mExpirations;
+
         BufferCache() : mCreating(false), mActive(0),
-                mLastChangeMs(::android::elapsedRealtime()) {}
+                mLastChangeMs(::android::elapsedRealtime()),
+                mLruHead(nullptr), mLruTail(nullptr), mLruCount(0),
+                mCapacity(kInitialCachedBufferCount), mReleaseSeq(0), mMaxReuseDistance(0),
+                mEvictedCount(0), mHits(0), mMisses(0), mCapacityMisses(0),
+                mEvictions(0), mExpirations(0) {}
 
         void incActive_l() {
             ++mActive;
@@ -147,6 +180,27 @@ private:
         int cachedBufferCount() const {
             return mBuffers.size() - mActive;
         }
+
+        /** Adds a buffer whose references are all released, as the most recent. */
+        void pushLru_l(ClientBuffer *buffer);
+
+        void removeLru_l(ClientBuffer *buffer);
+
+        /** Removes a buffer from the cache. Returns the next one. */
+        std::map<BufferId, std::unique_ptr<ClientBuffer>>::iterator erase_l(
+                std::map<BufferId, std::unique_ptr<ClientBuffer>>::iterator it);
+
+        /** Evicts the least recently released buffer. */
+        void evictLru_l();
+
+        /** Accounts for a buffer reused after |distance| releases. */
+        void onReuse_l(uint64_t distance);
+
+        /** Accounts for a buffer which was not cached. */
+        void onMiss_l(BufferId id);
+
+        /** Resizes the cache to the reuse distance seen since the last resize. */
+        void resize_l();
     } mCache;
 
     // FMQ - release notifier
@@ -197,10 +251,17 @@ private:
     }
 
 public:
+    // Links of BufferCache's LRU
+    ClientBuffer *mLruPrev;
+    ClientBuffer *mLruNext;
+    bool mInLru;
+    uint64_t mReleaseSeq;
+
     ClientBuffer(
             ConnectionId connectionId, BufferId id, native_handle_t *handle)
             : mHasCache(false), mConnectionId(connectionId),
-              mId(id), mHandle(handle) {
+              mId(id), mHandle(handle),
+              mLruPrev(nullptr), mLruNext(nullptr), mInLru(false), mReleaseSeq(0) {
         mExpireMs = ::android::elapsedRealtime() + kCacheTtlMs;
     }
 
@@ -215,8 +276,7 @@ public:
         return mId;
     }
 
-    bool expire() const {
-        int64_t now = ::android::elapsedRealtime();
+    bool expire(int64_t now) const {
         return now >= mExpireMs;
     }
 
@@ -269,6 +329,91 @@ public:
     }
 };
 
+void BufferPoolClient::Impl::BufferCache::pushLru_l(ClientBuffer *buffer) {
+    if (buffer->mInLru) {
+        return;
+    }
+    buffer->mLruPrev = mLruTail;
+    buffer->mLruNext = nullptr;
+    if (mLruTail) {
+        mLruTail->mLruNext = buffer;
+    } else {
+        mLruHead = buffer;
+    }
+    mLruTail = buffer;
+    buffer->mInLru = true;
+    buffer->mReleaseSeq = ++mReleaseSeq;
+    ++mLruCount;
+}
+
+void BufferPoolClient::Impl::BufferCache::removeLru_l(ClientBuffer *buffer) {
+    if (!buffer->mInLru) {
+        return;
+    }
+    if (buffer->mLruPrev) {
+        buffer->mLruPrev->mLruNext = buffer->mLruNext;
+    } else {
+        mLruHead = buffer->mLruNext;
+    }
+    if (buffer->mLruNext) {
+        buffer->mLruNext->mLruPrev = buffer->mLruPrev;
+    } else {
+        mLruTail = buffer->mLruPrev;
+    }
+    buffer->mLruPrev = nullptr;
+    buffer->mLruNext = nullptr;
+    buffer->mInLru = false;
+    --mLruCount;
+}
+
+std::map<BufferId, std::unique_ptr<BufferPoolClient::Impl::ClientBuffer>>::iterator
+BufferPoolClient::Impl::BufferCache::erase_l(
+        std::map<BufferId, std::unique_ptr<ClientBuffer>>::iterator it) {
+    removeLru_l(it->second.get());
+    return mBuffers.erase(it);
+}
+
+void BufferPoolClient::Impl::BufferCache::evictLru_l() {
+    ClientBuffer *buffer = mLruHead;
+    mEvicted[mEvictedCount++ % kEvictedHistorySize] =
+            std::make_pair(buffer->id(), buffer->mReleaseSeq);
+    ++mEvictions;
+    erase_l(mBuffers.find(buffer->id()));
+}
+
+void BufferPoolClient::Impl::BufferCache::onReuse_l(uint64_t distance) {
+    mMaxReuseDistance = std::max(mMaxReuseDistance, distance);
+    if (distance >= mCapacity) {
+        // Grow right away rather than at the next resize.
+        mCapacity = std::min<size_t>(distance + distance / 4 + 1, kMaxCachedBufferCount);
+    }
+}
+
+void BufferPoolClient::Impl::BufferCache::onMiss_l(BufferId id) {
+    ++mMisses;
+    size_t count = std::min(mEvictedCount, kEvictedHistorySize);
+    for (size_t i = 0; i < count; ++i) {
+        if (mEvicted[i].first == id) {
+            // The buffer would have been reused had the cache been larger.
+            ++mCapacityMisses;
+            onReuse_l(mReleaseSeq - mEvicted[i].second);
+            return;
+        }
+    }
+}
+
+void BufferPoolClient::Impl::BufferCache::resize_l() {
+    size_t capacity;
+    if (mMaxReuseDistance > 0) {
+        capacity = mMaxReuseDistance + mMaxReuseDistance / 4 + 1;
+    } else {
+        // Shrink slowly while buffers are not reused.
+        capacity = mCapacity - mCapacity / 8;
+    }
+    mCapacity = std::clamp(capacity, kMinCachedBufferCount, kMaxCachedBufferCount);
+    mMaxReuseDistance = 0;
+}
+
 BufferPoolClient::Impl::Impl(const std::shared_ptr<Accessor> &accessor,
                              const std::shared_ptr<IObserver> &observer)
     : mLocal(true), mValid(false), mAccessor(accessor), mSeqId(0),
@@ -367,7 +512,7 @@ BufferPoolStatus BufferPoolClient::Impl::allocate(
             auto cacheIt = mCache.mBuffers.find(bufferId);
             if (cacheIt != mCache.mBuffers.end()) {
                 // TODO: verify it is recycled. (not having active ref)
-                mCache.mBuffers.erase(cacheIt);
+                mCache.erase_l(cacheIt);
             }
             auto clientBuffer = std::make_unique<ClientBuffer>(
                     mConnectionId, bufferId, handle);
@@ -379,6 +524,8 @@ BufferPoolStatus BufferPoolClient::Impl::allocate(
                             shared_from_this(), pHandle);
                     if (*buffer) {
                         mCache.incActive_l();
+                    } else {
+                        mCache.pushLru_l(result.first->second.get());
                     }
                 }
             }
@@ -425,9 +572,15 @@ BufferPoolStatus BufferPoolClient::Impl::receive(
                 ALOGV("client receive from reference %lld", (long long)mConnectionId);
                 break;
             } else {
-                *buffer = cacheIt->second->createCache(shared_from_this(), pHandle);
+                ClientBuffer *cached = cacheIt->second.get();
+                *buffer = cached->createCache(shared_from_this(), pHandle);
                 if (*buffer) {
                     mCache.incActive_l();
+                    ++mCache.mHits;
+                    if (cached->mInLru) {
+                        mCache.onReuse_l(mCache.mReleaseSeq - cached->mReleaseSeq);
+                    }
+                    mCache.removeLru_l(cached);
                 }
                 ALOGV("client receive from cache %lld", (long long)mConnectionId);
                 break;
@@ -435,6 +588,7 @@ BufferPoolStatus BufferPoolClient::Impl::receive(
         } else {
             if (!mCache.mCreating) {
                 mCache.mCreating = true;
+                mCache.onMiss_l(bufferId);
                 lock.unlock();
                 native_handle_t* handle = nullptr;
                 status = fetchBufferHandle(transactionId, bufferId, &handle);
@@ -452,6 +606,8 @@ BufferPoolStatus BufferPoolClient::Impl::receive(
                                         shared_from_this(), pHandle);
                                 if (*buffer) {
                                     mCache.incActive_l();
+                                } else {
+                                    mCache.pushLru_l(result.first->second.get());
                                 }
                             }
                         }
@@ -600,6 +756,7 @@ bool BufferPoolClient::Impl::syncReleased(uint32_t messageId) {
                 if (found != mCache.mBuffers.end()) {
                     if (found->second->onCacheRelease()) {
                         mCache.decActive_l();
+                        mCache.pushLru_l(found->second.get());
                     } else {
                         // should not happen!
                         ALOGW("client %lld cache release status inconsistent!",
@@ -660,22 +817,38 @@ bool BufferPoolClient::Impl::syncReleased(uint32_t messageId) {
 // should have mCache.mLock
 void BufferPoolClient::Impl::evictCaches(bool clearCache) {
     int64_t now = ::android::elapsedRealtime();
-    if (now >= mLastEvictCacheMs + kCacheTtlMs ||
-            clearCache || mCache.cachedBufferCount() > kMaxCachedBufferCount) {
-        size_t evicted = 0;
-        for (auto it = mCache.mBuffers.begin(); it != mCache.mBuffers.end();) {
-            if (!it->second->hasCache() && (it->second->expire() ||
-                        clearCache || mCache.cachedBufferCount() > kCachedBufferCountTarget)) {
-                it = mCache.mBuffers.erase(it);
-                ++evicted;
-            } else {
-                ++it;
-            }
-        }
-        ALOGV("cache count %lld : total %zu, active %d, evicted %zu",
-              (long long)mConnectionId, mCache.mBuffers.size(), mCache.mActive, evicted);
+    if (now >= mLastEvictCacheMs + kCacheTtlMs) {
+        mCache.resize_l();
         mLastEvictCacheMs = now;
     }
+    // Buffers are released in the order of their expiry, so the least recently
+    // released buffers are both the ones to evict and the first to expire.
+    size_t evicted = 0;
+    while (mCache.mLruHead && (clearCache || mCache.mLruCount > mCache.mCapacity ||
+                                mCache.mLruHead->expire(now))) {
+        if (!clearCache && mCache.mLruCount <= mCache.mCapacity) {
+            ++mCache.mExpirations;
+        }
+        mCache.evictLru_l();
+        ++evicted;
+    }
+    if (evicted > 0) {
+        ALOGV("cache count %lld : total %zu, active %d, evicted %zu, capacity %zu",
+              (long long)mConnectionId, mCache.mBuffers.size(), mCache.mActive, evicted,
+              mCache.mCapacity);
+    }
+}
+
+void BufferPoolClient::Impl::dump(int fd) {
+    std::lock_guard<std::mutex> lock(mCache.mLock);
+    size_t requests = mCache.mHits + mCache.mMisses;
+    dprintf(fd, "  connection %lld (%s): %zu buffers, %d active, %zu/%zu cached; "
+            "%zu hits, %zu misses (%zu capacity), %d%% hit; %zu evicted (%zu expired)\n",
+            (long long)mConnectionId, mLocal ? "local" : "remote", mCache.mBuffers.size(),
+            mCache.mActive, mCache.mLruCount, mCache.mCapacity, mCache.mHits, mCache.mMisses,
+            mCache.mCapacityMisses,
+            requests ? static_cast<int>(100 * mCache.mHits / requests) : 0,
+            mCache.mEvictions, mCache.mExpirations);
 }
 
 // should have mCache.mLock
@@ -683,7 +856,7 @@ void BufferPoolClient::Impl::invalidateBuffer(BufferId id) {
     for (auto it = mCache.mBuffers.begin(); it != mCache.mBuffers.end(); ++it) {
         if (id == it->second->id()) {
             if (!it->second->hasCache()) {
-                mCache.mBuffers.erase(it);
+                mCache.erase_l(it);
                 ALOGV("cache invalidated %lld : buffer %u",
                       (long long)mConnectionId, id);
             } else {
@@ -704,13 +877,13 @@ void BufferPoolClient::Impl::invalidateRange(BufferId from, BufferId to) {
             if (from < to) {
                 if (from <= bid && bid < to) {
                     ++invalidated;
-                    it = mCache.mBuffers.erase(it);
+                    it = mCache.erase_l(it);
                     continue;
                 }
             } else {
                 if (from <= bid || bid < to) {
                     ++invalidated;
-                    it = mCache.mBuffers.erase(it);
+                    it = mCache.erase_l(it);
                     continue;
                 }
             }
@@ -852,6 +1025,12 @@ BufferPoolStatus BufferPoolClient::receive(
     return ResultStatus::CRITICAL_ERROR;
 }
 
+void BufferPoolClient::dump(int fd) {
+    if (isValid()) {
+        mImpl->dump(fd);
+    }
+}
+
 BufferPoolStatus BufferPoolClient::postSend(
         ConnectionId receiverId,
         const std::shared_ptr<BufferPoolData> &buffer,
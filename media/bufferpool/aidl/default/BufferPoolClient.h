@@ -84,6 +84,9 @@ private:
                           TransactionId *transactionId,
                           int64_t *timestampMs);
 
+    /** Writes the cache stats of the connection. */
+    void dump(int fd);
+
     class Impl;
     std::shared_ptr<Impl> mImpl;
 
@@ -19,6 +19,7 @@
 #include <aidl/android/hardware/media/bufferpool2/ResultStatus.h>
 #include <bufferpool2/ClientManager.h>
 
+#include <stdio.h>
 #include <sys/types.h>
 #include <utils/SystemClock.h>
 #include <unistd.h>
@@ -84,6 +85,8 @@ public:
 
     void cleanUp(bool clearCache = false);
 
+    void dump(int fd);
+
 private:
     // In order to prevent deadlock between multiple locks,
     // always lock ClientCache.lock before locking ActiveClients.lock.
@@ -410,6 +413,14 @@ void ClientManager::Impl::cleanUp(bool clearCache) {
     }
 }
 
+void ClientManager::Impl::dump(int fd) {
+    std::lock_guard<std::mutex> lock(mActive.mMutex);
+    dprintf(fd, "ClientManager: %zu active connections\n", mActive.mClients.size());
+    for (auto it = mActive.mClients.begin(); it != mActive.mClients.end(); ++it) {
+        it->second->dump(fd);
+    }
+}
+
 ::ndk::ScopedAStatus ClientManager::registerSender(
         const std::shared_ptr<IAccessor>& in_bufferPool, Registration* _aidl_return) {
     BufferPoolStatus status = ResultStatus::CRITICAL_ERROR;
@@ -430,6 +441,13 @@ void ClientManager::Impl::cleanUp(bool clearCache) {
     return ::ndk::ScopedAStatus::fromServiceSpecificError(ResultStatus::NOT_FOUND);
 }
 
+binder_status_t ClientManager::dump(int fd, const char** /* args */, uint32_t /* numArgs */) {
+    if (mImpl) {
+        mImpl->dump(fd);
+    }
+    return STATUS_OK;
+}
+
 // Methods for local use.
 std::shared_ptr<ClientManager> ClientManager::sInstance;
 std::mutex ClientManager::sInstanceLock;
@@ -443,6 +461,7 @@ std::shared_ptr<ClientManager> ClientManager::getInstance() {
     }
     Accessor::createInvalidator();
     Accessor::createEvictor();
+    Accessor::createPrefetcher();
     return sInstance;
 }
 
@@ -19,57 +19,225 @@
 #include <aidl/android/hardware/media/bufferpool2/BufferStatusMessage.h>
 #include <bufferpool2/BufferPoolTypes.h>
 
-#include <map>
-#include <set>
+#include <stdint.h>
+#include <array>
+#include <utility>
+#include <vector>
 
 namespace aidl::android::hardware::media::bufferpool2::implementation {
 
-// Helper template methods for handling map of set.
-template<class T, class U>
-bool insert(std::map<T, std::set<U>> *mapOfSet, T key, U value) {
-    auto iter = mapOfSet->find(key);
-    if (iter == mapOfSet->end()) {
-        std::set<U> valueSet{value};
-        mapOfSet->insert(std::make_pair(key, valueSet));
+// Open addressing hash table keyed by ids, with linear probing and backward shift
+// deletion. Slots are only allocated when the table grows, so a table of a steady
+// size does not allocate.
+template<class K, class V>
+class FlatMap {
+public:
+    FlatMap() : mSize(0), mShift(63) {}
+
+    size_t size() const {
+        return mSize;
+    }
+
+    V *find(K key) {
+        size_t i;
+        return findSlot(key, &i) ? &mSlots[i].mValue : nullptr;
+    }
+
+    const V *find(K key) const {
+        size_t i;
+        return findSlot(key, &i) ? &mSlots[i].mValue : nullptr;
+    }
+
+    // Inserts |value| unless |key| exists. Returns the value of |key| and whether it
+    // was inserted.
+    std::pair<V *, bool> insert(K key, V &&value) {
+        if ((mSize + 1) * 4 > mSlots.size() * 3) {
+            grow();
+        }
+        for (size_t i = index(key);; i = (i + 1) & mask()) {
+            Slot &slot = mSlots[i];
+            if (!slot.mUsed) {
+                slot.mKey = key;
+                slot.mValue = std::move(value);
+                slot.mUsed = true;
+                ++mSize;
+                return std::make_pair(&slot.mValue, true);
+            }
+            if (slot.mKey == key) {
+                return std::make_pair(&slot.mValue, false);
+            }
+        }
+    }
+
+    bool erase(K key) {
+        size_t hole;
+        if (!findSlot(key, &hole)) {
+            return false;
+        }
+        // Shift back the entries after the hole which would not be found past it.
+        for (size_t i = (hole + 1) & mask(); mSlots[i].mUsed; i = (i + 1) & mask()) {
+            size_t home = index(mSlots[i].mKey);
+            if (((i - home) & mask()) >= ((i - hole) & mask())) {
+                mSlots[hole].mKey = mSlots[i].mKey;
+                mSlots[hole].mValue = std::move(mSlots[i].mValue);
+                hole = i;
+            }
+        }
+        mSlots[hole].mUsed = false;
+        mSlots[hole].mValue = V();
+        --mSize;
         return true;
-    } else if (iter->second.find(value)  == iter->second.end()) {
-        iter->second.insert(value);
+    }
+
+    // Calls |func| with each key and value. The table must not be modified meanwhile.
+    template<class F>
+    void forEach(F func) {
+        for (Slot &slot : mSlots) {
+            if (slot.mUsed) {
+                func(slot.mKey, slot.mValue);
+            }
+        }
+    }
+
+private:
+    struct Slot {
+        K mKey;
+        V mValue;
+        bool mUsed;
+
+        Slot() : mKey(), mValue(), mUsed(false) {}
+    };
+
+    size_t mask() const {
+        return mSlots.size() - 1;
+    }
+
+    // Fibonacci hashing, as ids are mostly sequential.
+    size_t index(K key) const {
+        return (static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ULL) >> mShift;
+    }
+
+    bool findSlot(K key, size_t *pIndex) const {
+        if (mSize == 0) {
+            return false;
+        }
+        for (size_t i = index(key);; i = (i + 1) & mask()) {
+            const Slot &slot = mSlots[i];
+            if (!slot.mUsed) {
+                return false;
+            }
+            if (slot.mKey == key) {
+                *pIndex = i;
+                return true;
+            }
+        }
+    }
+
+    void grow() {
+        std::vector<Slot> slots(mSlots.empty() ? 16 : mSlots.size() * 2);
+        slots.swap(mSlots);
+        mShift = 64 - __builtin_ctzll(mSlots.size());
+        mSize = 0;
+        for (Slot &slot : slots) {
+            if (slot.mUsed) {
+                insert(slot.mKey, std::move(slot.mValue));
+            }
+        }
+    }
+
+    std::vector<Slot> mSlots;
+    size_t mSize;
+    int mShift;
+};
+
+// Set of ids on top of FlatMap.
+template<class K>
+class FlatSet {
+public:
+    size_t size() const {
+        return mMap.size();
+    }
+
+    bool contains(K key) const {
+        return mMap.find(key) != nullptr;
+    }
+
+    bool insert(K key) {
+        return mMap.insert(key, true).second;
+    }
+
+    bool erase(K key) {
+        return mMap.erase(key);
+    }
+
+private:
+    FlatMap<K, bool> mMap;
+};
+
+// Small unordered set which keeps up to N values inline.
+template<class T, size_t N>
+class InlineSet {
+public:
+    InlineSet() : mSize(0) {}
+
+    size_t size() const {
+        return mSize;
+    }
+
+    bool contains(T value) const {
+        return indexOf(value) < mSize;
+    }
+
+    bool insert(T value) {
+        if (contains(value)) {
+            return false;
+        }
+        if (mSize < N) {
+            mInline[mSize] = value;
+        } else {
+            mOverflow.push_back(value);
+        }
+        ++mSize;
         return true;
     }
-    return false;
-}
-
-// Helper template methods for handling map of set.
-template<class T, class U>
-bool erase(std::map<T, std::set<U>> *mapOfSet, T key, U value) {
-    bool ret = false;
-    auto iter = mapOfSet->find(key);
-    if (iter != mapOfSet->end()) {
-        if (iter->second.erase(value) > 0) {
-            ret = true;
+
+    bool erase(T value) {
+        size_t i = indexOf(value);
+        if (i == mSize) {
+            return false;
         }
-        if (iter->second.size() == 0) {
-            mapOfSet->erase(iter);
+        at(i) = at(mSize - 1);
+        if (mSize > N) {
+            mOverflow.pop_back();
         }
+        --mSize;
+        return true;
     }
-    return ret;
-}
 
-// Helper template methods for handling map of set.
-template<class T, class U>
-bool contains(std::map<T, std::set<U>> *mapOfSet, T key, U value) {
-    auto iter = mapOfSet->find(key);
-    if (iter != mapOfSet->end()) {
-        auto setIter = iter->second.find(value);
-        return setIter != iter->second.end();
+private:
+    T &at(size_t i) {
+        return i < N ? mInline[i] : mOverflow[i - N];
     }
-    return false;
-}
+
+    size_t indexOf(T value) const {
+        for (size_t i = 0; i < mSize; ++i) {
+            if ((i < N ? mInline[i] : mOverflow[i - N]) == value) {
+                return i;
+            }
+        }
+        return mSize;
+    }
+
+    std::array<T, N> mInline;
+    std::vector<T> mOverflow;
+    size_t mSize;
+};
 
 // Buffer data structure for internal BufferPool use.(storage/fetching)
 struct InternalBuffer {
     BufferId mId;
-    size_t mOwnerCount;
+    // Connections owning the buffer, rarely more than two.
+    InlineSet<ConnectionId, 2> mOwners;
     size_t mTransactionCount;
     const std::shared_ptr<BufferPoolAllocation> mAllocation;
     const size_t mAllocSize;
@@ -81,7 +249,7 @@ struct InternalBuffer {
             const std::shared_ptr<BufferPoolAllocation> &alloc,
             const size_t allocSize,
             const std::vector<uint8_t> &allocConfig)
-            : mId(id), mOwnerCount(0), mTransactionCount(0),
+            : mId(id), mTransactionCount(0),
             mAllocation(alloc), mAllocSize(allocSize), mConfig(allocConfig),
             mInvalidated(false) {}
 
@@ -89,6 +257,10 @@ struct InternalBuffer {
         return mAllocation->handle();
     }
 
+    bool isUnused() const {
+        return mOwners.size() == 0 && mTransactionCount == 0;
+    }
+
     void invalidate() {
         mInvalidated = true;
     }
@@ -104,6 +276,10 @@ struct TransactionStatus {
     int64_t mTimestampMs;
     bool mSenderValidated;
 
+    TransactionStatus()
+            : mId(0), mBufferId(0), mSender(-1LL), mReceiver(-1LL),
+              mStatus(BufferStatus::NOT_USED), mTimestampMs(0), mSenderValidated(false) {}
+
     TransactionStatus(const BufferStatusMessage &message, int64_t timestampMs) {
         mId = message.transactionId;
         mBufferId = message.bufferId;
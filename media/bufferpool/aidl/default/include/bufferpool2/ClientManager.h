@@ -39,6 +39,9 @@ struct ClientManager : public BnClientManager {
         ::aidl::android::hardware::media::bufferpool2::IClientManager::Registration* _aidl_return)
         override;
 
+    /** Writes the client cache stats of the active connections. */
+    binder_status_t dump(int fd, const char** args, uint32_t numArgs) override;
+
     /** Gets an instance. */
     static std::shared_ptr<ClientManager> getInstance();
 
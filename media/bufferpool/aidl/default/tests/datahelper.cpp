@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+#include <vector>
+
+#include "../DataHelper.h"
+
+using aidl::android::hardware::media::bufferpool2::implementation::FlatMap;
+using aidl::android::hardware::media::bufferpool2::implementation::FlatSet;
+using aidl::android::hardware::media::bufferpool2::implementation::InlineSet;
+
+namespace {
+
+// Slots of a FlatMap before it first grows, which holds up to 3/4 of them.
+constexpr size_t kInitialSlots = 16;
+
+// Home slot of |key| in a table of kInitialSlots slots, as FlatMap hashes it.
+size_t initialIndex(uint32_t key) {
+  return (static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ULL) >> 60;
+}
+
+// Returns |count| keys whose home slot is |index|, starting the search at |from|.
+std::vector<uint32_t> keysAt(size_t index, size_t count, uint32_t from = 1) {
+  std::vector<uint32_t> keys;
+  for (uint32_t key = from; keys.size() < count; ++key) {
+    if (initialIndex(key) == index) {
+      keys.push_back(key);
+    }
+  }
+  return keys;
+}
+
+// Checks |map| holds exactly |expected|, through find and forEach.
+void expectContents(FlatMap<uint32_t, int> &map,
+                    const std::map<uint32_t, int> &expected) {
+  ASSERT_EQ(expected.size(), map.size());
+  for (const auto &[key, value] : expected) {
+    const int *found = map.find(key);
+    ASSERT_NE(nullptr, found) << "key " << key;
+    EXPECT_EQ(value, *found) << "key " << key;
+  }
+  std::map<uint32_t, int> visited;
+  map.forEach([&](uint32_t key, int &value) {
+    EXPECT_TRUE(visited.emplace(key, value).second) << "key " << key;
+  });
+  EXPECT_EQ(expected, visited);
+}
+
+TEST(FlatMapTest, InsertFindErase) {
+  FlatMap<uint32_t, int> map;
+  EXPECT_EQ(0u, map.size());
+  EXPECT_EQ(nullptr, map.find(1));
+  EXPECT_FALSE(map.erase(1));
+
+  auto [value, inserted] = map.insert(1, 10);
+  EXPECT_TRUE(inserted);
+  EXPECT_EQ(10, *value);
+  // An existing key keeps its value.
+  std::tie(value, inserted) = map.insert(1, 20);
+  EXPECT_FALSE(inserted);
+  EXPECT_EQ(10, *value);
+  *value = 30;
+  EXPECT_EQ(30, *map.find(1));
+  EXPECT_EQ(1u, map.size());
+
+  EXPECT_TRUE(map.erase(1));
+  EXPECT_FALSE(map.erase(1));
+  EXPECT_EQ(nullptr, map.find(1));
+  EXPECT_EQ(0u, map.size());
+}
+
+TEST(FlatMapTest, EraseWithinCollisionChains) {
+  // Keys sharing the last slot probe around to the start of the table, where they
+  // are followed by the keys whose home is there, up to slot 8. The key of slot 9
+  // sits in its home right after the chains, so it must never be shifted back.
+  std::vector<uint32_t> lastSlotKeys = keysAt(kInitialSlots - 1, 5);
+  std::vector<uint32_t> firstSlotKeys = keysAt(0, 3);
+  std::vector<uint32_t> secondSlotKeys = keysAt(1, 2);
+  std::vector<uint32_t> tenthSlotKeys = keysAt(9, 1);
+  FlatMap<uint32_t, int> map;
+  std::map<uint32_t, int> expected;
+  for (const auto &keys : {lastSlotKeys, firstSlotKeys, secondSlotKeys, tenthSlotKeys}) {
+    for (uint32_t key : keys) {
+      ASSERT_TRUE(map.insert(key, key * 2).second);
+      expected[key] = key * 2;
+    }
+  }
+  ASSERT_NO_FATAL_FAILURE(expectContents(map, expected));
+
+  // Erase from the head, the middle and the tail of the chains, checking that each
+  // remaining key is still reachable from its home slot.
+  for (uint32_t key : {lastSlotKeys[0], lastSlotKeys[3], firstSlotKeys[1],
+                       lastSlotKeys[4], secondSlotKeys[0], firstSlotKeys[0]}) {
+    SCOPED_TRACE(testing::Message() << "erase " << key);
+    ASSERT_TRUE(map.erase(key));
+    expected.erase(key);
+    ASSERT_NO_FATAL_FAILURE(expectContents(map, expected));
+  }
+}
+
+TEST(FlatMapTest, RehashKeepsCollidingKeys) {
+  // Fill the table to the point where it grows with keys of a single home slot,
+  // then keep growing it.
+  std::vector<uint32_t> keys = keysAt(7, kInitialSlots * 3 / 4);
+  FlatMap<uint32_t, int> map;
+  std::map<uint32_t, int> expected;
+  for (uint32_t key : keys) {
+    ASSERT_TRUE(map.insert(key, -key).second);
+    expected[key] = -key;
+  }
+  ASSERT_NO_FATAL_FAILURE(expectContents(map, expected));
+  for (uint32_t key = 1; expected.size() < kInitialSlots * 32; ++key) {
+    if (expected.emplace(key, key).second) {
+      ASSERT_TRUE(map.insert(key, key).second) << "key " << key;
+    }
+  }
+  ASSERT_NO_FATAL_FAILURE(expectContents(map, expected));
+  for (uint32_t key : keys) {
+    ASSERT_TRUE(map.erase(key));
+    expected.erase(key);
+  }
+  ASSERT_NO_FATAL_FAILURE(expectContents(map, expected));
+}
+
+TEST(FlatMapTest, MatchesStdMap) {
+  // Few distinct keys, so that the operations often hit existing keys.
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<uint32_t> keyDist(0, 255);
+  FlatMap<uint32_t, int> map;
+  std::map<uint32_t, int> expected;
+  for (int i = 0; i < 20000; ++i) {
+    uint32_t key = keyDist(rng);
+    if (rng() % 2) {
+      auto [value, inserted] = map.insert(key, int(i));
+      auto [it, expectedInserted] = expected.emplace(key, i);
+      ASSERT_EQ(expectedInserted, inserted) << "key " << key;
+      ASSERT_EQ(it->second, *value) << "key " << key;
+    } else {
+      ASSERT_EQ(expected.erase(key) == 1, map.erase(key)) << "key " << key;
+    }
+    ASSERT_EQ(expected.size(), map.size());
+  }
+  ASSERT_NO_FATAL_FAILURE(expectContents(map, expected));
+}
+
+TEST(FlatMapTest, EraseCollectedDuringIteration) {
+  // The table must not change during forEach, so erased keys are collected and
+  // erased afterwards, as BufferPool does.
+  FlatMap<uint32_t, int> map;
+  std::map<uint32_t, int> expected;
+  for (uint32_t key = 0; key < 100; ++key) {
+    map.insert(key, key);
+    expected[key] = key;
+  }
+  std::vector<uint32_t> erased;
+  map.forEach([&](uint32_t key, int &value) {
+    if (key % 3 == 0) {
+      erased.push_back(key);
+    } else {
+      // Values may be changed in place.
+      value = -value;
+    }
+  });
+  EXPECT_EQ(34u, erased.size());
+  for (uint32_t key : erased) {
+    ASSERT_TRUE(map.erase(key));
+    expected.erase(key);
+  }
+  for (auto &[key, value] : expected) {
+    value = -value;
+  }
+  ASSERT_NO_FATAL_FAILURE(expectContents(map, expected));
+}
+
+TEST(FlatSetTest, InsertContainsErase) {
+  FlatSet<uint64_t> set;
+  EXPECT_FALSE(set.contains(5));
+  EXPECT_TRUE(set.insert(5));
+  EXPECT_FALSE(set.insert(5));
+  EXPECT_TRUE(set.contains(5));
+  for (uint64_t id = 100; id < 200; ++id) {
+    EXPECT_TRUE(set.insert(id));
+  }
+  EXPECT_EQ(101u, set.size());
+  EXPECT_TRUE(set.erase(5));
+  EXPECT_FALSE(set.erase(5));
+  EXPECT_FALSE(set.contains(5));
+  for (uint64_t id = 100; id < 200; ++id) {
+    EXPECT_TRUE(set.contains(id));
+  }
+  EXPECT_EQ(100u, set.size());
+}
+
+TEST(InlineSetTest, InsertEraseAcrossOverflow) {
+  InlineSet<int, 2> set;
+  EXPECT_FALSE(set.erase(1));
+  for (int value = 1; value <= 5; ++value) {
+    EXPECT_TRUE(set.insert(value));
+  }
+  EXPECT_FALSE(set.insert(3));
+  EXPECT_FALSE(set.insert(5));
+  EXPECT_EQ(5u, set.size());
+
+  // Erasing an inline value moves the last overflowed value in its place.
+  EXPECT_TRUE(set.erase(1));
+  EXPECT_FALSE(set.contains(1));
+  EXPECT_EQ(4u, set.size());
+  for (int value = 2; value <= 5; ++value) {
+    EXPECT_TRUE(set.contains(value)) << value;
+  }
+  // Erasing an overflowed value.
+  EXPECT_TRUE(set.erase(4));
+  EXPECT_FALSE(set.erase(4));
+  EXPECT_EQ(3u, set.size());
+  EXPECT_TRUE(set.contains(2));
+  EXPECT_TRUE(set.contains(3));
+  EXPECT_TRUE(set.contains(5));
+
+  for (int value : {5, 2, 3}) {
+    EXPECT_TRUE(set.erase(value));
+  }
+  EXPECT_EQ(0u, set.size());
+  EXPECT_TRUE(set.insert(1));
+  EXPECT_TRUE(set.contains(1));
+}
+
+}  // namespace
@@ -38,6 +38,7 @@
 #include <atomic>
 #include <chrono>
 #include <functional>
+#include <list>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -74,6 +75,11 @@ class Burst final : public nn::IBurst, public std::enable_shared_from_this<Burst
      * efficiency, if two hidl_memory objects represent the same underlying buffer, they must use
      * the same key.
      *
+     * A cache entry is pinned while a hold object returned by MemoryCache::cacheMemory is alive.
+     * Once unpinned, the entry stays cached so that later executions with the same memory reuse
+     * its slot, until the cache holds more than its capacity of entries. Unpinned entries are then
+     * evicted least recently used first, and the service is told to free their slots.
+     *
      * This class is thread-safe.
      */
     class MemoryCache : public std::enable_shared_from_this<MemoryCache> {
@@ -85,8 +91,18 @@ class Burst final : public nn::IBurst, public std::enable_shared_from_this<Burst
         using SharedCleanup = std::shared_ptr<const Cleanup>;
         using WeakCleanup = std::weak_ptr<const Cleanup>;
 
+        static constexpr size_t kDefaultCapacity = 128;
+
+        struct Stats {
+            size_t hits = 0;
+            size_t misses = 0;
+            size_t evictions = 0;
+            size_t entries = 0;
+            size_t pinnedEntries = 0;
+        };
+
         // Custom constructor to pre-allocate cache sizes.
-        MemoryCache();
+        explicit MemoryCache(size_t capacity = kDefaultCapacity);
 
         /**
          * Add a burst context to the MemoryCache object.
@@ -115,10 +131,20 @@ class Burst final : public nn::IBurst, public std::enable_shared_from_this<Burst
          */
         nn::GeneralResult<nn::SharedMemory> getMemory(int32_t slot);
 
+        /**
+         * Get the hit, miss and eviction counts of MemoryCache::cacheMemory, and the current
+         * number of entries.
+         */
+        Stats getStats();
+
       private:
-        void freeMemory(const nn::SharedMemory& memory);
+        void unpinMemory(const nn::SharedMemory& memory);
+        SharedCleanup pinLocked(int32_t slot, const nn::SharedMemory& memory) REQUIRES(mMutex);
+        std::vector<int32_t> evictLocked() REQUIRES(mMutex);
+        void freeSlots(const std::vector<int32_t>& slots);
         int32_t allocateSlotLocked() REQUIRES(mMutex);
 
+        const size_t kCapacity;
         std::mutex mMutex;
         std::condition_variable mCond;
         sp<IBurstContext> mBurstContext GUARDED_BY(mMutex);
@@ -126,6 +152,11 @@ class Burst final : public nn::IBurst, public std::enable_shared_from_this<Burst
         std::map<nn::SharedMemory, int32_t> mMemoryIdToSlot GUARDED_BY(mMutex);
         std::vector<nn::SharedMemory> mMemoryCache GUARDED_BY(mMutex);
         std::vector<WeakCleanup> mCacheCleaner GUARDED_BY(mMutex);
+        // Unpinned slots, least recently used first, and the position of each slot in the list,
+        // or end() if the slot is pinned or free.
+        std::list<int32_t> mUnpinnedSlots GUARDED_BY(mMutex);
+        std::vector<std::list<int32_t>::iterator> mUnpinnedPosition GUARDED_BY(mMutex);
+        Stats mStats GUARDED_BY(mMutex);
     };
 
     /**
@@ -68,6 +68,17 @@ std::chrono::microseconds getBurstServerPollingTimeWindow();
 std::vector<FmqRequestDatum> serialize(const V1_0::Request& request, MeasureTiming measure,
                                        const std::vector<int32_t>& slots);
 
+/**
+ * Function to serialize a request into an existing packet, reusing its storage.
+ *
+ * @param request Request object without the pool information.
+ * @param measure Whether to collect timing information for the execution.
+ * @param slots Slot identifiers corresponding to memory resources for the request.
+ * @param packet Output serialized FMQ request data. Previous contents are discarded.
+ */
+void serialize(const V1_0::Request& request, MeasureTiming measure,
+               const std::vector<int32_t>& slots, std::vector<FmqRequestDatum>* packet);
+
 /**
  * Deserialize the FMQ request data.
  *
@@ -81,6 +92,17 @@ std::vector<FmqRequestDatum> serialize(const V1_0::Request& request, MeasureTimi
 nn::Result<std::tuple<V1_0::Request, std::vector<int32_t>, MeasureTiming>> deserialize(
         const std::vector<FmqRequestDatum>& data);
 
+/**
+ * Deserialize the FMQ request data in place. The data must not be memory that another process
+ * can write, such as the FMQ itself, because each datum is read more than once.
+ *
+ * @param data Serialized FMQ request data.
+ * @param size Number of elements of data.
+ * @return Request object if successfully deserialized, otherwise an error message.
+ */
+nn::Result<std::tuple<V1_0::Request, std::vector<int32_t>, MeasureTiming>> deserialize(
+        const FmqRequestDatum* data, size_t size);
+
 /**
  * Function to serialize results.
  *
@@ -92,6 +114,17 @@ nn::Result<std::tuple<V1_0::Request, std::vector<int32_t>, MeasureTiming>> deser
 std::vector<FmqResultDatum> serialize(V1_0::ErrorStatus errorStatus,
                                       const std::vector<OutputShape>& outputShapes, Timing timing);
 
+/**
+ * Function to serialize results into an existing packet, reusing its storage.
+ *
+ * @param errorStatus Status of the execution.
+ * @param outputShapes Dynamic shapes of the output tensors.
+ * @param timing Timing information of the execution.
+ * @param packet Output serialized FMQ result data. Previous contents are discarded.
+ */
+void serialize(V1_0::ErrorStatus errorStatus, const std::vector<OutputShape>& outputShapes,
+               Timing timing, std::vector<FmqResultDatum>* packet);
+
 /**
  * Deserialize the FMQ result data.
  *
@@ -104,6 +137,17 @@ std::vector<FmqResultDatum> serialize(V1_0::ErrorStatus errorStatus,
 nn::Result<std::tuple<V1_0::ErrorStatus, std::vector<OutputShape>, Timing>> deserialize(
         const std::vector<FmqResultDatum>& data);
 
+/**
+ * Deserialize the FMQ result data in place. The data must not be memory that another process
+ * can write, such as the FMQ itself, because each datum is read more than once.
+ *
+ * @param data Serialized FMQ result data.
+ * @param size Number of elements of data.
+ * @return Result object if successfully deserialized, otherwise an error message.
+ */
+nn::Result<std::tuple<V1_0::ErrorStatus, std::vector<OutputShape>, Timing>> deserialize(
+        const FmqResultDatum* data, size_t size);
+
 /**
  * RequestChannelSender is responsible for serializing the result packet of information, sending it
  * on the result channel, and signaling that the data is available.
@@ -126,6 +170,8 @@ class RequestChannelSender final : public neuralnetworks::utils::IProtectedCallb
     /**
      * Send the request to the channel.
      *
+     * The request is serialized into a packet reused across calls, so calls must not overlap.
+     *
      * @param request Request object without the pool information.
      * @param measure Whether to collect timing information for the execution.
      * @param slots Slot identifiers corresponding to memory resources for the request.
@@ -148,6 +194,7 @@ class RequestChannelSender final : public neuralnetworks::utils::IProtectedCallb
   private:
     MessageQueue<FmqRequestDatum, kSynchronizedReadWrite> mFmqRequestChannel;
     std::atomic<bool> mValid{true};
+    std::vector<FmqRequestDatum> mPacket;
 };
 
 /**
@@ -202,6 +249,8 @@ class RequestChannelReceiver final {
     MessageQueue<FmqRequestDatum, kSynchronizedReadWrite> mFmqRequestChannel;
     std::atomic<bool> mTeardown{false};
     const std::chrono::microseconds kPollingTimeWindow;
+    // Holds packets which wrap around the end of the FMQ.
+    std::vector<FmqRequestDatum> mPacket;
 };
 
 /**
@@ -224,6 +273,8 @@ class ResultChannelSender final {
     /**
      * Send the result to the channel.
      *
+     * The result is serialized into a packet reused across calls, so calls must not overlap.
+     *
      * @param errorStatus Status of the execution.
      * @param outputShapes Dynamic shapes of the output tensors.
      * @param timing Timing information of the execution.
@@ -239,6 +290,7 @@ class ResultChannelSender final {
 
   private:
     MessageQueue<FmqResultDatum, kSynchronizedReadWrite> mFmqResultChannel;
+    std::vector<FmqResultDatum> mPacket;
 };
 
 /**
@@ -294,6 +346,8 @@ class ResultChannelReceiver final : public neuralnetworks::utils::IProtectedCall
     MessageQueue<FmqResultDatum, kSynchronizedReadWrite> mFmqResultChannel;
     std::atomic<bool> mValid{true};
     const std::chrono::microseconds kPollingTimeWindow;
+    // Holds packets which wrap around the end of the FMQ.
+    std::vector<FmqResultDatum> mPacket;
 };
 
 }  // namespace android::hardware::neuralnetworks::V1_2::utils
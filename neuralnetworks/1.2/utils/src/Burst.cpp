@@ -34,6 +34,7 @@
 #include <algorithm>
 #include <cstring>
 #include <limits>
+#include <list>
 #include <memory>
 #include <string>
 #include <thread>
@@ -106,13 +107,15 @@ nn::GeneralResult<hidl_vec<hidl_memory>> getMemoriesHelper(
 
 // MemoryCache methods
 
-Burst::MemoryCache::MemoryCache() {
+Burst::MemoryCache::MemoryCache(size_t capacity) : kCapacity(capacity) {
     constexpr size_t kPreallocatedCount = 1024;
+    const size_t preallocatedCount = std::min(capacity, kPreallocatedCount);
     std::vector<int32_t> freeSlotsSpace;
-    freeSlotsSpace.reserve(kPreallocatedCount);
+    freeSlotsSpace.reserve(preallocatedCount);
     mFreeSlots = std::stack<int32_t, std::vector<int32_t>>(std::move(freeSlotsSpace));
-    mMemoryCache.reserve(kPreallocatedCount);
-    mCacheCleaner.reserve(kPreallocatedCount);
+    mMemoryCache.reserve(preallocatedCount);
+    mCacheCleaner.reserve(preallocatedCount);
+    mUnpinnedPosition.reserve(preallocatedCount);
 }
 
 void Burst::MemoryCache::setBurstContext(sp<IBurstContext> burstContext) {
@@ -126,35 +129,38 @@ std::pair<int32_t, Burst::MemoryCache::SharedCleanup> Burst::MemoryCache::cacheM
     base::ScopedLockAssertion lockAssert(mMutex);
 
     // Use existing cache entry if (1) the Memory object is in the cache and (2) the cache entry is
-    // not currently being freed.
+    // not currently being unpinned.
     auto iter = mMemoryIdToSlot.find(memory);
     while (iter != mMemoryIdToSlot.end()) {
         const int32_t slot = iter->second;
         if (auto cleaner = mCacheCleaner.at(slot).lock()) {
+            ++mStats.hits;
             return std::make_pair(slot, std::move(cleaner));
         }
+        if (mUnpinnedPosition.at(slot) != mUnpinnedSlots.end()) {
+            ++mStats.hits;
+            mUnpinnedSlots.erase(mUnpinnedPosition[slot]);
+            mUnpinnedPosition[slot] = mUnpinnedSlots.end();
+            return std::make_pair(slot, pinLocked(slot, memory));
+        }
 
-        // If the code reaches this point, the Memory object was in the cache, but is currently
-        // being destroyed. This code waits until the cache entry has been freed, then loops to
-        // ensure the cache entry has been freed or has been made present by another thread.
+        // If the code reaches this point, the Memory object was in the cache, but its last hold is
+        // currently being released. This code waits until the cache entry has been unpinned, then
+        // loops to reuse it.
         mCond.wait(lock);
         iter = mMemoryIdToSlot.find(memory);
     }
 
     // Allocate a new cache entry.
+    ++mStats.misses;
     const int32_t slot = allocateSlotLocked();
     mMemoryIdToSlot[memory] = slot;
     mMemoryCache[slot] = memory;
+    auto cleaner = pinLocked(slot, memory);
 
-    // Create reference-counted self-cleaning cache object.
-    auto self = weak_from_this();
-    Task cleanup = [memory, memoryCache = std::move(self)] {
-        if (const auto lock = memoryCache.lock()) {
-            lock->freeMemory(memory);
-        }
-    };
-    auto cleaner = std::make_shared<const Cleanup>(std::move(cleanup));
-    mCacheCleaner[slot] = cleaner;
+    const auto evicted = evictLocked();
+    lock.unlock();
+    freeSlots(evicted);
 
     return std::make_pair(slot, std::move(cleaner));
 }
@@ -167,22 +173,80 @@ nn::GeneralResult<nn::SharedMemory> Burst::MemoryCache::getMemory(int32_t slot)
     return mMemoryCache[slot];
 }
 
-void Burst::MemoryCache::freeMemory(const nn::SharedMemory& memory) {
+Burst::MemoryCache::Stats Burst::MemoryCache::getStats() {
+    std::lock_guard guard(mMutex);
+    Stats stats = mStats;
+    stats.entries = mMemoryIdToSlot.size();
+    stats.pinnedEntries = mMemoryIdToSlot.size() - mUnpinnedSlots.size();
+    return stats;
+}
+
+Burst::MemoryCache::SharedCleanup Burst::MemoryCache::pinLocked(int32_t slot,
+                                                                const nn::SharedMemory& memory) {
+    // Create reference-counted self-unpinning cache object.
+    auto self = weak_from_this();
+    Task cleanup = [memory, memoryCache = std::move(self)] {
+        if (const auto lock = memoryCache.lock()) {
+            lock->unpinMemory(memory);
+        }
+    };
+    auto cleaner = std::make_shared<const Cleanup>(std::move(cleanup));
+    mCacheCleaner[slot] = cleaner;
+    return cleaner;
+}
+
+void Burst::MemoryCache::unpinMemory(const nn::SharedMemory& memory) {
+    std::vector<int32_t> evicted;
     {
         std::lock_guard guard(mMutex);
         const int32_t slot = mMemoryIdToSlot.at(memory);
-        if (mBurstContext) {
-            const auto ret = mBurstContext->freeMemory(slot);
+        mCacheCleaner[slot].reset();
+        mUnpinnedPosition[slot] = mUnpinnedSlots.insert(mUnpinnedSlots.end(), slot);
+        evicted = evictLocked();
+    }
+    mCond.notify_all();
+    freeSlots(evicted);
+}
+
+std::vector<int32_t> Burst::MemoryCache::evictLocked() {
+    std::vector<int32_t> evicted;
+    while (mMemoryIdToSlot.size() > kCapacity && !mUnpinnedSlots.empty()) {
+        const int32_t slot = mUnpinnedSlots.front();
+        mUnpinnedSlots.pop_front();
+        mUnpinnedPosition[slot] = mUnpinnedSlots.end();
+        mMemoryIdToSlot.erase(mMemoryCache[slot]);
+        mMemoryCache[slot] = {};
+        evicted.push_back(slot);
+    }
+    mStats.evictions += evicted.size();
+    return evicted;
+}
+
+void Burst::MemoryCache::freeSlots(const std::vector<int32_t>& slots) {
+    if (slots.empty()) {
+        return;
+    }
+
+    // The slots are neither mapped nor free while the service is being told to free them, so no
+    // execution refers to them until the service has let go of their memories.
+    sp<IBurstContext> burstContext;
+    {
+        std::lock_guard guard(mMutex);
+        burstContext = mBurstContext;
+    }
+    if (burstContext) {
+        for (int32_t slot : slots) {
+            const auto ret = burstContext->freeMemory(slot);
             if (!ret.isOk()) {
                 LOG(ERROR) << "IBustContext::freeMemory failed: " << ret.description();
             }
         }
-        mMemoryIdToSlot.erase(memory);
-        mMemoryCache[slot] = {};
-        mCacheCleaner[slot].reset();
+    }
+
+    std::lock_guard guard(mMutex);
+    for (int32_t slot : slots) {
         mFreeSlots.push(slot);
     }
-    mCond.notify_all();
 }
 
 int32_t Burst::MemoryCache::allocateSlotLocked() {
@@ -200,6 +264,7 @@ int32_t Burst::MemoryCache::allocateSlotLocked() {
     const int32_t slot = static_cast<int32_t>(mMemoryCache.size());
     mMemoryCache.emplace_back();
     mCacheCleaner.emplace_back();
+    mUnpinnedPosition.push_back(mUnpinnedSlots.end());
 
     return slot;
 }
@@ -344,8 +409,10 @@ nn::ExecutionResult<std::pair<std::vector<nn::OutputShape>, nn::Timing>> Burst::
         holds.push_back(std::move(hold));
     }
 
-    // send request packet
-    const auto requestPacket = serialize(hidlRequest, hidlMeasure, slots);
+    // send request packet, serialized into a buffer kept by the thread to avoid an allocation per
+    // execution
+    thread_local std::vector<FmqRequestDatum> requestPacket;
+    serialize(hidlRequest, hidlMeasure, slots, &requestPacket);
     const auto fallback = [this, &request, measure, &deadline, &loopTimeoutDuration] {
         return kPreparedModel->execute(request, measure, deadline, loopTimeoutDuration, {}, {});
     };
@@ -29,6 +29,7 @@
 
 #include <atomic>
 #include <chrono>
+#include <cstring>
 #include <memory>
 #include <thread>
 #include <tuple>
@@ -54,6 +55,79 @@ std::chrono::microseconds getPollingTimeWindow(const std::string& property) {
 #endif  // NN_DEBUGGABLE
 }
 
+// Waits for a packet on |channel|, copies it into |scratch| and passes it to |process| as a pointer
+// and a size. |isClosed| unblocks the wait.
+//
+// The packet is never processed in place: the FMQ is shared with the other process, which could
+// change a datum between the check of its discriminator and the read of its value, and reading a
+// safe_union member with the wrong discriminator aborts.
+template <typename Datum, typename IsClosed, typename Process>
+auto receivePacketBlocking(MessageQueue<Datum, kSynchronizedReadWrite>* channel,
+                           std::chrono::microseconds pollingTimeWindow, const IsClosed& isClosed,
+                           const char* closedMessage, std::vector<Datum>* scratch,
+                           const Process& process)
+        -> decltype(process(static_cast<const Datum*>(nullptr), size_t{})) {
+    if (isClosed()) {
+        return NN_ERROR() << closedMessage;
+    }
+
+    // First spend time polling if results are available in FMQ instead of waiting on the futex.
+    // Polling is more responsive (yielding lower latencies), but can take up more power, so only
+    // poll for a limited period of time.
+
+    auto& getCurrentTime = std::chrono::high_resolution_clock::now;
+    const auto timeToStopPolling = getCurrentTime() + pollingTimeWindow;
+
+    while (getCurrentTime() < timeToStopPolling) {
+        // if class is being torn down, immediately return
+        if (isClosed()) {
+            return NN_ERROR() << closedMessage;
+        }
+
+        // Check if data is available. If it is, immediately retrieve it and return.
+        const size_t available = channel->availableToRead();
+        if (available > 0) {
+            scratch->resize(available);
+            if (!channel->read(scratch->data(), available)) {
+                return NN_ERROR() << "Error receiving packet";
+            }
+            return process(scratch->data(), available);
+        }
+
+        std::this_thread::yield();
+    }
+
+    // If we get to this point, we either stopped polling because it was taking too long or polling
+    // was not allowed. Instead, perform a blocking call which uses a futex to save power.
+
+    // wait for the packet and read its first element
+    Datum datum;
+    bool success = channel->readBlocking(&datum, 1);
+
+    // retrieve remaining elements
+    // NOTE: all of the data is already available at this point, so there's no need to do a blocking
+    // wait to wait for more data. This is known because in FMQ, all writes are published (made
+    // available) atomically. Currently, the producer always publishes the entire packet in one
+    // function call, so if the first element of the packet is available, the remaining elements are
+    // also available.
+    const size_t count = channel->availableToRead();
+    scratch->resize(count + 1);
+    std::memcpy(&scratch->front(), &datum, sizeof(datum));
+    success &= channel->read(scratch->data() + 1, count);
+
+    // terminate loop
+    if (isClosed()) {
+        return NN_ERROR() << closedMessage;
+    }
+
+    // ensure packet was successfully received
+    if (!success) {
+        return NN_ERROR() << "Error receiving packet";
+    }
+
+    return process(scratch->data(), scratch->size());
+}
+
 }  // namespace
 
 std::chrono::microseconds getBurstControllerPollingTimeWindow() {
@@ -67,6 +141,13 @@ std::chrono::microseconds getBurstServerPollingTimeWindow() {
 // serialize a request into a packet
 std::vector<FmqRequestDatum> serialize(const V1_0::Request& request, V1_2::MeasureTiming measure,
                                        const std::vector<int32_t>& slots) {
+    std::vector<FmqRequestDatum> data;
+    serialize(request, measure, slots, &data);
+    return data;
+}
+
+void serialize(const V1_0::Request& request, V1_2::MeasureTiming measure,
+               const std::vector<int32_t>& slots, std::vector<FmqRequestDatum>* packet) {
     // count how many elements need to be sent for a request
     size_t count = 2 + request.inputs.size() + request.outputs.size() + slots.size();
     for (const auto& input : request.inputs) {
@@ -77,8 +158,9 @@ std::vector<FmqRequestDatum> serialize(const V1_0::Request& request, V1_2::Measu
     }
     CHECK_LE(count, std::numeric_limits<uint32_t>::max());
 
-    // create buffer to temporarily store elements
-    std::vector<FmqRequestDatum> data;
+    // reuse the buffer of the previous packet
+    std::vector<FmqRequestDatum>& data = *packet;
+    data.clear();
     data.reserve(count);
 
     // package packetInfo
@@ -132,23 +214,28 @@ std::vector<FmqRequestDatum> serialize(const V1_0::Request& request, V1_2::Measu
     data.back().measureTiming(measure);
 
     CHECK_EQ(data.size(), count);
-
-    // return packet
-    return data;
 }
 
 // serialize result
 std::vector<FmqResultDatum> serialize(V1_0::ErrorStatus errorStatus,
                                       const std::vector<V1_2::OutputShape>& outputShapes,
                                       V1_2::Timing timing) {
+    std::vector<FmqResultDatum> data;
+    serialize(errorStatus, outputShapes, timing, &data);
+    return data;
+}
+
+void serialize(V1_0::ErrorStatus errorStatus, const std::vector<V1_2::OutputShape>& outputShapes,
+               V1_2::Timing timing, std::vector<FmqResultDatum>* packet) {
     // count how many elements need to be sent for a request
     size_t count = 2 + outputShapes.size();
     for (const auto& outputShape : outputShapes) {
         count += outputShape.dimensions.size();
     }
 
-    // create buffer to temporarily store elements
-    std::vector<FmqResultDatum> data;
+    // reuse the buffer of the previous packet
+    std::vector<FmqResultDatum>& data = *packet;
+    data.clear();
     data.reserve(count);
 
     // package packetInfo
@@ -177,26 +264,28 @@ std::vector<FmqResultDatum> serialize(V1_0::ErrorStatus errorStatus,
     data.back().executionTiming(timing);
 
     CHECK_EQ(data.size(), count);
-
-    // return result
-    return data;
 }
 
 // deserialize request
 nn::Result<std::tuple<V1_0::Request, std::vector<int32_t>, V1_2::MeasureTiming>> deserialize(
         const std::vector<FmqRequestDatum>& data) {
+    return deserialize(data.data(), data.size());
+}
+
+nn::Result<std::tuple<V1_0::Request, std::vector<int32_t>, V1_2::MeasureTiming>> deserialize(
+        const FmqRequestDatum* data, size_t size) {
     using discriminator = FmqRequestDatum::hidl_discriminator;
 
     size_t index = 0;
 
     // validate packet information
-    if (index >= data.size() ||
-        data.at(index).getDiscriminator() != discriminator::packetInformation) {
+    if (index >= size ||
+        data[index].getDiscriminator() != discriminator::packetInformation) {
         return NN_ERROR() << "FMQ Request packet ill-formed";
     }
 
     // unpackage packet information
-    const FmqRequestDatum::PacketInformation& packetInfo = data.at(index).packetInformation();
+    const FmqRequestDatum::PacketInformation& packetInfo = data[index].packetInformation();
     index++;
     const uint32_t packetSize = packetInfo.packetSize;
     const uint32_t numberOfInputOperands = packetInfo.numberOfInputOperands;
@@ -204,7 +293,7 @@ nn::Result<std::tuple<V1_0::Request, std::vector<int32_t>, V1_2::MeasureTiming>>
     const uint32_t numberOfPools = packetInfo.numberOfPools;
 
     // verify packet size
-    if (data.size() != packetSize) {
+    if (size != packetSize) {
         return NN_ERROR() << "FMQ Request packet ill-formed";
     }
 
@@ -213,14 +302,14 @@ nn::Result<std::tuple<V1_0::Request, std::vector<int32_t>, V1_2::MeasureTiming>>
     inputs.reserve(numberOfInputOperands);
     for (size_t operand = 0; operand < numberOfInputOperands; ++operand) {
         // validate input operand information
-        if (index >= data.size() ||
-            data.at(index).getDiscriminator() != discriminator::inputOperandInformation) {
+        if (index >= size ||
+            data[index].getDiscriminator() != discriminator::inputOperandInformation) {
             return NN_ERROR() << "FMQ Request packet ill-formed";
         }
 
         // unpackage operand information
         const FmqRequestDatum::OperandInformation& operandInfo =
-                data.at(index).inputOperandInformation();
+                data[index].inputOperandInformation();
         index++;
         const bool hasNoValue = operandInfo.hasNoValue;
         const V1_0::DataLocation location = operandInfo.location;
@@ -231,13 +320,13 @@ nn::Result<std::tuple<V1_0::Request, std::vector<int32_t>, V1_2::MeasureTiming>>
         dimensions.reserve(numberOfDimensions);
         for (size_t i = 0; i < numberOfDimensions; ++i) {
             // validate dimension
-            if (index >= data.size() ||
-                data.at(index).getDiscriminator() != discriminator::inputOperandDimensionValue) {
+            if (index >= size ||
+                data[index].getDiscriminator() != discriminator::inputOperandDimensionValue) {
                 return NN_ERROR() << "FMQ Request packet ill-formed";
             }
 
             // unpackage dimension
-            const uint32_t dimension = data.at(index).inputOperandDimensionValue();
+            const uint32_t dimension = data[index].inputOperandDimensionValue();
             index++;
 
             // store result
@@ -254,14 +343,14 @@ nn::Result<std::tuple<V1_0::Request, std::vector<int32_t>, V1_2::MeasureTiming>>
     outputs.reserve(numberOfOutputOperands);
     for (size_t operand = 0; operand < numberOfOutputOperands; ++operand) {
         // validate output operand information
-        if (index >= data.size() ||
-            data.at(index).getDiscriminator() != discriminator::outputOperandInformation) {
+        if (index >= size ||
+            data[index].getDiscriminator() != discriminator::outputOperandInformation) {
             return NN_ERROR() << "FMQ Request packet ill-formed";
         }
 
         // unpackage operand information
         const FmqRequestDatum::OperandInformation& operandInfo =
-                data.at(index).outputOperandInformation();
+                data[index].outputOperandInformation();
         index++;
         const bool hasNoValue = operandInfo.hasNoValue;
         const V1_0::DataLocation location = operandInfo.location;
@@ -272,13 +361,13 @@ nn::Result<std::tuple<V1_0::Request, std::vector<int32_t>, V1_2::MeasureTiming>>
         dimensions.reserve(numberOfDimensions);
         for (size_t i = 0; i < numberOfDimensions; ++i) {
             // validate dimension
-            if (index >= data.size() ||
-                data.at(index).getDiscriminator() != discriminator::outputOperandDimensionValue) {
+            if (index >= size ||
+                data[index].getDiscriminator() != discriminator::outputOperandDimensionValue) {
                 return NN_ERROR() << "FMQ Request packet ill-formed";
             }
 
             // unpackage dimension
-            const uint32_t dimension = data.at(index).outputOperandDimensionValue();
+            const uint32_t dimension = data[index].outputOperandDimensionValue();
             index++;
 
             // store result
@@ -295,13 +384,13 @@ nn::Result<std::tuple<V1_0::Request, std::vector<int32_t>, V1_2::MeasureTiming>>
     slots.reserve(numberOfPools);
     for (size_t pool = 0; pool < numberOfPools; ++pool) {
         // validate input operand information
-        if (index >= data.size() ||
-            data.at(index).getDiscriminator() != discriminator::poolIdentifier) {
+        if (index >= size ||
+            data[index].getDiscriminator() != discriminator::poolIdentifier) {
             return NN_ERROR() << "FMQ Request packet ill-formed";
         }
 
         // unpackage operand information
-        const int32_t poolId = data.at(index).poolIdentifier();
+        const int32_t poolId = data[index].poolIdentifier();
         index++;
 
         // store result
@@ -309,12 +398,12 @@ nn::Result<std::tuple<V1_0::Request, std::vector<int32_t>, V1_2::MeasureTiming>>
     }
 
     // validate measureTiming
-    if (index >= data.size() || data.at(index).getDiscriminator() != discriminator::measureTiming) {
+    if (index >= size || data[index].getDiscriminator() != discriminator::measureTiming) {
         return NN_ERROR() << "FMQ Request packet ill-formed";
     }
 
     // unpackage measureTiming
-    const V1_2::MeasureTiming measure = data.at(index).measureTiming();
+    const V1_2::MeasureTiming measure = data[index].measureTiming();
     index++;
 
     // validate packet information
@@ -330,24 +419,29 @@ nn::Result<std::tuple<V1_0::Request, std::vector<int32_t>, V1_2::MeasureTiming>>
 // deserialize a packet into the result
 nn::Result<std::tuple<V1_0::ErrorStatus, std::vector<V1_2::OutputShape>, V1_2::Timing>> deserialize(
         const std::vector<FmqResultDatum>& data) {
+    return deserialize(data.data(), data.size());
+}
+
+nn::Result<std::tuple<V1_0::ErrorStatus, std::vector<V1_2::OutputShape>, V1_2::Timing>> deserialize(
+        const FmqResultDatum* data, size_t size) {
     using discriminator = FmqResultDatum::hidl_discriminator;
     size_t index = 0;
 
     // validate packet information
-    if (index >= data.size() ||
-        data.at(index).getDiscriminator() != discriminator::packetInformation) {
+    if (index >= size ||
+        data[index].getDiscriminator() != discriminator::packetInformation) {
         return NN_ERROR() << "FMQ Result packet ill-formed";
     }
 
     // unpackage packet information
-    const FmqResultDatum::PacketInformation& packetInfo = data.at(index).packetInformation();
+    const FmqResultDatum::PacketInformation& packetInfo = data[index].packetInformation();
     index++;
     const uint32_t packetSize = packetInfo.packetSize;
     const V1_0::ErrorStatus errorStatus = packetInfo.errorStatus;
     const uint32_t numberOfOperands = packetInfo.numberOfOperands;
 
     // verify packet size
-    if (data.size() != packetSize) {
+    if (size != packetSize) {
         return NN_ERROR() << "FMQ Result packet ill-formed";
     }
 
@@ -356,13 +450,13 @@ nn::Result<std::tuple<V1_0::ErrorStatus, std::vector<V1_2::OutputShape>, V1_2::T
     outputShapes.reserve(numberOfOperands);
     for (size_t operand = 0; operand < numberOfOperands; ++operand) {
         // validate operand information
-        if (index >= data.size() ||
-            data.at(index).getDiscriminator() != discriminator::operandInformation) {
+        if (index >= size ||
+            data[index].getDiscriminator() != discriminator::operandInformation) {
             return NN_ERROR() << "FMQ Result packet ill-formed";
         }
 
         // unpackage operand information
-        const FmqResultDatum::OperandInformation& operandInfo = data.at(index).operandInformation();
+        const FmqResultDatum::OperandInformation& operandInfo = data[index].operandInformation();
         index++;
         const bool isSufficient = operandInfo.isSufficient;
         const uint32_t numberOfDimensions = operandInfo.numberOfDimensions;
@@ -372,13 +466,13 @@ nn::Result<std::tuple<V1_0::ErrorStatus, std::vector<V1_2::OutputShape>, V1_2::T
         dimensions.reserve(numberOfDimensions);
         for (size_t i = 0; i < numberOfDimensions; ++i) {
             // validate dimension
-            if (index >= data.size() ||
-                data.at(index).getDiscriminator() != discriminator::operandDimensionValue) {
+            if (index >= size ||
+                data[index].getDiscriminator() != discriminator::operandDimensionValue) {
                 return NN_ERROR() << "FMQ Result packet ill-formed";
             }
 
             // unpackage dimension
-            const uint32_t dimension = data.at(index).operandDimensionValue();
+            const uint32_t dimension = data[index].operandDimensionValue();
             index++;
 
             // store result
@@ -390,13 +484,13 @@ nn::Result<std::tuple<V1_0::ErrorStatus, std::vector<V1_2::OutputShape>, V1_2::T
     }
 
     // validate execution timing
-    if (index >= data.size() ||
-        data.at(index).getDiscriminator() != discriminator::executionTiming) {
+    if (index >= size ||
+        data[index].getDiscriminator() != discriminator::executionTiming) {
         return NN_ERROR() << "FMQ Result packet ill-formed";
     }
 
     // unpackage execution timing
-    const V1_2::Timing timing = data.at(index).executionTiming();
+    const V1_2::Timing timing = data[index].executionTiming();
     index++;
 
     // validate packet information
@@ -430,8 +524,8 @@ RequestChannelSender::RequestChannelSender(PrivateConstructorTag /*tag*/, size_t
 nn::Result<void> RequestChannelSender::send(const V1_0::Request& request,
                                             V1_2::MeasureTiming measure,
                                             const std::vector<int32_t>& slots) {
-    const std::vector<FmqRequestDatum> serialized = serialize(request, measure, slots);
-    return sendPacket(serialized);
+    serialize(request, measure, slots, &mPacket);
+    return sendPacket(mPacket);
 }
 
 nn::Result<void> RequestChannelSender::sendPacket(const std::vector<FmqRequestDatum>& packet) {
@@ -485,8 +579,10 @@ RequestChannelReceiver::RequestChannelReceiver(
 
 nn::Result<std::tuple<V1_0::Request, std::vector<int32_t>, V1_2::MeasureTiming>>
 RequestChannelReceiver::getBlocking() {
-    const auto packet = NN_TRY(getPacketBlocking());
-    return deserialize(packet);
+    return receivePacketBlocking(
+            &mFmqRequestChannel, kPollingTimeWindow, [this] { return mTeardown.load(); },
+            "FMQ object is being torn down", &mPacket,
+            [](const FmqRequestDatum* data, size_t size) { return deserialize(data, size); });
 }
 
 void RequestChannelReceiver::invalidate() {
@@ -501,66 +597,13 @@ void RequestChannelReceiver::invalidate() {
 }
 
 nn::Result<std::vector<FmqRequestDatum>> RequestChannelReceiver::getPacketBlocking() {
-    if (mTeardown) {
-        return NN_ERROR() << "FMQ object is being torn down";
-    }
-
-    // First spend time polling if results are available in FMQ instead of waiting on the futex.
-    // Polling is more responsive (yielding lower latencies), but can take up more power, so only
-    // poll for a limited period of time.
-
-    auto& getCurrentTime = std::chrono::high_resolution_clock::now;
-    const auto timeToStopPolling = getCurrentTime() + kPollingTimeWindow;
-
-    while (getCurrentTime() < timeToStopPolling) {
-        // if class is being torn down, immediately return
-        if (mTeardown.load(std::memory_order_relaxed)) {
-            return NN_ERROR() << "FMQ object is being torn down";
-        }
-
-        // Check if data is available. If it is, immediately retrieve it and return.
-        const size_t available = mFmqRequestChannel.availableToRead();
-        if (available > 0) {
-            std::vector<FmqRequestDatum> packet(available);
-            const bool success = mFmqRequestChannel.readBlocking(packet.data(), available);
-            if (!success) {
-                return NN_ERROR() << "Error receiving packet";
-            }
-            return packet;
-        }
-
-        std::this_thread::yield();
-    }
-
-    // If we get to this point, we either stopped polling because it was taking too long or polling
-    // was not allowed. Instead, perform a blocking call which uses a futex to save power.
-
-    // wait for request packet and read first element of request packet
-    FmqRequestDatum datum;
-    bool success = mFmqRequestChannel.readBlocking(&datum, 1);
-
-    // retrieve remaining elements
-    // NOTE: all of the data is already available at this point, so there's no need to do a blocking
-    // wait to wait for more data. This is known because in FMQ, all writes are published (made
-    // available) atomically. Currently, the producer always publishes the entire packet in one
-    // function call, so if the first element of the packet is available, the remaining elements are
-    // also available.
-    const size_t count = mFmqRequestChannel.availableToRead();
-    std::vector<FmqRequestDatum> packet(count + 1);
-    std::memcpy(&packet.front(), &datum, sizeof(datum));
-    success &= mFmqRequestChannel.read(packet.data() + 1, count);
-
-    // terminate loop
-    if (mTeardown) {
-        return NN_ERROR() << "FMQ object is being torn down";
-    }
-
-    // ensure packet was successfully received
-    if (!success) {
-        return NN_ERROR() << "Error receiving packet";
-    }
-
-    return packet;
+    return receivePacketBlocking(
+            &mFmqRequestChannel, kPollingTimeWindow, [this] { return mTeardown.load(); },
+            "FMQ object is being torn down", &mPacket,
+            [](const FmqRequestDatum* data,
+               size_t size) -> nn::Result<std::vector<FmqRequestDatum>> {
+                return std::vector<FmqRequestDatum>(data, data + size);
+            });
 }
 
 // ResultChannelSender methods
@@ -588,8 +631,8 @@ ResultChannelSender::ResultChannelSender(PrivateConstructorTag /*tag*/,
 void ResultChannelSender::send(V1_0::ErrorStatus errorStatus,
                                const std::vector<V1_2::OutputShape>& outputShapes,
                                V1_2::Timing timing) {
-    const std::vector<FmqResultDatum> serialized = serialize(errorStatus, outputShapes, timing);
-    sendPacket(serialized);
+    serialize(errorStatus, outputShapes, timing, &mPacket);
+    sendPacket(mPacket);
 }
 
 void ResultChannelSender::sendPacket(const std::vector<FmqResultDatum>& packet) {
@@ -632,8 +675,10 @@ ResultChannelReceiver::ResultChannelReceiver(PrivateConstructorTag /*tag*/, size
 
 nn::Result<std::tuple<V1_0::ErrorStatus, std::vector<V1_2::OutputShape>, V1_2::Timing>>
 ResultChannelReceiver::getBlocking() {
-    const auto packet = NN_TRY(getPacketBlocking());
-    return deserialize(packet);
+    return receivePacketBlocking(
+            &mFmqResultChannel, kPollingTimeWindow, [this] { return !mValid.load(); },
+            "FMQ object is invalid", &mPacket,
+            [](const FmqResultDatum* data, size_t size) { return deserialize(data, size); });
 }
 
 void ResultChannelReceiver::notifyAsDeadObject() {
@@ -648,65 +693,13 @@ void ResultChannelReceiver::notifyAsDeadObject() {
 }
 
 nn::Result<std::vector<FmqResultDatum>> ResultChannelReceiver::getPacketBlocking() {
-    if (!mValid) {
-        return NN_ERROR() << "FMQ object is invalid";
-    }
-
-    // First spend time polling if results are available in FMQ instead of waiting on the futex.
-    // Polling is more responsive (yielding lower latencies), but can take up more power, so only
-    // poll for a limited period of time.
-
-    auto& getCurrentTime = std::chrono::high_resolution_clock::now;
-    const auto timeToStopPolling = getCurrentTime() + kPollingTimeWindow;
-
-    while (getCurrentTime() < timeToStopPolling) {
-        // if class is being torn down, immediately return
-        if (!mValid.load(std::memory_order_relaxed)) {
-            return NN_ERROR() << "FMQ object is invalid";
-        }
-
-        // Check if data is available. If it is, immediately retrieve it and return.
-        const size_t available = mFmqResultChannel.availableToRead();
-        if (available > 0) {
-            std::vector<FmqResultDatum> packet(available);
-            const bool success = mFmqResultChannel.readBlocking(packet.data(), available);
-            if (!success) {
-                return NN_ERROR() << "Error receiving packet";
-            }
-            return packet;
-        }
-
-        std::this_thread::yield();
-    }
-
-    // If we get to this point, we either stopped polling because it was taking too long or polling
-    // was not allowed. Instead, perform a blocking call which uses a futex to save power.
-
-    // wait for result packet and read first element of result packet
-    FmqResultDatum datum;
-    bool success = mFmqResultChannel.readBlocking(&datum, 1);
-
-    // retrieve remaining elements
-    // NOTE: all of the data is already available at this point, so there's no need to do a blocking
-    // wait to wait for more data. This is known because in FMQ, all writes are published (made
-    // available) atomically. Currently, the producer always publishes the entire packet in one
-    // function call, so if the first element of the packet is available, the remaining elements are
-    // also available.
-    const size_t count = mFmqResultChannel.availableToRead();
-    std::vector<FmqResultDatum> packet(count + 1);
-    std::memcpy(&packet.front(), &datum, sizeof(datum));
-    success &= mFmqResultChannel.read(packet.data() + 1, count);
-
-    if (!mValid) {
-        return NN_ERROR() << "FMQ object is invalid";
-    }
-
-    // ensure packet was successfully received
-    if (!success) {
-        return NN_ERROR() << "Error receiving packet";
-    }
-
-    return packet;
+    return receivePacketBlocking(
+            &mFmqResultChannel, kPollingTimeWindow, [this] { return !mValid.load(); },
+            "FMQ object is invalid", &mPacket,
+            [](const FmqResultDatum* data,
+               size_t size) -> nn::Result<std::vector<FmqResultDatum>> {
+                return std::vector<FmqResultDatum>(data, data + size);
+            });
 }
 
 }  // namespace android::hardware::neuralnetworks::V1_2::utils
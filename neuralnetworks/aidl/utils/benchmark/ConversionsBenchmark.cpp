@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the conversion of large models between the canonical and the AIDL types, in both
+// directions, with and without the validation done by convert(). The models are synthesized
+// chains of ADD operations, each with its own constant operand, so the operand and operation
+// tables and the constant pool all grow with the number of operations.
+
+#include <benchmark/benchmark.h>
+#include <nnapi/Result.h>
+#include <nnapi/Types.h>
+#include <nnapi/hal/aidl/Conversions.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace aidl::android::hardware::neuralnetworks::utils {
+namespace {
+
+constexpr uint32_t kWidth = 16;
+
+nn::Operand makeTensor(nn::Operand::LifeTime lifetime, nn::DataLocation location = {}) {
+    return nn::Operand{
+            .type = nn::OperandType::TENSOR_FLOAT32,
+            .dimensions = {1, kWidth},
+            .scale = 0.0f,
+            .zeroPoint = 0,
+            .lifetime = lifetime,
+            .location = location,
+    };
+}
+
+// Builds out = ADD(...ADD(ADD(in, c0), c1)..., cN-1) with the constants copied into the model.
+nn::Model makeModel(size_t operationCount) {
+    nn::Model model;
+    auto& operands = model.main.operands;
+    operands.reserve(2 * operationCount + 2);
+
+    const std::vector<float> constant(kWidth, 1.0f);
+    const int32_t activation = 0;
+    const auto activationLocation = model.operandValues.append(
+            reinterpret_cast<const uint8_t*>(&activation), sizeof(activation));
+    operands.push_back(nn::Operand{
+            .type = nn::OperandType::INT32,
+            .lifetime = nn::Operand::LifeTime::CONSTANT_COPY,
+            .location = activationLocation,
+    });
+    const uint32_t activationIndex = 0;
+
+    operands.push_back(makeTensor(nn::Operand::LifeTime::SUBGRAPH_INPUT));
+    uint32_t previous = 1;
+    model.main.operations.reserve(operationCount);
+    for (size_t i = 0; i < operationCount; ++i) {
+        const auto location =
+                model.operandValues.append(reinterpret_cast<const uint8_t*>(constant.data()),
+                                           constant.size() * sizeof(float));
+        operands.push_back(makeTensor(nn::Operand::LifeTime::CONSTANT_COPY, location));
+        const auto constantIndex = static_cast<uint32_t>(operands.size() - 1);
+
+        const bool last = i + 1 == operationCount;
+        operands.push_back(makeTensor(last ? nn::Operand::LifeTime::SUBGRAPH_OUTPUT
+                                           : nn::Operand::LifeTime::TEMPORARY_VARIABLE));
+        const auto output = static_cast<uint32_t>(operands.size() - 1);
+
+        model.main.operations.push_back(nn::Operation{
+                .type = nn::OperationType::ADD,
+                .inputs = {previous, constantIndex, activationIndex},
+                .outputs = {output},
+        });
+        previous = output;
+    }
+
+    model.main.inputIndexes = {1};
+    model.main.outputIndexes = {previous};
+    return model;
+}
+
+void setCounters(benchmark::State& state) {
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void BM_CanonicalToAidl(benchmark::State& state) {
+    const auto model = makeModel(state.range(0));
+    for (auto _ : state) {
+        auto result = convert(model);
+        if (!result.has_value()) {
+            state.SkipWithError(result.error().message.c_str());
+            return;
+        }
+        benchmark::DoNotOptimize(result);
+    }
+    setCounters(state);
+}
+
+void BM_CanonicalToAidlUnvalidated(benchmark::State& state) {
+    const auto model = makeModel(state.range(0));
+    for (auto _ : state) {
+        auto result = unvalidatedConvert(model);
+        if (!result.has_value()) {
+            state.SkipWithError(result.error().message.c_str());
+            return;
+        }
+        benchmark::DoNotOptimize(result);
+    }
+    setCounters(state);
+}
+
+void BM_AidlToCanonical(benchmark::State& state) {
+    const auto aidlModel = unvalidatedConvert(makeModel(state.range(0))).value();
+    for (auto _ : state) {
+        auto result = nn::convert(aidlModel);
+        if (!result.has_value()) {
+            state.SkipWithError(result.error().message.c_str());
+            return;
+        }
+        benchmark::DoNotOptimize(result);
+    }
+    setCounters(state);
+}
+
+void BM_AidlToCanonicalUnvalidated(benchmark::State& state) {
+    const auto aidlModel = unvalidatedConvert(makeModel(state.range(0))).value();
+    for (auto _ : state) {
+        auto result = nn::unvalidatedConvert(aidlModel);
+        if (!result.has_value()) {
+            state.SkipWithError(result.error().message.c_str());
+            return;
+        }
+        benchmark::DoNotOptimize(result);
+    }
+    setCounters(state);
+}
+
+void applyOperationCounts(benchmark::internal::Benchmark* b) {
+    b->Arg(1000)->Arg(10000)->Arg(50000)->Unit(benchmark::kMillisecond);
+}
+
+BENCHMARK(BM_CanonicalToAidl)->Apply(applyOperationCounts);
+BENCHMARK(BM_CanonicalToAidlUnvalidated)->Apply(applyOperationCounts);
+BENCHMARK(BM_AidlToCanonical)->Apply(applyOperationCounts);
+BENCHMARK(BM_AidlToCanonicalUnvalidated)->Apply(applyOperationCounts);
+
+}  // namespace
+}  // namespace aidl::android::hardware::neuralnetworks::utils
+
+BENCHMARK_MAIN();
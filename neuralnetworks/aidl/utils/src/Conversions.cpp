@@ -107,6 +107,50 @@ GeneralResult<std::vector<UnvalidatedConvertOutput<Type>>> validatedConvert(
     return canonical;
 }
 
+// The operand and operation tables of a model are converted in place into storage sized once up
+// front, checking and copying each index vector in a single pass. This avoids a temporary result
+// object per element, which dominates the conversion time of models with many operations.
+
+GeneralResult<void> copyToUnsigned(const std::vector<int32_t>& vec, std::vector<uint32_t>* out) {
+    out->resize(vec.size());
+    for (size_t i = 0; i < vec.size(); ++i) {
+        if (vec[i] < 0) {
+            return NN_ERROR() << "Negative value passed to conversion from signed to unsigned";
+        }
+        (*out)[i] = static_cast<uint32_t>(vec[i]);
+    }
+    return {};
+}
+
+GeneralResult<void> unvalidatedConvertInto(const aidl_hal::Operand& operand, Operand* canonical) {
+    canonical->type = NN_TRY(nn::unvalidatedConvert(operand.type));
+    NN_TRY(copyToUnsigned(operand.dimensions, &canonical->dimensions));
+    canonical->scale = operand.scale;
+    canonical->zeroPoint = operand.zeroPoint;
+    canonical->lifetime = NN_TRY(nn::unvalidatedConvert(operand.lifetime));
+    canonical->location = NN_TRY(nn::unvalidatedConvert(operand.location));
+    canonical->extraParams = NN_TRY(nn::unvalidatedConvert(operand.extraParams));
+    return {};
+}
+
+GeneralResult<void> unvalidatedConvertInto(const aidl_hal::Operation& operation,
+                                           Operation* canonical) {
+    canonical->type = NN_TRY(nn::unvalidatedConvert(operation.type));
+    NN_TRY(copyToUnsigned(operation.inputs, &canonical->inputs));
+    NN_TRY(copyToUnsigned(operation.outputs, &canonical->outputs));
+    return {};
+}
+
+template <typename CanonicalType, typename Type>
+GeneralResult<std::vector<CanonicalType>> unvalidatedConvertTable(
+        const std::vector<Type>& arguments) {
+    std::vector<CanonicalType> canonical(arguments.size());
+    for (size_t i = 0; i < arguments.size(); ++i) {
+        NN_TRY(unvalidatedConvertInto(arguments[i], &canonical[i]));
+    }
+    return canonical;
+}
+
 struct NativeHandleDeleter {
     void operator()(native_handle_t* handle) const {
         if (handle) {
@@ -234,14 +278,9 @@ GeneralResult<DataLocation> unvalidatedConvert(const aidl_hal::DataLocation& loc
 }
 
 GeneralResult<Operation> unvalidatedConvert(const aidl_hal::Operation& operation) {
-    const auto type = NN_TRY(unvalidatedConvert(operation.type));
-    auto inputs = NN_TRY(toUnsigned(operation.inputs));
-    auto outputs = NN_TRY(toUnsigned(operation.outputs));
-    return Operation{
-            .type = type,
-            .inputs = std::move(inputs),
-            .outputs = std::move(outputs),
-    };
+    Operation canonical;
+    NN_TRY(unvalidatedConvertInto(operation, &canonical));
+    return canonical;
 }
 
 GeneralResult<Operand::LifeTime> unvalidatedConvert(
@@ -250,20 +289,9 @@ GeneralResult<Operand::LifeTime> unvalidatedConvert(
 }
 
 GeneralResult<Operand> unvalidatedConvert(const aidl_hal::Operand& operand) {
-    const auto type = NN_TRY(unvalidatedConvert(operand.type));
-    auto dimensions = NN_TRY(toUnsigned(operand.dimensions));
-    const auto lifetime = NN_TRY(unvalidatedConvert(operand.lifetime));
-    const auto location = NN_TRY(unvalidatedConvert(operand.location));
-    auto extraParams = NN_TRY(unvalidatedConvert(operand.extraParams));
-    return Operand{
-            .type = type,
-            .dimensions = std::move(dimensions),
-            .scale = operand.scale,
-            .zeroPoint = operand.zeroPoint,
-            .lifetime = lifetime,
-            .location = location,
-            .extraParams = std::move(extraParams),
-    };
+    Operand canonical;
+    NN_TRY(unvalidatedConvertInto(operand, &canonical));
+    return canonical;
 }
 
 GeneralResult<Operand::ExtraParams> unvalidatedConvert(
@@ -310,8 +338,8 @@ GeneralResult<Model> unvalidatedConvert(const aidl_hal::Model& model) {
 }
 
 GeneralResult<Model::Subgraph> unvalidatedConvert(const aidl_hal::Subgraph& subgraph) {
-    auto operands = NN_TRY(unvalidatedConvert(subgraph.operands));
-    auto operations = NN_TRY(unvalidatedConvert(subgraph.operations));
+    auto operands = NN_TRY(unvalidatedConvertTable<Operand>(subgraph.operands));
+    auto operations = NN_TRY(unvalidatedConvertTable<Operation>(subgraph.operations));
     auto inputIndexes = NN_TRY(toUnsigned(subgraph.inputIndexes));
     auto outputIndexes = NN_TRY(toUnsigned(subgraph.outputIndexes));
     return Model::Subgraph{
@@ -527,7 +555,7 @@ GeneralResult<ExecutionPreference> unvalidatedConvert(
 
 GeneralResult<std::vector<Operation>> unvalidatedConvert(
         const std::vector<aidl_hal::Operation>& operations) {
-    return unvalidatedConvertVec(operations);
+    return unvalidatedConvertTable<Operation>(operations);
 }
 
 GeneralResult<SharedHandle> unvalidatedConvert(const ndk::ScopedFileDescriptor& handle) {
@@ -624,10 +652,9 @@ GeneralResult<std::vector<BufferRole>> convert(const std::vector<aidl_hal::Buffe
 }
 
 GeneralResult<std::vector<uint32_t>> toUnsigned(const std::vector<int32_t>& vec) {
-    if (!std::all_of(vec.begin(), vec.end(), [](int32_t v) { return v >= 0; })) {
-        return NN_ERROR() << "Negative value passed to conversion from signed to unsigned";
-    }
-    return std::vector<uint32_t>(vec.begin(), vec.end());
+    std::vector<uint32_t> result;
+    NN_TRY(copyToUnsigned(vec, &result));
+    return result;
 }
 
 }  // namespace android::nn
@@ -645,6 +672,17 @@ struct overloaded : Ts... {
 template <class... Ts>
 overloaded(Ts...) -> overloaded<Ts...>;
 
+nn::GeneralResult<void> copyToSigned(const std::vector<uint32_t>& vec, std::vector<int32_t>* out) {
+    out->resize(vec.size());
+    for (size_t i = 0; i < vec.size(); ++i) {
+        if (vec[i] > static_cast<uint32_t>(std::numeric_limits<int32_t>::max())) {
+            return NN_ERROR() << "Vector contains a value that doesn't fit into int32_t.";
+        }
+        (*out)[i] = static_cast<int32_t>(vec[i]);
+    }
+    return {};
+}
+
 #ifdef __ANDROID__
 nn::GeneralResult<common::NativeHandle> aidlHandleFromNativeHandle(
         const native_handle_t& nativeHandle) {
@@ -814,6 +852,41 @@ nn::GeneralResult<std::vector<UnvalidatedConvertOutput<Type>>> validatedConvert(
     return halObject;
 }
 
+nn::GeneralResult<void> unvalidatedConvertInto(const nn::Operand& operand, Operand* aidlOperand) {
+    if (operand.lifetime == nn::Operand::LifeTime::POINTER) {
+        return NN_ERROR(nn::ErrorStatus::INVALID_ARGUMENT)
+               << "Model cannot be unvalidatedConverted because it contains pointer-based memory";
+    }
+    aidlOperand->type = NN_TRY(unvalidatedConvert(operand.type));
+    NN_TRY(copyToSigned(operand.dimensions, &aidlOperand->dimensions));
+    aidlOperand->scale = operand.scale;
+    aidlOperand->zeroPoint = operand.zeroPoint;
+    aidlOperand->lifetime = NN_TRY(unvalidatedConvert(operand.lifetime));
+    aidlOperand->location = NN_TRY(unvalidatedConvert(operand.location));
+    aidlOperand->extraParams = NN_TRY(unvalidatedConvert(operand.extraParams));
+    return {};
+}
+
+nn::GeneralResult<void> unvalidatedConvertInto(const nn::Operation& operation,
+                                               Operation* aidlOperation) {
+    aidlOperation->type = NN_TRY(unvalidatedConvert(operation.type));
+    NN_TRY(copyToSigned(operation.inputs, &aidlOperation->inputs));
+    NN_TRY(copyToSigned(operation.outputs, &aidlOperation->outputs));
+    return {};
+}
+
+// Converts the operand or operation table of a subgraph in place into storage sized once up front,
+// without a temporary result object per element.
+template <typename AidlType, typename Type>
+nn::GeneralResult<std::vector<AidlType>> unvalidatedConvertTable(
+        const std::vector<Type>& arguments) {
+    std::vector<AidlType> halObject(arguments.size());
+    for (size_t i = 0; i < arguments.size(); ++i) {
+        NN_TRY(unvalidatedConvertInto(arguments[i], &halObject[i]));
+    }
+    return halObject;
+}
+
 }  // namespace
 
 nn::GeneralResult<std::vector<uint8_t>> unvalidatedConvert(const nn::CacheToken& cacheToken) {
@@ -950,20 +1023,9 @@ nn::GeneralResult<std::optional<OperandExtraParams>> unvalidatedConvert(
 }
 
 nn::GeneralResult<Operand> unvalidatedConvert(const nn::Operand& operand) {
-    const auto type = NN_TRY(unvalidatedConvert(operand.type));
-    auto dimensions = NN_TRY(toSigned(operand.dimensions));
-    const auto lifetime = NN_TRY(unvalidatedConvert(operand.lifetime));
-    const auto location = NN_TRY(unvalidatedConvert(operand.location));
-    auto extraParams = NN_TRY(unvalidatedConvert(operand.extraParams));
-    return Operand{
-            .type = type,
-            .dimensions = std::move(dimensions),
-            .scale = operand.scale,
-            .zeroPoint = operand.zeroPoint,
-            .lifetime = lifetime,
-            .location = location,
-            .extraParams = std::move(extraParams),
-    };
+    Operand aidlOperand;
+    NN_TRY(unvalidatedConvertInto(operand, &aidlOperand));
+    return aidlOperand;
 }
 
 nn::GeneralResult<OperationType> unvalidatedConvert(const nn::OperationType& operationType) {
@@ -974,19 +1036,14 @@ nn::GeneralResult<OperationType> unvalidatedConvert(const nn::OperationType& ope
 }
 
 nn::GeneralResult<Operation> unvalidatedConvert(const nn::Operation& operation) {
-    const auto type = NN_TRY(unvalidatedConvert(operation.type));
-    auto inputs = NN_TRY(toSigned(operation.inputs));
-    auto outputs = NN_TRY(toSigned(operation.outputs));
-    return Operation{
-            .type = type,
-            .inputs = std::move(inputs),
-            .outputs = std::move(outputs),
-    };
+    Operation aidlOperation;
+    NN_TRY(unvalidatedConvertInto(operation, &aidlOperation));
+    return aidlOperation;
 }
 
 nn::GeneralResult<Subgraph> unvalidatedConvert(const nn::Model::Subgraph& subgraph) {
-    auto operands = NN_TRY(unvalidatedConvert(subgraph.operands));
-    auto operations = NN_TRY(unvalidatedConvert(subgraph.operations));
+    auto operands = NN_TRY(unvalidatedConvertTable<Operand>(subgraph.operands));
+    auto operations = NN_TRY(unvalidatedConvertTable<Operation>(subgraph.operations));
     auto inputIndexes = NN_TRY(toSigned(subgraph.inputIndexes));
     auto outputIndexes = NN_TRY(toSigned(subgraph.outputIndexes));
     return Subgraph{
@@ -1011,11 +1068,8 @@ nn::GeneralResult<ExtensionNameAndPrefix> unvalidatedConvert(
 }
 
 nn::GeneralResult<Model> unvalidatedConvert(const nn::Model& model) {
-    if (!hal::utils::hasNoPointerData(model)) {
-        return NN_ERROR(nn::ErrorStatus::INVALID_ARGUMENT)
-               << "Model cannot be unvalidatedConverted because it contains pointer-based memory";
-    }
-
+    // Operands with pointer-based memory are rejected while the operand tables are converted, so
+    // the model is not traversed separately for them.
     auto main = NN_TRY(unvalidatedConvert(model.main));
     auto referenced = NN_TRY(unvalidatedConvert(model.referenced));
     auto operandValues = NN_TRY(unvalidatedConvert(model.operandValues));
@@ -1244,11 +1298,9 @@ nn::GeneralResult<std::vector<Extension>> convert(const std::vector<nn::Extensio
 }
 
 nn::GeneralResult<std::vector<int32_t>> toSigned(const std::vector<uint32_t>& vec) {
-    if (!std::all_of(vec.begin(), vec.end(),
-                     [](uint32_t v) { return v <= std::numeric_limits<int32_t>::max(); })) {
-        return NN_ERROR() << "Vector contains a value that doesn't fit into int32_t.";
-    }
-    return std::vector<int32_t>(vec.begin(), vec.end());
+    std::vector<int32_t> result;
+    NN_TRY(copyToSigned(vec, &result));
+    return result;
 }
 
 std::vector<uint8_t> toVec(const std::array<uint8_t, IDevice::BYTE_SIZE_OF_CACHE_TOKEN>& token) {
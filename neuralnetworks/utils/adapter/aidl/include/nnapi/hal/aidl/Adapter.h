@@ -55,7 +55,8 @@ std::shared_ptr<BnDevice> adapt(::android::nn::SharedDevice device, Executor exe
 /**
  * Adapt an NNAPI canonical interface object to a AIDL NN HAL interface object.
  *
- * This function uses a default executor, which will execute tasks from a detached thread.
+ * This function uses a default executor, which runs tasks on a pool of threads shared by the
+ * adapted devices, earliest deadline first.
  *
  * @param device NNAPI canonical IDevice interface object to be adapted.
  * @return AIDL NN HAL IDevice interface object.
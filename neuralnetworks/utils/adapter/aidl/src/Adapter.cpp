@@ -22,23 +22,28 @@
 #include <android/binder_interface_utils.h>
 #include <nnapi/IDevice.h>
 #include <nnapi/Types.h>
+#include <nnapi/hal/ThreadPool.h>
 
 #include <functional>
 #include <memory>
-#include <thread>
 
 // See hardware/interfaces/neuralnetworks/utils/README.md for more information on AIDL interface
 // lifetimes across processes and for protecting asynchronous calls across AIDL.
 
 namespace aidl::android::hardware::neuralnetworks::adapter {
 
+using ::android::hardware::neuralnetworks::utils::ThreadPool;
+
 std::shared_ptr<BnDevice> adapt(::android::nn::SharedDevice device, Executor executor) {
     return ndk::SharedRefBase::make<Device>(std::move(device), std::move(executor));
 }
 
 std::shared_ptr<BnDevice> adapt(::android::nn::SharedDevice device) {
-    Executor defaultExecutor = [](Task task, ::android::nn::OptionalTimePoint /*deadline*/) {
-        std::thread(std::move(task)).detach();
+    // Shared by all adapted devices, and never destroyed so that tasks still queued at exit do not
+    // have to be run.
+    static auto* const kThreadPool = new ThreadPool(ThreadPool::getDefaultThreadCount());
+    Executor defaultExecutor = [](Task task, ::android::nn::OptionalTimePoint deadline) {
+        kThreadPool->schedule(std::move(task), deadline);
     };
     return adapt(std::move(device), std::move(defaultExecutor));
 }
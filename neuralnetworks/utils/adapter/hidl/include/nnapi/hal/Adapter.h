@@ -55,7 +55,8 @@ sp<V1_3::IDevice> adapt(nn::SharedDevice device, Executor executor);
 /**
  * Adapt an NNAPI canonical interface object to a HIDL NN HAL interface object.
  *
- * This function uses a default executor, which will execute tasks from a detached thread.
+ * This function uses a default executor, which runs tasks on a pool of threads shared by the
+ * adapted devices, earliest deadline first.
  *
  * @param device NNAPI canonical IDevice interface object to be adapted.
  * @return HIDL NN HAL IDevice interface object.
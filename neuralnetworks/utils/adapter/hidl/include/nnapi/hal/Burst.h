@@ -33,6 +33,8 @@
 
 #include <atomic>
 #include <chrono>
+#include <list>
+#include <map>
 #include <memory>
 #include <optional>
 #include <thread>
@@ -52,13 +54,20 @@ class Burst : public V1_2::IBurstContext {
     /**
      * Class to cache the memory objects for a burst object.
      *
+     * The cache holds at most its capacity of entries, besides those of the slots of the request
+     * being retrieved. Beyond that, the least recently used entries are dropped, and are retrieved
+     * again through V1_2::IBurstCallback if a later request uses their slots.
+     *
      * This class is thread-safe.
      */
     class MemoryCache {
       public:
+        static constexpr size_t kDefaultCapacity = 128;
+
         // Precondition: burstExecutor != nullptr
         // Precondition: burstCallback != nullptr
-        MemoryCache(nn::SharedBurst burstExecutor, sp<V1_2::IBurstCallback> burstCallback);
+        MemoryCache(nn::SharedBurst burstExecutor, sp<V1_2::IBurstCallback> burstCallback,
+                    size_t capacity = kDefaultCapacity);
 
         /**
          * Get the cached memory objects corresponding to provided slot identifiers.
@@ -83,17 +92,28 @@ class Burst : public V1_2::IBurstContext {
         void removeCacheEntry(int32_t slot);
 
       private:
+        struct CacheEntry {
+            nn::SharedMemory memory;
+            nn::IBurst::OptionalCacheHold hold;
+            std::list<int32_t>::iterator lruPosition;
+        };
+
         nn::GeneralResult<void> ensureCacheEntriesArePresentLocked(
                 const std::vector<int32_t>& slots) REQUIRES(mMutex);
         nn::GeneralResult<std::pair<nn::SharedMemory, nn::IBurst::OptionalCacheHold>>
         getCacheEntryLocked(int32_t slot) REQUIRES(mMutex);
         void addCacheEntryLocked(int32_t slot, nn::SharedMemory memory) REQUIRES(mMutex);
+        // Drops least recently used entries until the cache is within its capacity, keeping those
+        // used since position "pinned", which is the LRU position of the first of them.
+        void evictLocked(std::list<int32_t>::const_iterator pinned) REQUIRES(mMutex);
 
         std::mutex mMutex;
-        std::map<int32_t, std::pair<nn::SharedMemory, nn::IBurst::OptionalCacheHold>> mCache
-                GUARDED_BY(mMutex);
+        std::map<int32_t, CacheEntry> mCache GUARDED_BY(mMutex);
+        // Cached slots, least recently used first.
+        std::list<int32_t> mLru GUARDED_BY(mMutex);
         nn::SharedBurst kBurstExecutor;
         const sp<V1_2::IBurstCallback> kBurstCallback;
+        const size_t kCapacity;
     };
 
     /**
@@ -21,23 +21,28 @@
 #include <android/hardware/neuralnetworks/1.3/IDevice.h>
 #include <nnapi/IDevice.h>
 #include <nnapi/Types.h>
+#include <nnapi/hal/ThreadPool.h>
 
 #include <functional>
 #include <memory>
-#include <thread>
 
 // See hardware/interfaces/neuralnetworks/utils/README.md for more information on HIDL interface
 // lifetimes across processes and for protecting asynchronous calls across HIDL.
 
 namespace android::hardware::neuralnetworks::adapter {
 
+using ::android::hardware::neuralnetworks::utils::ThreadPool;
+
 sp<V1_3::IDevice> adapt(nn::SharedDevice device, Executor executor) {
     return sp<Device>::make(std::move(device), std::move(executor));
 }
 
 sp<V1_3::IDevice> adapt(nn::SharedDevice device) {
-    Executor defaultExecutor = [](Task task, nn::OptionalTimePoint /*deadline*/) {
-        std::thread(std::move(task)).detach();
+    // Shared by all adapted devices, and never destroyed so that tasks still queued at exit do not
+    // have to be run.
+    static auto* const kThreadPool = new ThreadPool(ThreadPool::getDefaultThreadCount());
+    Executor defaultExecutor = [](Task task, nn::OptionalTimePoint deadline) {
+        kThreadPool->schedule(std::move(task), deadline);
     };
     return adapt(std::move(device), std::move(defaultExecutor));
 }
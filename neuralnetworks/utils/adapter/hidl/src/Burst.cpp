@@ -60,8 +60,10 @@ nn::GeneralResult<std::vector<nn::SharedMemory>> getMemoriesCallback(
 }  // anonymous namespace
 
 Burst::MemoryCache::MemoryCache(nn::SharedBurst burstExecutor,
-                                sp<V1_2::IBurstCallback> burstCallback)
-    : kBurstExecutor(std::move(burstExecutor)), kBurstCallback(std::move(burstCallback)) {
+                                sp<V1_2::IBurstCallback> burstCallback, size_t capacity)
+    : kBurstExecutor(std::move(burstExecutor)),
+      kBurstCallback(std::move(burstCallback)),
+      kCapacity(capacity) {
     CHECK(kBurstExecutor != nullptr);
     CHECK(kBurstCallback != nullptr);
 }
@@ -77,6 +79,21 @@ Burst::MemoryCache::getCacheEntries(const std::vector<int32_t>& slots) {
         results.push_back(NN_TRY(getCacheEntryLocked(slot)));
     }
 
+    // Mark the entries of this request as most recently used, then trim the older ones. The
+    // results hold their own references, so eviction never affects the current execution.
+    auto pinned = mLru.cend();
+    for (int32_t slot : slots) {
+        auto& lruPosition = mCache.at(slot).lruPosition;
+        if (lruPosition == pinned) {
+            continue;
+        }
+        mLru.splice(mLru.end(), mLru, lruPosition);
+        if (pinned == mLru.cend()) {
+            pinned = lruPosition;
+        }
+    }
+    evictLocked(pinned);
+
     return results;
 }
 
@@ -122,7 +139,7 @@ nn::GeneralResult<void> Burst::MemoryCache::ensureCacheEntriesArePresentLocked(
 nn::GeneralResult<std::pair<nn::SharedMemory, nn::IBurst::OptionalCacheHold>>
 Burst::MemoryCache::getCacheEntryLocked(int32_t slot) {
     if (const auto iter = mCache.find(slot); iter != mCache.end()) {
-        return iter->second;
+        return std::make_pair(iter->second.memory, iter->second.hold);
     }
     return NN_ERROR() << "Burst::MemoryCache::getCacheEntryLocked failed because slot " << slot
                       << " is not present in the cache";
@@ -130,12 +147,25 @@ Burst::MemoryCache::getCacheEntryLocked(int32_t slot) {
 
 void Burst::MemoryCache::addCacheEntryLocked(int32_t slot, nn::SharedMemory memory) {
     auto hold = kBurstExecutor->cacheMemory(memory);
-    mCache.emplace(slot, std::make_pair(std::move(memory), std::move(hold)));
+    const auto lruPosition = mLru.insert(mLru.end(), slot);
+    mCache.emplace(slot, CacheEntry{.memory = std::move(memory),
+                                    .hold = std::move(hold),
+                                    .lruPosition = lruPosition});
+}
+
+void Burst::MemoryCache::evictLocked(std::list<int32_t>::const_iterator pinned) {
+    while (mCache.size() > kCapacity && mLru.cbegin() != pinned) {
+        mCache.erase(mLru.front());
+        mLru.pop_front();
+    }
 }
 
 void Burst::MemoryCache::removeCacheEntry(int32_t slot) {
     std::lock_guard guard(mMutex);
-    mCache.erase(slot);
+    if (const auto iter = mCache.find(slot); iter != mCache.end()) {
+        mLru.erase(iter->second.lruPosition);
+        mCache.erase(iter);
+    }
 }
 
 // Burst methods
@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_UTILS_COMMON_THREAD_POOL_H
+#define ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_UTILS_COMMON_THREAD_POOL_H
+
+#include <android-base/thread_annotations.h>
+#include <nnapi/Types.h>
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace android::hardware::neuralnetworks::utils {
+
+/**
+ * A fixed set of worker threads executing tasks asynchronously.
+ *
+ * Each worker has its own queue with one lane per nn::Priority. A worker runs the tasks of its
+ * highest priority non-empty lane first, earliest deadline first within the lane and in
+ * scheduling order among tasks without a deadline. An idle worker steals from the queues of the
+ * other workers.
+ *
+ * Tasks are never dropped: a task whose deadline has passed is still run, and is counted in
+ * Metrics::deadlinesMissed. The destructor runs the tasks still queued, then joins the workers.
+ */
+class ThreadPool final {
+  public:
+    using Task = std::function<void()>;
+
+    struct Metrics {
+        /** Tasks scheduled but not started yet. */
+        size_t queueDepth = 0;
+        size_t maxQueueDepth = 0;
+        uint64_t tasksExecuted = 0;
+        /** Tasks run by another worker than the one they were queued to. */
+        uint64_t tasksStolen = 0;
+        /** Tasks started after their deadline. */
+        uint64_t deadlinesMissed = 0;
+        /** Time from scheduling a task to starting it. */
+        nn::Duration averageLatency{};
+        nn::Duration maxLatency{};
+    };
+
+    /** The number of workers of a pool shared by the devices of a process. */
+    static size_t getDefaultThreadCount();
+
+    // Precondition: threadCount > 0
+    explicit ThreadPool(size_t threadCount);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * Queues a task. Tasks scheduled from a worker are queued to that worker, others are spread
+     * over the workers in turn.
+     */
+    void schedule(Task task, nn::OptionalTimePoint deadline,
+                  nn::Priority priority = nn::Priority::MEDIUM);
+
+    Metrics getMetrics() const;
+
+  private:
+    struct Entry {
+        Task task;
+        nn::TimePoint deadline;
+        nn::TimePoint scheduled;
+        uint64_t sequence = 0;
+    };
+
+    static constexpr size_t kLaneCount = 3;
+
+    struct Queue {
+        std::mutex mutex;
+        // Each lane is a heap, earliest deadline on top.
+        std::array<std::vector<Entry>, kLaneCount> lanes GUARDED_BY(mutex);
+    };
+
+    static size_t getLane(nn::Priority priority);
+    static bool pop(Queue* queue, Entry* entry);
+
+    void workerLoop(size_t index);
+    // Takes the next task from the worker's queue, or else from another worker's queue.
+    Entry take(size_t index);
+    void onStarted(const Entry& entry, bool stolen);
+
+    std::vector<std::unique_ptr<Queue>> mQueues;
+    std::vector<std::thread> mWorkers;
+    std::atomic<uint64_t> mNextSequence = 0;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mCondition;
+    size_t mPending GUARDED_BY(mMutex) = 0;
+    size_t mMaxPending GUARDED_BY(mMutex) = 0;
+    bool mStopping GUARDED_BY(mMutex) = false;
+
+    std::atomic<uint64_t> mStarted = 0;
+    std::atomic<uint64_t> mExecuted = 0;
+    std::atomic<uint64_t> mStolen = 0;
+    std::atomic<uint64_t> mDeadlinesMissed = 0;
+    std::atomic<int64_t> mTotalLatencyNs = 0;
+    std::atomic<int64_t> mMaxLatencyNs = 0;
+};
+
+}  // namespace android::hardware::neuralnetworks::utils
+
+#endif  // ANDROID_HARDWARE_INTERFACES_NEURALNETWORKS_UTILS_COMMON_THREAD_POOL_H
@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ThreadPool.h"
+
+#include <android-base/logging.h>
+#include <android-base/thread_annotations.h>
+#include <nnapi/Types.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace android::hardware::neuralnetworks::utils {
+namespace {
+
+constexpr size_t kMinDefaultThreadCount = 4;
+
+// The pool and the queue index of the current thread, if it is a worker.
+thread_local const ThreadPool* tPool = nullptr;
+thread_local size_t tIndex = 0;
+
+// Heap order of a lane: the earliest deadline, then the earliest scheduled, on top.
+template <typename EntryType>
+bool later(const EntryType& a, const EntryType& b) {
+    if (a.deadline != b.deadline) {
+        return a.deadline > b.deadline;
+    }
+    return a.sequence > b.sequence;
+}
+
+}  // namespace
+
+size_t ThreadPool::getDefaultThreadCount() {
+    return std::max<size_t>(kMinDefaultThreadCount, std::thread::hardware_concurrency());
+}
+
+ThreadPool::ThreadPool(size_t threadCount) {
+    CHECK_GT(threadCount, 0u);
+    mQueues.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i) {
+        mQueues.push_back(std::make_unique<Queue>());
+    }
+    mWorkers.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i) {
+        mWorkers.emplace_back([this, i] { workerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard guard(mMutex);
+        mStopping = true;
+    }
+    mCondition.notify_all();
+    for (auto& worker : mWorkers) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::getLane(nn::Priority priority) {
+    switch (priority) {
+        case nn::Priority::HIGH:
+            return 0;
+        case nn::Priority::MEDIUM:
+            return 1;
+        case nn::Priority::LOW:
+            return 2;
+    }
+    return 1;
+}
+
+void ThreadPool::schedule(Task task, nn::OptionalTimePoint deadline, nn::Priority priority) {
+    CHECK(task != nullptr);
+    const uint64_t sequence = mNextSequence.fetch_add(1, std::memory_order_relaxed);
+    const size_t queueIndex = tPool == this ? tIndex : sequence % mQueues.size();
+    Entry entry{
+            .task = std::move(task),
+            .deadline = deadline.value_or(nn::TimePoint::max()),
+            .scheduled = nn::Clock::now(),
+            .sequence = sequence,
+    };
+
+    Queue& queue = *mQueues[queueIndex];
+    {
+        std::lock_guard guard(queue.mutex);
+        auto& lane = queue.lanes[getLane(priority)];
+        lane.push_back(std::move(entry));
+        std::push_heap(lane.begin(), lane.end(), later<Entry>);
+    }
+    {
+        std::lock_guard guard(mMutex);
+        ++mPending;
+        mMaxPending = std::max(mMaxPending, mPending);
+    }
+    mCondition.notify_one();
+}
+
+bool ThreadPool::pop(Queue* queue, Entry* entry) {
+    std::lock_guard guard(queue->mutex);
+    for (auto& lane : queue->lanes) {
+        if (!lane.empty()) {
+            std::pop_heap(lane.begin(), lane.end(), later<Entry>);
+            *entry = std::move(lane.back());
+            lane.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+ThreadPool::Entry ThreadPool::take(size_t index) {
+    // The caller reserved one of the queued tasks, so this finds one, though it may have to look
+    // again if another worker took the task it would have found.
+    Entry entry;
+    while (true) {
+        for (size_t i = 0; i < mQueues.size(); ++i) {
+            const size_t victim = (index + i) % mQueues.size();
+            if (pop(mQueues[victim].get(), &entry)) {
+                onStarted(entry, victim != index);
+                return entry;
+            }
+        }
+        std::this_thread::yield();
+    }
+}
+
+void ThreadPool::onStarted(const Entry& entry, bool stolen) {
+    const auto now = nn::Clock::now();
+    const int64_t latencyNs =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(now - entry.scheduled).count();
+    mStarted.fetch_add(1, std::memory_order_relaxed);
+    mTotalLatencyNs.fetch_add(latencyNs, std::memory_order_relaxed);
+    int64_t maxLatencyNs = mMaxLatencyNs.load(std::memory_order_relaxed);
+    while (latencyNs > maxLatencyNs &&
+           !mMaxLatencyNs.compare_exchange_weak(maxLatencyNs, latencyNs,
+                                                std::memory_order_relaxed)) {
+    }
+    if (now > entry.deadline) {
+        mDeadlinesMissed.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (stolen) {
+        mStolen.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void ThreadPool::workerLoop(size_t index) {
+    tPool = this;
+    tIndex = index;
+    while (true) {
+        {
+            std::unique_lock lock(mMutex);
+            base::ScopedLockAssertion lockAssert(mMutex);
+            while (mPending == 0 && !mStopping) {
+                mCondition.wait(lock);
+            }
+            if (mPending == 0) {
+                // Stopping, and all tasks were run.
+                return;
+            }
+            --mPending;
+        }
+        Entry entry = take(index);
+        entry.task();
+        mExecuted.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+ThreadPool::Metrics ThreadPool::getMetrics() const {
+    Metrics metrics;
+    {
+        std::lock_guard guard(mMutex);
+        metrics.queueDepth = mPending;
+        metrics.maxQueueDepth = mMaxPending;
+    }
+    metrics.tasksExecuted = mExecuted.load(std::memory_order_relaxed);
+    metrics.tasksStolen = mStolen.load(std::memory_order_relaxed);
+    metrics.deadlinesMissed = mDeadlinesMissed.load(std::memory_order_relaxed);
+    const uint64_t started = mStarted.load(std::memory_order_relaxed);
+    if (started > 0) {
+        metrics.averageLatency = std::chrono::nanoseconds(
+                mTotalLatencyNs.load(std::memory_order_relaxed) / static_cast<int64_t>(started));
+    }
+    metrics.maxLatency = std::chrono::nanoseconds(mMaxLatencyNs.load(std::memory_order_relaxed));
+    return metrics;
+}
+
+}  // namespace android::hardware::neuralnetworks::utils
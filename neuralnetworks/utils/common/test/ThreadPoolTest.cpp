@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gmock/gmock.h>
+#include <nnapi/Types.h>
+#include <nnapi/hal/ThreadPool.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace android::hardware::neuralnetworks::utils {
+namespace {
+
+using ::testing::ElementsAre;
+
+constexpr size_t kTaskCount = 1000;
+
+// Occupies a worker of |pool| until the returned promise is set.
+std::promise<void> blockWorker(ThreadPool* pool) {
+    std::promise<void> gate;
+    auto started = std::make_shared<std::promise<void>>();
+    auto startedFuture = started->get_future();
+    pool->schedule(
+            [started, future = gate.get_future().share()] {
+                started->set_value();
+                future.wait();
+            },
+            {});
+    startedFuture.wait();
+    return gate;
+}
+
+}  // namespace
+
+TEST(ThreadPoolTest, runsAllTasks) {
+    // setup call
+    std::atomic<size_t> count = 0;
+
+    // run test
+    {
+        ThreadPool pool(4);
+        for (size_t i = 0; i < kTaskCount; ++i) {
+            pool.schedule([&count] { ++count; }, {});
+        }
+    }
+
+    // verify result
+    EXPECT_EQ(count, kTaskCount);
+}
+
+TEST(ThreadPoolTest, scheduleFromWorker) {
+    // setup call
+    ThreadPool pool(2);
+    std::promise<void> done;
+
+    // run test
+    pool.schedule([&pool, &done] { pool.schedule([&done] { done.set_value(); }, {}); }, {});
+
+    // verify result
+    EXPECT_EQ(done.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+}
+
+TEST(ThreadPoolTest, priorityThenDeadlineOrder) {
+    // setup call
+    std::mutex mutex;
+    std::vector<int> order;
+    const auto record = [&mutex, &order](int value) {
+        return [&mutex, &order, value] {
+            std::lock_guard guard(mutex);
+            order.push_back(value);
+        };
+    };
+    const auto now = nn::Clock::now();
+
+    // run test
+    {
+        ThreadPool pool(1);
+        auto gate = blockWorker(&pool);
+        pool.schedule(record(5), {}, nn::Priority::LOW);
+        pool.schedule(record(4), {});
+        pool.schedule(record(3), now + std::chrono::seconds(2));
+        pool.schedule(record(2), now + std::chrono::seconds(1));
+        pool.schedule(record(1), {}, nn::Priority::HIGH);
+        gate.set_value();
+    }
+
+    // verify result
+    EXPECT_THAT(order, ElementsAre(1, 2, 3, 4, 5));
+}
+
+TEST(ThreadPoolTest, metrics) {
+    // setup call
+    ThreadPool pool(1);
+    auto gate = blockWorker(&pool);
+    pool.schedule([] {}, nn::Clock::now());
+    pool.schedule([] {}, {});
+
+    // run test
+    const auto queued = pool.getMetrics();
+    gate.set_value();
+    std::promise<void> done;
+    pool.schedule([&done] { done.set_value(); }, {});
+    done.get_future().wait();
+    const auto ran = pool.getMetrics();
+
+    // verify result
+    EXPECT_EQ(queued.queueDepth, 2u);
+    EXPECT_GE(queued.maxQueueDepth, 2u);
+    EXPECT_EQ(ran.queueDepth, 0u);
+    EXPECT_GE(ran.tasksExecuted, 3u);
+    EXPECT_EQ(ran.deadlinesMissed, 1u);
+    EXPECT_GE(ran.maxLatency, ran.averageLatency);
+}
+
+}  // namespace android::hardware::neuralnetworks::utils
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sensors-impl/DirectChannel.h"
+
+#include <aidl/sensors/convert.h>
+#include <cutils/ashmem.h>
+#include <log/log.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+
+using ::ndk::ScopedAStatus;
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace sensors {
+
+namespace {
+
+constexpr size_t kRecordSize = BnSensors::DIRECT_REPORT_SENSOR_EVENT_TOTAL_LENGTH;
+constexpr size_t kCounterOffset = BnSensors::DIRECT_REPORT_SENSOR_EVENT_OFFSET_SIZE_ATOMIC_COUNTER;
+constexpr size_t kTimestampOffset = BnSensors::DIRECT_REPORT_SENSOR_EVENT_OFFSET_SIZE_TIMESTAMP;
+
+// A record is a sensors_event_t with the report token in place of the sensor handle and the
+// atomic counter in place of the reserved field.
+static_assert(sizeof(sensors_event_t) == kRecordSize);
+static_assert(offsetof(sensors_event_t, sensor) ==
+              BnSensors::DIRECT_REPORT_SENSOR_EVENT_OFFSET_SIZE_REPORT_TOKEN);
+static_assert(offsetof(sensors_event_t, type) ==
+              BnSensors::DIRECT_REPORT_SENSOR_EVENT_OFFSET_SIZE_SENSOR_TYPE);
+static_assert(offsetof(sensors_event_t, reserved0) == kCounterOffset);
+static_assert(offsetof(sensors_event_t, timestamp) == kTimestampOffset);
+static_assert(offsetof(sensors_event_t, data) ==
+              BnSensors::DIRECT_REPORT_SENSOR_EVENT_OFFSET_SIZE_DATA);
+
+}  // namespace
+
+ScopedAStatus DirectChannel::create(const SharedMemInfo& memInfo,
+                                    std::shared_ptr<DirectChannel>* channel) {
+    if (memInfo.format != SharedMemInfo::SharedMemFormat::SENSORS_EVENT ||
+        memInfo.size < static_cast<int32_t>(kRecordSize) || memInfo.memoryHandle.fds.empty() ||
+        memInfo.memoryHandle.fds[0].get() < 0) {
+        return ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+
+    const int fd = memInfo.memoryHandle.fds[0].get();
+    const size_t size = static_cast<size_t>(memInfo.size);
+    switch (memInfo.type) {
+        case SharedMemType::ASHMEM: {
+            // Accessing a mapping beyond the end of the region would fault, so the region must
+            // hold all of the ring.
+            const int regionSize = ashmem_get_size_region(fd);
+            if (regionSize < 0 || static_cast<size_t>(regionSize) < size) {
+                return ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+            }
+            break;
+        }
+        case SharedMemType::GRALLOC: {
+            // Likewise for the buffer, whose size is that of its dma-buf.
+            const off_t bufferSize = ::lseek(fd, 0, SEEK_END);
+            if (bufferSize < 0 || static_cast<size_t>(bufferSize) < size) {
+                return ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+            }
+            break;
+        }
+        default:
+            return ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+
+    void* buffer = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (buffer == MAP_FAILED) {
+        ALOGE("Failed to map direct channel memory: %s", strerror(errno));
+        return ScopedAStatus::fromServiceSpecificError(
+                static_cast<int32_t>(BnSensors::ERROR_NO_MEMORY));
+    }
+
+    // The reader expects the memory to be cleared when the channel is registered.
+    memset(buffer, 0, size);
+    channel->reset(new DirectChannel(memInfo.type, static_cast<uint8_t*>(buffer), size));
+    return ScopedAStatus::ok();
+}
+
+DirectChannel::DirectChannel(SharedMemType type, uint8_t* buffer, size_t size)
+    : mType(type),
+      mBuffer(buffer),
+      mSize(size),
+      mRecordCount(size / kRecordSize),
+      mNextRecord(0),
+      mCounter(0) {}
+
+DirectChannel::~DirectChannel() {
+    ::munmap(mBuffer, mSize);
+}
+
+void DirectChannel::write(const Event& event, int32_t reportToken) {
+    sensors_event_t record;
+    ::android::hardware::sensors::implementation::convertToSensorEvent(event, &record);
+    record.version = kRecordSize;
+    record.sensor = reportToken;
+
+    std::lock_guard<std::mutex> lock(mWriteLock);
+    uint8_t* dst = mBuffer + mNextRecord * kRecordSize;
+    mNextRecord = (mNextRecord + 1) % mRecordCount;
+    // The counter starts at 1, as a cleared record reads as 0.
+    if (++mCounter == 0) {
+        mCounter = 1;
+    }
+
+    const auto* src = reinterpret_cast<const uint8_t*>(&record);
+    memcpy(dst, src, kCounterOffset);
+    memcpy(dst + kTimestampOffset, src + kTimestampOffset, kRecordSize - kTimestampOffset);
+    __atomic_store_n(reinterpret_cast<uint32_t*>(dst + kCounterOffset), mCounter,
+                     __ATOMIC_RELEASE);
+}
+
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -18,6 +18,7 @@
 
 #include "utils/SystemClock.h"
 
+#include <algorithm>
 #include <cmath>
 
 using ::ndk::ScopedAStatus;
@@ -28,52 +29,91 @@ namespace hardware {
 namespace sensors {
 
 static constexpr int32_t kDefaultMaxDelayUs = 10 * 1000 * 1000;
+// Each sensor has a FIFO of its own, so all of it is reserved.
+static constexpr int32_t kFifoEventCount = 1000;
+
+// The flags of the sensors that report to direct channels of either type at up to VERY_FAST.
+static constexpr uint32_t kDirectReportFlags =
+        static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_DIRECT_CHANNEL_ASHMEM) |
+        static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_DIRECT_CHANNEL_GRALLOC) |
+        (static_cast<uint32_t>(ISensors::RateLevel::VERY_FAST)
+         << static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_SHIFT_DIRECT_REPORT));
+
+// How long to wait for the framework to read from a full Event FMQ before flushing the FIFO again.
+static constexpr int64_t kFifoRetryPeriodNs = 10 * 1000 * 1000;
+
+// The report period of each direct report rate level, at its nominal rate.
+static int64_t getDirectReportPeriodNs(ISensors::RateLevel rate) {
+    switch (rate) {
+        case ISensors::RateLevel::NORMAL:
+            return 20 * 1000 * 1000;  // 50 Hz
+        case ISensors::RateLevel::FAST:
+            return 5 * 1000 * 1000;  // 200 Hz
+        case ISensors::RateLevel::VERY_FAST:
+            return 1250 * 1000;  // 800 Hz
+        default:
+            return 0;
+    }
+}
 
 Sensor::Sensor(ISensorsEventCallback* callback)
     : mIsEnabled(false),
       mSamplingPeriodNs(0),
+      mMaxReportLatencyNs(0),
       mLastSampleTimeNs(0),
+      mScheduler(SensorScheduler::getInstance()),
       mCallback(callback),
-      mMode(OperationMode::NORMAL) {
-    mRunThread = std::thread(startThread, this);
-}
+      mMode(OperationMode::NORMAL) {}
 
 Sensor::~Sensor() {
-    std::unique_lock<std::mutex> lock(mRunMutex);
-    mStopThread = true;
-    mIsEnabled = false;
-    mWaitCV.notify_all();
-    lock.release();
-    mRunThread.join();
+    // The owner stops the sensor before destroying it; this only makes sure the scheduler no
+    // longer refers to it.
+    mScheduler->remove(this);
+}
+
+void Sensor::stop() {
+    mScheduler->remove(this);
 }
 
 const SensorInfo& Sensor::getSensorInfo() const {
     return mSensorInfo;
 }
 
-void Sensor::batch(int64_t samplingPeriodNs) {
+void Sensor::batch(int64_t samplingPeriodNs, int64_t maxReportLatencyNs) {
     if (samplingPeriodNs < mSensorInfo.minDelayUs * 1000LL) {
         samplingPeriodNs = mSensorInfo.minDelayUs * 1000LL;
     } else if (samplingPeriodNs > mSensorInfo.maxDelayUs * 1000LL) {
         samplingPeriodNs = mSensorInfo.maxDelayUs * 1000LL;
     }
+    maxReportLatencyNs = std::max<int64_t>(maxReportLatencyNs, 0);
 
-    if (mSamplingPeriodNs != samplingPeriodNs) {
+    std::unique_lock<std::mutex> lock(mRunMutex);
+    if (mSamplingPeriodNs != samplingPeriodNs || mMaxReportLatencyNs != maxReportLatencyNs) {
         mSamplingPeriodNs = samplingPeriodNs;
-        // Wake up the 'run' thread to check if a new event should be generated now
-        mWaitCV.notify_all();
+        mMaxReportLatencyNs = maxReportLatencyNs;
+        // Wake up the scheduler to check if a new event should be generated, or the batched
+        // events reported, now
+        mScheduler->wake(this);
     }
 }
 
 void Sensor::activate(bool enable) {
+    std::unique_lock<std::mutex> lock(mRunMutex);
     if (mIsEnabled != enable) {
-        std::unique_lock<std::mutex> lock(mRunMutex);
         mIsEnabled = enable;
-        mWaitCV.notify_all();
+        if (enable) {
+            // The first sample is taken right away.
+            mLastSampleTimeNs = ::android::elapsedRealtimeNano() - getSamplingPeriodNs();
+        } else {
+            mFifo.clear();
+        }
+        mScheduler->wake(this);
     }
 }
 
 ScopedAStatus Sensor::flush() {
+    std::unique_lock<std::mutex> lock(mRunMutex);
+
     // Only generate a flush complete event if the sensor is enabled and if the sensor is not a
     // one-shot sensor.
     if (!mIsEnabled ||
@@ -82,8 +122,10 @@ ScopedAStatus Sensor::flush() {
                 static_cast<int32_t>(BnSensors::ERROR_BAD_VALUE));
     }
 
-    // Note: If a sensor supports batching, write all of the currently batched events for the sensor
-    // to the Event FMQ prior to writing the flush complete event.
+    // Write all of the currently batched events for the sensor to the Event FMQ followed by the
+    // flush complete event. What does not fit stays in the FIFO, in order, for the next run.
+    sampleFifo(::android::elapsedRealtimeNano());
+
     Event ev;
     ev.sensorHandle = mSensorInfo.sensorHandle;
     ev.sensorType = SensorType::META_DATA;
@@ -91,42 +133,135 @@ ScopedAStatus Sensor::flush() {
             .what = MetaDataEventType::META_DATA_FLUSH_COMPLETE,
     };
     ev.payload.set<EventPayload::Tag::meta>(meta);
-    std::vector<Event> evs{ev};
-    mCallback->postEvents(evs, isWakeUpSensor());
+    mFifo.push_back(ev);
+    flushFifo();
+    if (!mFifo.empty()) {
+        mScheduler->wake(this);
+    }
 
     return ScopedAStatus::ok();
 }
 
-void Sensor::startThread(Sensor* sensor) {
-    sensor->run();
-}
+int64_t Sensor::onTimer(int64_t now) {
+    std::unique_lock<std::mutex> lock(mRunMutex);
+    if (!isSampling()) {
+        return kNotDue;
+    }
 
-void Sensor::run() {
-    std::unique_lock<std::mutex> runLock(mRunMutex);
-    constexpr int64_t kNanosecondsInSeconds = 1000 * 1000 * 1000;
+    // The samples are only taken when the FIFO is due to be flushed, with the timestamps they
+    // would have had if taken on time, so that a batching sensor only wakes up once per batch.
+    sampleFifo(now);
+    if (!mFifo.empty() && now >= getFifoDueTimeNs()) {
+        flushFifo();
+    }
+    int64_t nextTimeNs = getFifoDueTimeNs();
+    if (nextTimeNs <= now) {
+        // The Event FMQ is full, try again once the framework had a chance to read from it.
+        nextTimeNs = now + kFifoRetryPeriodNs;
+    }
 
-    while (!mStopThread) {
-        if (!mIsEnabled || mMode == OperationMode::DATA_INJECTION) {
-            mWaitCV.wait(runLock, [&] {
-                return ((mIsEnabled && mMode == OperationMode::NORMAL) || mStopThread);
-            });
-        } else {
-            timespec curTime;
-            clock_gettime(CLOCK_BOOTTIME, &curTime);
-            int64_t now = (curTime.tv_sec * kNanosecondsInSeconds) + curTime.tv_nsec;
-            int64_t nextSampleTime = mLastSampleTimeNs + mSamplingPeriodNs;
-
-            if (now >= nextSampleTime) {
-                mLastSampleTimeNs = now;
-                nextSampleTime = mLastSampleTimeNs + mSamplingPeriodNs;
-                mCallback->postEvents(readEvents(), isWakeUpSensor());
+    // Direct reports keep their own schedule, advanced by whole periods so that the rate stays
+    // steady. The base class samples are used, so that the filtering of on-change sensors only
+    // applies to the Event FMQ.
+    for (auto& [channelHandle, report] : mDirectReports) {
+        if (now >= report.nextSampleTimeNs) {
+            for (const auto& event : Sensor::readEvents()) {
+                report.channel->write(event, mSensorInfo.sensorHandle);
+            }
+            report.nextSampleTimeNs += report.periodNs;
+            if (report.nextSampleTimeNs <= now) {
+                report.nextSampleTimeNs = now + report.periodNs;
             }
+        }
+        nextTimeNs = std::min(nextTimeNs, report.nextSampleTimeNs);
+    }
+    return nextTimeNs;
+}
+
+void Sensor::sampleFifo(int64_t now) {
+    if (!mIsEnabled || mMode != OperationMode::NORMAL) {
+        return;
+    }
 
-            mWaitCV.wait_for(runLock, std::chrono::nanoseconds(nextSampleTime - now));
+    // Like a hardware FIFO that overflows, only the latest samples are kept if the FIFO was not
+    // flushed in time.
+    const int64_t periodNs = getSamplingPeriodNs();
+    const int64_t capacity = static_cast<int64_t>(getFifoCapacity());
+    mLastSampleTimeNs = std::max(mLastSampleTimeNs, now - capacity * periodNs);
+    for (int64_t sampleTimeNs = mLastSampleTimeNs + periodNs; sampleTimeNs <= now;
+         sampleTimeNs += periodNs) {
+        for (Event& event : readEvents()) {
+            event.timestamp = sampleTimeNs;
+            mFifo.push_back(std::move(event));
         }
+        mLastSampleTimeNs = sampleTimeNs;
+    }
+    // The flush complete events are never dropped, nor counted against the capacity.
+    const size_t flushCount = std::count_if(mFifo.begin(), mFifo.end(), [](const Event& event) {
+        return event.sensorType == SensorType::META_DATA;
+    });
+    if (mFifo.size() - flushCount > getFifoCapacity()) {
+        size_t dropCount = mFifo.size() - flushCount - getFifoCapacity();
+        std::vector<Event> kept;
+        kept.reserve(mFifo.size() - dropCount);
+        for (Event& event : mFifo) {
+            if (dropCount > 0 && event.sensorType != SensorType::META_DATA) {
+                dropCount--;
+            } else {
+                kept.push_back(std::move(event));
+            }
+        }
+        mFifo = std::move(kept);
     }
 }
 
+void Sensor::flushFifo() {
+    if (!mFifo.empty()) {
+        const size_t written = mCallback->postEvents(mFifo, isWakeUpSensor());
+        mFifo.erase(mFifo.begin(), mFifo.begin() + std::min(written, mFifo.size()));
+    }
+}
+
+int64_t Sensor::getFifoDueTimeNs() const {
+    if (!mIsEnabled || mMode != OperationMode::NORMAL) {
+        return kNotDue;
+    }
+
+    // A flush requested by the framework is completed as soon as the Event FMQ has room for it.
+    if (std::any_of(mFifo.begin(), mFifo.end(), [](const Event& event) {
+            return event.sensorType == SensorType::META_DATA;
+        })) {
+        return 0;
+    }
+
+    // The FIFO is flushed once its oldest event has waited for the report latency, or once full.
+    const int64_t periodNs = getSamplingPeriodNs();
+    const int64_t freeCount = static_cast<int64_t>(getFifoCapacity() - mFifo.size());
+    const int64_t fullTimeNs = mLastSampleTimeNs + std::max<int64_t>(freeCount, 0) * periodNs;
+    const int64_t oldestTimeNs =
+            mFifo.empty() ? mLastSampleTimeNs + periodNs : mFifo.front().timestamp;
+    const int64_t latencyNs = mSensorInfo.fifoMaxEventCount > 0 ? mMaxReportLatencyNs : 0;
+    return oldestTimeNs + std::min(latencyNs, std::max<int64_t>(fullTimeNs - oldestTimeNs, 0));
+}
+
+int64_t Sensor::getSamplingPeriodNs() const {
+    // The sensor may be enabled before its sampling period is set.
+    return std::max<int64_t>(mSamplingPeriodNs, mSensorInfo.minDelayUs * 1000LL);
+}
+
+size_t Sensor::getFifoCapacity() const {
+    // Batching requires a FIFO; without one, or without a report latency, only the latest sample
+    // is kept.
+    if (mSensorInfo.fifoMaxEventCount > 0 && mMaxReportLatencyNs > 0) {
+        return static_cast<size_t>(mSensorInfo.fifoMaxEventCount);
+    }
+    return 1;
+}
+
+bool Sensor::isSampling() const {
+    return (mIsEnabled || !mDirectReports.empty()) && mMode == OperationMode::NORMAL;
+}
+
 bool Sensor::isWakeUpSensor() {
     return mSensorInfo.flags & static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_WAKE_UP);
 }
@@ -144,13 +279,54 @@ std::vector<Event> Sensor::readEvents() {
 }
 
 void Sensor::setOperationMode(OperationMode mode) {
+    std::unique_lock<std::mutex> lock(mRunMutex);
     if (mMode != mode) {
-        std::unique_lock<std::mutex> lock(mRunMutex);
         mMode = mode;
-        mWaitCV.notify_all();
+        if (mode == OperationMode::NORMAL) {
+            // No samples are taken while injecting data.
+            mLastSampleTimeNs = ::android::elapsedRealtimeNano() - getSamplingPeriodNs();
+        }
+        mScheduler->wake(this);
     }
 }
 
+bool Sensor::supportsDirectReport(DirectChannel::SharedMemType type, RateLevel rate) const {
+    uint32_t channelFlag;
+    switch (type) {
+        case DirectChannel::SharedMemType::ASHMEM:
+            channelFlag = static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_DIRECT_CHANNEL_ASHMEM);
+            break;
+        case DirectChannel::SharedMemType::GRALLOC:
+            channelFlag =
+                    static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_DIRECT_CHANNEL_GRALLOC);
+            break;
+        default:
+            return false;
+    }
+    const uint32_t maxRate =
+            (mSensorInfo.flags &
+             static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_MASK_DIRECT_REPORT)) >>
+            static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_SHIFT_DIRECT_REPORT);
+    return (mSensorInfo.flags & channelFlag) && rate != RateLevel::STOP &&
+           static_cast<uint32_t>(rate) <= maxRate;
+}
+
+void Sensor::startDirectReport(int32_t channelHandle, std::shared_ptr<DirectChannel> channel,
+                               RateLevel rate) {
+    std::unique_lock<std::mutex> lock(mRunMutex);
+    mDirectReports[channelHandle] = DirectReport{
+            .channel = std::move(channel),
+            .periodNs = getDirectReportPeriodNs(rate),
+            .nextSampleTimeNs = 0,
+    };
+    mScheduler->wake(this);
+}
+
+void Sensor::stopDirectReport(int32_t channelHandle) {
+    std::unique_lock<std::mutex> lock(mRunMutex);
+    mDirectReports.erase(channelHandle);
+}
+
 bool Sensor::supportsDataInjection() const {
     return mSensorInfo.flags & static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_DATA_INJECTION);
 }
@@ -213,10 +389,11 @@ AccelSensor::AccelSensor(int32_t sensorHandle, ISensorsEventCallback* callback)
     mSensorInfo.power = 0.001f;          // mA
     mSensorInfo.minDelayUs = 10 * 1000;  // microseconds
     mSensorInfo.maxDelayUs = kDefaultMaxDelayUs;
-    mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoReservedEventCount = kFifoEventCount;
+    mSensorInfo.fifoMaxEventCount = kFifoEventCount;
     mSensorInfo.requiredPermission = "";
-    mSensorInfo.flags = static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_DATA_INJECTION);
+    mSensorInfo.flags =
+            static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_DATA_INJECTION) | kDirectReportFlags;
 };
 
 void AccelSensor::readEventPayload(EventPayload& payload) {
@@ -242,8 +419,8 @@ PressureSensor::PressureSensor(int32_t sensorHandle, ISensorsEventCallback* call
     mSensorInfo.power = 0.001f;           // mA
     mSensorInfo.minDelayUs = 100 * 1000;  // microseconds
     mSensorInfo.maxDelayUs = kDefaultMaxDelayUs;
-    mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoReservedEventCount = kFifoEventCount;
+    mSensorInfo.fifoMaxEventCount = kFifoEventCount;
     mSensorInfo.requiredPermission = "";
     mSensorInfo.flags = 0;
 };
@@ -265,8 +442,8 @@ MagnetometerSensor::MagnetometerSensor(int32_t sensorHandle, ISensorsEventCallba
     mSensorInfo.power = 0.001f;          // mA
     mSensorInfo.minDelayUs = 20 * 1000;  // microseconds
     mSensorInfo.maxDelayUs = kDefaultMaxDelayUs;
-    mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoReservedEventCount = kFifoEventCount;
+    mSensorInfo.fifoMaxEventCount = kFifoEventCount;
     mSensorInfo.requiredPermission = "";
     mSensorInfo.flags = static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_DATA_INJECTION);
 };
@@ -294,8 +471,8 @@ LightSensor::LightSensor(int32_t sensorHandle, ISensorsEventCallback* callback)
     mSensorInfo.power = 0.001f;           // mA
     mSensorInfo.minDelayUs = 200 * 1000;  // microseconds
     mSensorInfo.maxDelayUs = kDefaultMaxDelayUs;
-    mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoReservedEventCount = kFifoEventCount;
+    mSensorInfo.fifoMaxEventCount = kFifoEventCount;
     mSensorInfo.requiredPermission = "";
     mSensorInfo.flags = static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_ON_CHANGE_MODE);
 };
@@ -317,8 +494,8 @@ ProximitySensor::ProximitySensor(int32_t sensorHandle, ISensorsEventCallback* ca
     mSensorInfo.power = 0.012f;           // mA
     mSensorInfo.minDelayUs = 200 * 1000;  // microseconds
     mSensorInfo.maxDelayUs = kDefaultMaxDelayUs;
-    mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoReservedEventCount = kFifoEventCount;
+    mSensorInfo.fifoMaxEventCount = kFifoEventCount;
     mSensorInfo.requiredPermission = "";
     mSensorInfo.flags = static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_ON_CHANGE_MODE |
                                               SensorInfo::SENSOR_FLAG_BITS_WAKE_UP);
@@ -340,10 +517,11 @@ GyroSensor::GyroSensor(int32_t sensorHandle, ISensorsEventCallback* callback) :
     mSensorInfo.power = 0.001f;
     mSensorInfo.minDelayUs = 10 * 1000;  // microseconds
     mSensorInfo.maxDelayUs = kDefaultMaxDelayUs;
-    mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoReservedEventCount = kFifoEventCount;
+    mSensorInfo.fifoMaxEventCount = kFifoEventCount;
     mSensorInfo.requiredPermission = "";
-    mSensorInfo.flags = static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_DATA_INJECTION);
+    mSensorInfo.flags =
+            static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_DATA_INJECTION) | kDirectReportFlags;
 };
 
 void GyroSensor::readEventPayload(EventPayload& payload) {
@@ -369,8 +547,8 @@ AmbientTempSensor::AmbientTempSensor(int32_t sensorHandle, ISensorsEventCallback
     mSensorInfo.power = 0.001f;
     mSensorInfo.minDelayUs = 40 * 1000;  // microseconds
     mSensorInfo.maxDelayUs = kDefaultMaxDelayUs;
-    mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoReservedEventCount = kFifoEventCount;
+    mSensorInfo.fifoMaxEventCount = kFifoEventCount;
     mSensorInfo.requiredPermission = "";
     mSensorInfo.flags = static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_ON_CHANGE_MODE);
 };
@@ -393,8 +571,8 @@ RelativeHumiditySensor::RelativeHumiditySensor(int32_t sensorHandle,
     mSensorInfo.power = 0.001f;
     mSensorInfo.minDelayUs = 40 * 1000;  // microseconds
     mSensorInfo.maxDelayUs = kDefaultMaxDelayUs;
-    mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoReservedEventCount = kFifoEventCount;
+    mSensorInfo.fifoMaxEventCount = kFifoEventCount;
     mSensorInfo.requiredPermission = "";
     mSensorInfo.flags = static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_ON_CHANGE_MODE);
 }
@@ -416,8 +594,8 @@ HingeAngleSensor::HingeAngleSensor(int32_t sensorHandle, ISensorsEventCallback*
     mSensorInfo.power = 0.001f;
     mSensorInfo.minDelayUs = 40 * 1000;  // microseconds
     mSensorInfo.maxDelayUs = kDefaultMaxDelayUs;
-    mSensorInfo.fifoReservedEventCount = 0;
-    mSensorInfo.fifoMaxEventCount = 0;
+    mSensorInfo.fifoReservedEventCount = kFifoEventCount;
+    mSensorInfo.fifoMaxEventCount = kFifoEventCount;
     mSensorInfo.requiredPermission = "";
     mSensorInfo.flags = static_cast<uint32_t>(SensorInfo::SENSOR_FLAG_BITS_ON_CHANGE_MODE |
                                               SensorInfo::SENSOR_FLAG_BITS_WAKE_UP |
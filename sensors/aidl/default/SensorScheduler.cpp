@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sensors-impl/SensorScheduler.h"
+
+#include "sensors-impl/Sensor.h"
+#include "utils/SystemClock.h"
+
+#include <chrono>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace sensors {
+
+std::shared_ptr<SensorScheduler> SensorScheduler::getInstance() {
+    static std::mutex lock;
+    static std::weak_ptr<SensorScheduler> instance;
+
+    std::lock_guard<std::mutex> guard(lock);
+    std::shared_ptr<SensorScheduler> scheduler = instance.lock();
+    if (scheduler == nullptr) {
+        scheduler = std::make_shared<SensorScheduler>();
+        instance = scheduler;
+    }
+    return scheduler;
+}
+
+SensorScheduler::SensorScheduler() : mRunningSensor(nullptr), mStopThread(false) {
+    mThread = std::thread([this] { run(); });
+}
+
+SensorScheduler::~SensorScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopThread = true;
+    }
+    mWaitCV.notify_all();
+    mThread.join();
+}
+
+void SensorScheduler::wake(Sensor* sensor) {
+    std::lock_guard<std::mutex> lock(mLock);
+    scheduleLocked(sensor, ::android::elapsedRealtimeNano());
+}
+
+void SensorScheduler::remove(Sensor* sensor) {
+    std::unique_lock<std::mutex> lock(mLock);
+    mWaitCV.wait(lock, [&] { return mRunningSensor != sensor; });
+    auto entry = mEntries.find(sensor);
+    if (entry != mEntries.end()) {
+        mQueue.erase(entry->second);
+        mEntries.erase(entry);
+    }
+}
+
+void SensorScheduler::scheduleLocked(Sensor* sensor, int64_t timeNs) {
+    auto entry = mEntries.find(sensor);
+    if (entry != mEntries.end()) {
+        if (entry->second->first <= timeNs) {
+            return;
+        }
+        mQueue.erase(entry->second);
+        mEntries.erase(entry);
+    }
+    auto position = mQueue.emplace(timeNs, sensor);
+    mEntries.emplace(sensor, position);
+    if (position == mQueue.begin()) {
+        // The thread may be waiting for a later sensor.
+        mWaitCV.notify_all();
+    }
+}
+
+void SensorScheduler::run() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (!mStopThread) {
+        if (mQueue.empty()) {
+            mWaitCV.wait(lock);
+            continue;
+        }
+
+        const int64_t now = ::android::elapsedRealtimeNano();
+        auto first = mQueue.begin();
+        if (first->first > now) {
+            mWaitCV.wait_for(lock, std::chrono::nanoseconds(first->first - now));
+            continue;
+        }
+
+        Sensor* sensor = first->second;
+        mEntries.erase(sensor);
+        mQueue.erase(first);
+        mRunningSensor = sensor;
+
+        // The sensor may wake itself while running, in which case it is due again right away.
+        lock.unlock();
+        const int64_t nextTimeNs = sensor->onTimer(now);
+        lock.lock();
+
+        mRunningSensor = nullptr;
+        if (nextTimeNs != Sensor::kNotDue) {
+            scheduleLocked(sensor, nextTimeNs);
+        }
+        // Unblock remove().
+        mWaitCV.notify_all();
+    }
+}
+
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -42,23 +42,55 @@ ScopedAStatus Sensors::activate(int32_t in_sensorHandle, bool in_enabled) {
 }
 
 ScopedAStatus Sensors::batch(int32_t in_sensorHandle, int64_t in_samplingPeriodNs,
-                             int64_t /* in_maxReportLatencyNs */) {
+                             int64_t in_maxReportLatencyNs) {
     auto sensor = mSensors.find(in_sensorHandle);
     if (sensor != mSensors.end()) {
-        sensor->second->batch(in_samplingPeriodNs);
+        sensor->second->batch(in_samplingPeriodNs, in_maxReportLatencyNs);
         return ScopedAStatus::ok();
     }
 
     return ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
 }
 
-ScopedAStatus Sensors::configDirectReport(int32_t /* in_sensorHandle */,
-                                          int32_t /* in_channelHandle */,
-                                          ISensors::RateLevel /* in_rate */,
-                                          int32_t* _aidl_return) {
-    *_aidl_return = EX_UNSUPPORTED_OPERATION;
+ScopedAStatus Sensors::configDirectReport(int32_t in_sensorHandle, int32_t in_channelHandle,
+                                          ISensors::RateLevel in_rate, int32_t* _aidl_return) {
+    std::lock_guard<std::mutex> lock(mDirectChannelLock);
+    *_aidl_return = 0;
 
-    return ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+    auto channel = mDirectChannels.find(in_channelHandle);
+    if (channel == mDirectChannels.end()) {
+        return ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+
+    // A sensor handle of -1 stops all of the sensors reporting to the channel.
+    if (in_sensorHandle == -1) {
+        if (in_rate != ISensors::RateLevel::STOP) {
+            return ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+        }
+        for (const auto& sensor : mSensors) {
+            sensor.second->stopDirectReport(in_channelHandle);
+        }
+        return ScopedAStatus::ok();
+    }
+
+    auto sensor = mSensors.find(in_sensorHandle);
+    if (sensor == mSensors.end()) {
+        return ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+
+    if (in_rate == ISensors::RateLevel::STOP) {
+        sensor->second->stopDirectReport(in_channelHandle);
+        return ScopedAStatus::ok();
+    }
+
+    if (!sensor->second->supportsDirectReport(channel->second->getType(), in_rate)) {
+        return ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
+
+    // Sensor handles are unique and positive, so they serve as report tokens.
+    sensor->second->startDirectReport(in_channelHandle, channel->second, in_rate);
+    *_aidl_return = in_sensorHandle;
+    return ScopedAStatus::ok();
 }
 
 ScopedAStatus Sensors::flush(int32_t in_sensorHandle) {
@@ -133,11 +165,32 @@ ScopedAStatus Sensors::injectSensorData(const Event& in_event) {
     return ScopedAStatus::fromServiceSpecificError(static_cast<int32_t>(ERROR_BAD_VALUE));
 }
 
-ScopedAStatus Sensors::registerDirectChannel(const ISensors::SharedMemInfo& /* in_mem */,
+ScopedAStatus Sensors::registerDirectChannel(const ISensors::SharedMemInfo& in_mem,
                                              int32_t* _aidl_return) {
-    *_aidl_return = EX_UNSUPPORTED_OPERATION;
+    *_aidl_return = -1;
+
+    bool supportsMemType = false;
+    for (const auto& sensor : mSensors) {
+        if (sensor.second->supportsDirectReport(in_mem.type, ISensors::RateLevel::NORMAL)) {
+            supportsMemType = true;
+            break;
+        }
+    }
+    if (!supportsMemType) {
+        return ScopedAStatus::fromExceptionCode(EX_ILLEGAL_ARGUMENT);
+    }
 
-    return ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+    std::shared_ptr<DirectChannel> channel;
+    ScopedAStatus status = DirectChannel::create(in_mem, &channel);
+    if (!status.isOk()) {
+        return status;
+    }
+
+    std::lock_guard<std::mutex> lock(mDirectChannelLock);
+    const int32_t channelHandle = mNextDirectChannelHandle++;
+    mDirectChannels[channelHandle] = std::move(channel);
+    *_aidl_return = channelHandle;
+    return ScopedAStatus::ok();
 }
 
 ScopedAStatus Sensors::setOperationMode(OperationMode in_mode) {
@@ -147,8 +200,14 @@ ScopedAStatus Sensors::setOperationMode(OperationMode in_mode) {
     return ScopedAStatus::ok();
 }
 
-ScopedAStatus Sensors::unregisterDirectChannel(int32_t /* in_channelHandle */) {
-    return ScopedAStatus::fromExceptionCode(EX_UNSUPPORTED_OPERATION);
+ScopedAStatus Sensors::unregisterDirectChannel(int32_t in_channelHandle) {
+    std::lock_guard<std::mutex> lock(mDirectChannelLock);
+    // The memory is unmapped once the sensors have dropped their references to the channel.
+    for (const auto& sensor : mSensors) {
+        sensor.second->stopDirectReport(in_channelHandle);
+    }
+    mDirectChannels.erase(in_channelHandle);
+    return ScopedAStatus::ok();
 }
 
 }  // namespace sensors
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <aidl/android/hardware/sensors/BnSensors.h>
+
+#include <memory>
+#include <mutex>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace sensors {
+
+/**
+ * A direct report channel: shared memory that sensor events are written to as a ring of
+ * DIRECT_REPORT_SENSOR_EVENT_TOTAL_LENGTH byte records in the SENSORS_EVENT format, without going
+ * through the Event FMQ. The atomic counter of a record is written last, so a reader that sees a
+ * new counter value also sees the rest of the record.
+ *
+ * This class is thread-safe.
+ */
+class DirectChannel {
+  public:
+    using Event = ::aidl::android::hardware::sensors::Event;
+    using SharedMemInfo = ::aidl::android::hardware::sensors::ISensors::SharedMemInfo;
+    using SharedMemType = SharedMemInfo::SharedMemType;
+
+    /**
+     * Maps the memory of a channel and clears it. ASHMEM memory and gralloc BLOB buffers are
+     * mapped through the first file descriptor of their handle.
+     *
+     * @param memInfo The memory of the channel, as given to ISensors::registerDirectChannel.
+     * @param channel The channel, if successfully created.
+     * @return Status::ok on success
+     *         EX_ILLEGAL_ARGUMENT if memInfo is not consistent.
+     *         EX_SERVICE_SPECIFIC with ERROR_NO_MEMORY if the memory cannot be mapped.
+     */
+    static ndk::ScopedAStatus create(const SharedMemInfo& memInfo,
+                                     std::shared_ptr<DirectChannel>* channel);
+
+    DirectChannel(const DirectChannel&) = delete;
+    DirectChannel& operator=(const DirectChannel&) = delete;
+    ~DirectChannel();
+
+    SharedMemType getType() const { return mType; }
+
+    // Writes an event to the next record of the ring, reported with the given token in place of
+    // its sensor handle.
+    void write(const Event& event, int32_t reportToken);
+
+  private:
+    DirectChannel(SharedMemType type, uint8_t* buffer, size_t size);
+
+    const SharedMemType mType;
+    uint8_t* const mBuffer;
+    // The size of the mapping, and of the ring, which holds as many whole records as fit.
+    const size_t mSize;
+    const size_t mRecordCount;
+
+    std::mutex mWriteLock;
+    size_t mNextRecord;
+    uint32_t mCounter;
+};
+
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -14,10 +14,17 @@
  * limitations under the License.
  */
 
-#include <thread>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include <aidl/android/hardware/sensors/BnSensors.h>
 
+#include "DirectChannel.h"
+#include "SensorScheduler.h"
+
 namespace aidl {
 namespace android {
 namespace hardware {
@@ -28,12 +35,15 @@ class ISensorsEventCallback {
     using Event = ::aidl::android::hardware::sensors::Event;
 
     virtual ~ISensorsEventCallback(){};
-    virtual void postEvents(const std::vector<Event>& events, bool wakeup) = 0;
+    // Writes as many of the events, oldest first, as the Event FMQ has room for without blocking,
+    // and returns how many were written.
+    virtual size_t postEvents(const std::vector<Event>& events, bool wakeup) = 0;
 };
 
 class Sensor {
   public:
     using OperationMode = ::aidl::android::hardware::sensors::ISensors::OperationMode;
+    using RateLevel = ::aidl::android::hardware::sensors::ISensors::RateLevel;
     using Event = ::aidl::android::hardware::sensors::Event;
     using EventPayload = ::aidl::android::hardware::sensors::Event::EventPayload;
     using SensorInfo = ::aidl::android::hardware::sensors::SensorInfo;
@@ -41,11 +51,19 @@ class Sensor {
     using MetaDataEventType =
             ::aidl::android::hardware::sensors::Event::EventPayload::MetaData::MetaDataEventType;
 
+    // The time returned by onTimer() when the sensor has nothing to do until reconfigured.
+    static constexpr int64_t kNotDue = std::numeric_limits<int64_t>::max();
+
     Sensor(ISensorsEventCallback* callback);
     virtual ~Sensor();
 
+    // Stops running the sensor, waiting for a run in progress to finish. Must be called before
+    // the sensor is destroyed, as a run calls into the derived class.
+    void stop();
+
     const SensorInfo& getSensorInfo() const;
-    void batch(int64_t samplingPeriodNs);
+    // Batching is only supported by sensors with a FIFO, other sensors ignore the report latency.
+    void batch(int64_t samplingPeriodNs, int64_t maxReportLatencyNs);
     virtual void activate(bool enable);
     ndk::ScopedAStatus flush();
 
@@ -53,27 +71,60 @@ class Sensor {
     bool supportsDataInjection() const;
     ndk::ScopedAStatus injectEvent(const Event& event);
 
+    // Whether the sensor can report to a direct channel of the given type at the given rate.
+    bool supportsDirectReport(DirectChannel::SharedMemType type, RateLevel rate) const;
+    // Starts reporting, or changes the rate of the report, to a direct channel.
+    void startDirectReport(int32_t channelHandle, std::shared_ptr<DirectChannel> channel,
+                           RateLevel rate);
+    void stopDirectReport(int32_t channelHandle);
+
+    // Called by the scheduler when the sensor is due: samples the sensor, reports the samples
+    // that are due and returns when the sensor is next due, or kNotDue.
+    int64_t onTimer(int64_t now);
+
   protected:
-    void run();
+    struct DirectReport {
+        std::shared_ptr<DirectChannel> channel;
+        int64_t periodNs;
+        int64_t nextSampleTimeNs;
+    };
+
     virtual std::vector<Event> readEvents();
     virtual void readEventPayload(EventPayload&) = 0;
-    static void startThread(Sensor* sensor);
 
     bool isWakeUpSensor();
+    // Whether events are due to the Event FMQ or to a direct channel. Requires mRunMutex.
+    bool isSampling() const;
+    // Adds the samples due by the given time to the FIFO. Requires mRunMutex.
+    void sampleFifo(int64_t now);
+    // Posts the events of the FIFO to the Event FMQ, keeping those that did not fit. Requires
+    // mRunMutex.
+    void flushFifo();
+    // When the FIFO is next due to be flushed, or kNotDue. Requires mRunMutex.
+    int64_t getFifoDueTimeNs() const;
+    int64_t getSamplingPeriodNs() const;
+    // The events the FIFO holds while batching. Requires mRunMutex.
+    size_t getFifoCapacity() const;
 
     bool mIsEnabled;
     int64_t mSamplingPeriodNs;
+    int64_t mMaxReportLatencyNs;
     int64_t mLastSampleTimeNs;
     SensorInfo mSensorInfo;
 
-    std::atomic_bool mStopThread;
-    std::condition_variable mWaitCV;
     std::mutex mRunMutex;
-    std::thread mRunThread;
+    std::shared_ptr<SensorScheduler> mScheduler;
+
+    // The samples batched for the Event FMQ, oldest first, along with the flush complete events
+    // that could not be written yet. Guarded by mRunMutex.
+    std::vector<Event> mFifo;
 
     ISensorsEventCallback* mCallback;
 
     OperationMode mMode;
+
+    // The direct channels the sensor reports to, by channel handle. Guarded by mRunMutex.
+    std::map<int32_t, DirectReport> mDirectReports;
 };
 
 class OnChangeSensor : public Sensor {
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace sensors {
+
+class Sensor;
+
+/**
+ * Runs the sensors on a single timer thread. Each sensor is run when it is next due, as returned
+ * by Sensor::onTimer(), so a sensor only causes a wakeup when it has work to do.
+ *
+ * This class is thread-safe.
+ */
+class SensorScheduler {
+  public:
+    // Returns the scheduler shared by all of the sensors that hold a reference to it.
+    static std::shared_ptr<SensorScheduler> getInstance();
+
+    SensorScheduler();
+    ~SensorScheduler();
+
+    SensorScheduler(const SensorScheduler&) = delete;
+    SensorScheduler& operator=(const SensorScheduler&) = delete;
+
+    // Runs the sensor as soon as possible, e.g. because its configuration changed.
+    void wake(Sensor* sensor);
+
+    // Stops running the sensor, waiting for a run in progress to finish. Must not be called with
+    // the locks the sensor takes while running held.
+    void remove(Sensor* sensor);
+
+  private:
+    void run();
+    // Runs the sensor at the given time, unless it is already due before then.
+    void scheduleLocked(Sensor* sensor, int64_t timeNs);
+
+    std::mutex mLock;
+    std::condition_variable mWaitCV;
+    // When each sensor is next due, earliest first, and the entry of each sensor in it.
+    std::multimap<int64_t, Sensor*> mQueue;
+    std::map<Sensor*, std::multimap<int64_t, Sensor*>::iterator> mEntries;
+    Sensor* mRunningSensor;
+    bool mStopThread;
+    std::thread mThread;
+};
+
+}  // namespace sensors
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
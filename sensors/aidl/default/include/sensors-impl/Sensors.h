@@ -20,7 +20,12 @@
 #include <aidl/android/hardware/sensors/BnSensors.h>
 #include <fmq/AidlMessageQueue.h>
 #include <hardware_legacy/power.h>
+#include <algorithm>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "DirectChannel.h"
 #include "Sensor.h"
 
 namespace aidl {
@@ -44,7 +49,8 @@ class Sensors : public BnSensors, public ISensorsEventCallback {
           mOutstandingWakeUpEvents(0),
           mReadWakeLockQueueRun(false),
           mAutoReleaseWakeLockTime(0),
-          mHasWakeLock(false) {
+          mHasWakeLock(false),
+          mNextDirectChannelHandle(1) {
         AddSensor<AccelSensor>();
         AddSensor<GyroSensor>();
         AddSensor<AmbientTempSensor>();
@@ -57,6 +63,10 @@ class Sensors : public BnSensors, public ISensorsEventCallback {
     }
 
     virtual ~Sensors() {
+        // The sensors must no longer run by the time they, and this callback, are destroyed.
+        for (auto& [handle, sensor] : mSensors) {
+            sensor->stop();
+        }
         deleteEventFlag();
         mReadWakeLockQueueRun = false;
         mWakeLockThread.join();
@@ -91,25 +101,32 @@ class Sensors : public BnSensors, public ISensorsEventCallback {
             ::aidl::android::hardware::sensors::ISensors::OperationMode in_mode) override;
     ::ndk::ScopedAStatus unregisterDirectChannel(int32_t in_channelHandle) override;
 
-    void postEvents(const std::vector<Event>& events, bool wakeup) override {
+    size_t postEvents(const std::vector<Event>& events, bool wakeup) override {
         std::lock_guard<std::mutex> lock(mWriteLock);
         if (mEventQueue == nullptr) {
-            return;
+            // There is no one to report the events to.
+            return events.size();
         }
-        if (mEventQueue->write(&events.front(), events.size())) {
-            if (mEventQueueFlag == nullptr) {
-                // Don't take the wake lock if we can't wake the receiver to avoid holding it
-                // indefinitely.
-                return;
-            }
-            mEventQueueFlag->wake(
-                    static_cast<uint32_t>(BnSensors::EVENT_QUEUE_FLAG_BITS_READ_AND_PROCESS));
-            if (wakeup) {
-                // Keep track of the number of outstanding WAKE_UP events in order to properly hold
-                // a wake lock until the framework has secured a wake lock
-                updateWakeLock(events.size(), 0 /* eventsHandled */);
-            }
+        // Only the events that fit are written, the caller keeps the rest until the framework has
+        // read enough events to make room for them. This never blocks, as the caller may be the
+        // thread running all of the sensors.
+        const size_t count = std::min(events.size(), mEventQueue->availableToWrite());
+        if (count == 0 || !mEventQueue->write(events.data(), count)) {
+            return 0;
+        }
+        if (mEventQueueFlag == nullptr) {
+            // Don't take the wake lock if we can't wake the receiver to avoid holding it
+            // indefinitely.
+            return count;
+        }
+        mEventQueueFlag->wake(
+                static_cast<uint32_t>(BnSensors::EVENT_QUEUE_FLAG_BITS_READ_AND_PROCESS));
+        if (wakeup) {
+            // Keep track of the number of outstanding WAKE_UP events in order to properly hold
+            // a wake lock until the framework has secured a wake lock
+            updateWakeLock(count, 0 /* eventsHandled */);
         }
+        return count;
     }
 
   protected:
@@ -214,6 +231,12 @@ class Sensors : public BnSensors, public ISensorsEventCallback {
     int64_t mAutoReleaseWakeLockTime;
     // Flag to indicate if a wake lock has been acquired
     bool mHasWakeLock;
+    // Lock to protect the direct channels
+    std::mutex mDirectChannelLock;
+    // The registered direct channels, by channel handle
+    std::map<int32_t, std::shared_ptr<DirectChannel>> mDirectChannels;
+    // The next available direct channel handle
+    int32_t mNextDirectChannelHandle;
 };
 
 }  // namespace sensors
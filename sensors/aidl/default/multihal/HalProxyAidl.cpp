@@ -31,7 +31,6 @@ using ::aidl::android::hardware::sensors::ISensors;
 using ::aidl::android::hardware::sensors::ISensorsCallback;
 using ::android::hardware::hidl_string;
 using ::android::hardware::hidl_vec;
-using ::android::hardware::sensors::V2_1::implementation::convertToOldEvent;
 using ::ndk::ScopedAStatus;
 
 namespace aidl {
@@ -153,9 +152,13 @@ ScopedAStatus HalProxyAidl::flush(int32_t in_sensorHandle) {
 
 ScopedAStatus HalProxyAidl::getSensorsList(
     std::vector<::aidl::android::hardware::sensors::SensorInfo> *_aidl_return) {
-  for (const auto &sensor : HalProxy::getSensors()) {
-    _aidl_return->push_back(convertSensorInfo(sensor.second));
-  }
+  std::call_once(mSensorsListOnce, [this] {
+    mSensorsList.reserve(HalProxy::getSensors().size());
+    for (const auto &sensor : HalProxy::getSensors()) {
+      mSensorsList.push_back(convertSensorInfo(sensor.second));
+    }
+  });
+  *_aidl_return = mSensorsList;
   return ScopedAStatus::ok();
 }
 
@@ -192,8 +195,7 @@ ScopedAStatus HalProxyAidl::injectSensorData(
     const ::aidl::android::hardware::sensors::Event &in_event) {
   ::android::hardware::sensors::V2_1::Event hidlEvent;
   convertToHidlEvent(in_event, &hidlEvent);
-  return resultToAStatus(
-      HalProxy::injectSensorData(convertToOldEvent(hidlEvent)));
+  return resultToAStatus(HalProxy::injectSensorData_2_1(hidlEvent));
 }
 
 ScopedAStatus
@@ -18,6 +18,7 @@
 
 #include <android/hardware/sensors/2.1/types.h>
 #include <fmq/AidlMessageQueue.h>
+#include <new>
 #include "ConvertUtils.h"
 #include "EventMessageQueueWrapper.h"
 #include "ISensorsWrapper.h"
@@ -56,18 +57,22 @@ class EventMessageQueueWrapperAidl
 
     bool write(const ::android::hardware::sensors::V2_1::Event* events,
                size_t numToWrite) override {
-        for (int i = 0; i < numToWrite; ++i) {
-            convertToAidlEvent(events[i], &mIntermediateEventBuffer[i]);
+        // The events are converted straight into the slots of the queue rather than through an
+        // intermediate buffer, as this is the path every event takes when the queue has room.
+        EventQueue::MemTransaction tx;
+        if (!mQueue->beginWrite(numToWrite, &tx)) {
+            return false;
+        }
+        for (size_t i = 0; i < numToWrite; ++i) {
+            auto* slot = new (tx.getSlot(i))::aidl::android::hardware::sensors::Event();
+            convertToAidlEvent(events[i], slot);
         }
-        return mQueue->write(mIntermediateEventBuffer.data(), numToWrite);
+        return mQueue->commitWrite(numToWrite);
     }
 
     virtual bool write(
             const std::vector<::android::hardware::sensors::V2_1::Event>& events) override {
-        for (int i = 0; i < events.size(); ++i) {
-            convertToAidlEvent(events[i], &mIntermediateEventBuffer[i]);
-        }
-        return mQueue->write(mIntermediateEventBuffer.data(), events.size());
+        return write(events.data(), events.size());
     }
 
     bool writeBlocking(const ::android::hardware::sensors::V2_1::Event* events, size_t count,
@@ -83,10 +88,11 @@ class EventMessageQueueWrapperAidl
     size_t getQuantumCount() override { return mQueue->getQuantumCount(); }
 
   private:
-    std::unique_ptr<::android::AidlMessageQueue<
+    using EventQueue = ::android::AidlMessageQueue<
             ::aidl::android::hardware::sensors::Event,
-            ::aidl::android::hardware::common::fmq::SynchronizedReadWrite>>
-            mQueue;
+            ::aidl::android::hardware::common::fmq::SynchronizedReadWrite>;
+
+    std::unique_ptr<EventQueue> mQueue;
     std::array<::aidl::android::hardware::sensors::Event,
                ::android::hardware::sensors::V2_1::implementation::MAX_RECEIVE_BUFFER_EVENT_COUNT>
             mIntermediateEventBuffer;
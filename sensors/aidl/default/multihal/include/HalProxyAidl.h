@@ -17,6 +17,8 @@
 #pragma once
 
 #include <aidl/android/hardware/sensors/BnSensors.h>
+#include <mutex>
+#include <vector>
 #include "HalProxy.h"
 
 namespace aidl {
@@ -57,6 +59,11 @@ class HalProxyAidl : public ::android::hardware::sensors::V2_1::implementation::
     ::ndk::ScopedAStatus unregisterDirectChannel(int32_t in_channelHandle) override;
 
     binder_status_t dump(int fd, const char **args, uint32_t numArgs) override;
+
+    // The static sensors of the sub-HALs are fixed once the proxy is constructed, so they are
+    // converted to AIDL once, on the first call to getSensorsList().
+    std::once_flag mSensorsListOnce;
+    std::vector<::aidl::android::hardware::sensors::SensorInfo> mSensorsList;
 };
 
 }  // namespace implementation
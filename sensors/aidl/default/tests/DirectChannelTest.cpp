@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <android-base/unique_fd.h>
+#include <cutils/ashmem.h>
+#include <sys/mman.h>
+
+#include <cstring>
+#include <vector>
+
+#include "sensors-impl/DirectChannel.h"
+
+using ::aidl::android::hardware::sensors::BnSensors;
+using ::aidl::android::hardware::sensors::DirectChannel;
+using ::aidl::android::hardware::sensors::Event;
+using ::aidl::android::hardware::sensors::ISensors;
+using ::aidl::android::hardware::sensors::SensorStatus;
+using ::aidl::android::hardware::sensors::SensorType;
+using ::android::base::unique_fd;
+
+namespace {
+
+constexpr size_t kRecordSize = BnSensors::DIRECT_REPORT_SENSOR_EVENT_TOTAL_LENGTH;
+
+struct Record {
+    int32_t size;
+    int32_t token;
+    int32_t type;
+    uint32_t counter;
+    int64_t timestamp;
+    float data[16];
+};
+
+class DirectChannelTest : public ::testing::Test {
+  protected:
+    void TearDown() override {
+        if (mBuffer != nullptr) {
+            ::munmap(mBuffer, mSize);
+            mBuffer = nullptr;
+        }
+    }
+
+    // Creates an ashmem region of the given size, mapped for reading the records back.
+    ISensors::SharedMemInfo createMemInfo(size_t size) {
+        TearDown();
+        mFd.reset(ashmem_create_region("DirectChannelTest", size));
+        EXPECT_GE(mFd.get(), 0);
+        mSize = size;
+        mBuffer = static_cast<uint8_t*>(
+                ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, mFd.get(), 0));
+        EXPECT_NE(mBuffer, MAP_FAILED);
+
+        ISensors::SharedMemInfo memInfo = {
+                .type = ISensors::SharedMemInfo::SharedMemType::ASHMEM,
+                .format = ISensors::SharedMemInfo::SharedMemFormat::SENSORS_EVENT,
+                .size = static_cast<int32_t>(size),
+        };
+        memInfo.memoryHandle.fds.emplace_back(dup(mFd.get()));
+        return memInfo;
+    }
+
+    Record readRecord(size_t index) const {
+        Record record;
+        memcpy(&record.size, mBuffer + index * kRecordSize + 0x0, sizeof(record.size));
+        memcpy(&record.token, mBuffer + index * kRecordSize + 0x4, sizeof(record.token));
+        memcpy(&record.type, mBuffer + index * kRecordSize + 0x8, sizeof(record.type));
+        memcpy(&record.counter, mBuffer + index * kRecordSize + 0xC, sizeof(record.counter));
+        memcpy(&record.timestamp, mBuffer + index * kRecordSize + 0x10, sizeof(record.timestamp));
+        memcpy(record.data, mBuffer + index * kRecordSize + 0x18, sizeof(record.data));
+        return record;
+    }
+
+    unique_fd mFd;
+    uint8_t* mBuffer = nullptr;
+    size_t mSize = 0;
+};
+
+Event makeAccelEvent(int64_t timestamp, float x) {
+    Event event;
+    event.sensorHandle = 1;
+    event.sensorType = SensorType::ACCELEROMETER;
+    event.timestamp = timestamp;
+    event.payload.set<Event::EventPayload::Tag::vec3>(Event::EventPayload::Vec3{
+            .x = x,
+            .y = 0,
+            .z = 9.8f,
+            .status = SensorStatus::ACCURACY_HIGH,
+    });
+    return event;
+}
+
+TEST_F(DirectChannelTest, ClearsMemoryOnCreate) {
+    auto memInfo = createMemInfo(2 * kRecordSize);
+    memset(mBuffer, 0xff, mSize);
+
+    std::shared_ptr<DirectChannel> channel;
+    ASSERT_TRUE(DirectChannel::create(memInfo, &channel).isOk());
+
+    EXPECT_EQ(channel->getType(), ISensors::SharedMemInfo::SharedMemType::ASHMEM);
+    for (size_t i = 0; i < mSize; ++i) {
+        ASSERT_EQ(mBuffer[i], 0) << "at offset " << i;
+    }
+}
+
+TEST_F(DirectChannelTest, WritesSensorsEventRecords) {
+    auto memInfo = createMemInfo(4 * kRecordSize);
+    std::shared_ptr<DirectChannel> channel;
+    ASSERT_TRUE(DirectChannel::create(memInfo, &channel).isOk());
+
+    channel->write(makeAccelEvent(1000, 1.0f), 7 /* reportToken */);
+    channel->write(makeAccelEvent(2000, 2.0f), 7 /* reportToken */);
+
+    const Record first = readRecord(0);
+    EXPECT_EQ(first.size, static_cast<int32_t>(kRecordSize));
+    EXPECT_EQ(first.token, 7);
+    EXPECT_EQ(first.type, static_cast<int32_t>(SensorType::ACCELEROMETER));
+    EXPECT_EQ(first.counter, 1u);
+    EXPECT_EQ(first.timestamp, 1000);
+    EXPECT_FLOAT_EQ(first.data[0], 1.0f);
+    EXPECT_FLOAT_EQ(first.data[2], 9.8f);
+
+    const Record second = readRecord(1);
+    EXPECT_EQ(second.counter, 2u);
+    EXPECT_EQ(second.timestamp, 2000);
+    EXPECT_FLOAT_EQ(second.data[0], 2.0f);
+
+    // Records not written yet remain cleared.
+    EXPECT_EQ(readRecord(2).counter, 0u);
+}
+
+TEST_F(DirectChannelTest, WrapsAroundTheRing) {
+    // Room for two whole records; the trailing partial record is never written.
+    auto memInfo = createMemInfo(2 * kRecordSize + kRecordSize / 2);
+    std::shared_ptr<DirectChannel> channel;
+    ASSERT_TRUE(DirectChannel::create(memInfo, &channel).isOk());
+
+    for (int64_t i = 1; i <= 5; ++i) {
+        channel->write(makeAccelEvent(i * 1000, static_cast<float>(i)), 3 /* reportToken */);
+    }
+
+    // The reader follows the counter: the latest record is where it is largest.
+    const Record first = readRecord(0);
+    const Record second = readRecord(1);
+    EXPECT_EQ(first.counter, 5u);
+    EXPECT_EQ(first.timestamp, 5000);
+    EXPECT_EQ(second.counter, 4u);
+    EXPECT_EQ(second.timestamp, 4000);
+    for (size_t i = 2 * kRecordSize; i < mSize; ++i) {
+        ASSERT_EQ(mBuffer[i], 0) << "at offset " << i;
+    }
+}
+
+TEST_F(DirectChannelTest, RejectsInconsistentMemInfo) {
+    std::shared_ptr<DirectChannel> channel;
+
+    auto tooSmall = createMemInfo(kRecordSize - 1);
+    EXPECT_EQ(DirectChannel::create(tooSmall, &channel).getExceptionCode(), EX_ILLEGAL_ARGUMENT);
+
+    auto largerThanRegion = createMemInfo(kRecordSize);
+    largerThanRegion.size = 2 * kRecordSize;
+    EXPECT_EQ(DirectChannel::create(largerThanRegion, &channel).getExceptionCode(),
+              EX_ILLEGAL_ARGUMENT);
+
+    ISensors::SharedMemInfo noHandle = {
+            .type = ISensors::SharedMemInfo::SharedMemType::ASHMEM,
+            .format = ISensors::SharedMemInfo::SharedMemFormat::SENSORS_EVENT,
+            .size = static_cast<int32_t>(kRecordSize),
+    };
+    EXPECT_EQ(DirectChannel::create(noHandle, &channel).getExceptionCode(), EX_ILLEGAL_ARGUMENT);
+
+    EXPECT_EQ(channel, nullptr);
+}
+
+TEST_F(DirectChannelTest, ChecksGrallocBufferSize) {
+    // Like a dma-buf, the size of a memfd is where it seeks to at its end.
+    unique_fd fd(memfd_create("DirectChannelTest", MFD_CLOEXEC));
+    ASSERT_GE(fd.get(), 0);
+    ASSERT_EQ(ftruncate(fd.get(), kRecordSize), 0);
+
+    ISensors::SharedMemInfo memInfo = {
+            .type = ISensors::SharedMemInfo::SharedMemType::GRALLOC,
+            .format = ISensors::SharedMemInfo::SharedMemFormat::SENSORS_EVENT,
+            .size = static_cast<int32_t>(2 * kRecordSize),
+    };
+    memInfo.memoryHandle.fds.emplace_back(dup(fd.get()));
+    std::shared_ptr<DirectChannel> channel;
+    EXPECT_EQ(DirectChannel::create(memInfo, &channel).getExceptionCode(), EX_ILLEGAL_ARGUMENT);
+    EXPECT_EQ(channel, nullptr);
+
+    memInfo.size = static_cast<int32_t>(kRecordSize);
+    ASSERT_TRUE(DirectChannel::create(memInfo, &channel).isOk());
+    EXPECT_EQ(channel->getType(), ISensors::SharedMemInfo::SharedMemType::GRALLOC);
+}
+
+}  // namespace
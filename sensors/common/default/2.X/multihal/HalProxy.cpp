@@ -216,6 +216,10 @@ Return<Result> HalProxy::initializeCommon(
         const sp<ISensorsCallbackWrapperBase>& sensorsCallback) {
     Result result = Result::OK;
 
+    // Drops the events pending write before, while the wakelock references of the wakeup ones
+    // can still be released.
+    dropPendingEvents();
+
     stopThreads();
     resetSharedWakelock();
 
@@ -223,9 +227,8 @@ Return<Result> HalProxy::initializeCommon(
     // again we do not get new events until after initialize resets the subhals.
     disableAllSensors();
 
-    // Clears the queue if any events were pending write before.
-    mPendingWriteEventsQueue = std::queue<std::pair<std::vector<V2_1::Event>, size_t>>();
-    mSizePendingWriteEventsQueue = 0;
+    // Drops the events posted while the threads were stopped and the sensors disabled.
+    dropPendingEvents();
 
     // Clears previously connected dynamic sensors
     mDynamicSensors.clear();
@@ -291,29 +294,28 @@ Return<Result> HalProxy::flush(int32_t sensorHandle) {
 }
 
 Return<Result> HalProxy::injectSensorData_2_1(const V2_1::Event& event) {
-    return injectSensorData(convertToOldEvent(event));
-}
-
-Return<Result> HalProxy::injectSensorData(const V1_0::Event& event) {
     Result result = Result::OK;
     if (mCurrentOperationMode == OperationMode::NORMAL &&
-        event.sensorType != V1_0::SensorType::ADDITIONAL_INFO) {
+        event.sensorType != V2_1::SensorType::ADDITIONAL_INFO) {
         ALOGE("An event with type != ADDITIONAL_INFO passed to injectSensorData while operation"
               " mode was NORMAL.");
         result = Result::BAD_VALUE;
     }
     if (result == Result::OK) {
-        V1_0::Event subHalEvent = event;
+        V2_1::Event subHalEvent = event;
         if (!isSubHalIndexValid(event.sensorHandle)) {
             return Result::BAD_VALUE;
         }
         subHalEvent.sensorHandle = clearSubHalIndex(event.sensorHandle);
-        result = getSubHalForSensorHandle(event.sensorHandle)
-                         ->injectSensorData(convertToNewEvent(subHalEvent));
+        result = getSubHalForSensorHandle(event.sensorHandle)->injectSensorData(subHalEvent);
     }
     return result;
 }
 
+Return<Result> HalProxy::injectSensorData(const V1_0::Event& event) {
+    return injectSensorData_2_1(convertToNewEvent(event));
+}
+
 Return<void> HalProxy::registerDirectChannel(const SharedMemInfo& mem,
                                              ISensorsV2_0::registerDirectChannel_cb _hidl_cb) {
     if (mDirectChannelSubHal == nullptr) {
@@ -370,13 +372,15 @@ Return<void> HalProxy::debug(const hidl_handle& fd, const hidl_vec<hidl_string>&
            << " ms ago" << std::endl;
     // TODO(b/142969448): Add logging for history of wakelock acquisition per subhal.
     stream << "  Wakelock ref count: " << mWakelockRefCount << std::endl;
-    stream << "  # of events on pending write writes queue: " << mSizePendingWriteEventsQueue
-           << std::endl;
-    stream << " Most events seen on pending write events queue: "
-           << mMostEventsObservedPendingWriteEventsQueue << std::endl;
-    if (!mPendingWriteEventsQueue.empty()) {
-        stream << "  Size of events list on front of pending writes queue: "
-               << mPendingWriteEventsQueue.front().first.size() << std::endl;
+    stream << "  # of events on pending event rings: " << getNumPendingEvents() << std::endl;
+    stream << " Most events seen on pending event rings: "
+           << mMostEventsObservedPendingEventRings.load() << std::endl;
+    {
+        std::lock_guard<std::mutex> lock(mDroppedEventsMutex);
+        for (const auto& [sensorHandle, numDropped] : mDroppedEvents) {
+            stream << "  # of events dropped for sensor 0x" << std::hex << sensorHandle << std::dec
+                   << ": " << numDropped << std::endl;
+        }
     }
     stream << "  # of non-dynamic sensors across all subhals: " << mSensors.size() << std::endl;
     stream << "  # of dynamic sensors across all subhals: " << mDynamicSensors.size() << std::endl;
@@ -528,6 +532,9 @@ void* HalProxy::getHandleForSubHalSharedObject(const std::string& filename) {
 
 void HalProxy::init() {
     initializeSensorList();
+    for (size_t i = 0; i < mSubHalList.size(); i++) {
+        mPendingEventRings.push_back(std::make_unique<PendingEventRing>());
+    }
 }
 
 void HalProxy::stopThreads() {
@@ -544,7 +551,7 @@ void HalProxy::stopThreads() {
         mWakelockQueueFlag->wake(static_cast<uint32_t>(WakeLockQueueFlagBits::DATA_WRITTEN));
     }
     mWakelockCV.notify_one();
-    mEventQueueWriteCV.notify_one();
+    notifyPendingWrites();
     if (mPendingWritesThread.joinable()) {
         mPendingWritesThread.join();
     }
@@ -558,9 +565,16 @@ void HalProxy::disableAllSensors() {
         int32_t sensorHandle = sensorEntry.first;
         activate(sensorHandle, false /* enabled */);
     }
-    std::lock_guard<std::mutex> dynamicSensorsLock(mDynamicSensorsMutex);
-    for (const auto& sensorEntry : mDynamicSensors) {
-        int32_t sensorHandle = sensorEntry.first;
+    // The subhals may post events while being deactivated, whose wake-up sensors are looked up
+    // under mDynamicSensorsMutex, so it is not held across the calls.
+    std::vector<int32_t> dynamicSensorHandles;
+    {
+        std::lock_guard<std::mutex> dynamicSensorsLock(mDynamicSensorsMutex);
+        for (const auto& sensorEntry : mDynamicSensors) {
+            dynamicSensorHandles.push_back(sensorEntry.first);
+        }
+    }
+    for (int32_t sensorHandle : dynamicSensorHandles) {
         activate(sensorHandle, false /* enabled */);
     }
 }
@@ -570,47 +584,136 @@ void HalProxy::startPendingWritesThread(HalProxy* halProxy) {
 }
 
 void HalProxy::handlePendingWrites() {
-    // TODO(b/143302327): Find a way to optimize locking strategy maybe using two mutexes instead of
-    // one.
-    std::unique_lock<std::mutex> lock(mEventQueueWriteMutex);
     while (mThreadsRun.load()) {
-        mEventQueueWriteCV.wait(
-                lock, [&] { return !mPendingWriteEventsQueue.empty() || !mThreadsRun.load(); });
-        if (mThreadsRun.load()) {
-            std::vector<Event>& pendingWriteEvents = mPendingWriteEventsQueue.front().first;
-            size_t numWakeupEvents = mPendingWriteEventsQueue.front().second;
-            size_t eventQueueSize = mEventQueue->getQuantumCount();
-            size_t numToWrite = std::min(pendingWriteEvents.size(), eventQueueSize);
-            lock.unlock();
-            if (!mEventQueue->writeBlocking(
-                        pendingWriteEvents.data(), numToWrite,
-                        static_cast<uint32_t>(EventQueueFlagBits::EVENTS_READ),
-                        static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS),
-                        kPendingWriteTimeoutNs, mEventQueueFlag)) {
-                ALOGE("Dropping %zu events after blockingWrite failed.", numToWrite);
-                if (numWakeupEvents > 0) {
-                    if (pendingWriteEvents.size() > eventQueueSize) {
-                        decrementRefCountAndMaybeReleaseWakelock(
-                                countNumWakeupEvents(pendingWriteEvents, eventQueueSize));
-                    } else {
-                        decrementRefCountAndMaybeReleaseWakelock(numWakeupEvents);
-                    }
+        {
+            std::unique_lock<std::mutex> lock(mPendingWritesMutex);
+            mPendingWritesCV.wait(lock, [&] {
+                return getNumPendingEvents() > 0 || !mThreadsRun.load();
+            });
+        }
+        if (!mThreadsRun.load()) {
+            break;
+        }
+
+        // The pending events of all subhals are merged into a single write of as many events as
+        // the fmq has room for. The fmq is not locked while waiting for room, so that subhals
+        // without pending events can keep writing to it directly.
+        size_t numToWrite;
+        {
+            std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
+            numToWrite = popPendingEvents(
+                    std::min(getNumPendingEvents(), mEventQueue->availableToWrite()));
+            if (numToWrite > 0) {
+                if (mEventQueue->write(mPendingWriteBuffer.data(), numToWrite)) {
+                    mEventQueueFlag->wake(
+                            static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS));
+                } else {
+                    ALOGE("Dropping %zu events after write failed.", numToWrite);
+                    dropEvents(mPendingWriteBuffer.data(), numToWrite);
                 }
             }
-            lock.lock();
-            mSizePendingWriteEventsQueue -= numToWrite;
-            if (pendingWriteEvents.size() > eventQueueSize) {
-                // TODO(b/143302327): Check if this erase operation is too inefficient. It will copy
-                // all the events ahead of it down to fill gap off array at front after the erase.
-                pendingWriteEvents.erase(pendingWriteEvents.begin(),
-                                         pendingWriteEvents.begin() + eventQueueSize);
-            } else {
-                mPendingWriteEventsQueue.pop();
+        }
+        if (numToWrite == 0) {
+            uint32_t efState = 0;
+            status_t status =
+                    mEventQueueFlag->wait(static_cast<uint32_t>(EventQueueFlagBits::EVENTS_READ),
+                                          &efState, kPendingWriteTimeoutNs, true /* retry */);
+            if (status == TIMED_OUT && mThreadsRun.load()) {
+                std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
+                size_t numDropped = popPendingEvents(mEventQueue->getQuantumCount());
+                ALOGE("Dropping %zu events after blockingWrite failed.", numDropped);
+                dropEvents(mPendingWriteBuffer.data(), numDropped);
             }
         }
     }
 }
 
+void HalProxy::pushPendingEvents(PendingEventRing* ring, const Event* events, size_t count) {
+    const size_t tail = ring->tail.load(std::memory_order_relaxed);
+    const size_t head = ring->head.load(std::memory_order_acquire);
+    const size_t numToPush = std::min(count, kPendingEventRingSize - (tail - head));
+    for (size_t i = 0; i < numToPush; i++) {
+        ring->events[(tail + i) % kPendingEventRingSize] = events[i];
+    }
+    // Published before being counted, so that the background thread never waits on events that
+    // it cannot pop yet.
+    ring->tail.store(tail + numToPush, std::memory_order_release);
+    int64_t numPending = mNumPendingEvents.fetch_add(numToPush) + numToPush;
+
+    size_t mostObserved = mMostEventsObservedPendingEventRings.load();
+    while (numPending > static_cast<int64_t>(mostObserved) &&
+           !mMostEventsObservedPendingEventRings.compare_exchange_weak(mostObserved, numPending)) {
+    }
+    if (numToPush < count) {
+        ALOGE("Dropping %zu events as the pending event ring is full.", count - numToPush);
+        dropEvents(events + numToPush, count - numToPush);
+    }
+}
+
+size_t HalProxy::popPendingEvents(size_t maxCount) {
+    if (mPendingWriteBuffer.size() < maxCount) {
+        mPendingWriteBuffer.resize(maxCount);
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < mPendingEventRings.size() && count < maxCount; i++) {
+        PendingEventRing* ring =
+                mPendingEventRings[(mNextPendingEventRing + i) % mPendingEventRings.size()].get();
+        const size_t head = ring->head.load(std::memory_order_relaxed);
+        const size_t tail = ring->tail.load(std::memory_order_acquire);
+        const size_t numToPop = std::min(tail - head, maxCount - count);
+        for (size_t j = 0; j < numToPop; j++) {
+            mPendingWriteBuffer[count + j] = ring->events[(head + j) % kPendingEventRingSize];
+        }
+        ring->head.store(head + numToPop, std::memory_order_release);
+        count += numToPop;
+    }
+    if (!mPendingEventRings.empty()) {
+        mNextPendingEventRing = (mNextPendingEventRing + 1) % mPendingEventRings.size();
+    }
+    mNumPendingEvents.fetch_sub(count);
+    return count;
+}
+
+size_t HalProxy::getNumPendingEvents() {
+    return static_cast<size_t>(std::max<int64_t>(mNumPendingEvents.load(), 0));
+}
+
+void HalProxy::dropPendingEvents() {
+    // Popping with mEventQueueWriteMutex held, as the background thread does, keeps the rings and
+    // mNumPendingEvents consistent with subhals still pushing to them.
+    std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
+    size_t numDropped;
+    while ((numDropped = popPendingEvents(getNumPendingEvents())) > 0) {
+        ALOGW("Dropping %zu events pending write.", numDropped);
+        dropEvents(mPendingWriteBuffer.data(), numDropped);
+    }
+}
+
+void HalProxy::notifyPendingWrites() {
+    // Taking the mutex ensures the background thread is either waiting or yet to check for
+    // pending events, so that the notification is not lost.
+    { std::lock_guard<std::mutex> lock(mPendingWritesMutex); }
+    mPendingWritesCV.notify_one();
+}
+
+void HalProxy::dropEvents(const Event* events, size_t count) {
+    size_t numWakeupEvents = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (isWakeUpSensor(events[i].sensorHandle)) {
+            numWakeupEvents++;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(mDroppedEventsMutex);
+        for (size_t i = 0; i < count; i++) {
+            mDroppedEvents[events[i].sensorHandle]++;
+        }
+    }
+    if (numWakeupEvents > 0) {
+        decrementRefCountAndMaybeReleaseWakelock(numWakeupEvents);
+    }
+}
+
 void HalProxy::startWakelockThread(HalProxy* halProxy) {
     halProxy->handleWakelocks();
 }
@@ -660,32 +763,41 @@ void HalProxy::resetSharedWakelock() {
 
 void HalProxy::postEventsToMessageQueue(const std::vector<Event>& events, size_t numWakeupEvents,
                                         V2_0::implementation::ScopedWakelock wakelock) {
-    size_t numToWrite = 0;
-    std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
     if (wakelock.isLocked()) {
         incrementRefCountAndMaybeAcquireWakelock(numWakeupEvents);
     }
-    if (mPendingWriteEventsQueue.empty()) {
+    if (events.empty()) {
+        return;
+    }
+
+    // All of the events of a post come from the same subhal.
+    size_t subHalIndex = extractSubHalIndex(events.front().sensorHandle);
+    if (subHalIndex >= mPendingEventRings.size()) {
+        ALOGE("Dropping %zu events posted with invalid subhal index %zu.", events.size(),
+              subHalIndex);
+        dropEvents(events.data(), events.size());
+        return;
+    }
+    PendingEventRing* ring = mPendingEventRings[subHalIndex].get();
+    std::lock_guard<std::mutex> producerLock(ring->producerMutex);
+
+    // Events are only written directly while none of the subhal's events are pending, so that
+    // they reach the fmq in the order they were posted.
+    size_t numToWrite = 0;
+    if (ring->head.load(std::memory_order_acquire) == ring->tail.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(mEventQueueWriteMutex);
         numToWrite = std::min(events.size(), mEventQueue->availableToWrite());
         if (numToWrite > 0) {
             if (mEventQueue->write(events.data(), numToWrite)) {
-                // TODO(b/143302327): While loop if mEventQueue->avaiableToWrite > 0 to possibly fit
-                // in more writes immediately
                 mEventQueueFlag->wake(static_cast<uint32_t>(EventQueueFlagBits::READ_AND_PROCESS));
             } else {
                 numToWrite = 0;
             }
         }
     }
-    size_t numLeft = events.size() - numToWrite;
-    if (numToWrite < events.size() &&
-        mSizePendingWriteEventsQueue + numLeft <= kMaxSizePendingWriteEventsQueue) {
-        std::vector<Event> eventsLeft(events.begin() + numToWrite, events.end());
-        mPendingWriteEventsQueue.push({eventsLeft, numWakeupEvents});
-        mSizePendingWriteEventsQueue += numLeft;
-        mMostEventsObservedPendingWriteEventsQueue =
-                std::max(mMostEventsObservedPendingWriteEventsQueue, mSizePendingWriteEventsQueue);
-        mEventQueueWriteCV.notify_one();
+    if (numToWrite < events.size()) {
+        pushPendingEvents(ring, events.data() + numToWrite, events.size() - numToWrite);
+        notifyPendingWrites();
     }
 }
 
@@ -744,6 +856,17 @@ bool HalProxy::isSubHalIndexValid(int32_t sensorHandle) {
     return extractSubHalIndex(sensorHandle) < mSubHalList.size();
 }
 
+bool HalProxy::isWakeUpSensor(int32_t sensorHandle) {
+    constexpr uint32_t kWakeUp = static_cast<uint32_t>(V1_0::SensorFlagBits::WAKE_UP);
+    auto sensor = mSensors.find(sensorHandle);
+    if (sensor != mSensors.end()) {
+        return sensor->second.flags & kWakeUp;
+    }
+    std::lock_guard<std::mutex> lock(mDynamicSensorsMutex);
+    auto dynamicSensor = mDynamicSensors.find(sensorHandle);
+    return dynamicSensor != mDynamicSensors.end() && (dynamicSensor->second.flags & kWakeUp);
+}
+
 size_t HalProxy::countNumWakeupEvents(const std::vector<Event>& events, size_t n) {
     size_t numWakeupEvents = 0;
     for (size_t i = 0; i < n; i++) {
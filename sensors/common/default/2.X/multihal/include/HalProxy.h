@@ -36,10 +36,11 @@
 #include <atomic>
 #include <condition_variable>
 #include <map>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <thread>
 #include <utility>
+#include <vector>
 
 namespace android {
 namespace hardware {
@@ -133,6 +134,8 @@ class HalProxy : public V2_0::implementation::IScopedWakelockRefCounter,
         return mSensors[sensorHandle];
     }
 
+    bool isWakeUpSensor(int32_t sensorHandle) override;
+
     bool areThreadsRunning() override { return mThreadsRun.load(); }
 
     // Below methods are from IScopedWakelockRefCounter interface
@@ -143,6 +146,13 @@ class HalProxy : public V2_0::implementation::IScopedWakelockRefCounter,
 
     const std::map<int32_t, SensorInfo>& getSensors() { return mSensors; }
 
+    /**
+     * The number of events of each subhal that can wait for room in the event fmq. This holds over
+     * 5 seconds of a subhal streaming at 3 kHz, the longest the background thread waits for the
+     * framework to read before dropping events anyway, in about 1.3 MB per subhal.
+     */
+    static constexpr size_t kPendingEventRingSize = 16384;
+
   private:
     using EventMessageQueueV2_1 = MessageQueue<V2_1::Event, kSynchronizedReadWrite>;
     using EventMessageQueueV2_0 = MessageQueue<V1_0::Event, kSynchronizedReadWrite>;
@@ -202,25 +212,51 @@ class HalProxy : public V2_0::implementation::IScopedWakelockRefCounter,
     static constexpr int32_t kSensorHandleSubHalIndexMask = 0xFF000000;
 
     /**
-     * A FIFO queue of pairs of vector of events and the number of wakeup events in that vector
-     * which are waiting to be written to the events fmq in the background thread.
+     * The events of a subhal waiting to be written to the events fmq by the background thread, in
+     * the order they were posted. The subhal's callbacks push to the ring while holding
+     * producerMutex, and the thread holding mEventQueueWriteMutex pops from it, so a subhal
+     * posting events never waits for the background thread to make room in the fmq.
      */
-    std::queue<std::pair<std::vector<Event>, size_t>> mPendingWriteEventsQueue;
+    struct PendingEventRing {
+        PendingEventRing() : events(kPendingEventRingSize) {}
 
-    //! The most events observed on the pending write events queue for debug purposes.
-    size_t mMostEventsObservedPendingWriteEventsQueue = 0;
+        std::mutex producerMutex;
+        std::vector<Event> events;
+        //! The positions of the next event to pop and to push, which only ever increase.
+        std::atomic<size_t> head = 0;
+        std::atomic<size_t> tail = 0;
+    };
 
-    //! The max number of events allowed in the pending write events queue
-    static constexpr size_t kMaxSizePendingWriteEventsQueue = 100000;
+    //! The pending events of each subhal, by subhal index.
+    std::vector<std::unique_ptr<PendingEventRing>> mPendingEventRings;
+
+    /**
+     * The number of events in the pending event rings. Events are counted once published, so it
+     * may briefly be negative while events popped are yet to be counted.
+     */
+    std::atomic<int64_t> mNumPendingEvents = 0;
 
-    //! The number of events in the pending write events queue
-    size_t mSizePendingWriteEventsQueue = 0;
+    //! The most events observed on the pending event rings for debug purposes.
+    std::atomic<size_t> mMostEventsObservedPendingEventRings = 0;
 
-    //! The mutex protecting writing to the fmq and the pending events queue
+    //! The events popped from the pending event rings to be written to the fmq in one write.
+    std::vector<Event> mPendingWriteBuffer;
+
+    //! The ring popped from first, rotated so that every subhal gets its turn when the fmq is full.
+    size_t mNextPendingEventRing = 0;
+
+    //! The mutex protecting writing to the fmq and popping from the pending event rings
     std::mutex mEventQueueWriteMutex;
 
-    //! The condition variable waiting on pending write events to stack up
-    std::condition_variable mEventQueueWriteCV;
+    //! The mutex and condition variable the background thread waits on for pending events
+    std::mutex mPendingWritesMutex;
+    std::condition_variable mPendingWritesCV;
+
+    //! The mutex protecting the number of events dropped for each sensor.
+    std::mutex mDroppedEventsMutex;
+
+    //! The number of events dropped for each sensor, because the fmq or their ring stayed full.
+    std::map<int32_t, uint64_t> mDroppedEvents;
 
     //! The thread object ptr that handles pending writes
     std::thread mPendingWritesThread;
@@ -303,6 +339,40 @@ class HalProxy : public V2_0::implementation::IScopedWakelockRefCounter,
     //! Handles the pending writes on events to eventqueue.
     void handlePendingWrites();
 
+    /**
+     * Pushes events to the pending event ring of their subhal, dropping those it has no room for.
+     *
+     * @param ring The ring of the subhal, whose producerMutex is held.
+     * @param events The events to push.
+     * @param count The number of events to push.
+     */
+    void pushPendingEvents(PendingEventRing* ring, const Event* events, size_t count);
+
+    /**
+     * Pops pending events of all subhals, oldest first within each subhal, into
+     * mPendingWriteBuffer. Requires mEventQueueWriteMutex.
+     *
+     * @param maxCount The most events to pop.
+     *
+     * @return The number of events popped.
+     */
+    size_t popPendingEvents(size_t maxCount);
+
+    //! Drops the pending events of all subhals. Takes mEventQueueWriteMutex.
+    void dropPendingEvents();
+
+    //! Wakes the background thread, which writes the pending events when the fmq has room.
+    void notifyPendingWrites();
+
+    /**
+     * Accounts for events that will never be written to the fmq, and releases the wakelock
+     * references of the wakeup events among them.
+     *
+     * @param events The events dropped.
+     * @param count The number of events dropped.
+     */
+    void dropEvents(const Event* events, size_t count);
+
     /**
      * Starts the thread that handles decrementing the ref count on wakeup events processed by the
      * framework and timing out wakelocks.
@@ -50,9 +50,9 @@ class ISubHalCallback {
             const hidl_vec<int32_t>& dynamicSensorHandlesRemoved, int32_t subHalIndex) = 0;
 
     /**
-     * Post events to the event message queue if there is room to write them. Otherwise post the
-     * remaining events to a background thread for a blocking write with a kPendingWriteTimeoutNs
-     * timeout.
+     * Post events to the event message queue if there is room to write them. Otherwise queue the
+     * remaining events on the subhal's pending event ring, for a background thread to write within
+     * kPendingWriteTimeoutNs.
      *
      * @param events The list of events to post to the message queue.
      * @param numWakeupEvents The number of wakeup events in events.
@@ -71,6 +71,14 @@ class ISubHalCallback {
      */
     virtual const V2_1::SensorInfo& getSensorInfo(int32_t sensorHandle) = 0;
 
+    /**
+     * Whether the static or dynamic sensor of sensorHandle is a wake-up sensor, whose events hold
+     * a reference to the wakelock until the framework reads them or they are dropped.
+     *
+     * @param sensorHandle The sensor handle, with its subhal index set.
+     */
+    virtual bool isWakeUpSensor(int32_t sensorHandle) = 0;
+
     virtual bool areThreadsRunning() = 0;
 };
 
@@ -25,6 +25,7 @@
 #include "V2_0/ScopedWakelock.h"
 #include "convertV2_1.h"
 
+#include <algorithm>
 #include <chrono>
 #include <set>
 #include <thread>
@@ -761,8 +762,7 @@ TEST(HalProxyTest, PostedEventSensorHandleSubHalIndexValid) {
 
 TEST(HalProxyTest, FillAndDrainPendingQueueTest) {
     constexpr size_t kQueueSize = 5;
-    // TODO: Make this constant linked to same limit in HalProxy.h
-    constexpr size_t kMaxPendingQueueSize = 100000;
+    constexpr size_t kMaxPendingQueueSize = HalProxy::kPendingEventRingSize;
     AllSensorsSubHal<SensorsSubHalV2_0> subhal;
     std::vector<ISensorsSubHal*> subHals{&subhal};
 
@@ -781,8 +781,9 @@ TEST(HalProxyTest, FillAndDrainPendingQueueTest) {
     subhal.postEvents(convertToNewEvents(events), false);
 
     // Drain pending queue
-    for (int i = 0; i < kMaxPendingQueueSize + kQueueSize; i += kQueueSize) {
-        ASSERT_TRUE(readEventsOutOfQueue(kQueueSize, eventQueue, eventQueueFlag));
+    for (size_t i = 0; i < kMaxPendingQueueSize + kQueueSize; i += kQueueSize) {
+        size_t numToRead = std::min(kQueueSize, kMaxPendingQueueSize + kQueueSize - i);
+        ASSERT_TRUE(readEventsOutOfQueue(numToRead, eventQueue, eventQueueFlag));
     }
 
     // Put one event on pending queue
@@ -798,6 +799,34 @@ TEST(HalProxyTest, FillAndDrainPendingQueueTest) {
     EXPECT_TRUE(readEventsOutOfQueue(1, eventQueue, eventQueueFlag));
 }
 
+TEST(HalProxyTest, OverflowPendingQueueDropsEventsTest) {
+    constexpr size_t kQueueSize = 5;
+    constexpr size_t kMaxPendingQueueSize = HalProxy::kPendingEventRingSize;
+    constexpr size_t kNumDroppedEvents = 3;
+    AllSensorsSubHal<SensorsSubHalV2_0> subhal;
+    std::vector<ISensorsSubHal*> subHals{&subhal};
+
+    std::unique_ptr<EventMessageQueueV2_0> eventQueue = makeEventFMQ(kQueueSize);
+    std::unique_ptr<WakeupMessageQueue> wakeLockQueue = makeWakelockFMQ(kQueueSize);
+    ::android::sp<ISensorsCallbackV2_0> callback = new SensorsCallback();
+    EventFlag* eventQueueFlag;
+    EventFlag::createEventFlag(eventQueue->getEventFlagWord(), &eventQueueFlag);
+    HalProxy proxy(subHals);
+    proxy.initialize(*eventQueue->getDesc(), *wakeLockQueue->getDesc(), callback);
+
+    // Post more events than the fmq and the pending queue hold together
+    std::vector<EventV1_0> events =
+            makeMultipleAccelerometerEvents(kQueueSize + kMaxPendingQueueSize + kNumDroppedEvents);
+    subhal.postEvents(convertToNewEvents(events), false);
+
+    // Only the events that fit are written, the rest are dropped
+    for (size_t i = 0; i < kMaxPendingQueueSize + kQueueSize; i += kQueueSize) {
+        size_t numToRead = std::min(kQueueSize, kMaxPendingQueueSize + kQueueSize - i);
+        ASSERT_TRUE(readEventsOutOfQueue(numToRead, eventQueue, eventQueueFlag));
+    }
+    EXPECT_FALSE(readEventsOutOfQueue(1, eventQueue, eventQueueFlag));
+}
+
 TEST(HalProxyTest, PostEventsMultipleSubhalsThreadedV2_1) {
     constexpr size_t kQueueSize = 5;
     constexpr size_t kNumEvents = 2;
@@ -20,10 +20,13 @@
 #include <aidl/android/hardware/tv/tuner/DemuxQueueNotifyBits.h>
 #include <aidl/android/hardware/tv/tuner/Result.h>
 
+#include <android-base/properties.h>
 #include <fmq/AidlMessageQueue.h>
+#include <inttypes.h>
 #include <utils/Log.h>
 #include <thread>
 #include "Demux.h"
+#include "IptvReadahead.h"
 
 namespace aidl {
 namespace android {
@@ -41,6 +44,8 @@ using AidlMQ = AidlMessageQueue<int8_t, SynchronizedReadWrite>;
 using AidlMQDesc = MQDescriptor<int8_t, SynchronizedReadWrite>;
 
 #define WAIT_TIMEOUT 3000000000
+// How long held back playback input waits for the filters to drain before a retry
+#define OUTPUT_DRAIN_TIMEOUT 10000000
 
 Demux::Demux(int32_t demuxId, uint32_t filterTypes) {
     mDemuxId = demuxId;
@@ -68,7 +73,6 @@ Demux::~Demux() {
                 static_cast<int32_t>(Result::INVALID_ARGUMENT));
     }
 
-    set<int64_t>::iterator it;
     switch (in_type) {
         case DvrType::PLAYBACK:
             mDvrPlayback = ndk::SharedRefBase::make<Dvr>(in_type, in_bufferSize, in_cb,
@@ -81,16 +85,6 @@ Demux::~Demux() {
                         static_cast<int32_t>(Result::UNKNOWN_ERROR));
             }
 
-            for (it = mPlaybackFilterIds.begin(); it != mPlaybackFilterIds.end(); it++) {
-                if (!mDvrPlayback->addPlaybackFilter(*it, mFilters[*it])) {
-                    ALOGE("[Demux] Can't get filter info for DVR playback");
-                    mDvrPlayback = nullptr;
-                    *_aidl_return = mDvrPlayback;
-                    return ::ndk::ScopedAStatus::fromServiceSpecificError(
-                            static_cast<int32_t>(Result::UNKNOWN_ERROR));
-                }
-            }
-
             ALOGI("Playback normal case");
 
             *_aidl_return = mDvrPlayback;
@@ -120,71 +114,85 @@ void Demux::setIptvThreadRunning(bool isIptvThreadRunning) {
     mIsIptvThreadRunningCv.notify_all();
 }
 
-void Demux::frontendIptvInputThreadLoop(dtv_plugin* interface, dtv_streamer* streamer, void* buf) {
-    Timer *timer, *fullBufferTimer;
-    bool isTuneBytePushedToDvr = false;
+void Demux::frontendIptvInputThreadLoop(dtv_plugin* interface, dtv_streamer* streamer) {
+    IptvReadahead readahead(::android::base::GetUintProperty<size_t>(IPTV_READAHEAD_SIZE_PROPERTY,
+                                                                      IPTV_READAHEAD_SIZE));
+    // The byte read on tune goes ahead of the stream
+    void* tuneByteBuffer = mFrontend->getTuneByteBuffer();
+    if (tuneByteBuffer != nullptr) {
+        int8_t* span;
+        readahead.getWriteSpan(&span);
+        memcpy(span, tuneByteBuffer, TUNE_BUFFER_SIZE);
+        readahead.commitWrite(TUNE_BUFFER_SIZE);
+    }
+
+    unique_ptr<Timer> fullBufferTimer;
     while (true) {
-        std::unique_lock<std::mutex> lock(mIsIptvThreadRunningMutex);
-        mIsIptvThreadRunningCv.wait(
-                lock, [this] { return mIsIptvReadThreadRunning || mIsIptvReadThreadTerminated; });
+        {
+            std::unique_lock<std::mutex> lock(mIsIptvThreadRunningMutex);
+            mIsIptvThreadRunningCv.wait(lock, [this] {
+                return mIsIptvReadThreadRunning || mIsIptvReadThreadTerminated;
+            });
+        }
         if (mIsIptvReadThreadTerminated) {
             ALOGI("[Demux] IPTV reading thread for playback terminated");
             break;
         }
-        if (mIsIptvDvrFMQFull &&
-            fullBufferTimer->get_elapsed_time_ms() > IPTV_PLAYBACK_BUFFER_TIMEOUT) {
-            ALOGE("DVR FMQ has not been flushed within timeout of %d ms",
-                  IPTV_PLAYBACK_BUFFER_TIMEOUT);
-            delete fullBufferTimer;
-            break;
-        }
-        timer = new Timer();
-        ssize_t bytes_read;
-        void* tuneByteBuffer = mFrontend->getTuneByteBuffer();
-        if (!isTuneBytePushedToDvr && tuneByteBuffer != nullptr) {
-            memcpy(buf, tuneByteBuffer, 1);
-            char* offsetBuf = (char*)buf + 1;
-            bytes_read = interface->read_stream(streamer, (void*)offsetBuf, IPTV_BUFFER_SIZE - 1,
-                                                IPTV_PLAYBACK_TIMEOUT);
-            isTuneBytePushedToDvr = true;
-        } else {
-            bytes_read =
-                    interface->read_stream(streamer, buf, IPTV_BUFFER_SIZE, IPTV_PLAYBACK_TIMEOUT);
-        }
 
-        if (bytes_read <= 0) {
-            double elapsed_time = timer->get_elapsed_time_ms();
-            if (elapsed_time > IPTV_PLAYBACK_TIMEOUT) {
-                ALOGE("[Demux] timeout reached - elapsed_time: %f, timeout: %d", elapsed_time,
-                      IPTV_PLAYBACK_TIMEOUT);
+        size_t fmqSpace = drainIptvReadahead(readahead);
+        if (readahead.full()) {
+            // Neither the DVR nor the readahead can take more. Sleep until the DVR
+            // consumes its input rather than polling the FMQ.
+            if (fullBufferTimer == nullptr) {
+                fullBufferTimer = make_unique<Timer>();
+            } else if (fullBufferTimer->get_elapsed_time_ms() > IPTV_PLAYBACK_BUFFER_TIMEOUT) {
+                ALOGE("DVR FMQ has not been flushed within timeout of %d ms",
+                      IPTV_PLAYBACK_BUFFER_TIMEOUT);
+                break;
             }
+            uint32_t efState = 0;
+            mDvrPlayback->getDvrEventFlag()->wait(
+                    static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_CONSUMED), &efState,
+                    IPTV_PLAYBACK_TIMEOUT * 1000000LL, true /* retry on spurious wake */);
+            continue;
+        }
+        fullBufferTimer.reset();
+
+        // Read in one batch as much as the FMQ can take right away, or at least one
+        // buffer to keep draining the socket while the DVR is behind
+        int8_t* span;
+        size_t count = min(readahead.getWriteSpan(&span),
+                           max(fmqSpace, static_cast<size_t>(IPTV_BUFFER_SIZE)));
+        ssize_t bytes_read = interface->read_stream(streamer, span, count, IPTV_PLAYBACK_TIMEOUT);
+        if (bytes_read < 0) {
             ALOGE("[Demux] Cannot read data from the socket");
-            delete timer;
             break;
         }
+        if (bytes_read == 0) {
+            ALOGV("[Demux] no IPTV data within %d ms", IPTV_PLAYBACK_TIMEOUT);
+            continue;
+        }
+        ALOGV("Number of bytes read: %zd", bytes_read);
+        readahead.commitWrite(bytes_read);
+    }
+}
 
-        delete timer;
-        ALOGI("Number of bytes read: %zd", bytes_read);
-        int result = mDvrPlayback->writePlaybackFMQ(buf, bytes_read);
-
-        switch (result) {
-            case DVR_WRITE_FAILURE_REASON_FMQ_FULL:
-                if (!mIsIptvDvrFMQFull) {
-                    mIsIptvDvrFMQFull = true;
-                    fullBufferTimer = new Timer();
-                }
-                ALOGI("Waiting for client to flush DVR FMQ.");
-                break;
-            case DVR_WRITE_FAILURE_REASON_UNKNOWN:
+size_t Demux::drainIptvReadahead(IptvReadahead& readahead) {
+    size_t fmqSpace = mDvrPlayback->getPlaybackFMQSpace();
+    while (!readahead.empty() && fmqSpace > 0) {
+        const int8_t* span;
+        size_t size = min(readahead.getReadSpan(&span), fmqSpace);
+        int result = mDvrPlayback->writePlaybackFMQ(const_cast<int8_t*>(span), size);
+        if (result != DVR_WRITE_SUCCESS) {
+            if (result == DVR_WRITE_FAILURE_REASON_UNKNOWN) {
                 ALOGE("Failed to write data into DVR FMQ for unknown reason");
-                break;
-            case DVR_WRITE_SUCCESS:
-                ALOGI("Wrote %zd bytes to DVR FMQ", bytes_read);
-                break;
-            default:
-                ALOGI("Invalid DVR Status");
+            }
+            return 0;
         }
+        readahead.commitRead(size);
+        fmqSpace -= size;
     }
+    return fmqSpace;
 }
 
 ::ndk::ScopedAStatus Demux::setFrontendDataSource(int32_t in_frontendId) {
@@ -248,14 +256,8 @@ void Demux::frontendIptvInputThreadLoop(dtv_plugin* interface, dtv_streamer* str
         }
         stopIptvFrontendInput();
         mIsIptvReadThreadTerminated = false;
-        void* buf = malloc(sizeof(char) * IPTV_BUFFER_SIZE);
-        if (buf == nullptr) {
-            ALOGE("[Demux] Buffer allocation failed");
-            return ::ndk::ScopedAStatus::fromServiceSpecificError(
-                    static_cast<int32_t>(Result::INVALID_STATE));
-        }
         mDemuxIptvReadThread =
-                std::thread(&Demux::frontendIptvInputThreadLoop, this, interface, streamer, buf);
+                std::thread(&Demux::frontendIptvInputThreadLoop, this, interface, streamer);
     }
     return ::ndk::ScopedAStatus::ok();
 }
@@ -287,20 +289,10 @@ void Demux::frontendIptvInputThreadLoop(dtv_plugin* interface, dtv_streamer* str
     if (filter->isPcrFilter()) {
         mPcrFilterIds.insert(filterId);
     }
-    bool result = true;
     if (!filter->isRecordFilter()) {
         // Only save non-record filters for now. Record filters are saved when the
         // IDvr.attacheFilter is called.
         mPlaybackFilterIds.insert(filterId);
-        if (mDvrPlayback != nullptr) {
-            result = mDvrPlayback->addPlaybackFilter(filterId, filter);
-        }
-    }
-
-    if (!result) {
-        *_aidl_return = nullptr;
-        return ::ndk::ScopedAStatus::fromServiceSpecificError(
-                static_cast<int32_t>(Result::INVALID_ARGUMENT));
     }
 
     *_aidl_return = filter;
@@ -374,10 +366,7 @@ void Demux::frontendIptvInputThreadLoop(dtv_plugin* interface, dtv_streamer* str
     stopFrontendInput();
     stopIptvFrontendInput();
 
-    set<int64_t>::iterator it;
-    for (it = mPlaybackFilterIds.begin(); it != mPlaybackFilterIds.end(); it++) {
-        mDvrPlayback->removePlaybackFilter(*it);
-    }
+    mPlaybackTsDemuxer.clearSinks();
     mPlaybackFilterIds.clear();
     mRecordFilterIds.clear();
     mFilters.clear();
@@ -407,8 +396,9 @@ void Demux::frontendIptvInputThreadLoop(dtv_plugin* interface, dtv_streamer* str
 ::ndk::ScopedAStatus Demux::removeFilter(int64_t filterId) {
     ALOGV("%s", __FUNCTION__);
 
-    if (mDvrPlayback != nullptr) {
-        mDvrPlayback->removePlaybackFilter(filterId);
+    auto filter = mFilters.find(filterId);
+    if (filter != mFilters.end()) {
+        mPlaybackTsDemuxer.removeSink(filter->second.get());
     }
     mPlaybackFilterIds.erase(filterId);
     mRecordFilterIds.erase(filterId);
@@ -417,79 +407,86 @@ void Demux::frontendIptvInputThreadLoop(dtv_plugin* interface, dtv_streamer* str
     return ::ndk::ScopedAStatus::ok();
 }
 
-void Demux::startBroadcastTsFilter(vector<int8_t> data) {
-    set<int64_t>::iterator it;
-    uint16_t pid = ((data[1] & 0x1f) << 8) | ((data[2] & 0xff));
+void Demux::startBroadcastTsFilter(const int8_t* data, size_t size) {
     if (DEBUG_DEMUX) {
-        ALOGW("[Demux] start ts filter pid: %d", pid);
-    }
-    for (it = mPlaybackFilterIds.begin(); it != mPlaybackFilterIds.end(); it++) {
-        if (pid == mFilters[*it]->getTpid()) {
-            mFilters[*it]->updateFilterOutput(data);
-        }
+        ALOGW("[Demux] start ts filter on %zu bytes", size);
     }
+    mPlaybackTsDemuxer.process(data, size);
 }
 
-void Demux::sendFrontendInputToRecord(vector<int8_t> data) {
+void Demux::startBroadcastEsFrame(uint16_t pid, const int8_t* frame, size_t size, uint64_t pts) {
+    mPlaybackTsDemuxer.processFrame(pid, frame, size, pts);
+}
+
+void Demux::sendFrontendInputToRecord(const int8_t* data, size_t size) {
     set<int64_t>::iterator it;
     if (DEBUG_DEMUX) {
         ALOGW("[Demux] update record filter output");
     }
     for (it = mRecordFilterIds.begin(); it != mRecordFilterIds.end(); it++) {
-        mFilters[*it]->updateRecordOutput(data);
+        mFilters[*it]->updateRecordOutput(data, size);
     }
 }
 
-void Demux::sendFrontendInputToRecord(vector<int8_t> data, uint16_t pid, uint64_t pts) {
-    sendFrontendInputToRecord(data);
+bool Demux::canQueueRecordOutput(size_t size, bool& fits) {
+    bool canQueue = true;
     set<int64_t>::iterator it;
     for (it = mRecordFilterIds.begin(); it != mRecordFilterIds.end(); it++) {
-        if (pid == mFilters[*it]->getTpid()) {
-            mFilters[*it]->updatePts(pts);
-        }
+        canQueue = mFilters[*it]->canQueueOutput(size, 0 /* frameCount */, fits) && canQueue;
     }
+    return canQueue;
 }
 
-bool Demux::startBroadcastFilterDispatcher() {
+bool Demux::canQueueFrameOutput(uint16_t pid, size_t size, size_t frameCount, bool& fits) {
+    // The frames only go to the playback filters of their PID
+    bool canQueue = true;
     set<int64_t>::iterator it;
-
-    // Handle the output data per filter type
     for (it = mPlaybackFilterIds.begin(); it != mPlaybackFilterIds.end(); it++) {
-        if (!mFilters[*it]->startFilterHandler().isOk()) {
-            return false;
+        std::shared_ptr<Filter> filter = mFilters[*it];
+        if (filter->getTpid() == pid) {
+            canQueue = filter->canQueueOutput(size, frameCount, fits) && canQueue;
         }
     }
+    return canQueue;
+}
 
-    return true;
+void Demux::setIptvDvrPlaybackStatus(PlaybackStatus status) {
+    set<int64_t>::iterator it;
+    for (it = mPlaybackFilterIds.begin(); it != mPlaybackFilterIds.end(); it++) {
+        mFilters[*it]->setIptvDvrPlaybackStatus(status);
+    }
 }
 
-bool Demux::startRecordFilterDispatcher() {
+void Demux::startBroadcastFilterDispatcher() {
     set<int64_t>::iterator it;
 
-    for (it = mRecordFilterIds.begin(); it != mRecordFilterIds.end(); it++) {
-        if (!mFilters[*it]->startRecordFilterHandler().isOk()) {
-            return false;
-        }
+    // The output data is handled per filter type on the filter threads
+    for (it = mPlaybackFilterIds.begin(); it != mPlaybackFilterIds.end(); it++) {
+        mFilters[*it]->notifyFilterOutput();
     }
-
-    return true;
 }
 
-::ndk::ScopedAStatus Demux::startFilterHandler(int64_t filterId) {
-    return mFilters[filterId]->startFilterHandler();
-}
+void Demux::startRecordFilterDispatcher() {
+    set<int64_t>::iterator it;
 
-void Demux::updateFilterOutput(int64_t filterId, vector<int8_t> data) {
-    mFilters[filterId]->updateFilterOutput(data);
+    for (it = mRecordFilterIds.begin(); it != mRecordFilterIds.end(); it++) {
+        mFilters[*it]->notifyFilterOutput();
+    }
 }
 
-void Demux::updateMediaFilterOutput(int64_t filterId, vector<int8_t> data, uint64_t pts) {
-    updateFilterOutput(filterId, data);
-    mFilters[filterId]->updatePts(pts);
+void Demux::updateFilterTpid(int64_t filterId) {
+    if (mPlaybackFilterIds.find(filterId) == mPlaybackFilterIds.end()) {
+        return;
+    }
+    std::shared_ptr<Filter> filter = mFilters[filterId];
+    mPlaybackTsDemuxer.removeSink(filter.get());
+    mPlaybackTsDemuxer.addSink(filter->getTpid(), filter.get());
 }
 
-uint16_t Demux::getFilterTpid(int64_t filterId) {
-    return mFilters[filterId]->getTpid();
+void Demux::setPlaybackPacketSize(size_t packetSize) {
+    if (packetSize != mPlaybackTsDemuxer.getPacketSize()) {
+        mPlaybackTsDemuxer.setPacketSize(packetSize);
+    }
 }
 
 int32_t Demux::getDemuxId() {
@@ -530,10 +527,13 @@ void Demux::frontendInputThreadLoop() {
 
     while (mFrontendInputThreadRunning) {
         uint32_t efState = 0;
+        // Input held back for the filters to drain is retried even without new input
+        bool isInputPending = mDvrPlayback->isPlaybackInputPending();
         ::android::status_t status = mDvrPlayback->getDvrEventFlag()->wait(
-                static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_READY), &efState, WAIT_TIMEOUT,
+                static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_READY), &efState,
+                isInputPending ? OUTPUT_DRAIN_TIMEOUT : WAIT_TIMEOUT,
                 true /* retry on spurious wake */);
-        if (status != ::android::OK) {
+        if (status != ::android::OK && !isInputPending) {
             ALOGD("[Demux] wait for data ready on the playback FMQ");
             continue;
         }
@@ -548,11 +548,11 @@ void Demux::frontendInputThreadLoop() {
         // Our current implementation filter the data and write it into the filter FMQ immediately
         // after the DATA_READY from the VTS/framework
         // This is for the non-ES data source, real playback use case handling.
-        if (!mDvrPlayback->readPlaybackFMQ(true /*isVirtualFrontend*/, mIsRecording) ||
-            !mDvrPlayback->startFilterDispatcher(true /*isVirtualFrontend*/, mIsRecording)) {
+        if (!mDvrPlayback->readPlaybackFMQ(true /*isVirtualFrontend*/, mIsRecording)) {
             ALOGE("[Demux] playback data failed to be filtered. Ending thread");
             break;
         }
+        mDvrPlayback->startFilterDispatcher(true /*isVirtualFrontend*/, mIsRecording);
     }
 
     mFrontendInputThreadRunning = false;
@@ -588,6 +588,8 @@ bool Demux::isRecording() {
 binder_status_t Demux::dump(int fd, const char** args, uint32_t numArgs) {
     dprintf(fd, " Demux %d:\n", mDemuxId);
     dprintf(fd, "  mIsRecording %d\n", mIsRecording);
+    dprintf(fd, "  Playback TS packets: %" PRIu64 ", sync losses: %" PRIu64 "\n",
+            mPlaybackTsDemuxer.getPacketCount(), mPlaybackTsDemuxer.getSyncLossCount());
     {
         dprintf(fd, "  Filters:\n");
         map<int64_t, std::shared_ptr<Filter>>::iterator it;
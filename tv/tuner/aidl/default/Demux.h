@@ -30,6 +30,7 @@
 #include "Frontend.h"
 #include "TimeFilter.h"
 #include "Timer.h"
+#include "TsDemuxer.h"
 #include "Tuner.h"
 #include "dtv_plugin.h"
 
@@ -58,6 +59,11 @@ class Tuner;
 
 const int IPTV_PLAYBACK_TIMEOUT = 20;            // ms
 const int IPTV_PLAYBACK_BUFFER_TIMEOUT = 20000;  // ms
+// Depth of the IPTV input read ahead of the DVR, overridden by the property
+const size_t IPTV_READAHEAD_SIZE = IPTV_BUFFER_SIZE * 16;
+const char IPTV_READAHEAD_SIZE_PROPERTY[] = "vendor.tuner.iptv.readahead_size";
+
+class IptvReadahead;
 
 class DvrPlaybackCallback : public BnDvrCallback {
   public:
@@ -99,26 +105,47 @@ class Demux : public BnDemux {
     ::ndk::ScopedAStatus removeFilter(int64_t filterId);
     bool attachRecordFilter(int64_t filterId);
     bool detachRecordFilter(int64_t filterId);
-    ::ndk::ScopedAStatus startFilterHandler(int64_t filterId);
-    void updateFilterOutput(int64_t filterId, vector<int8_t> data);
-    void updateMediaFilterOutput(int64_t filterId, vector<int8_t> data, uint64_t pts);
-    uint16_t getFilterTpid(int64_t filterId);
+    /**
+     * Routes the packets of the filter's configured tpid to a playback filter.
+     */
+    void updateFilterTpid(int64_t filterId);
+    void setPlaybackPacketSize(size_t packetSize);
     void setIsRecording(bool isRecording);
     bool isRecording();
     void startFrontendInputLoop();
-    void frontendIptvInputThreadLoop(dtv_plugin* interface, dtv_streamer* streamer, void* buf);
+    /**
+     * Reads the IPTV stream ahead into a ring while the DVR FMQ is full, in batches
+     * sized to the FMQ's free space, and sleeps on the DVR event flag when both are full.
+     */
+    void frontendIptvInputThreadLoop(dtv_plugin* interface, dtv_streamer* streamer);
 
     /**
-     * A dispatcher to read and dispatch input data to all the started filters.
+     * A dispatcher to hand the input data queued for the started filters to their threads.
      * Each filter handler handles the data filtering/output writing/filterEvent updating.
      * Note that recording filters are not included.
      */
-    bool startBroadcastFilterDispatcher();
-    void startBroadcastTsFilter(vector<int8_t> data);
+    void startBroadcastFilterDispatcher();
+    /**
+     * Routes the TS packets in |data| to the playback filters of their PIDs. A packet
+     * split across two calls is completed by the second one.
+     */
+    void startBroadcastTsFilter(const int8_t* data, size_t size);
+    /**
+     * Routes an ES playback frame to the playback filters of |pid|.
+     */
+    void startBroadcastEsFrame(uint16_t pid, const int8_t* frame, size_t size, uint64_t pts);
 
-    void sendFrontendInputToRecord(vector<int8_t> data);
-    void sendFrontendInputToRecord(vector<int8_t> data, uint16_t pid, uint64_t pts);
-    bool startRecordFilterDispatcher();
+    void sendFrontendInputToRecord(const int8_t* data, size_t size);
+    /**
+     * Whether the record filters can all queue |size| bytes of output, or the playback
+     * filters of |pid| |size| bytes in |frameCount| frames. Used to hold back playback
+     * input rather than drop output. |fits| is cleared if a filter never can.
+     */
+    bool canQueueRecordOutput(size_t size, bool& fits);
+    bool canQueueFrameOutput(uint16_t pid, size_t size, size_t frameCount, bool& fits);
+    // Passes the status of the IPTV DVR playback on to the playback filters
+    void setIptvDvrPlaybackStatus(PlaybackStatus status);
+    void startRecordFilterDispatcher();
 
     void getDemuxInfo(DemuxInfo* demuxInfo);
     int32_t getDemuxId();
@@ -150,6 +177,8 @@ class Demux : public BnDemux {
 
     static void* __threadLoopFrontend(void* user);
     void frontendInputThreadLoop();
+    // Writes the readahead into the DVR FMQ. Returns the space left in the FMQ.
+    size_t drainIptvReadahead(IptvReadahead& readahead);
 
     /**
      * To create a FilterMQ with the next available Filter ID.
@@ -184,6 +213,10 @@ class Demux : public BnDemux {
      * The array number is the filter ID.
      */
     std::map<int64_t, std::shared_ptr<Filter>> mFilters;
+    /**
+     * Routes playback input to the playback filters by PID.
+     */
+    TsDemuxer mPlaybackTsDemuxer;
 
     /**
      * Local reference to the opened Timer Filter instance.
@@ -200,9 +233,6 @@ class Demux : public BnDemux {
     std::thread mFrontendInputThread;
     std::thread mDemuxIptvReadThread;
 
-    // track whether the DVR FMQ for IPTV Playback is full
-    bool mIsIptvDvrFMQFull = false;
-
     /**
      * If a specific filter's writing loop is still running
      */
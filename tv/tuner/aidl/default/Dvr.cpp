@@ -30,6 +30,8 @@ namespace tv {
 namespace tuner {
 
 #define WAIT_TIMEOUT 3000000000
+// How long held back playback input waits for the filters to drain before a retry
+#define OUTPUT_DRAIN_TIMEOUT 10000000
 
 Dvr::Dvr(DvrType type, uint32_t bufferSize, const std::shared_ptr<IDvrCallback>& cb,
          std::shared_ptr<Demux> demux) {
@@ -57,6 +59,9 @@ Dvr::~Dvr() {
 
     mDvrSettings = in_settings;
     mDvrConfigured = true;
+    if (mType == DvrType::PLAYBACK) {
+        mDemux->setPlaybackPacketSize(in_settings.get<DvrSettings::Tag::playback>().packetSize);
+    }
 
     return ::ndk::ScopedAStatus::ok();
 }
@@ -112,6 +117,8 @@ Dvr::~Dvr() {
     }
 
     if (mType == DvrType::PLAYBACK) {
+        mPlaybackInputPending = false;
+        mEsPacketizer.reset();
         mDvrThreadRunning = true;
         mDvrThread = std::thread(&Dvr::playbackThreadLoop, this);
     } else if (mType == DvrType::RECORD) {
@@ -197,10 +204,12 @@ void Dvr::playbackThreadLoop() {
 
     while (mDvrThreadRunning) {
         uint32_t efState = 0;
-        ::android::status_t status =
-                mDvrEventFlag->wait(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_READY),
-                                    &efState, WAIT_TIMEOUT, true /* retry on spurious wake */);
-        if (status != ::android::OK) {
+        // Input held back for the filters to drain is retried even without new input
+        ::android::status_t status = mDvrEventFlag->wait(
+                static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_READY), &efState,
+                mPlaybackInputPending ? OUTPUT_DRAIN_TIMEOUT : WAIT_TIMEOUT,
+                true /* retry on spurious wake */);
+        if (status != ::android::OK && !mPlaybackInputPending) {
             ALOGD("[Dvr] wait for data ready on the playback FMQ");
             continue;
         }
@@ -223,11 +232,11 @@ void Dvr::playbackThreadLoop() {
         // Our current implementation filter the data and write it into the filter FMQ immediately
         // after the DATA_READY from the VTS/framework
         // This is for the non-ES data source, real playback use case handling.
-        if (!readPlaybackFMQ(isVirtualFrontend, isRecording) ||
-            !startFilterDispatcher(isVirtualFrontend, isRecording)) {
+        if (!readPlaybackFMQ(isVirtualFrontend, isRecording)) {
             ALOGE("[Dvr] playback data failed to be filtered. Ending thread");
             break;
         }
+        startFilterDispatcher(isVirtualFrontend, isRecording);
 
         maySendPlaybackStatusCallback();
     }
@@ -245,11 +254,7 @@ void Dvr::maySendIptvPlaybackStatusCallback() {
                                                          IPTV_PLAYBACK_STATUS_THRESHOLD_HIGH,
                                                          IPTV_PLAYBACK_STATUS_THRESHOLD_LOW);
     if (mPlaybackStatus != newStatus) {
-        map<int64_t, std::shared_ptr<Filter>>::iterator it;
-        for (it = mFilters.begin(); it != mFilters.end(); it++) {
-            std::shared_ptr<Filter> currentFilter = it->second;
-            currentFilter->setIptvDvrPlaybackStatus(newStatus);
-        }
+        mDemux->setIptvDvrPlaybackStatus(newStatus);
         mCallback->onPlaybackStatus(newStatus);
         mPlaybackStatus = newStatus;
     }
@@ -285,98 +290,157 @@ PlaybackStatus Dvr::checkPlaybackStatusChange(uint32_t availableToWrite, uint32_
 }
 
 bool Dvr::readPlaybackFMQ(bool isVirtualFrontend, bool isRecording) {
-    // Read playback data from the input FMQ
-    size_t size = mDvrMQ->availableToRead();
+    lock_guard<mutex> lock(mPlaybackInputLock);
+    // Dispatch all the whole packets available in the input FMQ in place. A filter without room
+    // for the packets of its PID drops them and reports an overflow, as hardware would, so that
+    // a filter falling behind never holds back the input of the others.
     int64_t playbackPacketSize = mDvrSettings.get<DvrSettings::Tag::playback>().packetSize;
-    vector<int8_t> dataOutputBuffer;
-    dataOutputBuffer.resize(playbackPacketSize);
-    // Dispatch the packet to the PID matching filter output buffer
-    for (int i = 0; i < size / playbackPacketSize; i++) {
-        if (!mDvrMQ->read(dataOutputBuffer.data(), playbackPacketSize)) {
-            return false;
-        }
-        if (isVirtualFrontend) {
-            if (isRecording) {
-                mDemux->sendFrontendInputToRecord(dataOutputBuffer);
-            } else {
-                mDemux->startBroadcastTsFilter(dataOutputBuffer);
-            }
-        } else {
-            startTpidFilter(dataOutputBuffer);
-        }
+    size_t size = mDvrMQ->availableToRead();
+    size -= size % playbackPacketSize;
+    if (size == 0) {
+        return true;
+    }
+
+    DvrMQ::MemTransaction tx;
+    if (!mDvrMQ->beginRead(size, &tx)) {
+        return false;
+    }
+    // The data wraps around the end of the ring into the second region, possibly
+    // in the middle of a packet
+    const DvrMQ::MemRegion& first = tx.getFirstRegion();
+    const DvrMQ::MemRegion& second = tx.getSecondRegion();
+    dispatchPlaybackInput(first.getAddress(), first.getLength(), isVirtualFrontend, isRecording);
+    if (second.getLength() > 0) {
+        dispatchPlaybackInput(second.getAddress(), second.getLength(), isVirtualFrontend,
+                              isRecording);
     }
 
+    if (!mDvrMQ->commitRead(size)) {
+        return false;
+    }
+    mDvrEventFlag->wake(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_CONSUMED));
     return true;
 }
 
+void Dvr::dispatchPlaybackInput(const int8_t* data, size_t size, bool isVirtualFrontend,
+                                bool isRecording) {
+    if (isVirtualFrontend && isRecording) {
+        mDemux->sendFrontendInputToRecord(data, size);
+    } else {
+        // The playback filters of this DVR are the playback filters of the demux
+        mDemux->startBroadcastTsFilter(data, size);
+    }
+}
+
 bool Dvr::processEsDataOnPlayback(bool isVirtualFrontend, bool isRecording) {
-    // Read ES from the DVR FMQ
+    lock_guard<mutex> lock(mPlaybackInputLock);
+    // The client may queue several ES buffers, each of metadata followed by its video and
+    // audio data. They are handled one at a time, so that one whose output does not fit yet
+    // holds back only itself and the buffers behind it.
+    while (true) {
+        int size = mDvrMQ->availableToRead();
+        if (size == 0) {
+            mPlaybackInputPending = false;
+            return true;
+        }
+        int bufferSize = 0;
+        if (!processEsBufferOnPlayback(size, isVirtualFrontend, isRecording, bufferSize)) {
+            return false;
+        }
+        if (bufferSize == 0) {
+            // The filters have no room for the output of the next buffer yet
+            return true;
+        }
+    }
+}
+
+bool Dvr::processEsBufferOnPlayback(int size, bool isVirtualFrontend, bool isRecording,
+                                    int& bufferSize) {
+    // Read ES from the DVR FMQ in place
     // Note that currently we only provides ES with metaData in a specific format to be parsed.
     // The ES size should be smaller than the Playback FMQ size to avoid reading truncated data.
-    int size = mDvrMQ->availableToRead();
-    vector<int8_t> dataOutputBuffer;
-    dataOutputBuffer.resize(size);
-    if (!mDvrMQ->read(dataOutputBuffer.data(), size)) {
+    DvrMQ::MemTransaction tx;
+    if (!mDvrMQ->beginRead(size, &tx)) {
+        return false;
+    }
+    const int8_t* esData = tx.getFirstRegion().getAddress();
+    if (tx.getSecondRegion().getLength() > 0) {
+        // The metadata and frames are parsed as one buffer, so only input wrapping
+        // around the end of the ring is copied
+        mEsInputBuffer.resize(size);
+        if (!tx.copyFrom(mEsInputBuffer.data(), 0, size)) {
+            return false;
+        }
+        esData = mEsInputBuffer.data();
+    }
+
+    // The metadata starts with its own size, which bounds the parsing of the rest of it
+    int metaDataSize = 0;
+    if (esData[0] != 'm') {
+        ALOGE("[Dvr] Invalid meta data, it does not start with its size.");
+        return false;
+    }
+    int index = 0;
+    getMetaDataValue(index, esData, metaDataSize, size);
+    if (metaDataSize <= 0 || metaDataSize > size) {
+        ALOGE("[Dvr] Invalid meta data, metaSize=%d, availableSize=%d", metaDataSize, size);
         return false;
     }
 
-    int metaDataSize = size;
     int totalFrames = 0;
     int videoEsDataSize = 0;
     int audioEsDataSize = 0;
     int audioPid = 0;
     int videoPid = 0;
 
-    vector<MediaEsMetaData> esMeta;
-    int videoReadPointer = 0;
+    int videoReadPointer = metaDataSize;
     int audioReadPointer = 0;
     int frameCount = 0;
+    mEsMeta.clear();
     // Get meta data from the es
-    for (int i = 0; i < metaDataSize; i++) {
-        switch (dataOutputBuffer[i]) {
-            case 'm':
-                metaDataSize = 0;
-                getMetaDataValue(i, dataOutputBuffer.data(), metaDataSize);
-                videoReadPointer = metaDataSize;
-                continue;
+    for (int i = index; i < metaDataSize; i++) {
+        switch (esData[i]) {
             case 'l':
-                getMetaDataValue(i, dataOutputBuffer.data(), totalFrames);
-                esMeta.resize(totalFrames);
+                getMetaDataValue(i, esData, totalFrames, metaDataSize);
+                mEsMeta.resize(totalFrames);
                 continue;
             case 'V':
-                getMetaDataValue(i, dataOutputBuffer.data(), videoEsDataSize);
+                getMetaDataValue(i, esData, videoEsDataSize, metaDataSize);
                 audioReadPointer = metaDataSize + videoEsDataSize;
                 continue;
             case 'A':
-                getMetaDataValue(i, dataOutputBuffer.data(), audioEsDataSize);
+                getMetaDataValue(i, esData, audioEsDataSize, metaDataSize);
                 continue;
             case 'p':
-                if (dataOutputBuffer[++i] == 'a') {
-                    getMetaDataValue(i, dataOutputBuffer.data(), audioPid);
-                } else if (dataOutputBuffer[i] == 'v') {
-                    getMetaDataValue(i, dataOutputBuffer.data(), videoPid);
+                if (i + 1 >= metaDataSize) {
+                    continue;
+                }
+                if (esData[++i] == 'a') {
+                    getMetaDataValue(i, esData, audioPid, metaDataSize);
+                } else if (esData[i] == 'v') {
+                    getMetaDataValue(i, esData, videoPid, metaDataSize);
                 }
                 continue;
             case 'v':
             case 'a':
-                if (dataOutputBuffer[i + 1] != ',') {
+                if (i + 1 >= metaDataSize || esData[i + 1] != ',' || frameCount >= totalFrames) {
                     ALOGE("[Dvr] Invalid format meta data.");
                     return false;
                 }
-                esMeta[frameCount] = {
-                        .isAudio = dataOutputBuffer[i] == 'a' ? true : false,
+                mEsMeta[frameCount] = {
+                        .isAudio = esData[i] == 'a' ? true : false,
                 };
                 i += 5;  // Move to Len
-                getMetaDataValue(i, dataOutputBuffer.data(), esMeta[frameCount].len);
-                if (esMeta[frameCount].isAudio) {
-                    esMeta[frameCount].startIndex = audioReadPointer;
-                    audioReadPointer += esMeta[frameCount].len;
+                getMetaDataValue(i, esData, mEsMeta[frameCount].len, metaDataSize);
+                if (mEsMeta[frameCount].isAudio) {
+                    mEsMeta[frameCount].startIndex = audioReadPointer;
+                    audioReadPointer += mEsMeta[frameCount].len;
                 } else {
-                    esMeta[frameCount].startIndex = videoReadPointer;
-                    videoReadPointer += esMeta[frameCount].len;
+                    mEsMeta[frameCount].startIndex = videoReadPointer;
+                    videoReadPointer += mEsMeta[frameCount].len;
                 }
                 i += 4;  // move to PTS
-                getMetaDataValue(i, dataOutputBuffer.data(), esMeta[frameCount].pts);
+                getMetaDataValue(i, esData, mEsMeta[frameCount].pts, metaDataSize);
                 frameCount++;
                 continue;
             default:
@@ -390,89 +454,117 @@ bool Dvr::processEsDataOnPlayback(bool isVirtualFrontend, bool isRecording) {
         return false;
     }
 
-    if (metaDataSize + audioEsDataSize + videoEsDataSize != size) {
+    // Only this buffer is handled, any input behind it is left for the next pass
+    const int esBufferSize = metaDataSize + audioEsDataSize + videoEsDataSize;
+    if (videoEsDataSize < 0 || audioEsDataSize < 0 || esBufferSize > size ||
+        videoReadPointer > metaDataSize + videoEsDataSize || audioReadPointer > esBufferSize) {
         ALOGE("[Dvr] Invalid meta data, metaSize=%d, videoSize=%d, audioSize=%d, totolSize=%d",
               metaDataSize, videoEsDataSize, audioEsDataSize, size);
         return false;
     }
 
-    // Read es raw data from the FMQ per meta data built previously
-    vector<int8_t> frameData;
-    map<int64_t, std::shared_ptr<Filter>>::iterator it;
-    int pid = 0;
-    for (int i = 0; i < totalFrames; i++) {
-        frameData.resize(esMeta[i].len);
-        pid = esMeta[i].isAudio ? audioPid : videoPid;
-        memcpy(frameData.data(), dataOutputBuffer.data() + esMeta[i].startIndex, esMeta[i].len);
-        // Send to the media filters or record filters
-        if (!isRecording) {
-            for (it = mFilters.begin(); it != mFilters.end(); it++) {
-                if (pid == mDemux->getFilterTpid(it->first)) {
-                    mDemux->updateMediaFilterOutput(it->first, frameData,
-                                                    static_cast<uint64_t>(esMeta[i].pts));
-                }
-            }
-        } else {
-            mDemux->sendFrontendInputToRecord(frameData, pid, static_cast<uint64_t>(esMeta[i].pts));
+    // Leave the input in the FMQ until every filter has room for its output. The client
+    // sees the FMQ fill up and is woken with DATA_CONSUMED once it is read.
+    bool fits = true;
+    bool canQueue;
+    if (isRecording) {
+        // Every record filter receives all of the packetized frames
+        size_t outputSize = 0;
+        for (int i = 0; i < totalFrames; i++) {
+            outputSize += EsPacketizer::getPacketizedSize(mEsMeta[i].len);
+        }
+        canQueue = mDemux->canQueueRecordOutput(outputSize, fits);
+    } else if (audioPid == videoPid) {
+        canQueue = mDemux->canQueueFrameOutput(audioPid, audioEsDataSize + videoEsDataSize,
+                                               totalFrames, fits);
+    } else {
+        // Each playback filter only receives the frames of its PID
+        int audioFrames = 0;
+        for (int i = 0; i < totalFrames; i++) {
+            audioFrames += mEsMeta[i].isAudio ? 1 : 0;
+        }
+        canQueue = mDemux->canQueueFrameOutput(audioPid, audioEsDataSize, audioFrames, fits);
+        canQueue = mDemux->canQueueFrameOutput(videoPid, videoEsDataSize,
+                                               totalFrames - audioFrames, fits) &&
+                   canQueue;
+    }
+    if (!fits) {
+        // Waiting would never make room for it, so drop it and move on to the next buffer
+        ALOGE("[Dvr] ES buffer output exceeds a filter buffer, audioSize=%d, videoSize=%d",
+              audioEsDataSize, videoEsDataSize);
+        if (!mDvrMQ->commitRead(esBufferSize)) {
+            return false;
         }
+        mDvrEventFlag->wake(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_CONSUMED));
+        bufferSize = esBufferSize;
+        return true;
+    }
+    if (!canQueue) {
+        mPlaybackInputPending = true;
         startFilterDispatcher(isVirtualFrontend, isRecording);
-        frameData.clear();
+        bufferSize = 0;
+        return true;
     }
+    mPlaybackInputPending = false;
+
+    if (!isRecording) {
+        // Send the frames to the media filters of their PIDs
+        for (int i = 0; i < totalFrames; i++) {
+            uint16_t pid = mEsMeta[i].isAudio ? audioPid : videoPid;
+            mDemux->startBroadcastEsFrame(pid, esData + mEsMeta[i].startIndex, mEsMeta[i].len,
+                                          static_cast<uint64_t>(mEsMeta[i].pts));
+        }
+    } else {
+        // Record the frames as a transport stream, as if received from a frontend
+        mEsPacketizer.clear();
+        for (int i = 0; i < totalFrames; i++) {
+            bool isAudio = mEsMeta[i].isAudio;
+            mEsPacketizer.addFrame(
+                    isAudio ? audioPid : videoPid,
+                    isAudio ? EsPacketizer::AUDIO_STREAM_ID : EsPacketizer::VIDEO_STREAM_ID,
+                    esData + mEsMeta[i].startIndex, mEsMeta[i].len,
+                    static_cast<uint64_t>(mEsMeta[i].pts));
+        }
+        mDemux->sendFrontendInputToRecord(mEsPacketizer.getPackets(),
+                                          mEsPacketizer.getPacketsSize());
+    }
+    startFilterDispatcher(isVirtualFrontend, isRecording);
 
+    if (!mDvrMQ->commitRead(esBufferSize)) {
+        return false;
+    }
+    mDvrEventFlag->wake(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_CONSUMED));
+    bufferSize = esBufferSize;
     return true;
 }
 
-void Dvr::getMetaDataValue(int& index, int8_t* dataOutputBuffer, int& value) {
+void Dvr::getMetaDataValue(int& index, const int8_t* dataOutputBuffer, int& value, int end) {
     index += 2;  // Move the pointer across the ":" to the value
-    while (dataOutputBuffer[index] != ',' && dataOutputBuffer[index] != '\n') {
+    while (index < end && dataOutputBuffer[index] != ',' && dataOutputBuffer[index] != '\n') {
         value = ((dataOutputBuffer[index++] - 48) + value * 10);
     }
 }
 
-void Dvr::startTpidFilter(vector<int8_t> data) {
-    map<int64_t, std::shared_ptr<Filter>>::iterator it;
-    for (it = mFilters.begin(); it != mFilters.end(); it++) {
-        uint16_t pid = ((data[1] & 0x1f) << 8) | ((data[2] & 0xff));
-        if (DEBUG_DVR) {
-            ALOGW("[Dvr] start ts filter pid: %d", pid);
-        }
-        if (pid == mDemux->getFilterTpid(it->first)) {
-            mDemux->updateFilterOutput(it->first, data);
-        }
+void Dvr::startFilterDispatcher(bool isVirtualFrontend, bool isRecording) {
+    if (isVirtualFrontend && isRecording) {
+        mDemux->startRecordFilterDispatcher();
+    } else {
+        // The playback filters of this DVR are the playback filters of the demux
+        mDemux->startBroadcastFilterDispatcher();
     }
 }
 
-bool Dvr::startFilterDispatcher(bool isVirtualFrontend, bool isRecording) {
-    if (isVirtualFrontend) {
-        if (isRecording) {
-            return mDemux->startRecordFilterDispatcher();
-        } else {
-            return mDemux->startBroadcastFilterDispatcher();
-        }
-    }
-
-    map<int64_t, std::shared_ptr<Filter>>::iterator it;
-    // Handle the output data per filter type
-    for (it = mFilters.begin(); it != mFilters.end(); it++) {
-        if (!mDemux->startFilterHandler(it->first).isOk()) {
-            return false;
-        }
-    }
-
-    return true;
-}
-
 int Dvr::writePlaybackFMQ(void* buf, size_t size) {
     lock_guard<mutex> lock(mWriteLock);
-    ALOGI("Playback status: %d", mPlaybackStatus);
+    ALOGV("Playback status: %d", mPlaybackStatus);
     if (mPlaybackStatus == PlaybackStatus::SPACE_FULL) {
         ALOGW("[Dvr] stops writing and wait for the client side flushing.");
         return DVR_WRITE_FAILURE_REASON_FMQ_FULL;
     }
-    ALOGI("availableToWrite before: %zu", mDvrMQ->availableToWrite());
+    ALOGV("availableToWrite before: %zu", mDvrMQ->availableToWrite());
     if (mDvrMQ->write((int8_t*)buf, size)) {
         mDvrEventFlag->wake(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_READY));
-        ALOGI("availableToWrite: %zu", mDvrMQ->availableToWrite());
+        ALOGV("availableToWrite: %zu", mDvrMQ->availableToWrite());
         maySendIptvPlaybackStatusCallback();
         return DVR_WRITE_SUCCESS;
     }
@@ -480,6 +572,15 @@ int Dvr::writePlaybackFMQ(void* buf, size_t size) {
     return DVR_WRITE_FAILURE_REASON_UNKNOWN;
 }
 
+size_t Dvr::getPlaybackFMQSpace() {
+    lock_guard<mutex> lock(mPlaybackStatusLock);
+    // Writes are refused until the client flushes a full FMQ
+    if (mPlaybackStatus == PlaybackStatus::SPACE_FULL) {
+        return 0;
+    }
+    return mDvrMQ->availableToWrite();
+}
+
 bool Dvr::writeRecordFMQ(const vector<int8_t>& data) {
     lock_guard<mutex> lock(mWriteLock);
     if (mRecordStatus == RecordStatus::OVERFLOW) {
@@ -523,16 +624,6 @@ RecordStatus Dvr::checkRecordStatusChange(uint32_t availableToWrite, uint32_t av
     return mRecordStatus;
 }
 
-bool Dvr::addPlaybackFilter(int64_t filterId, std::shared_ptr<Filter> filter) {
-    mFilters[filterId] = filter;
-    return true;
-}
-
-bool Dvr::removePlaybackFilter(int64_t filterId) {
-    mFilters.erase(filterId);
-    return true;
-}
-
 }  // namespace tuner
 }  // namespace tv
 }  // namespace hardware
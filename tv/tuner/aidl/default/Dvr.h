@@ -25,6 +25,7 @@
 #include <set>
 #include <thread>
 #include "Demux.h"
+#include "EsPacketizer.h"
 #include "Frontend.h"
 #include "Tuner.h"
 
@@ -94,12 +95,14 @@ class Dvr : public BnDvr {
      */
     bool createDvrMQ();
     int writePlaybackFMQ(void* buf, size_t size);
+    size_t getPlaybackFMQSpace();
     bool writeRecordFMQ(const std::vector<int8_t>& data);
-    bool addPlaybackFilter(int64_t filterId, std::shared_ptr<Filter> filter);
-    bool removePlaybackFilter(int64_t filterId);
     bool readPlaybackFMQ(bool isVirtualFrontend, bool isRecording);
     bool processEsDataOnPlayback(bool isVirtualFrontend, bool isRecording);
-    bool startFilterDispatcher(bool isVirtualFrontend, bool isRecording);
+    // Whether input was held back for the filters to drain their output, and should be
+    // retried without waiting for new input.
+    bool isPlaybackInputPending() { return mPlaybackInputPending; }
+    void startFilterDispatcher(bool isVirtualFrontend, bool isRecording);
     EventFlag* getDvrEventFlag();
     DvrSettings getSettings() { return mDvrSettings; }
 
@@ -110,11 +113,15 @@ class Dvr : public BnDvr {
     DvrType mType;
     uint32_t mBufferSize;
     std::shared_ptr<IDvrCallback> mCallback;
-    std::map<int64_t, std::shared_ptr<Filter>> mFilters;
 
     void deleteEventFlag();
     bool readDataFromMQ();
-    void getMetaDataValue(int& index, int8_t* dataOutputBuffer, int& value);
+    // Handles the ES buffer at the front of the FMQ, of at most size bytes. bufferSize is set to
+    // the size of the buffer read from the FMQ, or to 0 if it has to wait for filter space.
+    bool processEsBufferOnPlayback(int size, bool isVirtualFrontend, bool isRecording,
+                                   int& bufferSize);
+    // Parses the decimal value after the ':' at index, stopping before end.
+    void getMetaDataValue(int& index, const int8_t* dataOutputBuffer, int& value, int end);
     void maySendPlaybackStatusCallback();
     void maySendIptvPlaybackStatusCallback();
     void maySendRecordStatusCallback();
@@ -123,10 +130,11 @@ class Dvr : public BnDvr {
     RecordStatus checkRecordStatusChange(uint32_t availableToWrite, uint32_t availableToRead,
                                          int64_t highThreshold, int64_t lowThreshold);
     /**
-     * A dispatcher to read and dispatch input data to all the started filters.
-     * Each filter handler handles the data filtering/output writing/filterEvent updating.
+     * Routes a span of playback input to the record filters or the PID matching
+     * playback filters.
      */
-    void startTpidFilter(vector<int8_t> data);
+    void dispatchPlaybackInput(const int8_t* data, size_t size, bool isVirtualFrontend,
+                               bool isRecording);
     void playbackThreadLoop();
 
     unique_ptr<DvrMQ> mDvrMQ;
@@ -137,6 +145,23 @@ class Dvr : public BnDvr {
     bool mDvrConfigured = false;
     DvrSettings mDvrSettings;
 
+    /**
+     * Serializes the threads reading the playback FMQ: the DVR thread and the frontend
+     * input thread of the demux, which IPTV input also goes through. Whichever holds it
+     * is the only producer of the output of the filters.
+     */
+    std::mutex mPlaybackInputLock;
+    /**
+     * ES playback state, reused across the input buffers. Guarded by mPlaybackInputLock.
+     */
+    // Input copied out of the FMQ only when it wraps around the end of the ring
+    vector<int8_t> mEsInputBuffer;
+    vector<MediaEsMetaData> mEsMeta;
+    // Packets of the frames being recorded
+    EsPacketizer mEsPacketizer;
+    // Set while ES input is held back for the filters to drain their output
+    std::atomic<bool> mPlaybackInputPending = false;
+
     // Thread handlers
     std::thread mDvrThread;
 
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "android.hardware.tv.tuner-service.example-EsPacketizer"
+
+#include <string.h>
+#include <algorithm>
+
+#include "EsPacketizer.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+namespace {
+
+const size_t TS_PACKET_SIZE = 188;
+const size_t TS_HEADER_SIZE = 4;
+const size_t TS_PAYLOAD_SIZE = TS_PACKET_SIZE - TS_HEADER_SIZE;
+// Start code, stream_id, PES_packet_length, flags, PES_header_data_length and PTS
+const size_t PES_HEADER_SIZE = 14;
+const size_t PES_MAX_PACKET_LENGTH = 0xFFFF;
+
+// Writes a PTS with its marker bits, as in ISO/IEC 13818-1 Table 2-21
+void writePts(int8_t* data, uint64_t pts) {
+    data[0] = static_cast<int8_t>(0x21 | ((pts >> 29) & 0x0E));
+    data[1] = static_cast<int8_t>(pts >> 22);
+    data[2] = static_cast<int8_t>(0x01 | ((pts >> 14) & 0xFE));
+    data[3] = static_cast<int8_t>(pts >> 7);
+    data[4] = static_cast<int8_t>(0x01 | ((pts << 1) & 0xFE));
+}
+
+}  // namespace
+
+EsPacketizer::EsPacketizer() {
+    mContinuityCounters.fill(0);
+}
+
+void EsPacketizer::reset() {
+    mPacketsSize = 0;
+    mContinuityCounters.fill(0);
+}
+
+size_t EsPacketizer::getPacketizedSize(size_t frameSize) {
+    return (PES_HEADER_SIZE + frameSize + TS_PAYLOAD_SIZE - 1) / TS_PAYLOAD_SIZE * TS_PACKET_SIZE;
+}
+
+// The arena has been grown for the whole frame beforehand
+int8_t* EsPacketizer::appendPacket() {
+    int8_t* packet = mPackets.data() + mPacketsSize;
+    mPacketsSize += TS_PACKET_SIZE;
+    return packet;
+}
+
+void EsPacketizer::addFrame(uint16_t pid, uint8_t streamId, const int8_t* data, size_t size,
+                            uint64_t pts) {
+    if (pid >= TS_PID_COUNT) {
+        return;
+    }
+    size_t packetizedSize = getPacketizedSize(size);
+    if (mPacketsSize + packetizedSize > mPackets.size()) {
+        mPackets.resize(std::max(mPackets.size() * 2, mPacketsSize + packetizedSize));
+    }
+
+    int8_t pesHeader[PES_HEADER_SIZE];
+    // A video PES packet too long for PES_packet_length leaves it unbounded
+    size_t pesPacketLength = PES_HEADER_SIZE - 6 + size;
+    if (pesPacketLength > PES_MAX_PACKET_LENGTH) {
+        pesPacketLength = 0;
+    }
+    pesHeader[0] = 0x00;
+    pesHeader[1] = 0x00;
+    pesHeader[2] = 0x01;
+    pesHeader[3] = static_cast<int8_t>(streamId);
+    pesHeader[4] = static_cast<int8_t>(pesPacketLength >> 8);
+    pesHeader[5] = static_cast<int8_t>(pesPacketLength);
+    pesHeader[6] = static_cast<int8_t>(0x80);  // '10' marker bits, data aligned
+    pesHeader[7] = static_cast<int8_t>(0x80);  // PTS only
+    pesHeader[8] = 5;                          // PES_header_data_length
+    writePts(pesHeader + 9, pts);
+
+    size_t headerLeft = PES_HEADER_SIZE;
+    size_t dataLeft = size;
+    bool isUnitStart = true;
+    uint8_t& continuityCounter = mContinuityCounters[pid];
+    while (headerLeft + dataLeft > 0) {
+        int8_t* packet = appendPacket();
+        size_t payloadSize = std::min(headerLeft + dataLeft, TS_PAYLOAD_SIZE);
+        bool hasAdaptationField = payloadSize < TS_PAYLOAD_SIZE;
+
+        packet[0] = static_cast<int8_t>(TS_SYNC_BYTE);
+        packet[1] = static_cast<int8_t>((isUnitStart ? 0x40 : 0x00) | (pid >> 8));
+        packet[2] = static_cast<int8_t>(pid);
+        packet[3] = static_cast<int8_t>((hasAdaptationField ? 0x30 : 0x10) | continuityCounter);
+        continuityCounter = (continuityCounter + 1) & 0x0F;
+        isUnitStart = false;
+
+        int8_t* payload = packet + TS_HEADER_SIZE;
+        if (hasAdaptationField) {
+            // Stuff the last packet of the frame through its adaptation field
+            size_t adaptationFieldSize = TS_PAYLOAD_SIZE - payloadSize;
+            payload[0] = static_cast<int8_t>(adaptationFieldSize - 1);
+            if (adaptationFieldSize > 1) {
+                payload[1] = 0x00;
+                memset(payload + 2, 0xFF, adaptationFieldSize - 2);
+            }
+            payload += adaptationFieldSize;
+        }
+
+        size_t headerBytes = std::min(headerLeft, payloadSize);
+        memcpy(payload, pesHeader + PES_HEADER_SIZE - headerLeft, headerBytes);
+        headerLeft -= headerBytes;
+        size_t dataBytes = payloadSize - headerBytes;
+        if (dataBytes > 0) {
+            memcpy(payload + headerBytes, data + size - dataLeft, dataBytes);
+            dataLeft -= dataBytes;
+        }
+    }
+}
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <array>
+#include <vector>
+
+#include "TsDemuxer.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+/**
+ * Wraps elementary stream frames into PES packets carrying their PTS, as defined in
+ * ISO/IEC 13818-1 Section 2.4.3.6, and splits those into 188 byte TS packets.
+ *
+ * The packets of all the frames added since the last clear() are laid out back to back
+ * in an arena that keeps its capacity, so steady state packetizing does not allocate.
+ */
+class EsPacketizer {
+  public:
+    static const uint8_t VIDEO_STREAM_ID = 0xE0;
+    static const uint8_t AUDIO_STREAM_ID = 0xC0;
+
+    EsPacketizer();
+
+    /**
+     * Appends the TS packets of one frame of |pid| to the arena.
+     */
+    void addFrame(uint16_t pid, uint8_t streamId, const int8_t* data, size_t size, uint64_t pts);
+
+    /**
+     * Empties the arena. The continuity counters carry on.
+     */
+    void clear() { mPacketsSize = 0; }
+    /**
+     * Restarts the continuity counters, e.g. after a flush.
+     */
+    void reset();
+
+    const int8_t* getPackets() const { return mPackets.data(); }
+    size_t getPacketsSize() const { return mPacketsSize; }
+
+    /**
+     * The size of the TS packets a frame of |frameSize| bytes is split into.
+     */
+    static size_t getPacketizedSize(size_t frameSize);
+
+  private:
+    int8_t* appendPacket();
+
+    std::vector<int8_t> mPackets;
+    size_t mPacketsSize = 0;
+    std::array<uint8_t, TS_PID_COUNT> mContinuityCounters;
+};
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -23,6 +23,7 @@
 #include <aidl/android/hardware/tv/tuner/Result.h>
 #include <aidlcommonsupport/NativeHandle.h>
 #include <inttypes.h>
+#include <sys/mman.h>
 #include <utils/Log.h>
 
 #include "Filter.h"
@@ -193,7 +194,8 @@ Filter::Filter(DemuxFilterType type, int64_t filterId, uint32_t bufferSize,
       mCallbackScheduler(cb),
       mFilterId(filterId),
       mBufferSize(bufferSize),
-      mType(type) {
+      mType(type),
+      mFilterOutputRing(max<size_t>(bufferSize, FILTER_OUTPUT_RING_MIN_SIZE)) {
     switch (mType.mainType) {
         case DemuxFilterMainType::TS:
             if (mType.subType.get<DemuxFilterSubType::Tag::tsFilterType>() ==
@@ -276,9 +278,11 @@ Filter::~Filter() {
 
     switch (in_hint.hintType) {
         case FilterDelayHintType::TIME_DELAY_IN_MS:
+            mTimeDelayInMs = in_hint.hintValue;
             mCallbackScheduler.setTimeDelayHint(in_hint.hintValue);
             break;
         case FilterDelayHintType::DATA_SIZE_DELAY_IN_BYTES:
+            mDataSizeDelayInBytes = in_hint.hintValue;
             mCallbackScheduler.setDataSizeDelayHint(in_hint.hintValue);
             break;
         default:
@@ -286,6 +290,9 @@ Filter::~Filter() {
                     static_cast<int32_t>(Result::INVALID_ARGUMENT));
     }
 
+    // Let the filter thread pick up the new wait condition
+    wakeFilterThread();
+
     return ::ndk::ScopedAStatus::ok();
 }
 
@@ -303,9 +310,19 @@ Filter::~Filter() {
 
     mFilterSettings = in_settings;
     switch (mType.mainType) {
-        case DemuxFilterMainType::TS:
-            mTpid = in_settings.get<DemuxFilterSettings::Tag::ts>().tpid;
+        case DemuxFilterMainType::TS: {
+            const DemuxTsFilterSettings& tsSettings =
+                    in_settings.get<DemuxFilterSettings::Tag::ts>();
+            mTpid = tsSettings.tpid;
+            mDemux->updateFilterTpid(mFilterId);
+            if (tsSettings.filterSettings.getTag() ==
+                DemuxTsFilterSettingsFilterSettings::Tag::section) {
+                configureSectionAssembler(
+                        tsSettings.filterSettings
+                                .get<DemuxTsFilterSettingsFilterSettings::Tag::section>());
+            }
             break;
+        }
         case DemuxFilterMainType::MMTP:
             break;
         case DemuxFilterMainType::IP:
@@ -375,10 +392,19 @@ Filter::~Filter() {
 
     mFilterThreadRunning = false;
     if (mFilterThread.joinable()) {
+        wakeFilterThread();
         mFilterThread.join();
     }
 
+    // Drop the output queued while the filter was running
+    mFilterOutputRing.clear();
+    mFilterOutputFrames.clear();
+    mIsFrameOutput = false;
+    mFilterOutput.clear();
+    mRecordFilterOutput.clear();
     mCallbackScheduler.flushEvents();
+    // A section filter without repeat filters again once restarted
+    mSectionAssembler.reset();
 
     return ::ndk::ScopedAStatus::ok();
 }
@@ -399,10 +425,18 @@ Filter::~Filter() {
 ::ndk::ScopedAStatus Filter::releaseAvHandle(const NativeHandle& in_avMemory, int64_t in_avDataId) {
     ALOGV("%s", __FUNCTION__);
 
-    if ((mSharedAvMemHandle != nullptr) && (in_avMemory.fds.size() > 0) &&
-        (sameFile(in_avMemory.fds[0].get(), mSharedAvMemHandle->data[0]))) {
-        freeSharedAvHandle();
-        return ::ndk::ScopedAStatus::ok();
+    {
+        std::lock_guard<std::mutex> lock(mSharedAvMemLock);
+        if ((mSharedAvMemHandle != nullptr) && (in_avMemory.fds.size() > 0) &&
+            (sameFile(in_avMemory.fds[0].get(), mSharedAvMemHandle->data[0]))) {
+            freeSharedAvHandleLocked();
+            return ::ndk::ScopedAStatus::ok();
+        }
+
+        // The region of a media event on the shared AV memory may now be written again
+        if (mSharedAvRegions.erase(static_cast<uint64_t>(in_avDataId)) > 0) {
+            return ::ndk::ScopedAStatus::ok();
+        }
     }
 
     if (mDataId2Avfd.find(in_avDataId) == mDataId2Avfd.end()) {
@@ -442,6 +476,7 @@ Filter::~Filter() {
                 static_cast<int32_t>(Result::INVALID_STATE));
     }
 
+    std::lock_guard<std::mutex> lock(mSharedAvMemLock);
     if (mSharedAvMemHandle != nullptr) {
         *out_avMemory = ::android::dupToAidl(mSharedAvMemHandle);
         *_aidl_return = BUFFER_SIZE;
@@ -578,96 +613,168 @@ void Filter::filterThreadLoop() {
 
     ALOGI("IPTV DVR Playback status on Filter: %d", mIptvDvrPlaybackStatus);
 
-    // For the first time of filter output, implementation needs to send the filter
-    // Event Callback without waiting for the DATA_CONSUMED to init the process.
+    bool isFirstOutput = true;
     while (mFilterThreadRunning) {
-        std::unique_lock<std::mutex> lock(mFilterEventsLock);
-        if (mFilterEvents.size() == 0) {
-            lock.unlock();
+        if (!waitForFilterOutput()) {
             if (DEBUG_FILTER) {
                 ALOGD("[Filter] wait for filter data output.");
             }
-            usleep(1000 * 1000);
             continue;
         }
 
-        // After successfully write, send a callback and wait for the read to be done
-        if (mCallbackScheduler.hasCallbackRegistered()) {
-            if (mConfigured) {
-                auto startEvent =
-                        DemuxFilterEvent::make<DemuxFilterEvent::Tag::startId>(mStartId++);
-                mCallbackScheduler.onFilterEvent(std::move(startEvent));
-                mConfigured = false;
-            }
+        handleFilterOutput();
+        maySendOutputOverflowCallback();
+        if (mFilterEvents.empty()) {
+            continue;
+        }
 
-            // lock is still being held
-            for (auto&& event : mFilterEvents) {
-                mCallbackScheduler.onFilterEvent(std::move(event));
-            }
-        } else {
+        // Deliver the events of the batch through the callback scheduler
+        if (!mCallbackScheduler.hasCallbackRegistered()) {
             ALOGD("[Filter] filter callback is not configured yet.");
             mFilterThreadRunning = false;
-            return;
+            break;
+        }
+        if (mConfigured) {
+            auto startEvent = DemuxFilterEvent::make<DemuxFilterEvent::Tag::startId>(mStartId++);
+            mCallbackScheduler.onFilterEvent(std::move(startEvent));
+            mConfigured = false;
+        }
+        for (auto&& event : mFilterEvents) {
+            mCallbackScheduler.onFilterEvent(std::move(event));
         }
-
         mFilterEvents.clear();
-        mFilterStatus = DemuxFilterStatus::DATA_READY;
-        mCallbackScheduler.onFilterStatus(mFilterStatus);
-        break;
+
+        // For the first time of filter output, implementation needs to send the filter
+        // status without waiting for the DATA_CONSUMED to init the process.
+        if (isFirstOutput) {
+            mFilterStatus = DemuxFilterStatus::DATA_READY;
+            mCallbackScheduler.onFilterStatus(mFilterStatus);
+            isFirstOutput = false;
+        } else {
+            maySendFilterStatusCallback();
+        }
     }
+    ALOGD("[Filter] filter thread ended.");
+}
 
-    while (mFilterThreadRunning) {
-        uint32_t efState = 0;
-        // We do not wait for the last round of written data to be read to finish the thread
-        // because the VTS can verify the reading itself.
-        for (int i = 0; i < SECTION_WRITE_COUNT; i++) {
-            if (!mFilterThreadRunning) {
-                break;
-            }
-            while (mFilterThreadRunning && mIsUsingFMQ) {
-                ::android::status_t status = mFilterEventsFlag->wait(
-                        static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_CONSUMED), &efState,
-                        WAIT_TIMEOUT, true /* retry on spurious wake */);
-                if (status != ::android::OK) {
-                    ALOGD("[Filter] wait for data consumed");
-                    continue;
-                }
-                break;
-            }
+// Output of frames only counts once their frame is queued
+size_t Filter::getAvailableFilterOutput() {
+    if (mIsFrameOutput && mFilterOutputFrames.availableToRead() == 0) {
+        return 0;
+    }
+    return mFilterOutputRing.availableToRead();
+}
 
-            maySendFilterStatusCallback();
+// Mirrors the delay conditions of FilterCallbackScheduler so a batch is drained
+// when its events would be delivered.
+bool Filter::isFilterOutputReady() {
+    size_t available = getAvailableFilterOutput();
+    if (available == 0) {
+        return false;
+    }
+    if (available >= mFilterOutputRing.capacity() / 2) {
+        // Drain early rather than drop output
+        return true;
+    }
+    int dataSizeDelay = mDataSizeDelayInBytes;
+    if (dataSizeDelay == 0) {
+        return mTimeDelayInMs == 0;
+    }
+    return available >= static_cast<size_t>(dataSizeDelay);
+}
 
-            while (mFilterThreadRunning) {
-                std::lock_guard<std::mutex> lock(mFilterEventsLock);
-                if (mFilterEvents.size() == 0) {
-                    continue;
-                }
-                // After successfully write, send a callback and wait for the read to be done
-                for (auto&& event : mFilterEvents) {
-                    mCallbackScheduler.onFilterEvent(std::move(event));
-                }
-                mFilterEvents.clear();
-                break;
-            }
-            // We do not wait for the last read to be done
-            // VTS can verify the read result itself.
-            if (i == SECTION_WRITE_COUNT - 1) {
-                ALOGD("[Filter] filter %" PRIu64 " writing done. Ending thread", mFilterId);
-                break;
-            }
+// Returns true if there is output to handle
+bool Filter::waitForFilterOutput() {
+    std::unique_lock<std::mutex> lock(mFilterOutputWaitLock);
+    int timeDelayInMs = mTimeDelayInMs;
+    mFilterOutputWaiting = true;
+    // Pairs with the fence in notifyFilterOutput() so either the demux sees the thread
+    // waiting or the thread sees the output.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // Note: predicate protects from lost and spurious wakeups
+    int waitInMs = timeDelayInMs > 0 ? timeDelayInMs : FILTER_OUTPUT_WAIT_MS;
+    mFilterOutputCv.wait_for(lock, std::chrono::milliseconds(waitInMs), [this] {
+        return !mFilterThreadRunning || isFilterOutputReady();
+    });
+    mFilterOutputWaiting = false;
+
+    return mFilterThreadRunning && getAvailableFilterOutput() > 0;
+}
+
+void Filter::handleFilterOutput() {
+    ::ndk::ScopedAStatus status;
+    if (mIsFrameOutput) {
+        status = handleFrameOutput();
+    } else {
+        // Move all the queued output into the handler buffer in one batch
+        vector<int8_t>& output = mIsRecordFilter ? mRecordFilterOutput : mFilterOutput;
+        size_t offset = output.size();
+        output.resize(offset + mFilterOutputRing.availableToRead());
+        mFilterOutputRing.read(output.data() + offset, output.size() - offset);
+        status = mIsRecordFilter ? startRecordFilterHandler() : startFilterHandler();
+    }
+    if (status.isOk()) {
+        return;
+    }
+
+    // The client is not keeping up with the output. Drop this batch, as hardware would,
+    // and give the client time to consume the queue.
+    ALOGD("[Filter] filter %" PRIu64 " fails to write output. Dropping it", mFilterId);
+    mDroppedOutputBytes.fetch_add(mFilterOutput.size() + mRecordFilterOutput.size(),
+                                  std::memory_order_relaxed);
+    mFilterOutput.clear();
+    mRecordFilterOutput.clear();
+    maySendFilterStatusCallback();
+    if (mIsUsingFMQ) {
+        uint32_t efState = 0;
+        mFilterEventsFlag->wait(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_CONSUMED),
+                                &efState, WAIT_TIMEOUT, true /* retry on spurious wake */);
+    }
+}
+
+// ES input is queued as whole frames, each with its own pts
+::ndk::ScopedAStatus Filter::handleFrameOutput() {
+    vector<int8_t>& output = mIsRecordFilter ? mRecordFilterOutput : mFilterOutput;
+    OutputFrame frame;
+    while (mFilterOutputFrames.read(&frame, 1) == 1) {
+        output.resize(frame.size);
+        mFilterOutputRing.read(output.data(), frame.size);
+        mPts = frame.pts;
+        ::ndk::ScopedAStatus status =
+                mIsRecordFilter ? startRecordFilterHandler() : startFilterHandler();
+        if (!status.isOk()) {
+            return status;
         }
-        break;
     }
-    ALOGD("[Filter] filter thread ended.");
+    return ::ndk::ScopedAStatus::ok();
+}
+
+void Filter::wakeFilterThread() {
+    {
+        // Serializes with the predicate check of the waiting thread
+        std::lock_guard<std::mutex> lock(mFilterOutputWaitLock);
+    }
+    mFilterOutputCv.notify_all();
 }
 
 void Filter::freeSharedAvHandle() {
     if (!mIsMediaFilter) {
         return;
     }
+    std::lock_guard<std::mutex> lock(mSharedAvMemLock);
+    freeSharedAvHandleLocked();
+}
+
+void Filter::freeSharedAvHandleLocked() {
+    if (mSharedAvBuffer != nullptr) {
+        munmap(mSharedAvBuffer, BUFFER_SIZE);
+        mSharedAvBuffer = nullptr;
+    }
     native_handle_close(mSharedAvMemHandle);
     native_handle_delete(mSharedAvMemHandle);
     mSharedAvMemHandle = nullptr;
+    mSharedAvRegions.clear();
+    mSharedAvMemOffset = 0;
 }
 
 binder_status_t Filter::dump(int fd, const char** /* args */, uint32_t /* numArgs */) {
@@ -678,6 +785,10 @@ binder_status_t Filter::dump(int fd, const char** /* args */, uint32_t /* numArg
     dprintf(fd, "      mIsRecordFilter: %d\n", mIsRecordFilter);
     dprintf(fd, "      mIsUsingFMQ: %d\n", mIsUsingFMQ);
     dprintf(fd, "      mFilterThreadRunning: %d\n", (bool)mFilterThreadRunning);
+    dprintf(fd, "      Queued output: %zu, dropped: %" PRIu64 "\n",
+            mFilterOutputRing.availableToRead(), mDroppedOutputBytes.load());
+    dprintf(fd, "      Section CRC errors: %" PRIu64 ", repeats suppressed: %" PRIu64 "\n",
+            mSectionAssembler.getCrcErrorCount(), mSectionAssembler.getSuppressedCount());
     return STATUS_OK;
 }
 
@@ -698,6 +809,16 @@ void Filter::maySendFilterStatusCallback() {
     }
 }
 
+void Filter::maySendOutputOverflowCallback() {
+    if (!mOutputOverflowed.exchange(false, std::memory_order_relaxed)) {
+        return;
+    }
+    // The demux dropped output the filter thread had no room for
+    std::lock_guard<std::mutex> lock(mFilterStatusLock);
+    mFilterStatus = DemuxFilterStatus::OVERFLOW;
+    mCallbackScheduler.onFilterStatus(mFilterStatus);
+}
+
 DemuxFilterStatus Filter::checkFilterStatusChange(uint32_t availableToWrite,
                                                   uint32_t availableToRead, uint32_t highThreshold,
                                                   uint32_t lowThreshold) {
@@ -717,23 +838,71 @@ uint16_t Filter::getTpid() {
     return mTpid;
 }
 
-void Filter::updateFilterOutput(vector<int8_t>& data) {
-    std::lock_guard<std::mutex> lock(mFilterOutputLock);
-    mFilterOutput.insert(mFilterOutput.end(), data.begin(), data.end());
+void Filter::onTsPackets(const int8_t* packets, size_t size) {
+    updateFilterOutput(packets, size);
+}
+
+void Filter::onEsFrame(const int8_t* frame, size_t size, uint64_t pts) {
+    updateFrameOutput(frame, size, pts);
+}
+
+void Filter::updateFilterOutput(const int8_t* data, size_t size) {
+    // Only the started filters drain their output
+    if (!mFilterThreadRunning) {
+        return;
+    }
+    if (!mFilterOutputRing.write(data, size)) {
+        ALOGW("[Filter] filter %" PRIu64 " has no room for %zu bytes of output", mFilterId, size);
+        mDroppedOutputBytes.fetch_add(size, std::memory_order_relaxed);
+        mOutputOverflowed.store(true, std::memory_order_relaxed);
+    }
+}
+
+void Filter::updateRecordOutput(const int8_t* data, size_t size) {
+    updateFilterOutput(data, size);
+}
+
+void Filter::updateFrameOutput(const int8_t* data, size_t size, uint64_t pts) {
+    if (!mFilterThreadRunning) {
+        return;
+    }
+    mIsFrameOutput = true;
+    // Queue the data before its frame so the filter thread never sees a partial frame
+    if (mFilterOutputFrames.availableToWrite() == 0 || !mFilterOutputRing.write(data, size)) {
+        ALOGW("[Filter] filter %" PRIu64 " has no room for a frame of %zu bytes", mFilterId, size);
+        mDroppedOutputBytes.fetch_add(size, std::memory_order_relaxed);
+        mOutputOverflowed.store(true, std::memory_order_relaxed);
+        return;
+    }
+    OutputFrame frame = {
+            .size = static_cast<uint32_t>(size),
+            .pts = pts,
+    };
+    mFilterOutputFrames.write(&frame, 1);
 }
 
-void Filter::updatePts(uint64_t pts) {
-    std::lock_guard<std::mutex> lock(mFilterOutputLock);
-    mPts = pts;
+bool Filter::canQueueOutput(size_t size, size_t frameCount, bool& fits) {
+    // Output of stopped filters is discarded anyway
+    if (!mFilterThreadRunning) {
+        return true;
+    }
+    if (size > mFilterOutputRing.capacity() || frameCount > mFilterOutputFrames.capacity()) {
+        fits = false;
+        return false;
+    }
+    return mFilterOutputRing.availableToWrite() >= size &&
+           mFilterOutputFrames.availableToWrite() >= frameCount;
 }
 
-void Filter::updateRecordOutput(vector<int8_t>& data) {
-    std::lock_guard<std::mutex> lock(mRecordFilterOutputLock);
-    mRecordFilterOutput.insert(mRecordFilterOutput.end(), data.begin(), data.end());
+void Filter::notifyFilterOutput() {
+    // Pairs with the fence in waitForFilterOutput()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mFilterOutputWaiting && isFilterOutputReady()) {
+        wakeFilterThread();
+    }
 }
 
 ::ndk::ScopedAStatus Filter::startFilterHandler() {
-    std::lock_guard<std::mutex> lock(mFilterOutputLock);
     switch (mType.mainType) {
         case DemuxFilterMainType::TS:
             switch (mType.subType.get<DemuxFilterSubType::Tag::tsFilterType>()) {
@@ -851,10 +1020,7 @@ void Filter::updateRecordOutput(vector<int8_t>& data) {
             ALOGD("[Filter] assembled pes data length %d", pesEvent.dataLength);
         }
 
-        {
-            std::lock_guard<std::mutex> lock(mFilterEventsLock);
-            mFilterEvents.push_back(DemuxFilterEvent::make<DemuxFilterEvent::Tag::pes>(pesEvent));
-        }
+        mFilterEvents.push_back(DemuxFilterEvent::make<DemuxFilterEvent::Tag::pes>(pesEvent));
 
         mPesOutput.clear();
     }
@@ -957,19 +1123,22 @@ void Filter::updateRecordOutput(vector<int8_t>& data) {
 }
 
 ::ndk::ScopedAStatus Filter::createMediaFilterEventWithIon(vector<int8_t>& output) {
-    if (mUsingSharedAvMem) {
-        if (mSharedAvMemHandle == nullptr) {
-            return ::ndk::ScopedAStatus::fromServiceSpecificError(
-                    static_cast<int32_t>(Result::UNKNOWN_ERROR));
+    {
+        // Held across the copy, so the client cannot free the shared AV memory meanwhile
+        std::lock_guard<std::mutex> lock(mSharedAvMemLock);
+        if (mUsingSharedAvMem) {
+            if (mSharedAvMemHandle == nullptr) {
+                return ::ndk::ScopedAStatus::fromServiceSpecificError(
+                        static_cast<int32_t>(Result::UNKNOWN_ERROR));
+            }
+            return createShareMemMediaEvents(output);
         }
-        return createShareMemMediaEvents(output);
     }
 
     return createIndependentMediaEvents(output);
 }
 
 ::ndk::ScopedAStatus Filter::startRecordFilterHandler() {
-    std::lock_guard<std::mutex> lock(mRecordFilterOutputLock);
     if (mRecordFilterOutput.empty()) {
         return ::ndk::ScopedAStatus::ok();
     }
@@ -987,11 +1156,7 @@ void Filter::updateRecordOutput(vector<int8_t>& data) {
             .firstMbInSlice = 0,  // random address
     };
 
-    {
-        std::lock_guard<std::mutex> lock(mFilterEventsLock);
-        mFilterEvents.push_back(
-                DemuxFilterEvent::make<DemuxFilterEvent::Tag::tsRecord>(recordEvent));
-    }
+    mFilterEvents.push_back(DemuxFilterEvent::make<DemuxFilterEvent::Tag::tsRecord>(recordEvent));
 
     mRecordFilterOutput.clear();
     return ::ndk::ScopedAStatus::ok();
@@ -1007,73 +1172,54 @@ void Filter::updateRecordOutput(vector<int8_t>& data) {
     return ::ndk::ScopedAStatus::ok();
 }
 
+void Filter::configureSectionAssembler(const DemuxFilterSectionSettings& settings) {
+    SectionAssembler::Settings assemblerSettings = {
+            .checkCrc = settings.isCheckCrc,
+            // Without repeat, the filter stops once it delivered the table or first section
+            .repeat = settings.isRepeat,
+    };
+    if (settings.condition.getTag() == DemuxFilterSectionSettingsCondition::Tag::tableInfo) {
+        const DemuxFilterSectionSettingsConditionTableInfo& tableInfo =
+                settings.condition.get<DemuxFilterSectionSettingsCondition::Tag::tableInfo>();
+        assemblerSettings.tableId = tableInfo.tableId;
+        assemblerSettings.version = static_cast<uint32_t>(tableInfo.version);
+    }
+    mSectionAssembler.configure(assemblerSettings);
+}
+
 // Read PSI (Program Specific Information) Sections from TransportStreams
 // as defined in ISO/IEC 13818-1 Section 2.4.4
 bool Filter::writeSectionsAndCreateEvent(vector<int8_t>& data) {
-    // TODO check how many sections has been read
-    ALOGD("[Filter] section handler");
-
-    // Transport Stream Packets are 188 bytes long, as defined in the
-    // Introduction of ISO/IEC 13818-1
-    for (int i = 0; i < data.size(); i += 188) {
-        if (mSectionSizeLeft == 0) {
-            // Location for sectionSize as defined by Section 2.4.4
-            // Note that the first 4 bytes skipped are the TsHeader
-            mSectionSizeLeft = ((static_cast<uint8_t>(data[i + 5]) & 0x0f) << 8) |
-                               static_cast<uint8_t>(data[i + 6]);
-            mSectionSizeLeft += 3;
-            if (DEBUG_FILTER) {
-                ALOGD("[Filter] section data length %d", mSectionSizeLeft);
-            }
-        }
+    ALOGV("[Filter] section handler");
 
-        // 184 bytes per packet is derived by subtracting the 4 byte length of
-        // the TsHeader from its 188 byte packet size
-        uint32_t endPoint = min(184u, mSectionSizeLeft);
-        // append data and check size
-        vector<int8_t>::const_iterator first = data.begin() + i + 4;
-        vector<int8_t>::const_iterator last = data.begin() + i + 4 + endPoint;
-        mSectionOutput.insert(mSectionOutput.end(), first, last);
-        // size does not match then continue
-        mSectionSizeLeft -= endPoint;
-        if (DEBUG_FILTER) {
-            ALOGD("[Filter] section data left %d", mSectionSizeLeft);
-        }
-        if (mSectionSizeLeft > 0) {
-            continue;
-        }
-
-        if (!writeDataToFilterMQ(mSectionOutput)) {
-            mSectionOutput.clear();
+    return mSectionAssembler.process(data.data(), data.size(), [this](const Section& section) {
+        if (!writeDataToFilterMQ(section.data, section.size)) {
             return false;
         }
 
         DemuxFilterSectionEvent secEvent;
         secEvent = {
-                // temp dump meta data
-                .tableId = 0,
-                .version = 1,
-                .sectionNum = 1,
-                .dataLength = static_cast<int32_t>(mSectionOutput.size()),
+                .tableId = section.tableId,
+                .version = section.version,
+                .sectionNum = section.sectionNumber,
+                .dataLength = static_cast<int64_t>(section.size),
         };
         if (DEBUG_FILTER) {
-            ALOGD("[Filter] assembled section data length %" PRIu64, secEvent.dataLength);
+            ALOGD("[Filter] assembled section data length %zu", section.size);
         }
 
-        {
-            std::lock_guard<std::mutex> lock(mFilterEventsLock);
-            mFilterEvents.push_back(
-                    DemuxFilterEvent::make<DemuxFilterEvent::Tag::section>(secEvent));
-        }
-        mSectionOutput.clear();
-    }
-
-    return true;
+        mFilterEvents.push_back(DemuxFilterEvent::make<DemuxFilterEvent::Tag::section>(secEvent));
+        return true;
+    });
 }
 
 bool Filter::writeDataToFilterMQ(const std::vector<int8_t>& data) {
+    return writeDataToFilterMQ(data.data(), data.size());
+}
+
+bool Filter::writeDataToFilterMQ(const int8_t* data, size_t size) {
     std::lock_guard<std::mutex> lock(mWriteLock);
-    if (mFilterMQ->write(data.data(), data.size())) {
+    if (mFilterMQ->write(data, size)) {
         return true;
     }
     return false;
@@ -1144,6 +1290,7 @@ native_handle_t* Filter::createNativeHandle(int fd) {
                 static_cast<int32_t>(Result::UNKNOWN_ERROR));
     }
     memcpy(avBuffer, output.data(), output.size() * sizeof(uint8_t));
+    munmap(avBuffer, output.size());
 
     native_handle_t* nativeHandle = createNativeHandle(av_fd);
     if (nativeHandle == NULL) {
@@ -1166,10 +1313,7 @@ native_handle_t* Filter::createNativeHandle(int fd) {
         mPts = 0;
     }
 
-    {
-        std::lock_guard<std::mutex> lock(mFilterEventsLock);
-        mFilterEvents.push_back(std::move(event));
-    }
+    mFilterEvents.push_back(std::move(event));
 
     // Clear and log
     native_handle_close(nativeHandle);
@@ -1183,14 +1327,18 @@ native_handle_t* Filter::createNativeHandle(int fd) {
 }
 
 ::ndk::ScopedAStatus Filter::createShareMemMediaEvents(vector<int8_t>& output) {
-    // copy the filtered data to the shared buffer
-    uint8_t* sharedAvBuffer =
-            getIonBuffer(mSharedAvMemHandle->data[0], output.size() + mSharedAvMemOffset);
-    if (sharedAvBuffer == NULL) {
+    // copy the filtered data to the shared buffer, mapped once for the filter's lifetime
+    if (output.size() > BUFFER_SIZE) {
         return ::ndk::ScopedAStatus::fromServiceSpecificError(
-                static_cast<int32_t>(Result::UNKNOWN_ERROR));
+                static_cast<int32_t>(Result::OUT_OF_MEMORY));
+    }
+    if (mSharedAvBuffer == nullptr) {
+        mSharedAvBuffer = getIonBuffer(mSharedAvMemHandle->data[0], BUFFER_SIZE);
+        if (mSharedAvBuffer == NULL) {
+            return ::ndk::ScopedAStatus::fromServiceSpecificError(
+                    static_cast<int32_t>(Result::UNKNOWN_ERROR));
+        }
     }
-    memcpy(sharedAvBuffer + mSharedAvMemOffset, output.data(), output.size() * sizeof(uint8_t));
 
     // Create a memory handle with numFds == 0
     native_handle_t* nativeHandle = createNativeHandle(-1);
@@ -1199,23 +1347,41 @@ native_handle_t* Filter::createNativeHandle(int fd) {
                 static_cast<int32_t>(Result::UNKNOWN_ERROR));
     }
 
+    // The shared buffer is used as a ring, whose regions are only written again once the
+    // client released them. The data is dropped if the client holds on to the room it needs.
+    int64_t offset;
+    if (!allocateSharedAvRegion(output.size(), &offset)) {
+        ALOGW("[Filter] filter %" PRIu64 " has no room in the shared av memory. Dropping %zu"
+              " bytes",
+              mFilterId, output.size());
+        mDroppedOutputBytes.fetch_add(output.size(), std::memory_order_relaxed);
+        output.clear();
+        native_handle_delete(nativeHandle);
+        return ::ndk::ScopedAStatus::fromServiceSpecificError(
+                static_cast<int32_t>(Result::OUT_OF_MEMORY));
+    }
+    const uint64_t dataId = mLastUsedDataId++;
+    mSharedAvRegions[dataId] = {
+            .offset = offset,
+            .size = static_cast<int64_t>(output.size()),
+    };
+    memcpy(mSharedAvBuffer + offset, output.data(), output.size() * sizeof(uint8_t));
+
     // Create mediaEvent and send callback
     auto event = DemuxFilterEvent::make<DemuxFilterEvent::Tag::media>();
     auto& mediaEvent = event.get<DemuxFilterEvent::Tag::media>();
     mediaEvent.avMemory = ::android::dupToAidl(nativeHandle);
-    mediaEvent.offset = mSharedAvMemOffset;
+    mediaEvent.offset = offset;
     mediaEvent.dataLength = static_cast<int64_t>(output.size());
+    mediaEvent.avDataId = static_cast<int64_t>(dataId);
     if (mPts) {
         mediaEvent.pts = mPts;
         mPts = 0;
     }
 
-    {
-        std::lock_guard<std::mutex> lock(mFilterEventsLock);
-        mFilterEvents.push_back(std::move(event));
-    }
+    mFilterEvents.push_back(std::move(event));
 
-    mSharedAvMemOffset += output.size();
+    mSharedAvMemOffset = offset + output.size();
 
     // Clear and log
     native_handle_close(nativeHandle);
@@ -1227,6 +1393,38 @@ native_handle_t* Filter::createNativeHandle(int fd) {
     return ::ndk::ScopedAStatus::ok();
 }
 
+bool Filter::allocateSharedAvRegion(size_t size, int64_t* offset) {
+    if (size > BUFFER_SIZE) {
+        return false;
+    }
+    if (mSharedAvRegions.empty()) {
+        // Nothing is held, so start over from the beginning
+        *offset = 0;
+        return true;
+    }
+    const int64_t oldestOffset = mSharedAvRegions.begin()->second.offset;
+    const int64_t end = mSharedAvMemOffset + static_cast<int64_t>(size);
+    if (mSharedAvMemOffset > oldestOffset) {
+        // The room runs to the end of the buffer, then from its beginning to the oldest region
+        if (end <= BUFFER_SIZE) {
+            *offset = mSharedAvMemOffset;
+            return true;
+        }
+        if (static_cast<int64_t>(size) <= oldestOffset) {
+            *offset = 0;
+            return true;
+        }
+        return false;
+    }
+    // The writes wrapped around, the room runs up to the oldest region, and there is none once
+    // they caught up with it
+    if (mSharedAvMemOffset < oldestOffset && end <= oldestOffset) {
+        *offset = mSharedAvMemOffset;
+        return true;
+    }
+    return false;
+}
+
 bool Filter::sameFile(int fd1, int fd2) {
     struct stat stat1, stat2;
     if (fstat(fd1, &stat1) < 0 || fstat(fd2, &stat2) < 0) {
@@ -28,12 +28,17 @@
 #include <sys/stat.h>
 #include <atomic>
 #include <condition_variable>
+#include <map>
+#include <mutex>
 #include <set>
 #include <thread>
 
 #include "Demux.h"
 #include "Dvr.h"
 #include "Frontend.h"
+#include "SectionAssembler.h"
+#include "SpscRing.h"
+#include "TsDemuxer.h"
 
 using namespace std;
 
@@ -52,6 +57,12 @@ using ::android::hardware::EventFlag;
 using FilterMQ = AidlMessageQueue<int8_t, SynchronizedReadWrite>;
 
 const uint32_t BUFFER_SIZE = 0x800000;  // 8 MB
+// Demux output a filter holds before its thread drains it is sized from the filter buffer size,
+// but holds at least a few batches of playback input
+const uint32_t FILTER_OUTPUT_RING_MIN_SIZE = 0x10000;  // 64 KB
+const uint32_t FILTER_OUTPUT_FRAME_COUNT = 256;
+// How long a filter thread without a time delay hint sleeps between checks for output
+const int FILTER_OUTPUT_WAIT_MS = 1000;
 
 class Demux;
 class Dvr;
@@ -99,7 +110,7 @@ class FilterCallbackScheduler final {
     int mDataSizeDelayInBytes;
 };
 
-class Filter : public BnFilter {
+class Filter : public BnFilter, public TsPacketSink {
     friend class FilterCallbackScheduler;
 
   public:
@@ -129,6 +140,10 @@ class Filter : public BnFilter {
 
     binder_status_t dump(int fd, const char** args, uint32_t numArgs) override;
 
+    // TsPacketSink
+    void onTsPackets(const int8_t* packets, size_t size) override;
+    void onEsFrame(const int8_t* frame, size_t size, uint64_t pts) override;
+
     /**
      * To create a FilterMQ and its Event Flag.
      *
@@ -136,14 +151,30 @@ class Filter : public BnFilter {
      */
     bool createFilterMQ();
     uint16_t getTpid();
-    void updateFilterOutput(vector<int8_t>& data);
-    void updateRecordOutput(vector<int8_t>& data);
-    void updatePts(uint64_t pts);
-    ::ndk::ScopedAStatus startFilterHandler();
-    ::ndk::ScopedAStatus startRecordFilterHandler();
+    /**
+     * Queue demux output to the filter thread. They never block: TS output that does not
+     * fit is dropped, counted and reported as an overflow. ES playback checks that its
+     * frames fit with canQueueOutput() first, and holds back its input otherwise.
+     */
+    void updateFilterOutput(const int8_t* data, size_t size);
+    void updateRecordOutput(const int8_t* data, size_t size);
+    // A whole ES frame, handled on its own with its pts
+    void updateFrameOutput(const int8_t* data, size_t size, uint64_t pts);
+    /**
+     * Whether |size| bytes in |frameCount| frames can be queued without being dropped.
+     * |fits| is cleared if they never can be, as they exceed the capacity of the ring.
+     */
+    bool canQueueOutput(size_t size, size_t frameCount, bool& fits);
+    /**
+     * Wakes the filter thread if the queued output is ready to be handled. Called by
+     * the demux once per input buffer rather than per packet.
+     */
+    void notifyFilterOutput();
     void attachFilterToRecord(const std::shared_ptr<Dvr> dvr);
     void detachFilterFromRecord();
     void freeSharedAvHandle();
+    // Output dropped because a filter ring or the client had no room for it
+    uint64_t getDroppedOutputBytes() { return mDroppedOutputBytes; }
     bool isMediaFilter() { return mIsMediaFilter; };
     bool isPcrFilter() { return mIsPcrFilter; };
     bool isRecordFilter() { return mIsRecordFilter; };
@@ -169,6 +200,35 @@ class Filter : public BnFilter {
     uint16_t mTpid;
     std::shared_ptr<IFilter> mDataSource;
     bool mIsDataSourceDemux = true;
+
+    /**
+     * A frame of ES input queued in mFilterOutputRing.
+     */
+    struct OutputFrame {
+        uint32_t size;
+        uint64_t pts;
+    };
+    /**
+     * Demux output queued to the filter thread. The thread holding the playback input
+     * lock of the DVR is the only writer and the filter thread the only reader.
+     */
+    SpscRing<int8_t> mFilterOutputRing;
+    SpscRing<OutputFrame> mFilterOutputFrames{FILTER_OUTPUT_FRAME_COUNT};
+    std::atomic<bool> mIsFrameOutput = false;
+    std::atomic<uint64_t> mDroppedOutputBytes = 0;
+    // Set when output is dropped, until the filter thread reports the overflow
+    std::atomic<bool> mOutputOverflowed = false;
+
+    // Wakes the filter thread when it waits for output
+    std::mutex mFilterOutputWaitLock;
+    std::condition_variable mFilterOutputCv;
+    std::atomic<bool> mFilterOutputWaiting = false;
+
+    // Delay hints applied when draining mFilterOutputRing
+    std::atomic<int> mTimeDelayInMs = 0;
+    std::atomic<int> mDataSizeDelayInBytes = 0;
+
+    // Output drained from the ring, only accessed on the filter thread
     vector<int8_t> mFilterOutput;
     vector<int8_t> mRecordFilterOutput;
     int64_t mPts = 0;
@@ -187,12 +247,6 @@ class Filter : public BnFilter {
      */
     std::atomic<bool> mFilterThreadRunning;
 
-    /**
-     * How many times a filter should write
-     * TODO make this dynamic/random/can take as a parameter
-     */
-    const uint16_t SECTION_WRITE_COUNT = 10;
-
     bool DEBUG_FILTER = false;
 
     /**
@@ -210,16 +264,26 @@ class Filter : public BnFilter {
 
     void deleteEventFlag();
     bool writeDataToFilterMQ(const std::vector<int8_t>& data);
+    bool writeDataToFilterMQ(const int8_t* data, size_t size);
     bool readDataFromMQ();
+    void configureSectionAssembler(const DemuxFilterSectionSettings& settings);
     bool writeSectionsAndCreateEvent(vector<int8_t>& data);
     void maySendFilterStatusCallback();
+    void maySendOutputOverflowCallback();
     DemuxFilterStatus checkFilterStatusChange(uint32_t availableToWrite, uint32_t availableToRead,
                                               uint32_t highThreshold, uint32_t lowThreshold);
     /**
-     * A dispatcher to read and dispatch input data to all the started filters.
-     * Each filter handler handles the data filtering/output writing/filterEvent updating.
+     * Filter thread helpers. The thread waits until the queued output satisfies the
+     * delay hints, drains it in one batch and runs the filter handler over it.
      */
-    bool startFilterDispatcher();
+    size_t getAvailableFilterOutput();
+    bool isFilterOutputReady();
+    bool waitForFilterOutput();
+    void handleFilterOutput();
+    ::ndk::ScopedAStatus handleFrameOutput();
+    void wakeFilterThread();
+    ::ndk::ScopedAStatus startFilterHandler();
+    ::ndk::ScopedAStatus startRecordFilterHandler();
     static void* __threadLoopFilter(void* user);
     void filterThreadLoop();
 
@@ -228,8 +292,16 @@ class Filter : public BnFilter {
     native_handle_t* createNativeHandle(int fd);
     ::ndk::ScopedAStatus createMediaFilterEventWithIon(vector<int8_t>& output);
     ::ndk::ScopedAStatus createIndependentMediaEvents(vector<int8_t>& output);
+    // Requires mSharedAvMemLock, held across the copy into the shared AV memory
     ::ndk::ScopedAStatus createShareMemMediaEvents(vector<int8_t>& output);
+    /**
+     * Finds room for |size| bytes in the shared AV memory after the last region written,
+     * without overwriting the regions the client still holds. Requires mSharedAvMemLock.
+     */
+    bool allocateSharedAvRegion(size_t size, int64_t* offset);
     bool sameFile(int fd1, int fd2);
+    // Requires mSharedAvMemLock
+    void freeSharedAvHandleLocked();
 
     void createMediaEvent(vector<DemuxFilterEvent>&, bool isAudioPresentation);
     void createTsRecordEvent(vector<DemuxFilterEvent>&);
@@ -246,21 +318,13 @@ class Filter : public BnFilter {
      * Lock to protect writes to the FMQs
      */
     std::mutex mWriteLock;
-    /**
-     * Lock to protect writes to the filter event
-     */
-    // TODO make each filter separate event lock
-    std::mutex mFilterEventsLock;
     /**
      * Lock to protect writes to the input status
      */
     std::mutex mFilterStatusLock;
-    std::mutex mFilterOutputLock;
-    std::mutex mRecordFilterOutputLock;
 
-    // handle single Section filter
-    uint32_t mSectionSizeLeft = 0;
-    vector<int8_t> mSectionOutput;
+    // Reassembles the sections of a TS section filter
+    SectionAssembler mSectionAssembler;
 
     // temp handle single PES filter
     // TODO handle mulptiple Pes filters
@@ -274,8 +338,24 @@ class Filter : public BnFilter {
 
     // Shared A/V memory handle
     native_handle_t* mSharedAvMemHandle = nullptr;
+    // Mapping of the shared AV memory
+    uint8_t* mSharedAvBuffer = nullptr;
     bool mUsingSharedAvMem = false;
     int64_t mSharedAvMemOffset = 0;
+    /**
+     * A region of the shared AV memory reported in a media event.
+     */
+    struct SharedAvRegion {
+        int64_t offset;
+        int64_t size;
+    };
+    // The regions the client has not released yet, by data id, so oldest first
+    std::map<uint64_t, SharedAvRegion> mSharedAvRegions;
+    /**
+     * Lock to protect the shared AV memory handle, its mapping, write offset and regions,
+     * which the binder threads hand out and free while the filter thread writes into them
+     */
+    std::mutex mSharedAvMemLock;
 
     uint32_t mAudioStreamType;
     uint32_t mVideoStreamType;
@@ -18,6 +18,7 @@
 #define LOG_TAG "android.hardware.tv.tuner-service.example-Frontend"
 
 #include <aidl/android/hardware/tv/tuner/Result.h>
+#include <android-base/properties.h>
 #include <utils/Log.h>
 
 #include "Frontend.h"
@@ -219,8 +220,10 @@ Frontend::~Frontend() {
 }
 
 dtv_plugin* Frontend::createIptvPluginInterface() {
-    const char* path = "/vendor/lib/iptv_udp_plugin.so";
-    DtvPlugin* plugin = new DtvPlugin(path);
+    // The plugin keeps a pointer to its path
+    static const std::string path =
+            ::android::base::GetProperty(IPTV_PLUGIN_PATH_PROPERTY, IPTV_PLUGIN_PATH);
+    DtvPlugin* plugin = new DtvPlugin(path.c_str());
     bool plugin_loaded = plugin->load();
     if (!plugin_loaded) {
         ALOGE("Failed to load plugin");
@@ -35,6 +35,9 @@ class Tuner;
 
 const int TUNE_BUFFER_SIZE = 1;        // byte
 const int TUNE_BUFFER_TIMEOUT = 2000;  // ms
+// The IPTV plugin, overridden by the property, e.g. with the iptv_test_plugin stand-in
+const char IPTV_PLUGIN_PATH[] = "/vendor/lib/iptv_udp_plugin.so";
+const char IPTV_PLUGIN_PATH_PROPERTY[] = "vendor.tuner.iptv.plugin_path";
 
 class Frontend : public BnFrontend {
   public:
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <memory>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+/**
+ * The bytes read ahead from an IPTV plugin that the DVR FMQ could not take yet.
+ *
+ * Both ends are used by the IPTV input thread alone. Free space and data are exposed
+ * as contiguous spans so the plugin reads straight into the ring and the DVR writes
+ * straight out of it.
+ */
+class IptvReadahead {
+  public:
+    explicit IptvReadahead(size_t capacity)
+        : mCapacity(std::max<size_t>(capacity, 1)), mBuffer(new int8_t[mCapacity]) {}
+
+    size_t capacity() const { return mCapacity; }
+    size_t size() const { return mSize; }
+    bool empty() const { return mSize == 0; }
+    bool full() const { return mSize == mCapacity; }
+
+    /**
+     * The free space up to the end of the ring. Returns its size.
+     */
+    size_t getWriteSpan(int8_t** data) {
+        size_t tail = (mHead + mSize) % mCapacity;
+        *data = mBuffer.get() + tail;
+        return std::min(mCapacity - mSize, mCapacity - tail);
+    }
+    void commitWrite(size_t size) { mSize += size; }
+
+    /**
+     * The oldest data up to the end of the ring. Returns its size.
+     */
+    size_t getReadSpan(const int8_t** data) const {
+        *data = mBuffer.get() + mHead;
+        return std::min(mSize, mCapacity - mHead);
+    }
+    void commitRead(size_t size) {
+        mHead = (mHead + size) % mCapacity;
+        mSize -= size;
+    }
+
+    void clear() {
+        mHead = 0;
+        mSize = 0;
+    }
+
+  private:
+    const size_t mCapacity;
+    std::unique_ptr<int8_t[]> mBuffer;
+    size_t mHead = 0;
+    size_t mSize = 0;
+};
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,324 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "android.hardware.tv.tuner-service.example-SectionAssembler"
+
+#include <utils/Log.h>
+#include <algorithm>
+#include <array>
+
+#include "SectionAssembler.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+namespace {
+
+const size_t TS_PACKET_SIZE = 188;
+const size_t TS_HEADER_SIZE = 4;
+// table_id, section_syntax_indicator and section_length
+const size_t SECTION_HEADER_SIZE = 3;
+// Header, table_id_extension, version, section numbers and CRC_32
+const size_t LONG_SECTION_MIN_SIZE = 12;
+const uint8_t STUFFING_TABLE_ID = 0xFF;
+
+// Slicing-by-8 tables: tables[0] is the byte-wise table and tables[k] advances
+// a byte through k more zero bytes, so eight bytes are folded per step.
+struct CrcTables {
+    CrcTables() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i << 24;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+            }
+            tables[0][i] = crc;
+        }
+        for (size_t k = 1; k < tables.size(); k++) {
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t prev = tables[k - 1][i];
+                tables[k][i] = (prev << 8) ^ tables[0][prev >> 24];
+            }
+        }
+    }
+
+    std::array<std::array<uint32_t, 256>, 8> tables;
+};
+
+const CrcTables& crcTables() {
+    static const CrcTables tables;
+    return tables;
+}
+
+inline uint32_t readBigEndian32(const uint8_t* data) {
+    return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) |
+           (static_cast<uint32_t>(data[2]) << 8) | data[3];
+}
+
+}  // namespace
+
+uint32_t SectionAssembler::crc32(const uint8_t* data, size_t size, uint32_t crc) {
+    const auto& t = crcTables().tables;
+    while (size >= 8) {
+        uint32_t high = crc ^ readBigEndian32(data);
+        uint32_t low = readBigEndian32(data + 4);
+        crc = t[7][high >> 24] ^ t[6][(high >> 16) & 0xFF] ^ t[5][(high >> 8) & 0xFF] ^
+              t[4][high & 0xFF] ^ t[3][low >> 24] ^ t[2][(low >> 16) & 0xFF] ^
+              t[1][(low >> 8) & 0xFF] ^ t[0][low & 0xFF];
+        data += 8;
+        size -= 8;
+    }
+    while (size-- > 0) {
+        crc = (crc << 8) ^ t[0][(crc >> 24) ^ *data++];
+    }
+    return crc;
+}
+
+void SectionAssembler::configure(const Settings& settings) {
+    mSettings = settings;
+    reset();
+}
+
+void SectionAssembler::reset() {
+    mPartialSection.clear();
+    mPartialSectionSize = 0;
+    mLastContinuityCounter = -1;
+    mVersions.clear();
+    mHasTable = false;
+    mDeliveredSections.reset();
+    mDone = false;
+}
+
+bool SectionAssembler::process(const int8_t* packets, size_t size,
+                               const SectionCallback& onSection) {
+    if (mDone) {
+        // A filter without repeat stops filtering once its table is delivered
+        return true;
+    }
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(packets);
+    for (size_t i = 0; i + TS_PACKET_SIZE <= size && !mDone; i += TS_PACKET_SIZE) {
+        const uint8_t* packet = data + i;
+        bool isUnitStart = packet[1] & 0x40;
+        uint8_t adaptationFieldControl = (packet[3] >> 4) & 0x03;
+        uint8_t continuityCounter = packet[3] & 0x0F;
+        if (!(adaptationFieldControl & 0x01)) {
+            // No payload
+            continue;
+        }
+
+        if (mLastContinuityCounter >= 0) {
+            if (continuityCounter == mLastContinuityCounter) {
+                // Duplicate packet
+                continue;
+            }
+            if (continuityCounter != ((mLastContinuityCounter + 1) & 0x0F)) {
+                ALOGV("[SectionAssembler] continuity error, dropping partial section");
+                mPartialSection.clear();
+            }
+        }
+        mLastContinuityCounter = continuityCounter;
+
+        size_t offset = TS_HEADER_SIZE;
+        if (adaptationFieldControl == 0x03) {
+            offset += 1 + packet[TS_HEADER_SIZE];
+        }
+        if (offset >= TS_PACKET_SIZE) {
+            continue;
+        }
+        if (!processPayload(packet + offset, TS_PACKET_SIZE - offset, isUnitStart, onSection)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SectionAssembler::processPayload(const uint8_t* payload, size_t size, bool isUnitStart,
+                                      const SectionCallback& onSection) {
+    if (!isUnitStart) {
+        // Continuation of a section; no new section starts in this packet
+        if (mPartialSection.empty()) {
+            return true;
+        }
+        return appendPartialSection(payload, size, onSection);
+    }
+
+    // The pointer_field gives the start of the first new section
+    size_t pointer = payload[0];
+    payload++;
+    size--;
+    if (pointer > size) {
+        mPartialSection.clear();
+        return true;
+    }
+    if (!mPartialSection.empty()) {
+        if (!appendPartialSection(payload, pointer, onSection)) {
+            return false;
+        }
+        // A section not completed by the pointed bytes is corrupted
+        mPartialSection.clear();
+    }
+    payload += pointer;
+    size -= pointer;
+
+    // Deliver the sections contained in the packet in place
+    while (size > 0 && payload[0] != STUFFING_TABLE_ID && !mDone) {
+        if (size < SECTION_HEADER_SIZE) {
+            return appendPartialSection(payload, size, onSection);
+        }
+        size_t sectionSize = SECTION_HEADER_SIZE + (((payload[1] & 0x0F) << 8) | payload[2]);
+        if (sectionSize > size) {
+            return appendPartialSection(payload, size, onSection);
+        }
+        if (!deliverSection(payload, sectionSize, onSection)) {
+            return false;
+        }
+        payload += sectionSize;
+        size -= sectionSize;
+    }
+    return true;
+}
+
+bool SectionAssembler::appendPartialSection(const uint8_t* data, size_t size,
+                                            const SectionCallback& onSection) {
+    if (mPartialSection.empty()) {
+        mPartialSectionSize = 0;
+    }
+    if (mPartialSectionSize == 0) {
+        // Complete the header to learn the section size
+        size_t headerBytes = std::min(size, SECTION_HEADER_SIZE - mPartialSection.size());
+        mPartialSection.insert(mPartialSection.end(), data, data + headerBytes);
+        data += headerBytes;
+        size -= headerBytes;
+        if (mPartialSection.size() < SECTION_HEADER_SIZE) {
+            return true;
+        }
+        mPartialSectionSize = SECTION_HEADER_SIZE +
+                              (((mPartialSection[1] & 0x0F) << 8) | mPartialSection[2]);
+    }
+
+    size_t needed = mPartialSectionSize - mPartialSection.size();
+    mPartialSection.insert(mPartialSection.end(), data, data + std::min(size, needed));
+    if (mPartialSection.size() < mPartialSectionSize) {
+        return true;
+    }
+
+    bool result = deliverSection(mPartialSection.data(), mPartialSection.size(), onSection);
+    mPartialSection.clear();
+    return result;
+}
+
+bool SectionAssembler::deliverSection(const uint8_t* data, size_t size,
+                                      const SectionCallback& onSection) {
+    Section section = {
+            .data = reinterpret_cast<const int8_t*>(data),
+            .size = size,
+            .tableId = data[0],
+            .tableIdExtension = 0,
+            .version = 0,
+            .sectionNumber = 0,
+    };
+    if (mSettings.tableId >= 0 && section.tableId != mSettings.tableId) {
+        return true;
+    }
+
+    bool isLongForm = data[1] & 0x80;
+    if (!isLongForm) {
+        // Short-form sections carry neither version nor CRC_32
+        if (!onSection(section)) {
+            return false;
+        }
+        mDone = !mSettings.repeat;
+        return true;
+    }
+    if (size < LONG_SECTION_MIN_SIZE) {
+        return true;
+    }
+    section.tableIdExtension = (data[3] << 8) | data[4];
+    section.version = (data[5] >> 1) & 0x1F;
+    section.sectionNumber = data[6];
+    if (mSettings.version != ANY_VERSION && section.version != mSettings.version) {
+        return true;
+    }
+
+    // Look up repetitions first so their CRC_32 is never computed
+    const uint8_t lastSectionNumber = data[7];
+    const bool isTable = !mSettings.repeat && mSettings.tableId >= 0;
+    if (isTable && !isPendingInTable(section, lastSectionNumber)) {
+        mSuppressedCount++;
+        return true;
+    }
+    uint32_t key = (static_cast<uint32_t>(section.tableId) << 24) |
+                   (section.tableIdExtension << 8) | section.sectionNumber;
+    auto delivered = mVersions.end();
+    if (mSettings.skipUnchangedVersions) {
+        delivered = mVersions.find(key);
+        if (delivered != mVersions.end() && delivered->second == section.version) {
+            mSuppressedCount++;
+            return true;
+        }
+    }
+
+    if (mSettings.checkCrc && crc32(data, size) != 0) {
+        mCrcErrorCount++;
+        ALOGV("[SectionAssembler] CRC error in table %d section %d", section.tableId,
+              section.sectionNumber);
+        return true;
+    }
+
+    if (!onSection(section)) {
+        return false;
+    }
+    // Only remember the versions and sections that made it to the output
+    if (mSettings.skipUnchangedVersions) {
+        if (delivered != mVersions.end()) {
+            delivered->second = section.version;
+        } else {
+            mVersions.emplace(key, section.version);
+        }
+    }
+    if (isTable) {
+        if (!mHasTable) {
+            mHasTable = true;
+            mTableIdExtension = section.tableIdExtension;
+            mTableVersion = section.version;
+            mLastSectionNumber = lastSectionNumber;
+        }
+        mDeliveredSections.set(section.sectionNumber);
+        mDone = mDeliveredSections.count() == mLastSectionNumber + 1u;
+    } else {
+        mDone = !mSettings.repeat;
+    }
+    return true;
+}
+
+bool SectionAssembler::isPendingInTable(const Section& section, uint8_t lastSectionNumber) {
+    if (!mHasTable) {
+        // The first matching section picks the table
+        return section.sectionNumber <= lastSectionNumber;
+    }
+    return section.tableIdExtension == mTableIdExtension && section.version == mTableVersion &&
+           section.sectionNumber <= mLastSectionNumber &&
+           !mDeliveredSections.test(section.sectionNumber);
+}
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
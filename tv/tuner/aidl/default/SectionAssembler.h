@@ -0,0 +1,139 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <bitset>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+/**
+ * A PSI/SI section as defined in ISO/IEC 13818-1 Section 2.4.4, from table_id through
+ * CRC_32. The data is only valid for the duration of the callback it is passed to.
+ */
+struct Section {
+    const int8_t* data;
+    size_t size;
+    uint8_t tableId;
+    // The fields below are only set for sections with section_syntax_indicator set
+    uint16_t tableIdExtension;
+    uint8_t version;
+    uint8_t sectionNumber;
+};
+
+/**
+ * Reassembles the sections carried in the TS packets of one PID.
+ *
+ * Sections within a packet are delivered in place; only the ones spanning packets are
+ * gathered into a reusable buffer. Partial sections are dropped on continuity errors.
+ */
+class SectionAssembler {
+  public:
+    static const uint32_t ANY_VERSION = 0xFFFFFFFF;
+
+    struct Settings {
+        // Drop the long-form sections whose CRC_32 does not match
+        bool checkCrc = false;
+        // If false, stop once a table is delivered, as DemuxFilterSectionSettings.isRepeat
+        // defines: with a tableId, after every section of the first matching long-form table,
+        // otherwise after the first section
+        bool repeat = true;
+        // Only deliver a long-form section again once its version changes
+        bool skipUnchangedVersions = false;
+        // Only deliver the sections of this table_id, if not negative
+        int32_t tableId = -1;
+        // Only deliver the long-form sections of this version, unless ANY_VERSION
+        uint32_t version = ANY_VERSION;
+    };
+
+    /**
+     * Returns false to stop processing, e.g. when the output is full.
+     */
+    using SectionCallback = std::function<bool(const Section&)>;
+
+    /**
+     * Applies new settings and forgets the partial section and the delivered versions.
+     */
+    void configure(const Settings& settings);
+    /**
+     * Forgets the partial section and the delivered versions and tables, so that a filter
+     * without repeat filters again.
+     */
+    void reset();
+
+    // Whether a filter without repeat has delivered its table and ignores further data
+    bool isDone() const { return mDone; }
+
+    /**
+     * Processes whole 188 byte TS packets. Returns false if |onSection| stopped it.
+     */
+    bool process(const int8_t* packets, size_t size, const SectionCallback& onSection);
+
+    uint64_t getCrcErrorCount() const { return mCrcErrorCount; }
+    uint64_t getSuppressedCount() const { return mSuppressedCount; }
+
+    /**
+     * The MPEG-2 CRC_32: polynomial 0x04C11DB7, not reflected, no final XOR. A section
+     * including its CRC_32 field checks to 0.
+     */
+    static uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0xFFFFFFFF);
+
+  private:
+    bool processPayload(const uint8_t* payload, size_t size, bool isUnitStart,
+                        const SectionCallback& onSection);
+    // Appends to the partial section and delivers it once complete
+    bool appendPartialSection(const uint8_t* data, size_t size, const SectionCallback& onSection);
+    bool deliverSection(const uint8_t* data, size_t size, const SectionCallback& onSection);
+    // Without repeat, whether the long-form |section| is part of the table being delivered and
+    // was not delivered yet
+    bool isPendingInTable(const Section& section, uint8_t lastSectionNumber);
+
+    Settings mSettings;
+
+    // Section spanning packets and its total size once its header is in
+    std::vector<uint8_t> mPartialSection;
+    size_t mPartialSectionSize = 0;
+    int mLastContinuityCounter = -1;
+
+    // Delivered version per table_id, table_id_extension and section_number
+    std::unordered_map<uint32_t, uint8_t> mVersions;
+
+    // Without repeat, the table being delivered and its delivered section numbers
+    bool mHasTable = false;
+    uint16_t mTableIdExtension = 0;
+    uint8_t mTableVersion = 0;
+    uint8_t mLastSectionNumber = 0;
+    std::bitset<256> mDeliveredSections;
+    bool mDone = false;
+
+    uint64_t mCrcErrorCount = 0;
+    uint64_t mSuppressedCount = 0;
+};
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <type_traits>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+/**
+ * A bounded ring of trivially copyable elements for exactly one producer thread and
+ * one consumer thread. Neither side ever blocks or takes a lock.
+ *
+ * write() and availableToWrite() are producer calls; read(), availableToRead() and
+ * clear() are consumer calls.
+ */
+template <typename T>
+class SpscRing {
+    static_assert(std::is_trivially_copyable<T>::value, "SpscRing elements are memcpy'd");
+
+  public:
+    /**
+     * The capacity is rounded up to a power of two. The storage is not initialized,
+     * so the pages of a large ring are only committed once used.
+     */
+    explicit SpscRing(size_t capacity)
+        : mCapacity(roundUpToPowerOfTwo(capacity)),
+          mMask(mCapacity - 1),
+          mBuffer(new T[mCapacity]) {}
+
+    size_t capacity() const { return mCapacity; }
+
+    size_t availableToRead() const {
+        return mTail.load(std::memory_order_acquire) - mHead.load(std::memory_order_relaxed);
+    }
+
+    size_t availableToWrite() const {
+        return mCapacity -
+               (mTail.load(std::memory_order_relaxed) - mHead.load(std::memory_order_acquire));
+    }
+
+    /**
+     * Appends all of |data|, or nothing if there is not enough room for it.
+     */
+    bool write(const T* data, size_t count) {
+        size_t tail = mTail.load(std::memory_order_relaxed);
+        if (count > mCapacity - (tail - mHead.load(std::memory_order_acquire))) {
+            return false;
+        }
+        copyIn(tail & mMask, data, count);
+        mTail.store(tail + count, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Moves up to |count| elements into |data|. Returns the number of elements read.
+     */
+    size_t read(T* data, size_t count) {
+        size_t head = mHead.load(std::memory_order_relaxed);
+        count = std::min(count, mTail.load(std::memory_order_acquire) - head);
+        copyOut(head & mMask, data, count);
+        mHead.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    /**
+     * Drops everything written so far.
+     */
+    void clear() { mHead.store(mTail.load(std::memory_order_acquire), std::memory_order_release); }
+
+  private:
+    static size_t roundUpToPowerOfTwo(size_t value) {
+        size_t result = 1;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    void copyIn(size_t index, const T* data, size_t count) {
+        size_t first = std::min(count, mCapacity - index);
+        memcpy(mBuffer.get() + index, data, first * sizeof(T));
+        memcpy(mBuffer.get(), data + first, (count - first) * sizeof(T));
+    }
+
+    void copyOut(size_t index, T* data, size_t count) const {
+        size_t first = std::min(count, mCapacity - index);
+        memcpy(data, mBuffer.get() + index, first * sizeof(T));
+        memcpy(data + first, mBuffer.get(), (count - first) * sizeof(T));
+    }
+
+    const size_t mCapacity;
+    const size_t mMask;
+    std::unique_ptr<T[]> mBuffer;
+
+    // Positions only ever increase; they are reduced modulo the capacity on access.
+    // Kept on separate cache lines so the two threads do not share one.
+    alignas(64) std::atomic<size_t> mHead = 0;
+    alignas(64) std::atomic<size_t> mTail = 0;
+};
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
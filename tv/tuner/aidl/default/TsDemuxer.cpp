@@ -0,0 +1,209 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "android.hardware.tv.tuner-service.example-TsDemuxer"
+
+#include <inttypes.h>
+#include <utils/Log.h>
+#include <algorithm>
+
+#include "TsDemuxer.h"
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+TsDemuxer::TsDemuxer(size_t packetSize) : mSinkLists(1), mPacketSize(packetSize) {
+    mPidToSinkList.fill(0);
+    mPartialPacket.reserve(mPacketSize);
+}
+
+void TsDemuxer::addSink(uint16_t pid, TsPacketSink* sink) {
+    if (pid >= TS_PID_COUNT || sink == nullptr) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    uint16_t index = mPidToSinkList[pid];
+    if (index == 0) {
+        // Reuse a list released by removeSink() before growing
+        auto it = std::find_if(mSinkLists.begin() + 1, mSinkLists.end(),
+                               [](const auto& sinks) { return sinks.empty(); });
+        index = it - mSinkLists.begin();
+        if (it == mSinkLists.end()) {
+            mSinkLists.emplace_back();
+        }
+        mPidToSinkList[pid] = index;
+    }
+
+    std::vector<TsPacketSink*>& sinks = mSinkLists[index];
+    if (std::find(sinks.begin(), sinks.end(), sink) == sinks.end()) {
+        sinks.push_back(sink);
+    }
+}
+
+void TsDemuxer::removeSink(TsPacketSink* sink) {
+    std::lock_guard<std::mutex> lock(mLock);
+    for (uint16_t pid = 0; pid < TS_PID_COUNT; pid++) {
+        uint16_t index = mPidToSinkList[pid];
+        if (index == 0) {
+            continue;
+        }
+        std::vector<TsPacketSink*>& sinks = mSinkLists[index];
+        sinks.erase(std::remove(sinks.begin(), sinks.end(), sink), sinks.end());
+        if (sinks.empty()) {
+            mPidToSinkList[pid] = 0;
+        }
+    }
+}
+
+void TsDemuxer::clearSinks() {
+    std::lock_guard<std::mutex> lock(mLock);
+    mPidToSinkList.fill(0);
+    mSinkLists.resize(1);
+}
+
+void TsDemuxer::setPacketSize(size_t packetSize) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mPacketSize = packetSize;
+    mPartialPacket.clear();
+    mPartialPacket.reserve(mPacketSize);
+    mSyncLost = false;
+}
+
+void TsDemuxer::reset() {
+    std::lock_guard<std::mutex> lock(mLock);
+    mPartialPacket.clear();
+    mSyncLost = false;
+}
+
+void TsDemuxer::process(const int8_t* data, size_t size) {
+    std::lock_guard<std::mutex> lock(mLock);
+    size_t offset = 0;
+    uint64_t packetCount = 0;
+    uint64_t syncLossCount = 0;
+
+    // Complete the packet split across the end of the previous input
+    if (!mPartialPacket.empty()) {
+        size_t needed = mPacketSize - mPartialPacket.size();
+        if (size < needed) {
+            mPartialPacket.insert(mPartialPacket.end(), data, data + size);
+            return;
+        }
+        mPartialPacket.insert(mPartialPacket.end(), data, data + needed);
+        dispatchLocked(getPid(mPartialPacket.data()), mPartialPacket.data(), mPacketSize);
+        mPartialPacket.clear();
+        offset = needed;
+        packetCount++;
+    }
+
+    // Consecutive packets of the same PID are dispatched as one span
+    uint16_t runPid = 0;
+    size_t runStart = 0;
+    size_t runSize = 0;
+    while (offset < size) {
+        if (static_cast<uint8_t>(data[offset]) != TS_SYNC_BYTE) {
+            if (runSize > 0) {
+                dispatchLocked(runPid, data + runStart, runSize);
+                runSize = 0;
+            }
+            if (!mSyncLost) {
+                mSyncLost = true;
+                syncLossCount++;
+            }
+            offset = findSyncLocked(data, offset, size);
+            continue;
+        }
+        if (size - offset < mPacketSize) {
+            break;
+        }
+
+        mSyncLost = false;
+        uint16_t pid = getPid(data + offset);
+        if (runSize > 0 && pid == runPid) {
+            runSize += mPacketSize;
+        } else {
+            if (runSize > 0) {
+                dispatchLocked(runPid, data + runStart, runSize);
+            }
+            runPid = pid;
+            runStart = offset;
+            runSize = mPacketSize;
+        }
+        offset += mPacketSize;
+        packetCount++;
+    }
+    if (runSize > 0) {
+        dispatchLocked(runPid, data + runStart, runSize);
+    }
+
+    if (offset < size) {
+        mPartialPacket.assign(data + offset, data + size);
+    }
+
+    mPacketCount.fetch_add(packetCount, std::memory_order_relaxed);
+    if (syncLossCount > 0) {
+        mSyncLossCount.fetch_add(syncLossCount, std::memory_order_relaxed);
+        ALOGV("[TsDemuxer] lost sync %" PRIu64 " times", syncLossCount);
+    }
+}
+
+void TsDemuxer::processFrame(uint16_t pid, const int8_t* frame, size_t size, uint64_t pts) {
+    if (pid >= TS_PID_COUNT) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mLock);
+    uint16_t index = mPidToSinkList[pid];
+    if (index == 0) {
+        return;
+    }
+    for (TsPacketSink* sink : mSinkLists[index]) {
+        sink->onEsFrame(frame, size, pts);
+    }
+}
+
+void TsDemuxer::dispatchLocked(uint16_t pid, const int8_t* packets, size_t size) {
+    uint16_t index = mPidToSinkList[pid];
+    if (index == 0) {
+        return;
+    }
+    for (TsPacketSink* sink : mSinkLists[index]) {
+        sink->onTsPackets(packets, size);
+    }
+}
+
+size_t TsDemuxer::findSyncLocked(const int8_t* data, size_t offset, size_t size) {
+    for (size_t i = offset + 1; i < size; i++) {
+        if (static_cast<uint8_t>(data[i]) != TS_SYNC_BYTE) {
+            continue;
+        }
+        // Confirm with the sync byte of the following packet when it is available
+        if (i + mPacketSize >= size ||
+            static_cast<uint8_t>(data[i + mPacketSize]) == TS_SYNC_BYTE) {
+            return i;
+        }
+    }
+    return size;
+}
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
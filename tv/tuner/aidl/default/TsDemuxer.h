@@ -0,0 +1,134 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace aidl {
+namespace android {
+namespace hardware {
+namespace tv {
+namespace tuner {
+
+const uint8_t TS_SYNC_BYTE = 0x47;
+const uint16_t TS_PID_COUNT = 8192;
+
+/**
+ * Receives the transport stream packets, or the elementary stream frames, of the PIDs
+ * it is registered for.
+ */
+class TsPacketSink {
+  public:
+    virtual ~TsPacketSink() = default;
+
+    /**
+     * Called with one or more whole, contiguous packets of the same PID. The data
+     * is only valid for the duration of the call.
+     */
+    virtual void onTsPackets(const int8_t* packets, size_t size) = 0;
+
+    /**
+     * Called with one whole frame of ES playback input. The data is only valid for the
+     * duration of the call.
+     */
+    virtual void onEsFrame(const int8_t* /* frame */, size_t /* size */, uint64_t /* pts */) {}
+};
+
+/**
+ * Splits a transport stream into packets and routes each of them to the sinks
+ * registered for its PID through a table indexed by all 8192 PIDs.
+ *
+ * Input is parsed in place: runs of consecutive packets of the same PID are handed
+ * to the sinks as a single span, and only a packet split across two input buffers
+ * is copied. The stream is re-synchronized on the sync byte after corruption.
+ */
+class TsDemuxer {
+  public:
+    explicit TsDemuxer(size_t packetSize = 188);
+
+    /**
+     * Routes the packets of |pid| to |sink| as well. A sink may be registered for
+     * several PIDs.
+     */
+    void addSink(uint16_t pid, TsPacketSink* sink);
+    /**
+     * Stops routing any packets to |sink|.
+     */
+    void removeSink(TsPacketSink* sink);
+    void clearSinks();
+
+    /**
+     * The packet size of the stream, e.g. 188 or 204 bytes. Drops any partial
+     * packet kept from the previous input.
+     */
+    void setPacketSize(size_t packetSize);
+    size_t getPacketSize() const { return mPacketSize; }
+
+    /**
+     * Dispatches the packets in |data|. A trailing partial packet is kept and
+     * completed by the next call.
+     */
+    void process(const int8_t* data, size_t size);
+    /**
+     * Routes an elementary stream frame of |pid| to its sinks.
+     */
+    void processFrame(uint16_t pid, const int8_t* frame, size_t size, uint64_t pts);
+    /**
+     * Drops the partial packet kept from the previous input, e.g. after a flush.
+     */
+    void reset();
+
+    uint64_t getPacketCount() const { return mPacketCount.load(std::memory_order_relaxed); }
+    uint64_t getSyncLossCount() const { return mSyncLossCount.load(std::memory_order_relaxed); }
+
+    static uint16_t getPid(const int8_t* packet) {
+        return ((static_cast<uint8_t>(packet[1]) & 0x1f) << 8) | static_cast<uint8_t>(packet[2]);
+    }
+
+  private:
+    // Needs to be called while holding mLock
+    void dispatchLocked(uint16_t pid, const int8_t* packets, size_t size);
+    // Returns the offset of the next packet start at or after |offset|, or |size|
+    size_t findSyncLocked(const int8_t* data, size_t offset, size_t size);
+
+    // Protects the PID table and the parser state. Held once per input buffer.
+    std::mutex mLock;
+
+    // Index into mSinkLists for each PID, 0 for PIDs without any sink
+    std::array<uint16_t, TS_PID_COUNT> mPidToSinkList;
+    // Sink lists in use by PIDs. Entry 0 is always empty.
+    std::vector<std::vector<TsPacketSink*>> mSinkLists;
+
+    size_t mPacketSize;
+    std::vector<int8_t> mPartialPacket;
+    // Set from a sync loss until the next packet start is found
+    bool mSyncLost = false;
+
+    std::atomic<uint64_t> mPacketCount = 0;
+    std::atomic<uint64_t> mSyncLossCount = 0;
+};
+
+}  // namespace tuner
+}  // namespace tv
+}  // namespace hardware
+}  // namespace android
+}  // namespace aidl
@@ -0,0 +1,134 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures section reassembly of a repeating EIT-like table, as seen while scanning
+// the EPG, with and without CRC checks and repetition suppression.
+
+#include "benchmark/benchmark.h"
+
+#include "SectionAssembler.h"
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+using ::aidl::android::hardware::tv::tuner::Section;
+using ::aidl::android::hardware::tv::tuner::SectionAssembler;
+using ::benchmark::Counter;
+using ::benchmark::State;
+
+namespace {
+
+const size_t kPacketSize = 188;
+const int kSectionCount = 64;
+const int kTableRepetitions = 8;
+
+std::vector<uint8_t> makeSection(uint8_t tableId, uint8_t sectionNumber, size_t size) {
+    std::vector<uint8_t> section(size);
+    section[0] = tableId;
+    section[1] = 0xB0 | static_cast<uint8_t>((size - 3) >> 8);
+    section[2] = static_cast<uint8_t>(size - 3);
+    section[3] = 0x12;
+    section[4] = 0x34;
+    section[5] = 0xC1 | (1 << 1);
+    section[6] = sectionNumber;
+    section[7] = kSectionCount - 1;
+    for (size_t i = 8; i < size - 4; i++) {
+        section[i] = static_cast<uint8_t>(i * 31 + sectionNumber);
+    }
+    uint32_t crc = SectionAssembler::crc32(section.data(), size - 4);
+    for (int i = 0; i < 4; i++) {
+        section[size - 4 + i] = static_cast<uint8_t>(crc >> (24 - 8 * i));
+    }
+    return section;
+}
+
+// Each section starts in a new packet, as multiplexers commonly emit them
+const std::vector<int8_t>& tableStream() {
+    static const std::vector<int8_t> stream = [] {
+        std::vector<int8_t> stream;
+        uint8_t continuity = 0;
+        for (int repetition = 0; repetition < kTableRepetitions; repetition++) {
+            for (int number = 0; number < kSectionCount; number++) {
+                std::vector<uint8_t> section = makeSection(0x50, number, 200 + number * 40);
+                for (size_t offset = 0; offset < section.size();) {
+                    uint8_t packet[kPacketSize];
+                    memset(packet, 0xFF, sizeof(packet));
+                    bool isUnitStart = offset == 0;
+                    packet[0] = 0x47;
+                    packet[1] = isUnitStart ? 0x40 : 0x00;
+                    packet[2] = 0x12;
+                    packet[3] = 0x10 | (continuity++ & 0x0F);
+                    // A zero pointer_field precedes the payload of unit starts
+                    size_t header = 4;
+                    if (isUnitStart) {
+                        packet[header++] = 0;
+                    }
+                    size_t size = std::min(kPacketSize - header, section.size() - offset);
+                    memcpy(packet + header, section.data() + offset, size);
+                    offset += size;
+                    stream.insert(stream.end(), packet, packet + kPacketSize);
+                }
+            }
+        }
+        return stream;
+    }();
+    return stream;
+}
+
+void runSectionAssembler(State& state, bool checkCrc, bool skipUnchangedVersions) {
+    const std::vector<int8_t>& stream = tableStream();
+    SectionAssembler assembler;
+    int64_t sections = 0;
+    for (auto _ : state) {
+        assembler.configure(
+                {.checkCrc = checkCrc, .skipUnchangedVersions = skipUnchangedVersions});
+        assembler.process(stream.data(), stream.size(), [&sections](const Section& section) {
+            benchmark::DoNotOptimize(section.data);
+            sections++;
+            return true;
+        });
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(stream.size()));
+    state.counters["sections"] =
+            Counter(static_cast<double>(sections) / state.iterations(), Counter::kDefaults);
+}
+
+}  // namespace
+
+static void BM_Crc32(State& state) {
+    std::vector<uint8_t> data = makeSection(0x50, 0, state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(SectionAssembler::crc32(data.data(), data.size()));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Crc32)->Arg(1024)->Arg(4096);
+
+static void BM_SectionAssembler(State& state) {
+    runSectionAssembler(state, /*checkCrc*/ false, /*skipUnchangedVersions*/ false);
+}
+BENCHMARK(BM_SectionAssembler);
+
+static void BM_SectionAssemblerCheckCrc(State& state) {
+    runSectionAssembler(state, /*checkCrc*/ true, /*skipUnchangedVersions*/ false);
+}
+BENCHMARK(BM_SectionAssemblerCheckCrc);
+
+static void BM_SectionAssemblerSuppressRepeats(State& state) {
+    runSectionAssembler(state, /*checkCrc*/ true, /*skipUnchangedVersions*/ true);
+}
+BENCHMARK(BM_SectionAssemblerSuppressRepeats);
@@ -0,0 +1,245 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the playback demultiplexing throughput of the default tuner HAL on a
+// synthesized multiplex, or on a recorded one given with --input=<file.ts>.
+
+#include "benchmark/benchmark.h"
+
+#include "TsDemuxer.h"
+
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+using ::aidl::android::hardware::tv::tuner::TS_SYNC_BYTE;
+using ::aidl::android::hardware::tv::tuner::TsDemuxer;
+using ::aidl::android::hardware::tv::tuner::TsPacketSink;
+using ::benchmark::Counter;
+using ::benchmark::State;
+using ::benchmark::internal::Benchmark;
+
+namespace {
+
+const size_t kPacketSize = 188;
+// Read size of the IPTV input thread and a size that splits packets
+const std::vector<int64_t> kChunkSizes = {kPacketSize * 7 * 8, 4096};
+const std::vector<int64_t> kSinkCounts = {1, 8, 32};
+
+std::string gInputPath;
+
+// Appends the packets to an output buffer like a filter does, dropping them when full
+class BufferSink : public TsPacketSink {
+  public:
+    BufferSink() : mOutput(1024 * kPacketSize) {}
+
+    void onTsPackets(const int8_t* packets, size_t size) override { append(packets, size); }
+
+    void append(const int8_t* data, size_t size) {
+        if (mSize + size > mOutput.size()) {
+            mSize = 0;
+        }
+        size = std::min(size, mOutput.size());
+        memcpy(mOutput.data() + mSize, data, size);
+        mSize += size;
+    }
+
+  private:
+    std::vector<int8_t> mOutput;
+    size_t mSize = 0;
+};
+
+void writePacket(std::vector<int8_t>* stream, uint16_t pid, uint8_t* continuity) {
+    size_t start = stream->size();
+    stream->resize(start + kPacketSize);
+    int8_t* packet = stream->data() + start;
+    packet[0] = TS_SYNC_BYTE;
+    packet[1] = static_cast<int8_t>((pid >> 8) & 0x1f);
+    packet[2] = static_cast<int8_t>(pid & 0xff);
+    packet[3] = static_cast<int8_t>(0x10 | ((*continuity)++ & 0x0f));
+    for (size_t i = 4; i < kPacketSize; i++) {
+        packet[i] = static_cast<int8_t>(i + pid);
+    }
+}
+
+// A multiplex of one video and three audio elementary streams plus PSI/SI on 30
+// other PIDs. Video is sent in bursts of consecutive packets as muxers do.
+const std::vector<int8_t>& syntheticStream() {
+    static const std::vector<int8_t> stream = [] {
+        std::vector<int8_t> stream;
+        std::map<uint16_t, uint8_t> continuity;
+        const uint16_t videoPid = 0x100;
+        const std::vector<uint16_t> audioPids = {0x101, 0x102, 0x103};
+        std::vector<uint16_t> psiPids = {0x00, 0x01, 0x10, 0x11, 0x12, 0x14};
+        for (uint16_t pid = 0x1000; psiPids.size() < 30; pid++) {
+            psiPids.push_back(pid);
+        }
+
+        const size_t packetCount = 32 * 1024;
+        size_t psiIndex = 0;
+        for (size_t i = 0; stream.size() < packetCount * kPacketSize; i++) {
+            size_t burst = 4 + i % 5;
+            for (size_t j = 0; j < burst; j++) {
+                writePacket(&stream, videoPid, &continuity[videoPid]);
+            }
+            uint16_t audioPid = audioPids[i % audioPids.size()];
+            writePacket(&stream, audioPid, &continuity[audioPid]);
+            if (i % 3 == 0) {
+                uint16_t psiPid = psiPids[psiIndex++ % psiPids.size()];
+                writePacket(&stream, psiPid, &continuity[psiPid]);
+            }
+        }
+        return stream;
+    }();
+    return stream;
+}
+
+const std::vector<int8_t>& inputStream() {
+    static const std::vector<int8_t> stream = [] {
+        if (gInputPath.empty()) {
+            return syntheticStream();
+        }
+        std::ifstream file(gInputPath, std::ios::binary);
+        std::vector<int8_t> data((std::istreambuf_iterator<char>(file)),
+                                 std::istreambuf_iterator<char>());
+        return data;
+    }();
+    return stream;
+}
+
+// The PIDs of the stream, most frequent first
+std::vector<uint16_t> streamPids(const std::vector<int8_t>& stream) {
+    std::map<uint16_t, size_t> counts;
+    for (size_t offset = 0; offset + kPacketSize <= stream.size(); offset += kPacketSize) {
+        counts[TsDemuxer::getPid(stream.data() + offset)]++;
+    }
+    std::vector<std::pair<size_t, uint16_t>> sorted;
+    for (const auto& [pid, count] : counts) {
+        sorted.push_back({count, pid});
+    }
+    std::sort(sorted.rbegin(), sorted.rend());
+    std::vector<uint16_t> pids;
+    for (const auto& [count, pid] : sorted) {
+        pids.push_back(pid);
+    }
+    return pids;
+}
+
+void demuxArgs(Benchmark* b) {
+    b->ArgNames({"chunk", "sinks"});
+    for (int64_t chunk : kChunkSizes) {
+        for (int64_t sinks : kSinkCounts) {
+            b->Args({chunk, sinks});
+        }
+    }
+}
+
+void sinkArgs(Benchmark* b) {
+    b->ArgNames({"sinks"});
+    for (int64_t sinks : kSinkCounts) {
+        b->Args({sinks});
+    }
+}
+
+void setThroughputCounters(State& state, size_t streamSize) {
+    int64_t bytes = state.iterations() * static_cast<int64_t>(streamSize);
+    state.SetBytesProcessed(bytes);
+    state.counters["Mbit"] = Counter(bytes * 8 / 1e6, Counter::kIsRate);
+}
+
+}  // namespace
+
+// Routes the stream through the PID table of TsDemuxer
+static void BM_TsDemuxer(State& state) {
+    const std::vector<int8_t>& stream = inputStream();
+    if (stream.size() < kPacketSize) {
+        state.SkipWithError("no input");
+        return;
+    }
+    size_t chunkSize = state.range(0);
+    std::vector<uint16_t> pids = streamPids(stream);
+    std::vector<BufferSink> sinks(std::min<size_t>(state.range(1), pids.size()));
+
+    TsDemuxer demuxer(kPacketSize);
+    for (size_t i = 0; i < sinks.size(); i++) {
+        demuxer.addSink(pids[i], &sinks[i]);
+    }
+
+    for (auto _ : state) {
+        for (size_t offset = 0; offset < stream.size(); offset += chunkSize) {
+            demuxer.process(stream.data() + offset, std::min(chunkSize, stream.size() - offset));
+        }
+    }
+    setThroughputCounters(state, stream.size());
+    state.counters["syncLoss"] = demuxer.getSyncLossCount();
+}
+BENCHMARK(BM_TsDemuxer)->Apply(demuxArgs);
+
+// The previous dispatch: one packet copy and a scan of all the filters per packet
+static void BM_PerPacketScan(State& state) {
+    const std::vector<int8_t>& stream = inputStream();
+    if (stream.size() < kPacketSize) {
+        state.SkipWithError("no input");
+        return;
+    }
+    std::vector<uint16_t> pids = streamPids(stream);
+    std::vector<BufferSink> sinks(std::min<size_t>(state.range(0), pids.size()));
+    std::map<int64_t, std::pair<uint16_t, BufferSink*>> filters;
+    for (size_t i = 0; i < sinks.size(); i++) {
+        filters[i] = {pids[i], &sinks[i]};
+    }
+
+    std::vector<int8_t> packet(kPacketSize);
+    for (auto _ : state) {
+        for (size_t offset = 0; offset + kPacketSize <= stream.size(); offset += kPacketSize) {
+            memcpy(packet.data(), stream.data() + offset, kPacketSize);
+            uint16_t pid = TsDemuxer::getPid(packet.data());
+            for (auto& [id, filter] : filters) {
+                if (filter.first == pid) {
+                    std::vector<int8_t> data = packet;
+                    filter.second->append(data.data(), data.size());
+                }
+            }
+        }
+    }
+    setThroughputCounters(state, stream.size());
+}
+BENCHMARK(BM_PerPacketScan)->Apply(sinkArgs);
+
+int main(int argc, char** argv) {
+    // Take --input=<file.ts> out before the benchmark library parses the flags
+    int count = 0;
+    for (int i = 0; i < argc; i++) {
+        if (strncmp(argv[i], "--input=", 8) == 0) {
+            gInputPath = argv[i] + 8;
+        } else {
+            argv[count++] = argv[i];
+        }
+    }
+    argc = count;
+
+    ::benchmark::Initialize(&argc, argv);
+    if (::benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    ::benchmark::RunSpecifiedBenchmarks();
+    ::benchmark::Shutdown();
+    return 0;
+}
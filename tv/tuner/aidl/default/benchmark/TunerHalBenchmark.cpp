@@ -0,0 +1,788 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the default tuner HAL end to end. Tuner, Demux, Dvr and Filter run in-process
+// and a fixture is played back through the DVR into section, PES, media (on shared AV
+// memory) or record filters, as the framework would drive them.
+//
+// The fixtures are synthesized, or recorded ones are given with --input=<file.ts> and
+// --es_input=<file.es>, the latter in the format of the DVR ES playback.
+//
+// Reported per run: the input rate in Mbit/s, the filter events per second, the latency
+// from an input write to the next event of each filter, and the process CPU time spent
+// per input TS packet across all the HAL threads, and the filter output bytes dropped because
+// a filter ring, the filter FMQ or the shared AV memory had no room for them.
+
+#include "benchmark/benchmark.h"
+
+#include <aidl/android/hardware/tv/tuner/BnDvrCallback.h>
+#include <aidl/android/hardware/tv/tuner/BnFilterCallback.h>
+#include <aidl/android/hardware/tv/tuner/DemuxQueueNotifyBits.h>
+#include <aidlcommonsupport/NativeHandle.h>
+#include <fmq/AidlMessageQueue.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Demux.h"
+#include "Dvr.h"
+#include "EsPacketizer.h"
+#include "Filter.h"
+#include "SectionAssembler.h"
+#include "Tuner.h"
+
+using namespace ::aidl::android::hardware::tv::tuner;
+using ::aidl::android::hardware::common::fmq::MQDescriptor;
+using ::aidl::android::hardware::common::fmq::SynchronizedReadWrite;
+using ::android::AidlMessageQueue;
+using ::android::hardware::EventFlag;
+using ::benchmark::Counter;
+using ::benchmark::State;
+using ::benchmark::internal::Benchmark;
+
+namespace {
+
+using ClientMQ = AidlMessageQueue<int8_t, SynchronizedReadWrite>;
+
+const size_t kPacketSize = 188;
+const int32_t kPlaybackBufferSize = 4 * 1024 * 1024;
+const int32_t kRecordBufferSize = 16 * 1024 * 1024;
+const int32_t kFilterBufferSize = 1024 * 1024;
+// Write size of the playback input, as a framework client would use
+const size_t kPlaybackChunkSize = kPacketSize * 348;
+const int64_t kWaitTimeoutNs = 10 * 1000 * 1000;
+const auto kDrainTimeout = std::chrono::seconds(10);
+
+// PIDs of the synthesized fixtures
+const uint16_t kVideoPid = 0x100;
+const std::vector<uint16_t> kAudioPids = {0x101, 0x102, 0x103};
+// PAT, SDT, EIT and TDT
+const std::vector<uint16_t> kSectionPids = {0x00, 0x11, 0x12, 0x14};
+
+enum FilterKind : int64_t { SECTION, PES, MEDIA, RECORD };
+
+std::string gInputPath;
+std::string gEsInputPath;
+
+int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+}
+
+int64_t cpuTimeNs() {
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+std::vector<int8_t> readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<int8_t>((std::istreambuf_iterator<char>(file)),
+                               std::istreambuf_iterator<char>());
+}
+
+// A frame of the synthesized elementary streams
+struct EsFrame {
+    bool isAudio;
+    uint16_t pid;
+    uint64_t pts;
+    std::vector<int8_t> data;
+};
+
+// Two seconds of a 6 Mbit/s video stream at 25 fps and three audio streams
+const std::vector<EsFrame>& syntheticFrames() {
+    static const std::vector<EsFrame> frames = [] {
+        std::vector<EsFrame> frames;
+        const int videoFrames = 50;
+        for (int i = 0; i < videoFrames; i++) {
+            // A large frame every twelve, as for a GOP
+            size_t size = i % 12 == 0 ? 90000 : 25000 + (i * 7919) % 10000;
+            uint64_t pts = i * 3600;
+            frames.push_back({false, kVideoPid, pts, std::vector<int8_t>(size)});
+            for (uint16_t audioPid : kAudioPids) {
+                for (int j = 0; j < 2; j++) {
+                    frames.push_back({true, audioPid, pts + j * 1800, std::vector<int8_t>(576)});
+                }
+            }
+        }
+        for (size_t i = 0; i < frames.size(); i++) {
+            for (size_t j = 0; j < frames[i].data.size(); j++) {
+                frames[i].data[j] = static_cast<int8_t>(i * 31 + j);
+            }
+        }
+        return frames;
+    }();
+    return frames;
+}
+
+// One long-form section of |size| bytes per packet, starting with its pointer_field
+void appendSectionPacket(std::vector<int8_t>* packets, uint16_t pid, uint8_t* continuity,
+                         uint8_t sectionNumber) {
+    const size_t size = 160;
+    std::vector<uint8_t> section(size);
+    section[0] = static_cast<uint8_t>(pid == 0 ? 0x00 : 0x42 + pid);
+    section[1] = 0xB0 | static_cast<uint8_t>((size - 3) >> 8);
+    section[2] = static_cast<uint8_t>(size - 3);
+    section[3] = 0x00;
+    section[4] = 0x01;
+    section[5] = 0xC1;
+    section[6] = sectionNumber;
+    section[7] = 0xFF;
+    for (size_t i = 8; i < size - 4; i++) {
+        section[i] = static_cast<uint8_t>(i + sectionNumber);
+    }
+    uint32_t crc = SectionAssembler::crc32(section.data(), size - 4);
+    for (int i = 0; i < 4; i++) {
+        section[size - 4 + i] = static_cast<uint8_t>(crc >> (24 - 8 * i));
+    }
+
+    size_t start = packets->size();
+    packets->resize(start + kPacketSize, static_cast<int8_t>(0xFF));
+    int8_t* packet = packets->data() + start;
+    packet[0] = TS_SYNC_BYTE;
+    packet[1] = static_cast<int8_t>(0x40 | (pid >> 8));
+    packet[2] = static_cast<int8_t>(pid);
+    packet[3] = static_cast<int8_t>(0x10 | ((*continuity)++ & 0x0F));
+    packet[4] = 0;  // pointer_field
+    memcpy(packet + 5, section.data(), size);
+}
+
+// The frames packetized per PID and multiplexed with PSI/SI, each PID spread evenly
+const std::vector<int8_t>& syntheticTsStream() {
+    static const std::vector<int8_t> stream = [] {
+        std::map<uint16_t, std::vector<int8_t>> pidPackets;
+        EsPacketizer packetizer;
+        for (const EsFrame& frame : syntheticFrames()) {
+            packetizer.clear();
+            packetizer.addFrame(frame.pid,
+                                frame.isAudio ? EsPacketizer::AUDIO_STREAM_ID
+                                              : EsPacketizer::VIDEO_STREAM_ID,
+                                frame.data.data(), frame.data.size(), frame.pts);
+            std::vector<int8_t>& packets = pidPackets[frame.pid];
+            packets.insert(packets.end(), packetizer.getPackets(),
+                           packetizer.getPackets() + packetizer.getPacketsSize());
+        }
+        for (uint16_t pid : kSectionPids) {
+            uint8_t continuity = 0;
+            for (int i = 0; i < 40; i++) {
+                appendSectionPacket(&pidPackets[pid], pid, &continuity, i % 8);
+            }
+        }
+
+        // Order the packets by their relative position within their PID
+        std::vector<std::pair<double, const int8_t*>> order;
+        for (const auto& [pid, packets] : pidPackets) {
+            size_t count = packets.size() / kPacketSize;
+            for (size_t i = 0; i < count; i++) {
+                order.push_back({(i + 0.5) / count, packets.data() + i * kPacketSize});
+            }
+        }
+        std::stable_sort(order.begin(), order.end(),
+                         [](const auto& a, const auto& b) { return a.first < b.first; });
+        std::vector<int8_t> stream;
+        stream.reserve(order.size() * kPacketSize);
+        for (const auto& [position, packet] : order) {
+            stream.insert(stream.end(), packet, packet + kPacketSize);
+        }
+        return stream;
+    }();
+    return stream;
+}
+
+// The frames in the DVR ES playback format: a text header with the sizes, PIDs and the
+// length and PTS of each frame, followed by the video then the audio data. Only one
+// audio stream is carried.
+std::vector<int8_t> makeEsBuffer(const std::vector<const EsFrame*>& frames) {
+    std::string entries;
+    size_t videoSize = 0;
+    size_t audioSize = 0;
+    for (const EsFrame* frame : frames) {
+        entries += std::string(frame->isAudio ? "a" : "v") +
+                   ", Len:" + std::to_string(frame->data.size()) +
+                   ", PTS:" + std::to_string(frame->pts) + "\n";
+        (frame->isAudio ? audioSize : videoSize) += frame->data.size();
+    }
+    std::string header = "l:" + std::to_string(frames.size()) + "\nV:" +
+                         std::to_string(videoSize) + "\nA:" + std::to_string(audioSize) +
+                         "\npv:" + std::to_string(kVideoPid) +
+                         "\npa:" + std::to_string(kAudioPids[0]) + "\n" + entries;
+    // The metadata size includes its own, fixed width, entry
+    header = "m:" + std::to_string(header.size() + 11 + 1000000000).substr(1) + "\n" + header;
+
+    std::vector<int8_t> buffer(header.begin(), header.end());
+    for (bool audio : {false, true}) {
+        for (const EsFrame* frame : frames) {
+            if (frame->isAudio == audio) {
+                buffer.insert(buffer.end(), frame->data.begin(), frame->data.end());
+            }
+        }
+    }
+    return buffer;
+}
+
+// Half a second of frames per buffer
+const std::vector<std::vector<int8_t>>& esBuffers() {
+    static const std::vector<std::vector<int8_t>> buffers = [] {
+        std::vector<std::vector<int8_t>> buffers;
+        if (!gEsInputPath.empty()) {
+            buffers.push_back(readFile(gEsInputPath));
+            return buffers;
+        }
+        std::vector<const EsFrame*> frames;
+        for (const EsFrame& frame : syntheticFrames()) {
+            if (frame.isAudio && frame.pid != kAudioPids[0]) {
+                continue;
+            }
+            frames.push_back(&frame);
+            if (frames.size() == 12 * 3) {
+                buffers.push_back(makeEsBuffer(frames));
+                frames.clear();
+            }
+        }
+        if (!frames.empty()) {
+            buffers.push_back(makeEsBuffer(frames));
+        }
+        return buffers;
+    }();
+    return buffers;
+}
+
+const std::vector<int8_t>& tsStream() {
+    static const std::vector<int8_t> stream =
+            gInputPath.empty() ? syntheticTsStream() : readFile(gInputPath);
+    return stream;
+}
+
+// The elementary stream PIDs of a stream, most frequent first
+std::vector<uint16_t> elementaryStreamPids(const std::vector<int8_t>& stream) {
+    std::map<uint16_t, size_t> counts;
+    for (size_t offset = 0; offset + kPacketSize <= stream.size(); offset += kPacketSize) {
+        uint16_t pid = TsDemuxer::getPid(stream.data() + offset);
+        if (pid >= 0x20 && pid != 0x1FFF) {
+            counts[pid]++;
+        }
+    }
+    std::vector<std::pair<size_t, uint16_t>> sorted;
+    for (const auto& [pid, count] : counts) {
+        sorted.push_back({count, pid});
+    }
+    std::sort(sorted.rbegin(), sorted.rend());
+    std::vector<uint16_t> pids;
+    for (const auto& [count, pid] : sorted) {
+        pids.push_back(pid);
+    }
+    return pids;
+}
+
+class DvrCallback : public BnDvrCallback {
+  public:
+    ::ndk::ScopedAStatus onPlaybackStatus(PlaybackStatus /* status */) override {
+        return ::ndk::ScopedAStatus::ok();
+    }
+    ::ndk::ScopedAStatus onRecordStatus(RecordStatus /* status */) override {
+        return ::ndk::ScopedAStatus::ok();
+    }
+};
+
+// Where the data of record filters goes; drained from the callbacks of any filter
+struct RecordSink {
+    std::unique_ptr<ClientMQ> mq;
+    std::shared_ptr<IDvr> dvr;
+    std::mutex lock;
+    std::vector<int8_t> buffer;
+
+    void drain() {
+        std::lock_guard<std::mutex> guard(lock);
+        bool isFull = mq->availableToWrite() == 0;
+        size_t size = mq->availableToRead();
+        buffer.resize(std::max(buffer.size(), size));
+        if (size > 0) {
+            mq->read(buffer.data(), size);
+        }
+        if (isFull) {
+            // The DVR holds back record output after an overflow until flushed
+            dvr->flush();
+        }
+    }
+};
+
+// Counts the events of a filter and consumes their data as a client would
+class FilterCallback : public BnFilterCallback {
+  public:
+    ::ndk::ScopedAStatus onFilterEvent(const std::vector<DemuxFilterEvent>& events) override {
+        // Give the regions of the shared AV memory back, so the filter can reuse them
+        if (auto filter = mFilter.lock()) {
+            for (auto& event : events) {
+                if (event.getTag() == DemuxFilterEvent::Tag::media) {
+                    auto& media = event.get<DemuxFilterEvent::Tag::media>();
+                    filter->releaseAvHandle(media.avMemory, media.avDataId);
+                }
+            }
+        }
+        if (!mIsCounting) {
+            return ::ndk::ScopedAStatus::ok();
+        }
+        int64_t writtenAtNs = mWrittenAtNs.exchange(0);
+        if (writtenAtNs != 0) {
+            int64_t latencyNs = nowNs() - writtenAtNs;
+            mLatencyNs += latencyNs;
+            mLatencySamples++;
+            mMaxLatencyNs = std::max(mMaxLatencyNs.load(), latencyNs);
+        }
+        mEvents += events.size();
+
+        if (mFilterMQ != nullptr && mFilterMQ->availableToRead() > 0) {
+            size_t size = mFilterMQ->availableToRead();
+            mBuffer.resize(std::max(mBuffer.size(), size));
+            mFilterMQ->read(mBuffer.data(), size);
+            mFilterEventFlag->wake(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_CONSUMED));
+        }
+        if (mRecordSink != nullptr) {
+            mRecordSink->drain();
+        }
+        return ::ndk::ScopedAStatus::ok();
+    }
+
+    ::ndk::ScopedAStatus onFilterStatus(DemuxFilterStatus /* status */) override {
+        return ::ndk::ScopedAStatus::ok();
+    }
+
+    bool setFilterMQ(const MQDescriptor<int8_t, SynchronizedReadWrite>& desc) {
+        mFilterMQ = std::make_unique<ClientMQ>(desc);
+        return mFilterMQ->isValid() && EventFlag::createEventFlag(mFilterMQ->getEventFlagWord(),
+                                                                  &mFilterEventFlag) ==
+                                               ::android::OK;
+    }
+    void setRecordSink(RecordSink* sink) { mRecordSink = sink; }
+    void setFilter(const std::shared_ptr<IFilter>& filter) { mFilter = filter; }
+
+    void startCounting() {
+        mEvents = 0;
+        mLatencyNs = 0;
+        mLatencySamples = 0;
+        mMaxLatencyNs = 0;
+        mIsCounting = true;
+    }
+    // Samples the latency to the next event
+    void onInputWritten(int64_t timeNs) {
+        int64_t expected = 0;
+        mWrittenAtNs.compare_exchange_strong(expected, timeNs);
+    }
+
+    std::atomic<uint64_t> mEvents = 0;
+    std::atomic<int64_t> mLatencyNs = 0;
+    std::atomic<int64_t> mLatencySamples = 0;
+    std::atomic<int64_t> mMaxLatencyNs = 0;
+
+  private:
+    std::atomic<bool> mIsCounting = false;
+    std::atomic<int64_t> mWrittenAtNs = 0;
+    // Not owned, the filter holds the callback
+    std::weak_ptr<IFilter> mFilter;
+    std::unique_ptr<ClientMQ> mFilterMQ;
+    EventFlag* mFilterEventFlag = nullptr;
+    RecordSink* mRecordSink = nullptr;
+    std::vector<int8_t> mBuffer;
+};
+
+// One demux with a playback DVR and the filters under test
+class Session {
+  public:
+    bool open(DataFormat format, bool isRecording) {
+        mFormat = format;
+        mTuner = ::ndk::SharedRefBase::make<Tuner>();
+        mTuner->init();
+        std::vector<int32_t> demuxIds;
+        if (!mTuner->openDemux(&demuxIds, &mDemux).isOk()) {
+            return false;
+        }
+
+        auto dvrCallback = ::ndk::SharedRefBase::make<DvrCallback>();
+        if (!mDemux->openDvr(DvrType::PLAYBACK, kPlaybackBufferSize, dvrCallback, &mPlayback)
+                     .isOk()) {
+            return false;
+        }
+        PlaybackSettings playbackSettings = {
+                .statusMask = 0,
+                .lowThreshold = kPlaybackBufferSize / 8,
+                .highThreshold = kPlaybackBufferSize * 7 / 8,
+                .dataFormat = format,
+                .packetSize = static_cast<int64_t>(kPacketSize),
+        };
+        MQDescriptor<int8_t, SynchronizedReadWrite> desc;
+        if (!mPlayback->configure(DvrSettings::make<DvrSettings::playback>(playbackSettings))
+                     .isOk() ||
+            !mPlayback->getQueueDesc(&desc).isOk()) {
+            return false;
+        }
+        mPlaybackMQ = std::make_unique<ClientMQ>(desc);
+        if (!mPlaybackMQ->isValid() ||
+            EventFlag::createEventFlag(mPlaybackMQ->getEventFlagWord(), &mPlaybackEventFlag) !=
+                    ::android::OK) {
+            return false;
+        }
+
+        if (isRecording) {
+            if (!mDemux->openDvr(DvrType::RECORD, kRecordBufferSize, dvrCallback, &mRecord.dvr)
+                         .isOk()) {
+                return false;
+            }
+            RecordSettings recordSettings = {
+                    .statusMask = 0,
+                    .lowThreshold = kRecordBufferSize / 8,
+                    .highThreshold = kRecordBufferSize * 7 / 8,
+                    .dataFormat = DataFormat::TS,
+                    .packetSize = static_cast<int64_t>(kPacketSize),
+            };
+            if (!mRecord.dvr->configure(DvrSettings::make<DvrSettings::record>(recordSettings))
+                         .isOk() ||
+                !mRecord.dvr->getQueueDesc(&desc).isOk()) {
+                return false;
+            }
+            mRecord.mq = std::make_unique<ClientMQ>(desc);
+            if (!mRecord.mq->isValid() || !mRecord.dvr->start().isOk()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool addFilter(FilterKind kind, uint16_t pid, bool isVideo) {
+        DemuxTsFilterType tsType;
+        DemuxTsFilterSettingsFilterSettings settings;
+        switch (kind) {
+            case SECTION:
+                tsType = DemuxTsFilterType::SECTION;
+                settings.set<DemuxTsFilterSettingsFilterSettings::section>(
+                        DemuxFilterSectionSettings{
+                                .condition = DemuxFilterSectionSettingsCondition::make<
+                                        DemuxFilterSectionSettingsCondition::sectionBits>(),
+                                .isCheckCrc = true,
+                                .isRepeat = true,
+                                .isRaw = false,
+                        });
+                break;
+            case PES:
+                tsType = DemuxTsFilterType::PES;
+                settings.set<DemuxTsFilterSettingsFilterSettings::pesData>(
+                        DemuxFilterPesDataSettings{.streamId = 0, .isRaw = false});
+                break;
+            case MEDIA:
+                tsType = isVideo ? DemuxTsFilterType::VIDEO : DemuxTsFilterType::AUDIO;
+                settings.set<DemuxTsFilterSettingsFilterSettings::av>(
+                        DemuxFilterAvSettings{.isPassthrough = false, .isSecureMemory = false});
+                break;
+            case RECORD:
+                tsType = DemuxTsFilterType::RECORD;
+                settings.set<DemuxTsFilterSettingsFilterSettings::record>(
+                        DemuxFilterRecordSettings{
+                                .tsIndexMask = 0,
+                                .scIndexType = DemuxRecordScIndexType::NONE,
+                        });
+                break;
+        }
+        DemuxFilterType type = {
+                .mainType = DemuxFilterMainType::TS,
+                .subType = DemuxFilterSubType::make<DemuxFilterSubType::tsFilterType>(tsType),
+        };
+
+        auto callback = ::ndk::SharedRefBase::make<FilterCallback>();
+        std::shared_ptr<IFilter> filter;
+        if (!mDemux->openFilter(type, kFilterBufferSize, callback, &filter).isOk()) {
+            return false;
+        }
+        callback->setFilter(filter);
+        DemuxTsFilterSettings tsSettings = {.tpid = pid, .filterSettings = settings};
+        if (!filter->configure(DemuxFilterSettings::make<DemuxFilterSettings::ts>(tsSettings))
+                     .isOk()) {
+            return false;
+        }
+
+        if (kind == RECORD) {
+            callback->setRecordSink(&mRecord);
+            if (!mRecord.dvr->attachFilter(filter).isOk()) {
+                return false;
+            }
+        } else {
+            MQDescriptor<int8_t, SynchronizedReadWrite> desc;
+            if (!filter->getQueueDesc(&desc).isOk() || !callback->setFilterMQ(desc)) {
+                return false;
+            }
+        }
+        if (kind == MEDIA) {
+            ::aidl::android::hardware::common::NativeHandle avMemory;
+            int64_t avMemorySize;
+            if (!filter->getAvSharedHandle(&avMemory, &avMemorySize).isOk()) {
+                return false;
+            }
+        }
+
+        mFilters.push_back(filter);
+        mCallbacks.push_back(callback);
+        return filter->start().isOk();
+    }
+
+    bool start() {
+        if (!mPlayback->start().isOk()) {
+            return false;
+        }
+        // Skip the test events sent on filter start
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        for (auto& callback : mCallbacks) {
+            callback->startCounting();
+        }
+        return true;
+    }
+
+    // Writes |data| into the playback FMQ, waiting for the DVR to make room
+    bool play(const std::vector<int8_t>& data, size_t chunkSize) {
+        for (size_t offset = 0; offset < data.size(); offset += chunkSize) {
+            size_t size = std::min(chunkSize, data.size() - offset);
+            // The DVR parses all the ES input available as a single buffer
+            if (!waitFor([&] {
+                    return mFormat == DataFormat::ES ? mPlaybackMQ->availableToRead() == 0
+                                                     : mPlaybackMQ->availableToWrite() >= size;
+                })) {
+                return false;
+            }
+            if (!mPlaybackMQ->write(data.data() + offset, size)) {
+                return false;
+            }
+            mPlaybackEventFlag->wake(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_READY));
+            int64_t writtenAtNs = nowNs();
+            for (auto& callback : mCallbacks) {
+                callback->onInputWritten(writtenAtNs);
+            }
+        }
+        return true;
+    }
+
+    // Waits for the DVR to consume all of the input
+    bool drain() {
+        return waitFor([&] { return mPlaybackMQ->availableToRead() == 0; });
+    }
+
+    void close() {
+        for (auto& filter : mFilters) {
+            filter->stop();
+            filter->close();
+        }
+        if (mPlayback != nullptr) {
+            mPlayback->stop();
+            mPlayback->close();
+        }
+        if (mRecord.dvr != nullptr) {
+            mRecord.dvr->stop();
+            mRecord.dvr->close();
+        }
+        if (mDemux != nullptr) {
+            mDemux->close();
+        }
+        if (mPlaybackEventFlag != nullptr) {
+            EventFlag::deleteEventFlag(&mPlaybackEventFlag);
+        }
+    }
+
+    void setCounters(State& state, int64_t inputBytes, int64_t cpuNs) {
+        uint64_t events = 0;
+        int64_t latencyNs = 0;
+        int64_t latencySamples = 0;
+        int64_t maxLatencyNs = 0;
+        for (auto& callback : mCallbacks) {
+            events += callback->mEvents;
+            latencyNs += callback->mLatencyNs;
+            latencySamples += callback->mLatencySamples;
+            maxLatencyNs = std::max(maxLatencyNs, callback->mMaxLatencyNs.load());
+        }
+        uint64_t droppedBytes = 0;
+        for (auto& filter : mFilters) {
+            droppedBytes += std::static_pointer_cast<Filter>(filter)->getDroppedOutputBytes();
+        }
+        state.SetBytesProcessed(inputBytes);
+        state.counters["Mbit"] = Counter(inputBytes * 8 / 1e6, Counter::kIsRate);
+        state.counters["events"] = Counter(events, Counter::kIsRate);
+        state.counters["latency_us"] = latencySamples > 0 ? latencyNs / latencySamples / 1e3 : 0;
+        state.counters["latency_max_us"] = maxLatencyNs / 1e3;
+        state.counters["cpu_ns_per_packet"] =
+                static_cast<double>(cpuNs) / std::max<int64_t>(inputBytes / kPacketSize, 1);
+        state.counters["dropped_bytes"] = droppedBytes;
+    }
+
+  private:
+    template <typename Predicate>
+    bool waitFor(Predicate predicate) {
+        auto deadline = std::chrono::steady_clock::now() + kDrainTimeout;
+        while (!predicate()) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                return false;
+            }
+            uint32_t efState = 0;
+            mPlaybackEventFlag->wait(static_cast<uint32_t>(DemuxQueueNotifyBits::DATA_CONSUMED),
+                                     &efState, kWaitTimeoutNs, true /* retry on spurious wake */);
+        }
+        return true;
+    }
+
+    DataFormat mFormat = DataFormat::TS;
+    std::shared_ptr<Tuner> mTuner;
+    std::shared_ptr<IDemux> mDemux;
+    std::shared_ptr<IDvr> mPlayback;
+    std::unique_ptr<ClientMQ> mPlaybackMQ;
+    EventFlag* mPlaybackEventFlag = nullptr;
+    RecordSink mRecord;
+    std::vector<std::shared_ptr<IFilter>> mFilters;
+    std::vector<std::shared_ptr<FilterCallback>> mCallbacks;
+};
+
+// Adds |count| filters of |kind|, spread over the PIDs that kind of filter applies to
+bool addFilters(Session* session, FilterKind kind, int64_t count,
+                const std::vector<uint16_t>& esPids) {
+    for (int64_t i = 0; i < count; i++) {
+        uint16_t pid;
+        if (kind == SECTION) {
+            pid = kSectionPids[i % kSectionPids.size()];
+        } else if (esPids.empty()) {
+            return false;
+        } else {
+            pid = esPids[i % esPids.size()];
+        }
+        if (!session->addFilter(kind, pid, pid == esPids.front())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void runTsPlayback(State& state, FilterKind kind, int64_t filterCount) {
+    const std::vector<int8_t>& stream = tsStream();
+    if (stream.size() < kPacketSize) {
+        state.SkipWithError("no input");
+        return;
+    }
+    Session session;
+    if (!session.open(DataFormat::TS, kind == RECORD) ||
+        !addFilters(&session, kind, filterCount, elementaryStreamPids(stream)) ||
+        !session.start()) {
+        session.close();
+        state.SkipWithError("failed to set up the HAL");
+        return;
+    }
+
+    int64_t startCpuNs = cpuTimeNs();
+    for (auto _ : state) {
+        if (!session.play(stream, kPlaybackChunkSize)) {
+            state.SkipWithError("the DVR stopped consuming input");
+            break;
+        }
+    }
+    session.drain();
+    session.setCounters(state, state.iterations() * static_cast<int64_t>(stream.size()),
+                        cpuTimeNs() - startCpuNs);
+    session.close();
+}
+
+void runEsPlayback(State& state, FilterKind kind, int64_t filterCount) {
+    const std::vector<std::vector<int8_t>>& buffers = esBuffers();
+    if (buffers.empty() || buffers[0].empty()) {
+        state.SkipWithError("no input");
+        return;
+    }
+    Session session;
+    if (!session.open(DataFormat::ES, kind == RECORD) ||
+        !addFilters(&session, kind, filterCount, {kVideoPid, kAudioPids[0]}) ||
+        !session.start()) {
+        session.close();
+        state.SkipWithError("failed to set up the HAL");
+        return;
+    }
+
+    int64_t inputBytes = 0;
+    int64_t startCpuNs = cpuTimeNs();
+    for (auto _ : state) {
+        for (const std::vector<int8_t>& buffer : buffers) {
+            if (!session.play(buffer, buffer.size())) {
+                state.SkipWithError("the DVR stopped consuming input");
+                break;
+            }
+            inputBytes += buffer.size();
+        }
+    }
+    session.drain();
+    session.setCounters(state, inputBytes, cpuTimeNs() - startCpuNs);
+    session.close();
+}
+
+}  // namespace
+
+// TS playback into section, PES and media filters
+static void BM_TsPlayback(State& state) {
+    runTsPlayback(state, static_cast<FilterKind>(state.range(0)), state.range(1));
+}
+BENCHMARK(BM_TsPlayback)
+        ->ArgNames({"kind", "filters"})
+        ->ArgsProduct({{SECTION, PES, MEDIA}, {1, 4, 16}})
+        ->UseRealTime();
+
+// TS playback recorded through record filters into the record DVR
+static void BM_TsRecord(State& state) {
+    runTsPlayback(state, RECORD, state.range(0));
+}
+BENCHMARK(BM_TsRecord)->ArgNames({"filters"})->Arg(1)->Arg(4)->UseRealTime();
+
+// ES playback into media filters
+static void BM_EsPlayback(State& state) {
+    runEsPlayback(state, MEDIA, state.range(0));
+}
+BENCHMARK(BM_EsPlayback)->ArgNames({"filters"})->Arg(1)->Arg(2)->Arg(8)->UseRealTime();
+
+// ES playback packetized into a TS recording
+static void BM_EsRecord(State& state) {
+    runEsPlayback(state, RECORD, state.range(0));
+}
+BENCHMARK(BM_EsRecord)->ArgNames({"filters"})->Arg(1)->UseRealTime();
+
+int main(int argc, char** argv) {
+    // Take the fixture paths out before the benchmark library parses the flags
+    int count = 0;
+    for (int i = 0; i < argc; i++) {
+        if (strncmp(argv[i], "--input=", 8) == 0) {
+            gInputPath = argv[i] + 8;
+        } else if (strncmp(argv[i], "--es_input=", 11) == 0) {
+            gEsInputPath = argv[i] + 11;
+        } else {
+            argv[count++] = argv[i];
+        }
+    }
+    argc = count;
+
+    ::benchmark::Initialize(&argc, argv);
+    if (::benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    ::benchmark::RunSpecifiedBenchmarks();
+    ::benchmark::Shutdown();
+    return 0;
+}
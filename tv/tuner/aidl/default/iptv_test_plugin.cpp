@@ -0,0 +1,285 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// A stand-in for the vendor IPTV plugin to exercise the IPTV frontend without one.
+//
+// It streams a transport stream from
+//  - "file:///path/to/stream.ts", looping over the file, or
+//  - "udp://address:port" and "rtp://address:port", joining the group of a multicast
+//    address. The RTP headers are stripped.
+//
+// Point the tuner HAL to it with
+//  adb shell setprop vendor.tuner.iptv.plugin_path /vendor/lib64/iptv_test_plugin.so
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "iptv_test_plugin"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utils/Log.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "dtv_plugin_api.h"
+
+namespace {
+
+const size_t MAX_DATAGRAM_SIZE = 65536;
+const size_t RTP_HEADER_SIZE = 12;
+const int STREAMER_COUNT = 4;
+
+struct Uri {
+    std::string scheme;
+    std::string path;
+    std::string address;
+    int port = -1;
+};
+
+// Extracts the uri of a transport description such as { "uri": "udp://1.2.3.4:1234" }
+bool parseTransportDesc(const char* transport_desc, Uri* uri) {
+    if (transport_desc == nullptr) {
+        return false;
+    }
+    std::string desc(transport_desc);
+    size_t key = desc.find("\"uri\"");
+    if (key == std::string::npos) {
+        return false;
+    }
+    size_t start = desc.find('"', desc.find(':', key + 5));
+    size_t end = start == std::string::npos ? start : desc.find('"', start + 1);
+    if (end == std::string::npos) {
+        return false;
+    }
+    std::string value = desc.substr(start + 1, end - start - 1);
+
+    size_t separator = value.find("://");
+    if (separator == std::string::npos) {
+        return false;
+    }
+    uri->scheme = value.substr(0, separator);
+    std::string rest = value.substr(separator + 3);
+    if (uri->scheme == "file") {
+        uri->path = rest;
+        return !uri->path.empty();
+    }
+    if (uri->scheme != "udp" && uri->scheme != "rtp") {
+        return false;
+    }
+    size_t colon = rest.rfind(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+    uri->address = rest.substr(0, colon);
+    uri->port = atoi(rest.c_str() + colon + 1);
+    in_addr addr;
+    return uri->port > 0 && uri->port < 65536 && inet_pton(AF_INET, uri->address.c_str(), &addr);
+}
+
+int openUdpSocket(const Uri& uri) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    // Leave room for bursts while the tuner HAL is behind
+    int receiveBufferSize = 4 * 1024 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receiveBufferSize, sizeof(receiveBufferSize));
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(uri.port);
+    inet_pton(AF_INET, uri.address.c_str(), &addr.sin_addr);
+    bool isMulticast = IN_MULTICAST(ntohl(addr.sin_addr.s_addr));
+    if (!isMulticast) {
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    }
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        ALOGE("Failed to bind to port %d: %s", uri.port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    if (isMulticast) {
+        ip_mreq group = {};
+        group.imr_multiaddr = addr.sin_addr;
+        group.imr_interface.s_addr = htonl(INADDR_ANY);
+        if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &group, sizeof(group)) < 0) {
+            ALOGE("Failed to join %s: %s", uri.address.c_str(), strerror(errno));
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+// Returns the offset of the payload of an RTP packet, or |size| if it has none
+size_t getRtpPayloadOffset(const uint8_t* packet, size_t size) {
+    if (size < RTP_HEADER_SIZE || (packet[0] >> 6) != 2) {
+        return size;
+    }
+    size_t offset = RTP_HEADER_SIZE + (packet[0] & 0x0F) * 4;
+    if ((packet[0] & 0x10) && offset + 4 <= size) {
+        // Header extension
+        offset += 4 + ((packet[offset + 2] << 8) | packet[offset + 3]) * 4;
+    }
+    return std::min(offset, size);
+}
+
+}  // namespace
+
+struct dtv_streamer {
+    Uri uri;
+    int fd = -1;
+    // Remainder of the last datagram, kept for reads smaller than a datagram
+    std::vector<uint8_t> datagram;
+    size_t datagramOffset = 0;
+    size_t datagramSize = 0;
+};
+
+namespace {
+
+const char* transport_types[] = {"file", "udp", "rtp", nullptr};
+
+const char** get_transport_types(void) {
+    return transport_types;
+}
+
+int get_streamer_count(void) {
+    return STREAMER_COUNT;
+}
+
+int validate(const char* transport_desc) {
+    Uri uri;
+    return parseTransportDesc(transport_desc, &uri) ? 1 : 0;
+}
+
+dtv_streamer* create_streamer(void) {
+    return new dtv_streamer();
+}
+
+void close_stream(dtv_streamer* streamer) {
+    if (streamer->fd >= 0) {
+        close(streamer->fd);
+        streamer->fd = -1;
+    }
+    streamer->datagramOffset = 0;
+    streamer->datagramSize = 0;
+}
+
+void destroy_streamer(dtv_streamer* streamer) {
+    close_stream(streamer);
+    delete streamer;
+}
+
+int open_stream(dtv_streamer* streamer, const char* transport_desc) {
+    close_stream(streamer);
+    if (!parseTransportDesc(transport_desc, &streamer->uri)) {
+        return -1;
+    }
+    if (streamer->uri.scheme == "file") {
+        streamer->fd = open(streamer->uri.path.c_str(), O_RDONLY | O_CLOEXEC);
+    } else {
+        streamer->fd = openUdpSocket(streamer->uri);
+        streamer->datagram.resize(MAX_DATAGRAM_SIZE);
+    }
+    if (streamer->fd < 0) {
+        ALOGE("Failed to open %s", transport_desc);
+    }
+    return streamer->fd;
+}
+
+ssize_t readFile(dtv_streamer* streamer, uint8_t* buf, size_t count) {
+    ssize_t result = read(streamer->fd, buf, count);
+    if (result == 0) {
+        // Loop over the file
+        if (lseek(streamer->fd, 0, SEEK_SET) < 0) {
+            return -1;
+        }
+        result = read(streamer->fd, buf, count);
+    }
+    return result;
+}
+
+// Fills |buf| with the datagrams received so far, waiting up to |timeout_ms| for one
+ssize_t readDatagrams(dtv_streamer* streamer, uint8_t* buf, size_t count, int timeout_ms) {
+    size_t total = 0;
+    while (total < count) {
+        if (streamer->datagramOffset == streamer->datagramSize) {
+            pollfd pfd = {.fd = streamer->fd, .events = POLLIN, .revents = 0};
+            if (poll(&pfd, 1, total == 0 ? timeout_ms : 0) <= 0) {
+                break;
+            }
+            ssize_t size = recv(streamer->fd, streamer->datagram.data(), MAX_DATAGRAM_SIZE,
+                                MSG_DONTWAIT);
+            if (size < 0) {
+                if (errno == EAGAIN || errno == EINTR) {
+                    break;
+                }
+                return total > 0 ? total : -1;
+            }
+            streamer->datagramSize = size;
+            streamer->datagramOffset = 0;
+            if (streamer->uri.scheme == "rtp") {
+                streamer->datagramOffset =
+                        getRtpPayloadOffset(streamer->datagram.data(), streamer->datagramSize);
+            }
+        }
+        size_t size = std::min(count - total, streamer->datagramSize - streamer->datagramOffset);
+        memcpy(buf + total, streamer->datagram.data() + streamer->datagramOffset, size);
+        streamer->datagramOffset += size;
+        total += size;
+    }
+    return total;
+}
+
+ssize_t read_stream(dtv_streamer* streamer, void* buf, size_t count, int timeout_ms) {
+    if (streamer == nullptr || streamer->fd < 0) {
+        return -1;
+    }
+    if (streamer->uri.scheme == "file") {
+        return readFile(streamer, static_cast<uint8_t*>(buf), count);
+    }
+    return readDatagrams(streamer, static_cast<uint8_t*>(buf), count, timeout_ms);
+}
+
+}  // namespace
+
+extern "C" {
+
+__attribute__((visibility("default"))) dtv_plugin plugin_entry = {
+        .version = 1,
+        .get_transport_types = get_transport_types,
+        .get_streamer_count = get_streamer_count,
+        .validate = validate,
+        .create_streamer = create_streamer,
+        .destroy_streamer = destroy_streamer,
+        .set_property = nullptr,
+        .get_property = nullptr,
+        .add_pid = nullptr,
+        .remove_pid = nullptr,
+        .open_stream = open_stream,
+        .close_stream = close_stream,
+        .read_stream = read_stream,
+};
+
+}  // extern "C"
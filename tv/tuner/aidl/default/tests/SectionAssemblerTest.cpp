@@ -0,0 +1,302 @@
+/*
+ * Copyright 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "SectionAssembler.h"
+
+using ::aidl::android::hardware::tv::tuner::Section;
+using ::aidl::android::hardware::tv::tuner::SectionAssembler;
+
+namespace {
+
+const size_t kPacketSize = 188;
+
+// A PAT of transport stream 1 with program 1 on PID 0x1000, as multiplexers emit it
+const std::vector<uint8_t> kPat = {0x00, 0xB0, 0x0D, 0x00, 0x01, 0xC1, 0x00, 0x00,
+                                   0x00, 0x01, 0xF0, 0x00, 0x2A, 0xB1, 0x04, 0xB2};
+
+// A long-form section of |size| bytes with a valid CRC_32
+std::vector<uint8_t> makeSection(uint8_t tableId, uint8_t version, uint8_t sectionNumber,
+                                 uint8_t lastSectionNumber, size_t size,
+                                 uint16_t tableIdExtension = 0x1234) {
+    std::vector<uint8_t> section(size);
+    section[0] = tableId;
+    section[1] = 0xB0 | static_cast<uint8_t>((size - 3) >> 8);
+    section[2] = static_cast<uint8_t>(size - 3);
+    section[3] = tableIdExtension >> 8;
+    section[4] = tableIdExtension & 0xFF;
+    section[5] = 0xC1 | (version << 1);
+    section[6] = sectionNumber;
+    section[7] = lastSectionNumber;
+    for (size_t i = 8; i < size - 4; i++) {
+        section[i] = static_cast<uint8_t>(i * 7 + sectionNumber);
+    }
+    uint32_t crc = SectionAssembler::crc32(section.data(), size - 4);
+    for (int i = 0; i < 4; i++) {
+        section[size - 4 + i] = static_cast<uint8_t>(crc >> (24 - 8 * i));
+    }
+    return section;
+}
+
+// Packetizes |sections| back to back with up to |payloadPerPacket| bytes of them per packet, as
+// a multiplexer does. Packets where a section starts carry a pointer_field to it, the packets
+// not filled are padded with an adaptation field, and the last packet is stuffed.
+std::vector<int8_t> packetize(const std::vector<std::vector<uint8_t>>& sections,
+                              size_t payloadPerPacket = kPacketSize) {
+    std::vector<uint8_t> payload;
+    std::vector<size_t> starts;
+    for (const auto& section : sections) {
+        starts.push_back(payload.size());
+        payload.insert(payload.end(), section.begin(), section.end());
+    }
+
+    std::vector<int8_t> stream;
+    uint8_t continuityCounter = 0;
+    auto nextStart = starts.begin();
+    for (size_t offset = 0; offset < payload.size();) {
+        size_t end = std::min({offset + payloadPerPacket, offset + kPacketSize - 4, payload.size()});
+        bool isUnitStart = nextStart != starts.end() && *nextStart < end;
+        if (isUnitStart) {
+            // The pointer_field takes a byte of the payload
+            end = std::min(end, offset + kPacketSize - 5);
+            isUnitStart = *nextStart < end;
+        }
+        size_t payloadSize = (isUnitStart ? 1 : 0) + end - offset;
+        size_t padding = end < payload.size() ? kPacketSize - 4 - payloadSize : 0;
+
+        uint8_t packet[kPacketSize];
+        memset(packet, 0xFF, sizeof(packet));
+        packet[0] = 0x47;
+        packet[1] = isUnitStart ? 0x40 : 0x00;
+        packet[2] = 0x12;
+        packet[3] = (padding > 0 ? 0x30 : 0x10) | (continuityCounter++ & 0x0F);
+        size_t position = 4;
+        if (padding > 0) {
+            packet[position] = static_cast<uint8_t>(padding - 1);
+            if (padding > 1) {
+                // No adaptation field flags, followed by stuffing bytes
+                packet[position + 1] = 0x00;
+            }
+            position += padding;
+        }
+        if (isUnitStart) {
+            packet[position++] = static_cast<uint8_t>(*nextStart - offset);
+            while (nextStart != starts.end() && *nextStart < end) {
+                nextStart++;
+            }
+        }
+        memcpy(packet + position, payload.data() + offset, end - offset);
+        offset = end;
+        stream.insert(stream.end(), packet, packet + kPacketSize);
+    }
+    return stream;
+}
+
+// Processes |stream| and returns the delivered sections
+std::vector<std::vector<uint8_t>> process(SectionAssembler& assembler,
+                                          const std::vector<int8_t>& stream) {
+    std::vector<std::vector<uint8_t>> sections;
+    EXPECT_TRUE(assembler.process(stream.data(), stream.size(), [&](const Section& section) {
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(section.data);
+        sections.emplace_back(data, data + section.size);
+        return true;
+    }));
+    return sections;
+}
+
+TEST(SectionAssemblerTest, Crc32MatchesMpeg2Vectors) {
+    // The CRC-32/MPEG-2 check value
+    const char* check = "123456789";
+    EXPECT_EQ(0x0376E6E7u,
+              SectionAssembler::crc32(reinterpret_cast<const uint8_t*>(check), strlen(check)));
+    EXPECT_EQ(0x2AB104B2u, SectionAssembler::crc32(kPat.data(), kPat.size() - 4));
+    // A section including its CRC_32 checks to 0
+    EXPECT_EQ(0u, SectionAssembler::crc32(kPat.data(), kPat.size()));
+}
+
+TEST(SectionAssemblerTest, Crc32IsIncremental) {
+    std::vector<uint8_t> section = makeSection(0x50, 1, 0, 0, 1021);
+    ASSERT_EQ(0u, SectionAssembler::crc32(section.data(), section.size()));
+    // Splits at offsets that are and are not multiples of the 8 bytes folded per step
+    for (size_t split : {1, 7, 8, 13, 64, 1000}) {
+        uint32_t crc = SectionAssembler::crc32(section.data(), split);
+        EXPECT_EQ(0u, SectionAssembler::crc32(section.data() + split, section.size() - split, crc))
+                << "split " << split;
+    }
+}
+
+TEST(SectionAssemblerTest, DeliversSectionsWithinAPacket) {
+    std::vector<uint8_t> other = makeSection(0x42, 3, 0, 0, 40);
+    SectionAssembler assembler;
+    assembler.configure({.checkCrc = true});
+    // Both sections fit in one packet, followed by stuffing
+    auto sections = process(assembler, packetize({kPat, other}));
+    ASSERT_EQ(2u, sections.size());
+    EXPECT_EQ(kPat, sections[0]);
+    EXPECT_EQ(other, sections[1]);
+    EXPECT_EQ(0u, assembler.getCrcErrorCount());
+}
+
+TEST(SectionAssemblerTest, ReassemblesSectionsSplitAcrossPackets) {
+    // Sections spanning up to 6 packets, each followed by one starting in the same packet
+    std::vector<std::vector<uint8_t>> expected;
+    for (uint8_t number = 0; number < 8; number++) {
+        expected.push_back(makeSection(0x50, 2, number, 7, 100 + number * 150));
+    }
+    for (size_t payloadPerPacket : {kPacketSize, size_t(97), size_t(13)}) {
+        SCOPED_TRACE(testing::Message() << "payload per packet " << payloadPerPacket);
+        SectionAssembler assembler;
+        assembler.configure({.checkCrc = true});
+        EXPECT_EQ(expected, process(assembler, packetize(expected, payloadPerPacket)));
+        EXPECT_EQ(0u, assembler.getCrcErrorCount());
+    }
+}
+
+TEST(SectionAssemblerTest, ReassemblesSplitSectionHeader) {
+    // The second section starts 2 bytes before the end of the first packet, so its
+    // section_length is only known from the next packet
+    std::vector<uint8_t> first = makeSection(0x50, 0, 0, 1, kPacketSize - 5 - 2);
+    std::vector<uint8_t> second = makeSection(0x50, 0, 1, 1, 300);
+    SectionAssembler assembler;
+    assembler.configure({.checkCrc = true});
+    auto sections = process(assembler, packetize({first, second}));
+    ASSERT_EQ(2u, sections.size());
+    EXPECT_EQ(first, sections[0]);
+    EXPECT_EQ(second, sections[1]);
+}
+
+TEST(SectionAssemblerTest, SkipsDuplicatePackets) {
+    std::vector<uint8_t> section = makeSection(0x50, 0, 0, 0, 300);
+    std::vector<int8_t> stream = packetize({section}, 100);
+    ASSERT_EQ(3 * kPacketSize, stream.size());
+    // A packet sent twice carries the same continuity counter and is dropped the second time
+    std::vector<int8_t> duplicated;
+    for (size_t i = 0; i < stream.size(); i += kPacketSize) {
+        for (int copy = 0; copy < 2; copy++) {
+            duplicated.insert(duplicated.end(), stream.begin() + i,
+                              stream.begin() + i + kPacketSize);
+        }
+    }
+
+    SectionAssembler assembler;
+    assembler.configure({.checkCrc = true});
+    auto sections = process(assembler, duplicated);
+    ASSERT_EQ(1u, sections.size());
+    EXPECT_EQ(section, sections[0]);
+}
+
+TEST(SectionAssemblerTest, DropsPartialSectionOnContinuityError) {
+    std::vector<uint8_t> lost = makeSection(0x50, 0, 0, 1, 400);
+    std::vector<uint8_t> next = makeSection(0x50, 0, 1, 1, 100);
+    std::vector<int8_t> stream = packetize({lost, next});
+    ASSERT_EQ(3 * kPacketSize, stream.size());
+    // Lose the middle packet of the first section
+    stream.erase(stream.begin() + kPacketSize, stream.begin() + 2 * kPacketSize);
+
+    SectionAssembler assembler;
+    assembler.configure({.checkCrc = true});
+    auto sections = process(assembler, stream);
+    ASSERT_EQ(1u, sections.size());
+    EXPECT_EQ(next, sections[0]);
+}
+
+TEST(SectionAssemblerTest, DropsSectionsWithWrongCrc) {
+    std::vector<uint8_t> corrupted = makeSection(0x50, 0, 0, 1, 200);
+    corrupted[100] ^= 0x01;
+    std::vector<uint8_t> valid = makeSection(0x50, 0, 1, 1, 200);
+    std::vector<int8_t> stream = packetize({corrupted, valid});
+
+    SectionAssembler checking;
+    checking.configure({.checkCrc = true});
+    auto sections = process(checking, stream);
+    ASSERT_EQ(1u, sections.size());
+    EXPECT_EQ(valid, sections[0]);
+    EXPECT_EQ(1u, checking.getCrcErrorCount());
+
+    SectionAssembler unchecked;
+    unchecked.configure({.checkCrc = false});
+    EXPECT_EQ(2u, process(unchecked, stream).size());
+}
+
+TEST(SectionAssemblerTest, FiltersByTableIdAndVersion) {
+    std::vector<int8_t> stream = packetize({makeSection(0x4E, 1, 0, 0, 50),
+                                            makeSection(0x50, 1, 0, 0, 50),
+                                            makeSection(0x50, 2, 0, 0, 50)});
+    SectionAssembler assembler;
+    assembler.configure({.tableId = 0x50, .version = 2});
+    auto sections = process(assembler, stream);
+    ASSERT_EQ(1u, sections.size());
+    EXPECT_EQ(0x50, sections[0][0]);
+    EXPECT_EQ(2, (sections[0][5] >> 1) & 0x1F);
+}
+
+TEST(SectionAssemblerTest, RepeatsByDefault) {
+    std::vector<uint8_t> section = makeSection(0x50, 0, 0, 0, 50);
+    SectionAssembler assembler;
+    assembler.configure({.tableId = 0x50});
+    EXPECT_EQ(3u, process(assembler, packetize({section, section, section})).size());
+    EXPECT_FALSE(assembler.isDone());
+}
+
+TEST(SectionAssemblerTest, StopsAfterTableWithoutRepeat) {
+    // The table of 3 sections is repeated, interleaved with another table_id_extension
+    std::vector<std::vector<uint8_t>> table = {makeSection(0x50, 4, 0, 2, 60),
+                                               makeSection(0x50, 4, 1, 2, 300),
+                                               makeSection(0x50, 4, 2, 2, 60)};
+    std::vector<uint8_t> otherService = makeSection(0x50, 4, 0, 0, 60, 0x5678);
+    std::vector<int8_t> stream = packetize({table[1], table[2], otherService, table[0], table[1],
+                                            table[2], table[0]});
+
+    SectionAssembler assembler;
+    assembler.configure({.repeat = false, .tableId = 0x50});
+    auto sections = process(assembler, stream);
+    EXPECT_EQ((std::vector<std::vector<uint8_t>>{table[1], table[2], table[0]}), sections);
+    EXPECT_TRUE(assembler.isDone());
+    // Nothing is delivered once the table is complete
+    EXPECT_TRUE(process(assembler, packetize({table[0]})).empty());
+
+    // Until the filter is restarted
+    assembler.reset();
+    EXPECT_FALSE(assembler.isDone());
+    EXPECT_EQ(1u, process(assembler, packetize({table[2]})).size());
+}
+
+TEST(SectionAssemblerTest, StopsAfterFirstSectionWithoutRepeatOrTable) {
+    SectionAssembler assembler;
+    assembler.configure({.repeat = false});
+    auto sections = process(assembler, packetize({kPat, makeSection(0x50, 0, 0, 0, 50), kPat}));
+    ASSERT_EQ(1u, sections.size());
+    EXPECT_EQ(kPat, sections[0]);
+    EXPECT_TRUE(assembler.isDone());
+}
+
+TEST(SectionAssemblerTest, SkipsUnchangedVersions) {
+    std::vector<uint8_t> version1 = makeSection(0x50, 1, 0, 0, 50);
+    std::vector<uint8_t> version2 = makeSection(0x50, 2, 0, 0, 50);
+    SectionAssembler assembler;
+    assembler.configure({.skipUnchangedVersions = true});
+    auto sections = process(assembler, packetize({version1, version1, version2, version2}));
+    EXPECT_EQ((std::vector<std::vector<uint8_t>>{version1, version2}), sections);
+    EXPECT_EQ(2u, assembler.getSuppressedCount());
+    EXPECT_FALSE(assembler.isDone());
+}
+
+}  // namespace